@@ -7,6 +7,7 @@
 #include <chrono>
 #include <algorithm>
 #include <unordered_map>
+#include <unordered_set>
 #include <regex>
 #include <optional>
 #include <mutex>
@@ -17,6 +18,33 @@
 #include <thread>
 #include <queue>
 #include <condition_variable>
+#include <deque>
+#include <cassert>
+#include <type_traits>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string_view>
+#include <cstdint>
+#include <cctype>
+#include <cerrno>
+#include <limits>
+#include <utility>
+#include <random>
+#include <array>
+#include <cmath>
+#include <memory_resource>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -58,1816 +86,15650 @@ std::unordered_map<std::string, ShortcutAction> globalShortcuts;
  * purple, representing navigation and exploration in the digital space.
  */
 
-// Enhanced Theme management system with advanced customization
-class Theme {
+// Compile-time floor for log statements: anything below it is compiled out.
+// 0 = TRACE, 1 = DEBUG, 2 = INFO, 3 = WARN, 4 = ERROR
+#ifndef NOVA_LOG_LEVEL
+#define NOVA_LOG_LEVEL 0
+#endif
+
+enum class LogLevel : uint8_t { TRACE, DEBUG, INFO, WARN, ERROR, OFF };
+
+enum class LogCategory : uint8_t {
+    ENGINE,
+    TAB,
+    GROUP,
+    THEME,
+    UI,
+    BOOKMARKS,
+    PRIVACY,
+    ARCHIVE,
+    HISTORY,
+    SYNC,
+    EXTENSIONS,
+    NOTIFICATIONS,
+    AI,
+    DEMO,
+    BENCH,
+    COUNT
+};
+
+// Fixed-size log entry as it travels through the ring buffer and into sinks
+struct LogRecord {
+    static constexpr size_t kMaxText = 232;
+    
+    uint64_t timestampNanos;
+    uint32_t threadId;
+    LogLevel level;
+    LogCategory category;
+    uint16_t length;
+    char text[kMaxText];
+    
+    std::string_view message() const { return std::string_view(text, length); }
+};
+
+// Formats one log line into a stack buffer without touching the heap.
+// Output past LogRecord::kMaxText is truncated.
+class LogMessage {
 public:
-    enum class Mode { LIGHT, DARK, AUTO, CUSTOM };
-    enum class ColorScheme { DEFAULT, SOLARIZED, NORD, MONOKAI, DRACULA, CUSTOM };
+    LogMessage(LogLevel level, LogCategory category) : level(level), category(category) {}
     
-    struct ThemeConfig {
-        Mode mode = Mode::AUTO;
-        ColorScheme scheme = ColorScheme::DEFAULT;
-        std::string accentColor = "#5D3FD3"; // Default NOVA purple
-        std::string backgroundColor = "";
-        std::string textColor = "";
-        std::string linkColor = "";
-        float contrast = 1.0f;
-        bool reducedMotion = false;
-        bool highContrast = false;
-        std::map<std::string, std::string> customColors;
-    };
+    LogMessage& operator<<(std::string_view text) {
+        size_t room = LogRecord::kMaxText - length;
+        size_t count = std::min(room, text.size());
+        std::memcpy(buffer + length, text.data(), count);
+        length += count;
+        return *this;
+    }
     
-    Theme() : config{} {}
+    LogMessage& operator<<(const char* text) { return *this << std::string_view(text); }
+    LogMessage& operator<<(const std::string& text) { return *this << std::string_view(text); }
+    LogMessage& operator<<(char c) { return *this << std::string_view(&c, 1); }
+    LogMessage& operator<<(bool value) { return *this << (value ? "1" : "0"); }
     
-    void setMode(Mode mode) {
-        config.mode = mode;
-        std::cout << "Theme changed to " << getModeString() << " mode" << std::endl;
-        notifyThemeListeners();
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    LogMessage& operator<<(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        return *this << std::string_view(digits, static_cast<size_t>(result.ptr - digits));
     }
     
-    Mode getMode() const { return config.mode; }
-    
-    void setColorScheme(ColorScheme scheme) {
-        config.scheme = scheme;
-        std::cout << "Color scheme changed to " << getSchemeString() << std::endl;
-        notifyThemeListeners();
+    template <typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    LogMessage& operator<<(T value) {
+        // Matches the default std::ostream formatting of floating point values
+        char digits[32];
+        int count = std::snprintf(digits, sizeof(digits), "%g", static_cast<double>(value));
+        return *this << std::string_view(digits, static_cast<size_t>(std::max(count, 0)));
     }
     
-    ColorScheme getColorScheme() const { return config.scheme; }
+    LogLevel getLevel() const { return level; }
+    LogCategory getCategory() const { return category; }
+    std::string_view text() const { return std::string_view(buffer, length); }
     
-    std::string getModeString() const {
-        switch (config.mode) {
-            case Mode::LIGHT: return "light";
-            case Mode::DARK: return "dark";
-            case Mode::AUTO: return "auto (system)";
-            case Mode::CUSTOM: return "custom";
-            default: return "unknown";
-        }
+private:
+    LogLevel level;
+    LogCategory category;
+    size_t length = 0;
+    char buffer[LogRecord::kMaxText];
+};
+
+// Destination for drained log records. Sinks are only ever called from the
+// logger's writer thread.
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+    virtual void write(const LogRecord& record) = 0;
+    virtual void flush() = 0;
+};
+
+// Human-readable sink: INFO and below go to stdout, WARN and above to stderr
+class ConsoleLogSink : public LogSink {
+public:
+    void write(const LogRecord& record) override {
+        std::FILE* stream = record.level >= LogLevel::WARN ? stderr : stdout;
+        std::fwrite(record.text, 1, record.length, stream);
+        std::fputc('\n', stream);
     }
     
-    std::string getSchemeString() const {
-        switch (config.scheme) {
-            case ColorScheme::DEFAULT: return "default";
-            case ColorScheme::SOLARIZED: return "solarized";
-            case ColorScheme::NORD: return "nord";
-            case ColorScheme::MONOKAI: return "monokai";
-            case ColorScheme::DRACULA: return "dracula";
-            case ColorScheme::CUSTOM: return "custom";
-            default: return "unknown";
-        }
+    void flush() override {
+        std::fflush(stdout);
+        std::fflush(stderr);
     }
-    
-    // Advanced theme features
-    void setCustomAccentColor(const std::string& hexColor) {
-        config.accentColor = hexColor;
-        std::cout << "Setting custom accent color to: " << hexColor << std::endl;
-        notifyThemeListeners();
+};
+
+// Structured binary sink. The file starts with the 8-byte magic "NOVALOG1"
+// followed by records of: u64 timestamp (ns since epoch), u32 thread id,
+// u8 level, u8 category, u16 length, then `length` bytes of UTF-8 text.
+class BinaryLogSink : public LogSink {
+public:
+    explicit BinaryLogSink(const std::string& path) : file(std::fopen(path.c_str(), "wb")) {
+        if (file) std::fwrite("NOVALOG1", 1, 8, file);
     }
     
-    void setCustomColor(const std::string& element, const std::string& hexColor) {
-        config.customColors[element] = hexColor;
-        std::cout << "Set custom color for " << element << " to " << hexColor << std::endl;
-        notifyThemeListeners();
+    ~BinaryLogSink() override {
+        if (file) std::fclose(file);
     }
     
-    void adjustContrast(float level) {
-        config.contrast = std::clamp(level, 0.5f, 2.0f);
-        std::cout << "Adjusting contrast level to: " << level << std::endl;
-        notifyThemeListeners();
+    bool isOpen() const { return file != nullptr; }
+    
+    void write(const LogRecord& record) override {
+        if (!file) return;
+        uint8_t level = static_cast<uint8_t>(record.level);
+        uint8_t category = static_cast<uint8_t>(record.category);
+        std::fwrite(&record.timestampNanos, sizeof(record.timestampNanos), 1, file);
+        std::fwrite(&record.threadId, sizeof(record.threadId), 1, file);
+        std::fwrite(&level, 1, 1, file);
+        std::fwrite(&category, 1, 1, file);
+        std::fwrite(&record.length, sizeof(record.length), 1, file);
+        std::fwrite(record.text, 1, record.length, file);
     }
     
-    void setReducedMotion(bool enabled) {
-        config.reducedMotion = enabled;
-        std::cout << "Reduced motion " << (enabled ? "enabled" : "disabled") << std::endl;
-        notifyThemeListeners();
+    void flush() override {
+        if (file) std::fflush(file);
     }
     
-    void setHighContrast(bool enabled) {
-        config.highContrast = enabled;
-        std::cout << "High contrast mode " << (enabled ? "enabled" : "disabled") << std::endl;
-        notifyThemeListeners();
+private:
+    std::FILE* file;
+};
+
+// Asynchronous logger. Producers format on their own stack and claim a slot in
+// a bounded lock-free ring (Vyukov MPMC queue); a single background thread
+// drains it into the sinks. When the ring is full, INFO and below are dropped
+// and counted rather than blocking the caller; WARN and above wait for room.
+class Logger {
+public:
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
     }
     
-    void saveThemeConfig(const std::string& name) {
-        savedThemes[name] = config;
-        std::cout << "Saved current theme configuration as: " << name << std::endl;
-        // In a real implementation, this would persist to disk
+    bool shouldLog(LogLevel level, LogCategory category) const {
+        return level >= minimumLevel.load(std::memory_order_relaxed) &&
+               (categoryMask.load(std::memory_order_relaxed) & categoryBit(category)) != 0;
     }
     
-    void loadThemeConfig(const std::string& name) {
-        if (savedThemes.find(name) != savedThemes.end()) {
-            config = savedThemes[name];
-            std::cout << "Loading saved theme configuration: " << name << std::endl;
-            notifyThemeListeners();
+    void setLevel(LogLevel level) { minimumLevel.store(level, std::memory_order_relaxed); }
+    LogLevel getLevel() const { return minimumLevel.load(std::memory_order_relaxed); }
+    
+    void setCategoryEnabled(LogCategory category, bool enabled) {
+        if (enabled) {
+            categoryMask.fetch_or(categoryBit(category), std::memory_order_relaxed);
         } else {
-            std::cerr << "Theme configuration not found: " << name << std::endl;
+            categoryMask.fetch_and(~categoryBit(category), std::memory_order_relaxed);
         }
     }
     
-    void loadThemePreset(const std::string& presetName) {
-        if (presetName == "dark") {
-            config.mode = Mode::DARK;
-            config.backgroundColor = "#121212";
-            config.textColor = "#FFFFFF";
-            config.linkColor = "#5D3FD3";
-        } else if (presetName == "light") {
-            config.mode = Mode::LIGHT;
-            config.backgroundColor = "#FFFFFF";
-            config.textColor = "#121212";
-            config.linkColor = "#5D3FD3";
-        } else if (presetName == "nord") {
-            config.mode = Mode::CUSTOM;
-            config.scheme = ColorScheme::NORD;
-            config.backgroundColor = "#2E3440";
-            config.textColor = "#ECEFF4";
-            config.accentColor = "#88C0D0";
-        } else if (presetName == "dracula") {
-            config.mode = Mode::CUSTOM;
-            config.scheme = ColorScheme::DRACULA;
-            config.backgroundColor = "#282A36";
-            config.textColor = "#F8F8F2";
-            config.accentColor = "#BD93F9";
-        } else {
-            std::cerr << "Unknown theme preset: " << presetName << std::endl;
-            return;
-        }
-        
-        std::cout << "Loading theme preset: " << presetName << std::endl;
-        notifyThemeListeners();
+    // Enables only the given category, e.g. to keep benchmark output clean
+    void setOnlyCategory(LogCategory category) {
+        categoryMask.store(categoryBit(category), std::memory_order_relaxed);
     }
     
-    void adaptToTimeOfDay() {
-        auto now = std::chrono::system_clock::now();
-        auto time = std::chrono::system_clock::to_time_t(now);
-        std::tm* localTime = std::localtime(&time);
+    void addSink(std::unique_ptr<LogSink> sink) {
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        sinks.push_back(std::move(sink));
+    }
+    
+    void submit(const LogMessage& message) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & kMask];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                if (message.getLevel() < LogLevel::WARN) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                std::this_thread::yield();
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
         
-        int hour = localTime->tm_hour;
+        fillRecord(slot->record, message);
+        slot->sequence.store(pos + 1, std::memory_order_release);
         
-        if (hour >= 7 && hour < 19) {
-            // Daytime: use light theme
-            if (config.mode != Mode::LIGHT) {
-                std::cout << "Adapting to daytime with light theme" << std::endl;
-                loadThemePreset("light");
-            }
-        } else {
-            // Nighttime: use dark theme
-            if (config.mode != Mode::DARK) {
-                std::cout << "Adapting to nighttime with dark theme" << std::endl;
-                loadThemePreset("dark");
-            }
+        if (writerSleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wakeCondition.notify_one();
         }
     }
     
-    void scheduleAutomaticThemeChanges(bool enabled) {
-        autoThemeEnabled = enabled;
-        std::cout << "Automatic theme changes " << (enabled ? "enabled" : "disabled") << std::endl;
-        // In a real implementation, this would set up a timer to check time periodically
+    // Blocks until everything submitted so far has reached the sinks
+    void flush() {
+        size_t target = enqueuePos.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        flushTarget = std::max(flushTarget, target);
+        wakeCondition.notify_one();
+        flushedCondition.wait(lock, [&] { return flushedUpTo >= target || !running; });
     }
     
-    void addThemeChangeListener(std::function<void(const ThemeConfig&)> listener) {
-        themeListeners.push_back(listener);
+    size_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+    
+private:
+    static constexpr size_t kCapacity = 8192; // must be a power of two
+    static constexpr size_t kMask = kCapacity - 1;
+    
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        LogRecord record;
+    };
+    
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) size_t dequeuePos = 0;
+    std::atomic<size_t> dropped{0};
+    size_t reportedDropped = 0;
+    std::atomic<LogLevel> minimumLevel;
+    std::atomic<uint32_t> categoryMask{~0u};
+    
+    std::mutex sinkMutex;
+    std::vector<std::unique_ptr<LogSink>> sinks;
+    
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable flushedCondition;
+    std::atomic<bool> writerSleeping{false};
+    size_t flushTarget = 0;
+    size_t flushedUpTo = 0;
+    bool running = true;
+    std::thread writer;
+    
+    Logger() : slots(new Slot[kCapacity]) {
+#ifdef NDEBUG
+        minimumLevel.store(LogLevel::INFO);
+#else
+        minimumLevel.store(LogLevel::DEBUG);
+#endif
+        for (size_t i = 0; i < kCapacity; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        sinks.push_back(std::make_unique<ConsoleLogSink>());
+        writer = std::thread([this] { writerLoop(); });
     }
     
-    const ThemeConfig& getCurrentConfig() const {
-        return config;
+    ~Logger() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            running = false;
+            wakeCondition.notify_one();
+        }
+        writer.join();
+        drain();
+        flushSinks();
+    }
+    
+    static uint32_t categoryBit(LogCategory category) {
+        return 1u << static_cast<uint32_t>(category);
+    }
+    
+    static void fillRecord(LogRecord& record, const LogMessage& message) {
+        std::string_view text = message.text();
+        record.timestampNanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        record.threadId = currentThreadId();
+        record.level = message.getLevel();
+        record.category = message.getCategory();
+        record.length = static_cast<uint16_t>(text.size());
+        std::memcpy(record.text, text.data(), text.size());
+    }
+    
+    static uint32_t currentThreadId() {
+        thread_local uint32_t id = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        return id;
+    }
+    
+    // Hands every published record to the sinks; returns how many were written
+    size_t drain() {
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        size_t written = 0;
+        for (;;) {
+            Slot& slot = slots[dequeuePos & kMask];
+            if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) break;
+            for (auto& sink : sinks) sink->write(slot.record);
+            slot.sequence.store(dequeuePos + kCapacity, std::memory_order_release);
+            dequeuePos++;
+            written++;
+        }
+        return written;
     }
     
-private:
-    ThemeConfig config;
-    bool autoThemeEnabled = false;
-    std::map<std::string, ThemeConfig> savedThemes;
-    std::vector<std::function<void(const ThemeConfig&)>> themeListeners;
+    void reportDrops() {
+        size_t total = dropped.load(std::memory_order_relaxed);
+        if (total == reportedDropped) return;
+        
+        LogMessage notice(LogLevel::WARN, LogCategory::ENGINE);
+        notice << "Logger dropped " << (total - reportedDropped) << " messages (ring buffer full)";
+        reportedDropped = total;
+        
+        LogRecord record;
+        fillRecord(record, notice);
+        
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        for (auto& sink : sinks) sink->write(record);
+    }
     
-    void notifyThemeListeners() {
-        for (const auto& listener : themeListeners) {
-            listener(config);
+    void flushSinks() {
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        for (auto& sink : sinks) sink->flush();
+    }
+    
+    void writerLoop() {
+        for (;;) {
+            if (drain() > 0) {
+                reportDrops();
+                flushSinks();
+            }
+            
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            if (flushTarget > flushedUpTo && dequeuePos >= flushTarget) {
+                flushedUpTo = dequeuePos;
+                flushedCondition.notify_all();
+            }
+            if (!running) {
+                flushedCondition.notify_all();
+                return;
+            }
+            
+            // A producer that misses the sleeping flag is picked up by the timeout
+            writerSleeping.store(true, std::memory_order_relaxed);
+            Slot& next = slots[dequeuePos & kMask];
+            if (next.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+                wakeCondition.wait_for(lock, std::chrono::milliseconds(flushTarget > flushedUpTo ? 1 : 20));
+            }
+            writerSleeping.store(false, std::memory_order_relaxed);
         }
     }
 };
 
-// Enhanced Tab class with modern browser capabilities
-class Tab {
-public:
-    enum class MediaState { PLAYING, PAUSED, MUTED, NONE };
-    enum class LoadState { LOADING, LOADED, ERROR, UNLOADED };
-    enum class ImportanceLevel { CRITICAL, HIGH, NORMAL, LOW, BACKGROUND };
-    
-    struct TabMetadata {
-        std::string favicon;
-        std::string ogImage;
-        std::string description;
-        std::vector<std::string> keywords;
-        std::chrono::system_clock::time_point lastVisited;
-        std::chrono::system_clock::time_point created;
-        int visitCount = 0;
-        std::map<std::string, std::string> customMetadata;
-    };
+constexpr bool isLogLevelCompiledIn(LogLevel level) {
+    return static_cast<int>(level) - NOVA_LOG_LEVEL >= 0;
+}
+
+// Statements below NOVA_LOG_LEVEL vanish at compile time; the others cost one
+// relaxed load when filtered out at runtime. Arguments are stream-style:
+//   NOVA_LOG_INFO(TAB, "Navigating to: " << url);
+#define NOVA_LOG(level, category, ...) \
+    do { \
+        if constexpr (isLogLevelCompiledIn(level)) { \
+            if (Logger::instance().shouldLog(level, category)) { \
+                LogMessage novaLogMessage(level, category); \
+                novaLogMessage << __VA_ARGS__; \
+                Logger::instance().submit(novaLogMessage); \
+            } \
+        } \
+    } while (0)
+
+#define NOVA_LOG_TRACE(category, ...) NOVA_LOG(LogLevel::TRACE, LogCategory::category, __VA_ARGS__)
+#define NOVA_LOG_DEBUG(category, ...) NOVA_LOG(LogLevel::DEBUG, LogCategory::category, __VA_ARGS__)
+#define NOVA_LOG_INFO(category, ...) NOVA_LOG(LogLevel::INFO, LogCategory::category, __VA_ARGS__)
+#define NOVA_LOG_WARN(category, ...) NOVA_LOG(LogLevel::WARN, LogCategory::category, __VA_ARGS__)
+#define NOVA_LOG_ERROR(category, ...) NOVA_LOG(LogLevel::ERROR, LogCategory::category, __VA_ARGS__)
+
+// Components of a parsed URL. Every field is a view into the string that was
+// parsed, so the source must outlive the ParsedUrl.
+struct ParsedUrl {
+    std::string_view scheme;
+    std::string_view userinfo;
+    std::string_view host;      // IPv6 literals are returned without brackets
+    std::string_view port;
+    std::string_view path;
+    std::string_view query;     // without the leading '?'
+    std::string_view fragment;  // without the leading '#'
+    bool hasAuthority = false;
+    bool isIpv6 = false;
+    bool valid = false;
+    
+    // Returns 0 when no explicit port was given
+    uint16_t portNumber() const {
+        uint32_t value = 0;
+        for (char c : port) {
+            value = value * 10 + static_cast<uint32_t>(c - '0');
+        }
+        return static_cast<uint16_t>(value);
+    }
     
-    Tab(const std::string& url = "about:blank") 
-        : url(url), title("New Tab"), isActive(false), isPinned(false), 
-          isHibernated(false), mediaState(MediaState::NONE), loadState(LoadState::UNLOADED),
-          importance(ImportanceLevel::NORMAL) {
-        
-        metadata.created = std::chrono::system_clock::now();
-        metadata.lastVisited = metadata.created;
+    bool isHttp() const {
+        return equalsIgnoreCase(scheme, "http") || equalsIgnoreCase(scheme, "https");
     }
     
-    void navigate(const std::string& newUrl) {
-        // Record history before navigating
-        if (url != "about:blank" && !url.empty()) {
-            browserHistory.push_back({url, title});
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            char x = a[i], y = b[i];
+            if (x >= 'A' && x <= 'Z') x = static_cast<char>(x - 'A' + 'a');
+            if (y >= 'A' && y <= 'Z') y = static_cast<char>(y - 'A' + 'a');
+            if (x != y) return false;
         }
+        return true;
+    }
+};
+
+// Allocation-free URL parser following the generic syntax of RFC 3986:
+//   scheme:[//[userinfo@]host[:port]]path[?query][#fragment]
+class UrlParser {
+public:
+    static ParsedUrl parse(std::string_view url) {
+        ParsedUrl result;
+        std::string_view rest = url;
         
-        url = newUrl;
-        loadState = LoadState::LOADING;
-        std::cout << "Navigating to: " << url << std::endl;
-        
-        // Simulated page loading
-        std::cout << "Loading content..." << std::endl;
-        
-        // In a real implementation, this would start the actual page loading process
-        // For now, we'll simulate it completing immediately
-        loadState = LoadState::LOADED;
+        // Scheme: ALPHA *( ALPHA / DIGIT / "+" / "-" / "." ) followed by ':'
+        size_t schemeEnd = scanScheme(rest);
+        if (schemeEnd != std::string_view::npos) {
+            result.scheme = rest.substr(0, schemeEnd);
+            rest.remove_prefix(schemeEnd + 1);
+        }
         
-        // Update metadata
-        metadata.lastVisited = std::chrono::system_clock::now();
-        metadata.visitCount++;
+        // Fragment and query are split off first so '@' or ':' inside them
+        // can never be mistaken for authority delimiters
+        size_t hashPos = rest.find('#');
+        if (hashPos != std::string_view::npos) {
+            result.fragment = rest.substr(hashPos + 1);
+            rest = rest.substr(0, hashPos);
+        }
+        size_t queryPos = rest.find('?');
+        if (queryPos != std::string_view::npos) {
+            result.query = rest.substr(queryPos + 1);
+            rest = rest.substr(0, queryPos);
+        }
         
-        // In a real browser, we would extract these from the page
-        if (!url.empty() && url != "about:blank") {
-            std::string domain = extractDomain(url);
-            metadata.favicon = "https://" + domain + "/favicon.ico";
+        if (rest.size() >= 2 && rest[0] == '/' && rest[1] == '/') {
+            rest.remove_prefix(2);
+            size_t authorityEnd = rest.find('/');
+            std::string_view authority = rest.substr(0, authorityEnd);
+            rest = authorityEnd == std::string_view::npos ? std::string_view() : rest.substr(authorityEnd);
+            
+            result.hasAuthority = true;
+            if (!parseAuthority(authority, result)) {
+                ParsedUrl invalid;
+                invalid.scheme = result.scheme;
+                return invalid;
+            }
         }
+        
+        result.path = rest;
+        result.valid = !result.scheme.empty() || result.hasAuthority;
+        return result;
     }
     
-    std::string extractDomain(const std::string& url) {
-        // Simple domain extraction
-        std::string domain;
-        std::regex domainPattern(R"(https?://([^/]+))");
-        std::smatch matches;
-        if (std::regex_search(url, matches, domainPattern) && matches.size() > 1) {
-            domain = matches[1].str();
+private:
+    static bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    
+    static size_t scanScheme(std::string_view s) {
+        if (s.empty() || !isAlpha(s[0])) return std::string_view::npos;
+        for (size_t i = 1; i < s.size(); ++i) {
+            char c = s[i];
+            if (c == ':') return i;
+            if (!isAlpha(c) && !isDigit(c) && c != '+' && c != '-' && c != '.') break;
         }
-        return domain;
+        return std::string_view::npos;
     }
     
-    void setTitle(const std::string& newTitle) {
-        title = newTitle;
-    }
-    
-    void setActive(bool active) {
-        if (active && !isActive) {
-            // Tab is being activated
-            metadata.lastVisited = std::chrono::system_clock::now();
+    static bool parseAuthority(std::string_view authority, ParsedUrl& result) {
+        // Userinfo ends at the last '@' since it may itself contain escaped '@'
+        size_t atPos = authority.rfind('@');
+        if (atPos != std::string_view::npos) {
+            result.userinfo = authority.substr(0, atPos);
+            authority.remove_prefix(atPos + 1);
         }
         
-        isActive = active;
+        std::string_view portPart;
+        bool hasPort = false;
+        if (!authority.empty() && authority[0] == '[') {
+            size_t close = authority.find(']');
+            if (close == std::string_view::npos) return false;
+            result.host = authority.substr(1, close - 1);
+            result.isIpv6 = true;
+            std::string_view after = authority.substr(close + 1);
+            if (!after.empty()) {
+                if (after[0] != ':') return false;
+                portPart = after.substr(1);
+                hasPort = true;
+            }
+        } else {
+            size_t colon = authority.find(':');
+            result.host = authority.substr(0, colon);
+            if (colon != std::string_view::npos) {
+                portPart = authority.substr(colon + 1);
+                hasPort = true;
+            }
+        }
         
-        if (isActive && isHibernated) {
-            // Automatically wake up hibernated tabs when activated
-            hibernateTab(false);
+        if (hasPort) {
+            if (portPart.size() > 5) return false;
+            uint32_t value = 0;
+            for (char c : portPart) {
+                if (!isDigit(c)) return false;
+                value = value * 10 + static_cast<uint32_t>(c - '0');
+            }
+            if (value > 65535) return false;
+            result.port = portPart;
         }
+        return true;
     }
     
-    void setPinned(bool pinned) {
-        isPinned = pinned;
-        std::cout << (pinned ? "Tab pinned" : "Tab unpinned") << std::endl;
-        
-        // Pinned tabs should not be hibernated
-        if (isPinned && isHibernated) {
-            hibernateTab(false);
+public:
+    // The registrable part of a lowercase host, roughly: the last two labels,
+    // or three under a two-letter country code with a short second level
+    // (co.uk). IP addresses are their own site.
+    static std::string_view siteOf(std::string_view host) {
+        size_t last = host.rfind('.');
+        if (last == std::string_view::npos || last == 0 || isDigit(host.back())) return host;
+        size_t second = host.rfind('.', last - 1);
+        if (second == std::string_view::npos) return host;
+        if (host.size() - last - 1 == 2 && last - second - 1 <= 3 && second > 0) {
+            size_t third = host.rfind('.', second - 1);
+            return third == std::string_view::npos ? host : host.substr(third + 1);
         }
+        return host.substr(second + 1);
+    }
+};
+
+// The form of a URL that tells whether two tabs show the same page: scheme
+// and host lowercased, the host without "www." or a trailing dot, no
+// default port, no fragment, and the query sorted with tracking parameters
+// left out. Only web and file URLs are pages; about: and the like are not.
+class CanonicalUrl {
+public:
+    // Empty when `url` is not a page
+    static std::string of(std::string_view url) {
+        std::string canonical;
+        canonical.reserve(url.size());
+        if (!write(url, [&](std::string_view piece) { canonical += piece; })) return std::string();
+        return canonical;
+    }
+    
+    // FNV-1a of the canonical form, hashed as it is produced; 0 when `url`
+    // is not a page
+    static uint64_t hash(std::string_view url) {
+        uint64_t hash = 14695981039346656037ull;
+        bool page = write(url, [&](std::string_view piece) {
+            for (char c : piece) hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        });
+        if (!page) return 0;
+        return hash == 0 ? 1 : hash;
     }
     
-    std::string getUrl() const { return url; }
-    std::string getTitle() const { return title; }
-    bool getIsActive() const { return isActive; }
-    bool getIsPinned() const { return isPinned; }
-    bool getIsHibernated() const { return isHibernated; }
-    LoadState getLoadState() const { return loadState; }
-    MediaState getMediaState() const { return mediaState; }
-    ImportanceLevel getImportance() const { return importance; }
-    const TabMetadata& getMetadata() const { return metadata; }
-    
-    // Advanced tab features
-    void captureScreenshot() {
-        std::cout << "Captured screenshot of tab: " << title << std::endl;
+private:
+    static constexpr size_t kSortedParameters = 16;  // sorted in place; more go to the heap
+    
+    // Hands the canonical form to `emit` a piece at a time
+    template <typename Emit>
+    static bool write(std::string_view url, Emit&& emit) {
+        ParsedUrl parsed = UrlParser::parse(url);
+        bool file = ParsedUrl::equalsIgnoreCase(parsed.scheme, "file");
+        if (!parsed.valid || !parsed.hasAuthority || !(parsed.isHttp() || file) || (parsed.host.empty() && !file)) {
+            return false;
+        }
         
-        // In a real implementation, would call into the rendering engine
-        // to capture the current visual state of the page
-        std::string screenshotPath = "/tmp/screenshot_" + 
-            std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".png";
+        emitLower(parsed.scheme, emit);
+        emit("://");
+        std::string_view host = parsed.host;
+        while (!host.empty() && host.back() == '.') host.remove_suffix(1);
+        if (host.size() > 4 && ParsedUrl::equalsIgnoreCase(host.substr(0, 4), "www.") &&
+            host.find('.', 4) != std::string_view::npos) {
+            host.remove_prefix(4);
+        }
+        if (parsed.isIpv6) emit("[");
+        emitLower(host, emit);
+        if (parsed.isIpv6) emit("]");
+        uint16_t port = parsed.portNumber();
+        bool defaultPort = (port == 80 && ParsedUrl::equalsIgnoreCase(parsed.scheme, "http")) ||
+                           (port == 443 && ParsedUrl::equalsIgnoreCase(parsed.scheme, "https"));
+        if (!parsed.port.empty() && !defaultPort) emit(":" + std::to_string(port));
+        emit(parsed.path.empty() ? std::string_view("/") : parsed.path);
         
-        std::cout << "Screenshot saved to: " << screenshotPath << std::endl;
+        std::array<std::string_view, kSortedParameters> inPlace;
+        std::vector<std::string_view> onHeap;
+        size_t count = 0;
+        std::string_view query = parsed.query;
+        while (!query.empty()) {
+            size_t amp = query.find('&');
+            std::string_view parameter = query.substr(0, amp);
+            query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+            if (parameter.empty() || isTracking(parameter.substr(0, parameter.find('=')))) continue;
+            if (count == kSortedParameters) onHeap.assign(inPlace.begin(), inPlace.end());
+            if (count >= kSortedParameters) {
+                onHeap.push_back(parameter);
+            } else {
+                inPlace[count] = parameter;
+            }
+            count++;
+        }
+        std::string_view* parameters = count > kSortedParameters ? onHeap.data() : inPlace.data();
+        std::sort(parameters, parameters + count);
+        for (size_t i = 0; i < count; ++i) {
+            emit(i == 0 ? "?" : "&");
+            emit(parameters[i]);
+        }
+        return true;
     }
     
-    void pinToSidebar() {
-        std::cout << "Pinned tab to sidebar: " << title << std::endl;
-        // Would add a shortcut to this tab in the sidebar
-        isPinnedToSidebar = true;
+    template <typename Emit>
+    static void emitLower(std::string_view text, Emit& emit) {
+        char buffer[64];
+        while (!text.empty()) {
+            size_t size = std::min(text.size(), sizeof(buffer));
+            for (size_t i = 0; i < size; ++i) {
+                char c = text[i];
+                buffer[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+            }
+            emit(std::string_view(buffer, size));
+            text.remove_prefix(size);
+        }
     }
     
-    void unpinFromSidebar() {
-        std::cout << "Unpinned tab from sidebar: " << title << std::endl;
-        isPinnedToSidebar = false;
+    // Campaign and click identifiers that say how the page was reached,
+    // not which page it is
+    static bool isTracking(std::string_view name) {
+        static const std::unordered_set<std::string_view> tracking = {
+            "fbclid", "gclid", "dclid", "gbraid", "wbraid", "msclkid", "yclid", "igshid", "mc_cid", "mc_eid",
+            "_ga", "_gl", "_hsenc", "_hsmi", "mkt_tok", "ref_src", "vero_id", "oly_anon_id", "oly_enc_id"};
+        if (name.size() > 4 && ParsedUrl::equalsIgnoreCase(name.substr(0, 4), "utm_")) return true;
+        if (name.size() < 3 || name.size() > 11) return false;
+        char lower[12];
+        for (size_t i = 0; i < name.size(); ++i) lower[i] = (name[i] >= 'A' && name[i] <= 'Z') ? static_cast<char>(name[i] - 'A' + 'a') : name[i];
+        return tracking.count(std::string_view(lower, name.size())) > 0;
+    }
+};
+
+// Compact integer id for an interned host name; 0 means "no domain"
+using DomainAtom = uint32_t;
+
+// Process-wide intern table for host names. Each distinct (case-folded) host is
+// stored exactly once and identified by a DomainAtom from then on.
+class DomainAtoms {
+public:
+    static DomainAtoms& instance() {
+        static DomainAtoms atoms;
+        return atoms;
     }
     
-    void hibernateTab(bool hibernate = true) {
-        // Don't hibernate pinned tabs
-        if (hibernate && isPinned) {
-            std::cout << "Cannot hibernate pinned tab: " << title << std::endl;
-            return;
-        }
+    DomainAtom intern(std::string_view host) {
+        if (host.empty()) return 0;
+        std::string folded = foldCase(host);
         
-        isHibernated = hibernate;
-        std::cout << (hibernate ? "Tab hibernated to save resources: " : "Tab restored from hibernation: ") 
-                  << title << std::endl;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(folded);
+        if (it != ids.end()) return it->second;
         
-        // In a real implementation, this would suspend/resume the tab's processes
-    }
-    
-    void recordInteractions() {
-        std::cout << "Recording interactions for later analysis: " << title << std::endl;
-        isRecordingInteractions = true;
-        // Would begin tracking user interactions with the page
-    }
-    
-    void stopRecordingInteractions() {
-        if (isRecordingInteractions) {
-            std::cout << "Stopped recording interactions for: " << title << std::endl;
-            isRecordingInteractions = false;
-            // Would generate a report of interactions
-        }
+        names.push_back(std::move(folded));
+        DomainAtom atom = static_cast<DomainAtom>(names.size());
+        ids.emplace(names.back(), atom);
+        return atom;
     }
     
-    void setMediaState(MediaState state) {
-        mediaState = state;
-        std::string stateStr;
-        
-        switch (state) {
-            case MediaState::PLAYING: stateStr = "playing"; break;
-            case MediaState::PAUSED: stateStr = "paused"; break;
-            case MediaState::MUTED: stateStr = "muted"; break;
-            case MediaState::NONE: stateStr = "none"; break;
-        }
+    // Looks up a host without interning it; returns 0 if it was never seen
+    DomainAtom find(std::string_view host) const {
+        if (host.empty()) return 0;
+        std::string folded = foldCase(host);
         
-        std::cout << "Setting media state for tab to " << stateStr << ": " << title << std::endl;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(folded);
+        return it != ids.end() ? it->second : 0;
     }
     
-    void boost() {
-        std::cout << "Boosting tab performance: " << title << std::endl;
-        importance = ImportanceLevel::HIGH;
-        // Would allocate more resources to this tab
+    std::string_view name(DomainAtom atom) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (atom == 0 || atom > names.size()) return {};
+        return names[atom - 1];
     }
     
-    void deprioritize() {
-        std::cout << "Deprioritizing tab: " << title << std::endl;
-        importance = ImportanceLevel::LOW;
-        // Would reduce resource allocation
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return names.size();
     }
     
-    void minify() {
-        std::cout << "Minifying tab view: " << title << std::endl;
-        isMinified = true;
-        // Would reduce the tab's UI to minimal elements
+private:
+    DomainAtoms() = default;
+    
+    static std::string foldCase(std::string_view host) {
+        std::string folded(host);
+        for (char& c : folded) {
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        }
+        return folded;
     }
     
-    void restore() {
-        if (isMinified) {
-            std::cout << "Restoring tab from minified view: " << title << std::endl;
-            isMinified = false;
+    mutable std::mutex mutex;
+    std::deque<std::string> names; // deque keeps the views in ids stable
+    std::unordered_map<std::string_view, DomainAtom> ids;
+};
+
+// Open-addressing hash map keyed by DomainAtom (linear probing, backward-shift
+// deletion). Atom 0 marks an empty slot, so it cannot be used as a key.
+template <typename Value>
+class FlatAtomMap {
+public:
+    Value* find(DomainAtom key) {
+        if (key == 0 || slots.empty()) return nullptr;
+        for (size_t i = slotFor(key);; i = (i + 1) & mask()) {
+            if (slots[i].key == key) return &slots[i].value;
+            if (slots[i].key == 0) return nullptr;
         }
     }
     
-    bool canGoBack() const {
-        return !browserHistory.empty();
+    const Value* find(DomainAtom key) const {
+        return const_cast<FlatAtomMap*>(this)->find(key);
     }
     
-    void goBack() {
-        if (canGoBack()) {
-            auto previous = browserHistory.back();
-            browserHistory.pop_back();
-            forwardHistory.push_back({url, title});
-            
-            // Navigate without adding to history
-            url = previous.first;
-            title = previous.second;
-            std::cout << "Navigating back to: " << url << std::endl;
-            
-            // Update metadata
-            metadata.lastVisited = std::chrono::system_clock::now();
-            metadata.visitCount++;
+    Value& operator[](DomainAtom key) {
+        if ((count + 1) * 4 > slots.size() * 3) {
+            rehash(slots.empty() ? 16 : slots.size() * 2);
         }
+        size_t i = slotFor(key);
+        while (slots[i].key != 0 && slots[i].key != key) {
+            i = (i + 1) & mask();
+        }
+        if (slots[i].key == 0) {
+            slots[i].key = key;
+            slots[i].value = Value{};
+            count++;
+        }
+        return slots[i].value;
     }
     
-    bool canGoForward() const {
-        return !forwardHistory.empty();
+    bool erase(DomainAtom key) {
+        if (key == 0 || slots.empty()) return false;
+        size_t i = slotFor(key);
+        while (slots[i].key != key) {
+            if (slots[i].key == 0) return false;
+            i = (i + 1) & mask();
+        }
+        
+        // Shift following entries back so no tombstones are needed
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask(); slots[j].key != 0; j = (j + 1) & mask()) {
+            size_t home = slotFor(slots[j].key);
+            bool movable = hole <= j ? (home <= hole || home > j) : (home <= hole && home > j);
+            if (movable) {
+                slots[hole] = std::move(slots[j]);
+                hole = j;
+            }
+        }
+        slots[hole].key = 0;
+        slots[hole].value = Value{};
+        count--;
+        return true;
     }
     
-    void goForward() {
-        if (canGoForward()) {
-            auto next = forwardHistory.back();
-            forwardHistory.pop_back();
-            browserHistory.push_back({url, title});
-            
-            // Navigate without adding to history
-            url = next.first;
-            title = next.second;
-            std::cout << "Navigating forward to: " << url << std::endl;
-            
-            // Update metadata
-            metadata.lastVisited = std::chrono::system_clock::now();
-            metadata.visitCount++;
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const auto& slot : slots) {
+            if (slot.key != 0) fn(slot.key, slot.value);
         }
     }
     
-    void reload(bool bypassCache = false) {
-        std::cout << "Reloading page" << (bypassCache ? " (bypass cache)" : "") << ": " << url << std::endl;
-        loadState = LoadState::LOADING;
-        // In a real implementation, this would trigger the page reload
-        loadState = LoadState::LOADED;
+    void clear() {
+        slots.clear();
+        count = 0;
     }
     
-    void findInPage(const std::string& searchText) {
-        std::cout << "Searching for \"" << searchText << "\" in page: " << title << std::endl;
-        // Would highlight matches in the page
-    }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
     
-    void scheduleReload(std::chrono::seconds interval) {
-        std::cout << "Tab will auto-reload every " << interval.count() << " seconds" << std::endl;
-        // In a real implementation, this would set up a timer
+private:
+    struct Slot {
+        DomainAtom key = 0;
+        Value value{};
+    };
+    
+    std::vector<Slot> slots;
+    size_t count = 0;
+    
+    size_t mask() const { return slots.size() - 1; }
+    
+    size_t slotFor(DomainAtom key) const {
+        // Fibonacci hashing spreads sequential atom ids across the table
+        return static_cast<size_t>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> 32) & mask();
     }
     
-    void addTabListener(std::function<void(const std::string&, const std::string&)> listener) {
-        tabListeners.push_back(listener);
+    void rehash(size_t capacity) {
+        std::vector<Slot> old = std::move(slots);
+        slots.assign(capacity, Slot{});
+        count = 0;
+        for (auto& slot : old) {
+            if (slot.key != 0) (*this)[slot.key] = std::move(slot.value);
+        }
+    }
+};
+
+// Contiguous, read-only view over a run of delivered events
+template <typename Event>
+struct EventSpan {
+    const Event* first = nullptr;
+    size_t count = 0;
+    
+    const Event* begin() const { return first; }
+    const Event* end() const { return first + count; }
+    size_t size() const { return count; }
+};
+
+// Subscriber registry shared between an EventChannel and the Subscription
+// handles it gives out, so either side may be destroyed first
+class SubscriberListBase {
+public:
+    virtual ~SubscriberListBase() = default;
+    virtual void unsubscribe(uint64_t id) = 0;
+};
+
+// Move-only handle for an event subscription; unsubscribes when destroyed
+class Subscription {
+public:
+    Subscription() = default;
+    Subscription(std::weak_ptr<SubscriberListBase> list, uint64_t id) : list(std::move(list)), id(id) {}
+    Subscription(Subscription&& other) noexcept : list(std::move(other.list)), id(other.id) { other.id = 0; }
+    
+    Subscription& operator=(Subscription&& other) noexcept {
+        if (this != &other) {
+            reset();
+            list = std::move(other.list);
+            id = other.id;
+            other.id = 0;
+        }
+        return *this;
     }
     
-    void notifyTabListeners(const std::string& event, const std::string& data) {
-        for (const auto& listener : tabListeners) {
-            listener(event, data);
+    Subscription(const Subscription&) = delete;
+    Subscription& operator=(const Subscription&) = delete;
+    
+    ~Subscription() { reset(); }
+    
+    void reset() {
+        if (id != 0) {
+            if (auto owner = list.lock()) owner->unsubscribe(id);
+            id = 0;
         }
+        list.reset();
     }
     
-private:
-    std::string url;
-    std::string title;
-    bool isActive;
-    bool isPinned;
-    bool isHibernated;
-    bool isMinified = false;
-    bool isPinnedToSidebar = false;
-    bool isRecordingInteractions = false;
-    MediaState mediaState;
-    LoadState loadState;
-    ImportanceLevel importance;
-    TabMetadata metadata;
-    std::vector<std::function<void(const std::string&, const std::string&)>> tabListeners;
+    bool isActive() const { return id != 0 && !list.expired(); }
     
-    // Navigation history
-    std::vector<std::pair<std::string, std::string>> browserHistory; // url, title pairs
-    std::vector<std::pair<std::string, std::string>> forwardHistory;
+private:
+    std::weak_ptr<SubscriberListBase> list;
+    uint64_t id = 0;
 };
 
-// Enhanced TabGroup with advanced organizational features
-class TabGroup {
+// Frame-scoped event batching. While at least one EventBatch is open on the
+// current thread, channels coalesce their events and deliver them once, as a
+// single span per subscriber, when the outermost batch closes.
+class EventBatch {
 public:
-    enum class AutoGroupingRule { 
-        BY_DOMAIN,
-        BY_TOPIC,
-        BY_TIME,
-        BY_PROJECT,
-        BY_INTERACTION_PATTERN,
-        CUSTOM
+    // Implemented by channels holding undelivered events
+    class Pending {
+    public:
+        virtual ~Pending() = default;
+        virtual void deliverPending() = 0;
     };
     
-    enum class ViewMode {
-        GRID,
-        LIST,
-        CAROUSEL,
-        STACKED
-    };
+    EventBatch() { state().depth++; }
+    ~EventBatch() {
+        if (--state().depth == 0) flush();
+    }
     
-    struct GroupMetrics {
-        size_t totalTabs = 0;
-        size_t activeTabs = 0;
-        size_t hibernatedTabs = 0;
-        std::chrono::system_clock::time_point lastAccessed;
-        std::chrono::seconds totalFocusTime{0};
+    EventBatch(const EventBatch&) = delete;
+    EventBatch& operator=(const EventBatch&) = delete;
+    
+    static bool isOpen() { return state().depth > 0; }
+    
+    static void enqueue(Pending* channel) { state().dirty.push_back(channel); }
+    
+    // Called by channels destroyed while they still have queued events
+    static void cancel(Pending* channel) {
+        auto& dirty = state().dirty;
+        std::replace(dirty.begin(), dirty.end(), channel, static_cast<Pending*>(nullptr));
+    }
+    
+private:
+    struct State {
+        int depth = 0;
+        std::vector<Pending*> dirty;
     };
     
-    TabGroup(const std::string& name = "New Group") 
-        : name(name), color("#5F9EA0"), isCollapsed(false), isAutoGroup(false),
-          autoGroupRule(AutoGroupingRule::BY_DOMAIN), viewMode(ViewMode::LIST) {
-        metrics.lastAccessed = std::chrono::system_clock::now();
+    static State& state() {
+        thread_local State current;
+        return current;
     }
     
-    void addTab(std::shared_ptr<Tab> tab) {
-        if (!tab) return;
+    static void flush() {
+        // Subscribers may publish or open nested batches while we deliver, so
+        // re-check the size on every step instead of holding iterators
+        auto& dirty = state().dirty;
+        for (size_t i = 0; i < dirty.size(); ++i) {
+            if (auto* channel = dirty[i]) {
+                dirty[i] = nullptr;
+                channel->deliverPending();
+            }
+        }
+        dirty.clear();
+    }
+};
+
+// Typed publish/subscribe channel. Event must be a small trivially copyable
+// struct with a `type` member; inside an EventBatch, a newer event replaces
+// a pending one of the same type.
+template <typename Event>
+class EventChannel : private EventBatch::Pending {
+public:
+    using Callback = std::function<void(EventSpan<Event>)>;
+    
+    EventChannel() : subscribers(std::make_shared<SubscriberList>()) {}
+    
+    ~EventChannel() override {
+        if (queued) EventBatch::cancel(this);
+    }
+    
+    EventChannel(const EventChannel&) = delete;
+    EventChannel& operator=(const EventChannel&) = delete;
+    
+    [[nodiscard]] Subscription subscribe(Callback callback) {
+        uint64_t id = subscribers->add(std::move(callback));
+        return Subscription(subscribers, id);
+    }
+    
+    void publish(const Event& event) {
+        if (subscribers->activeCount == 0) return;
         
-        tabs.push_back(tab);
-        updateMetrics();
-        updateThumbnail(tab);
+        if (EventBatch::isOpen()) {
+            coalesce(event);
+            return;
+        }
+        subscribers->dispatch(EventSpan<Event>{&event, 1});
+    }
+    
+    size_t subscriberCount() const { return subscribers->activeCount; }
+    
+private:
+    static_assert(std::is_trivially_copyable<Event>::value, "events must be plain data");
+    
+    struct SubscriberList : SubscriberListBase {
+        struct Entry {
+            uint64_t id;
+            Callback callback;
+        };
         
-        // Set up a listener for this tab
-        tab->addTabListener([this](const std::string& event, const std::string& data) {
-            this->handleTabEvent(event, data);
-        });
+        std::vector<Entry> entries;
+        std::vector<Entry> added; // subscriptions made during a dispatch
+        uint64_t nextId = 1;
+        size_t activeCount = 0;
+        int dispatchDepth = 0;
+        bool hasRemoved = false;
         
-        std::cout << "Added tab to group: " << name << std::endl;
+        uint64_t add(Callback callback) {
+            uint64_t id = nextId++;
+            (dispatchDepth > 0 ? added : entries).push_back({id, std::move(callback)});
+            activeCount++;
+            return id;
+        }
         
-        // Add to domain index for quick lookups
-        if (!tab->getUrl().empty() && tab->getUrl() != "about:blank") {
-            std::string domain = tab->extractDomain(tab->getUrl());
-            if (!domain.empty()) {
-                domainIndex[domain].push_back(tab);
+        void unsubscribe(uint64_t id) override {
+            for (auto* list : {&entries, &added}) {
+                for (auto& entry : *list) {
+                    if (entry.id == id && entry.callback) {
+                        // Slots are only compacted outside of dispatch
+                        entry.callback = nullptr;
+                        hasRemoved = true;
+                        activeCount--;
+                        if (dispatchDepth == 0) compact();
+                        return;
+                    }
+                }
+            }
+        }
+        
+        void dispatch(EventSpan<Event> events) {
+            dispatchDepth++;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (entries[i].callback) entries[i].callback(events);
+            }
+            if (--dispatchDepth == 0) compact();
+        }
+        
+        void compact() {
+            if (!added.empty()) {
+                for (auto& entry : added) entries.push_back(std::move(entry));
+                added.clear();
+            }
+            if (hasRemoved) {
+                entries.erase(std::remove_if(entries.begin(), entries.end(),
+                    [](const Entry& entry) { return !entry.callback; }), entries.end());
+                hasRemoved = false;
             }
         }
+    };
+    
+    std::shared_ptr<SubscriberList> subscribers;
+    std::vector<Event> pending;
+    std::vector<Event> delivering;
+    bool queued = false;
+    
+    void coalesce(const Event& event) {
+        for (auto& existing : pending) {
+            if (existing.type == event.type) {
+                existing = event;
+                return;
+            }
+        }
+        pending.push_back(event);
+        if (!queued) {
+            queued = true;
+            EventBatch::enqueue(this);
+        }
     }
     
-    void removeTab(std::shared_ptr<Tab> tab) {
-        if (!tab) return;
+    void deliverPending() override {
+        queued = false;
+        // Swap rather than move so both buffers keep their capacity
+        delivering.swap(pending);
+        subscribers->dispatch(EventSpan<Event>{delivering.data(), delivering.size()});
+        delivering.clear();
+    }
+};
+
+// Engine-wide timer service. A single thread drives a hierarchical timing
+// wheel (4 levels of 64 slots, 10 ms ticks, ~46 h horizon; later deadlines
+// are re-cascaded), so scheduling and cancelling are O(1) and the thread
+// sleeps until the next occupied slot. Timers with a slack are aligned to
+// multiples of it, letting many of them fire in one wake-up.
+// Callbacks run on the timer thread and should be short; work on tabs,
+// groups, themes or the engine is posted to the MainThreadQueue.
+using TimerId = uint64_t;
+
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+    static constexpr Clock::duration kTick = std::chrono::milliseconds(10);
+    
+    struct Stats {
+        size_t pending = 0;
+        uint64_t fired = 0;
+        uint64_t wakeups = 0;
+    };
+    
+    static TimerWheel& instance() {
+        static TimerWheel wheel;
+        return wheel;
+    }
+    
+    // A zero period makes a one-shot timer. The returned id is never 0.
+    TimerId schedule(Clock::duration delay, Callback callback,
+                     Clock::duration period = Clock::duration::zero(),
+                     Clock::duration slack = Clock::duration::zero()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t index = allocateNode();
+        Node& node = nodes[index];
+        node.callback = std::move(callback);
+        node.periodTicks = toTicks(period);
+        node.slackTicks = toTicks(slack);
+        node.expires = alignExpiry(ticksAt(Clock::now() + delay), node.slackTicks);
+        node.state = NodeState::QUEUED;
+        link(index);
+        pendingCount++;
         
-        // Find and remove the tab
-        auto it = std::find_if(tabs.begin(), tabs.end(),
-            [&tab](const std::shared_ptr<Tab>& t) { return t.get() == tab.get(); });
+        if (!worker.joinable()) {
+            worker = std::thread([this] { run(); });
+        } else if (node.expires < sleepingUntil) {
+            wakeCondition.notify_one();
+        }
+        return (static_cast<uint64_t>(node.generation) << 32) | (index + 1);
+    }
+    
+    // Safe from any thread. If another thread is running the timer's callback,
+    // waits for it to return; from inside a callback it only stops re-arming.
+    bool cancel(TimerId id) {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint32_t index = static_cast<uint32_t>(id & 0xFFFFFFFFu) - 1;
+        uint32_t generation = static_cast<uint32_t>(id >> 32);
+        if (index >= nodes.size() || nodes[index].generation != generation) return false;
         
-        if (it != tabs.end()) {
-            // Remove from domain index
-            if (!tab->getUrl().empty() && tab->getUrl() != "about:blank") {
-                std::string domain = tab->extractDomain(tab->getUrl());
-                if (!domain.empty() && domainIndex.count(domain) > 0) {
-                    auto& domainTabs = domainIndex[domain];
-                    domainTabs.erase(
-                        std::remove_if(domainTabs.begin(), domainTabs.end(),
-                            [&tab](const std::shared_ptr<Tab>& t) { return t.get() == tab.get(); }),
-                        domainTabs.end());
-                }
+        Node& node = nodes[index];
+        if (node.cancelled || node.state == NodeState::FREE) return false;
+        pendingCount--;
+        
+        if (node.state == NodeState::QUEUED) {
+            unlink(index);
+            freeNode(index);
+        } else {
+            // Due or running: the dispatch loop frees it
+            node.cancelled = true;
+            if (node.state == NodeState::RUNNING && std::this_thread::get_id() != worker.get_id()) {
+                runningCondition.wait(lock, [&] { return runningIndex != index; });
             }
-            
-            // Remove from main list
-            tabs.erase(it);
-            updateMetrics();
-            std::cout << "Removed tab from group: " << name << std::endl;
         }
+        return true;
     }
     
-    void setName(const std::string& newName) {
-        name = newName;
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats result;
+        result.pending = pendingCount;
+        result.fired = firedCount;
+        result.wakeups = wakeupCount;
+        return result;
     }
     
-    void setColor(const std::string& newColor) {
-        color = newColor;
+private:
+    enum class NodeState : uint8_t { FREE, QUEUED, DUE, RUNNING };
+    
+    struct Node {
+        uint64_t expires = 0;
+        uint64_t periodTicks = 0;
+        uint64_t slackTicks = 0;
+        Callback callback;
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+        uint32_t generation = 1;
+        uint16_t bucket = 0;
+        NodeState state = NodeState::FREE;
+        bool cancelled = false;
+    };
+    
+    static constexpr uint32_t kNil = 0xFFFFFFFFu;
+    static constexpr unsigned kLevels = 4;
+    static constexpr unsigned kSlotBits = 6;
+    static constexpr unsigned kSlots = 1u << kSlotBits;
+    static constexpr uint64_t kNever = ~0ull;
+    
+    const Clock::time_point origin = Clock::now();
+    mutable std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable runningCondition;
+    // Deque keeps nodes in place while a callback runs unlocked
+    std::deque<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    std::vector<uint32_t> due;
+    uint32_t buckets[kLevels * kSlots];
+    uint64_t occupied[kLevels] = {};
+    uint64_t currentTick = 0;
+    uint64_t sleepingUntil = 0;
+    uint32_t runningIndex = kNil;
+    size_t pendingCount = 0;
+    uint64_t firedCount = 0;
+    uint64_t wakeupCount = 0;
+    bool stopping = false;
+    std::thread worker;
+    
+    TimerWheel() {
+        std::fill(std::begin(buckets), std::end(buckets), kNil);
+        // Callbacks log, so the logger must outlive the timer thread
+        Logger::instance();
+    }
+    
+    ~TimerWheel() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            wakeCondition.notify_one();
+        }
+        if (worker.joinable()) worker.join();
     }
     
-    void setIcon(const std::string& newIcon) {
-        icon = newIcon;
+    static uint64_t toTicks(Clock::duration duration) {
+        if (duration <= Clock::duration::zero()) return 0;
+        return static_cast<uint64_t>((duration.count() + kTick.count() - 1) / kTick.count());
     }
     
-    std::string getName() const { return name; }
-    std::string getColor() const { return color; }
-    std::string getIcon() const { return icon; }
-    std::vector<std::shared_ptr<Tab>> getTabs() const { return tabs; }
-    const GroupMetrics& getMetrics() const { return metrics; }
+    uint64_t ticksAt(Clock::time_point time) const { return toTicks(time - origin); }
     
-    // Advanced tab group features
-    void toggleCollapse() {
-        isCollapsed = !isCollapsed;
-        std::cout << "Group '" << name << "' is now " 
-                 << (isCollapsed ? "collapsed" : "expanded") << std::endl;
+    uint64_t ticksNow() const {
+        return static_cast<uint64_t>((Clock::now() - origin) / kTick);
     }
     
-    void setViewMode(ViewMode mode) {
-        viewMode = mode;
-        std::string modeStr;
-        
-        switch (mode) {
-            case ViewMode::GRID: modeStr = "grid"; break;
-            case ViewMode::LIST: modeStr = "list"; break;
-            case ViewMode::CAROUSEL: modeStr = "carousel"; break;
-            case ViewMode::STACKED: modeStr = "stacked"; break;
-        }
-        
-        std::cout << "Changed view mode to " << modeStr << " for group: " << name << std::endl;
+    uint64_t alignExpiry(uint64_t tick, uint64_t slackTicks) const {
+        tick = std::max(tick, currentTick + 1);
+        if (slackTicks > 1) tick = (tick + slackTicks - 1) / slackTicks * slackTicks;
+        return tick;
     }
     
-    void setAutoGrouping(bool enabled, AutoGroupingRule rule = AutoGroupingRule::BY_DOMAIN) {
-        isAutoGroup = enabled;
-        autoGroupRule = rule;
-        std::cout << "Auto-grouping " << (enabled ? "enabled" : "disabled") 
-                 << " for group: " << name << std::endl;
-                 
-        if (enabled) {
-            reorganizeTabs();
+    uint32_t allocateNode() {
+        if (!freeNodes.empty()) {
+            uint32_t index = freeNodes.back();
+            freeNodes.pop_back();
+            return index;
         }
+        nodes.emplace_back();
+        return static_cast<uint32_t>(nodes.size() - 1);
     }
     
-    void reorganizeTabs() {
-        if (!isAutoGroup) return;
+    void freeNode(uint32_t index) {
+        Node& node = nodes[index];
+        Callback().swap(node.callback);
+        node.state = NodeState::FREE;
+        node.cancelled = false;
+        node.generation++;
+        freeNodes.push_back(index);
+    }
+    
+    // Files a node under the coarsest level whose span still covers its deadline
+    void link(uint32_t index) {
+        Node& node = nodes[index];
+        uint64_t delta = node.expires - currentTick;
+        unsigned level = 0;
+        while (level + 1 < kLevels && delta >= (1ull << (kSlotBits * (level + 1)))) level++;
         
-        std::cout << "Reorganizing tabs based on rule: ";
+        uint64_t target = node.expires;
+        uint64_t horizon = 1ull << (kSlotBits * kLevels);
+        if (delta >= horizon) target = currentTick + horizon - 1;
+        unsigned slot = static_cast<unsigned>(target >> (kSlotBits * level)) & (kSlots - 1);
         
-        switch (autoGroupRule) {
-            case AutoGroupingRule::BY_DOMAIN:
-                std::cout << "by domain" << std::endl;
-                // This is already handled by our domain index
-                break;
-            case AutoGroupingRule::BY_TOPIC:
-                std::cout << "by topic" << std::endl;
-                // Would use NLP to cluster by topic
-                break;
-            case AutoGroupingRule::BY_TIME:
-                std::cout << "by access time" << std::endl;
-                // Sort by last access time
-                std::sort(tabs.begin(), tabs.end(),
-                    [](const std::shared_ptr<Tab>& a, const std::shared_ptr<Tab>& b) {
-                        return a->getMetadata().lastVisited > b->getMetadata().lastVisited;
-                    });
-                break;
-            case AutoGroupingRule::BY_PROJECT:
-                std::cout << "by project" << std::endl;
-                // Would require project metadata
-                break;
-            case AutoGroupingRule::BY_INTERACTION_PATTERN:
-                std::cout << "by interaction pattern" << std::endl;
-                // Would analyze user interaction patterns
-                break;
-            case AutoGroupingRule::CUSTOM:
-                std::cout << "using custom rules" << std::endl;
-                // Would apply custom rule functions
-                break;
+        node.bucket = static_cast<uint16_t>(level * kSlots + slot);
+        node.prev = kNil;
+        node.next = buckets[node.bucket];
+        if (node.next != kNil) nodes[node.next].prev = index;
+        buckets[node.bucket] = index;
+        occupied[level] |= 1ull << slot;
+    }
+    
+    void unlink(uint32_t index) {
+        Node& node = nodes[index];
+        if (node.prev != kNil) nodes[node.prev].next = node.next;
+        else buckets[node.bucket] = node.next;
+        if (node.next != kNil) nodes[node.next].prev = node.prev;
+        if (buckets[node.bucket] == kNil) {
+            occupied[node.bucket / kSlots] &= ~(1ull << (node.bucket % kSlots));
         }
     }
     
-    void createSnapshot() {
-        std::string snapshotId = "snapshot_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
-        std::vector<std::string> urlList;
-        
-        for (const auto& tab : tabs) {
-            urlList.push_back(tab->getUrl());
+    uint32_t detachBucket(unsigned level, unsigned slot) {
+        unsigned bucket = level * kSlots + slot;
+        uint32_t head = buckets[bucket];
+        buckets[bucket] = kNil;
+        occupied[level] &= ~(1ull << slot);
+        return head;
+    }
+    
+    // First tick after currentTick at which a slot fires or cascades
+    uint64_t nextEventTick() const {
+        uint64_t next = kNever;
+        for (unsigned level = 0; level < kLevels; ++level) {
+            uint64_t bits = occupied[level];
+            if (bits == 0) continue;
+            unsigned shift = kSlotBits * level;
+            uint64_t block = level == 0 ? currentTick + 1 : (currentTick >> shift) + 1;
+            unsigned start = static_cast<unsigned>(block & (kSlots - 1));
+            uint64_t rotated = start == 0 ? bits : (bits >> start) | (bits << (kSlots - start));
+            uint64_t tick = (block + static_cast<uint64_t>(__builtin_ctzll(rotated))) << shift;
+            next = std::min(next, tick);
+        }
+        return next;
+    }
+    
+    // Cascades coarse slots that start at `tick` and collects the timers due then
+    void advanceTo(uint64_t tick) {
+        currentTick = tick;
+        for (unsigned level = kLevels - 1; level > 0; --level) {
+            unsigned shift = kSlotBits * level;
+            if ((tick & ((1ull << shift) - 1)) != 0) continue;
+            uint32_t index = detachBucket(level, static_cast<unsigned>(tick >> shift) & (kSlots - 1));
+            while (index != kNil) {
+                uint32_t next = nodes[index].next;
+                link(index);
+                index = next;
+            }
         }
         
-        snapshots[snapshotId] = urlList;
-        
-        std::cout << "Creating snapshot " << snapshotId << " of group '" << name 
-                 << "' with " << tabs.size() << " tabs" << std::endl;
+        uint32_t index = detachBucket(0, static_cast<unsigned>(tick) & (kSlots - 1));
+        while (index != kNil) {
+            nodes[index].state = NodeState::DUE;
+            due.push_back(index);
+            index = nodes[index].next;
+        }
     }
     
-    void restoreSnapshot(const std::string& snapshotId) {
-        if (snapshots.find(snapshotId) != snapshots.end()) {
-            std::cout << "Restoring snapshot " << snapshotId << " to group '" << name << "'" << std::endl;
+    void dispatch(std::unique_lock<std::mutex>& lock) {
+        for (uint32_t index : due) {
+            Node& node = nodes[index];
+            if (!node.cancelled) {
+                node.state = NodeState::RUNNING;
+                runningIndex = index;
+                lock.unlock();
+                node.callback();
+                lock.lock();
+                runningIndex = kNil;
+                firedCount++;
+            }
             
-            // Clear current tabs
-            tabs.clear();
+            if (node.cancelled) {
+                freeNode(index);
+            } else if (node.periodTicks == 0) {
+                pendingCount--;
+                freeNode(index);
+            } else {
+                node.state = NodeState::QUEUED;
+                node.expires = alignExpiry(node.expires + node.periodTicks, node.slackTicks);
+                link(index);
+            }
+            runningCondition.notify_all();
+        }
+        due.clear();
+    }
+    
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            uint64_t now = ticksNow();
+            while (currentTick < now) {
+                uint64_t next = nextEventTick();
+                if (next > now) {
+                    currentTick = now;
+                    break;
+                }
+                advanceTo(next);
+                dispatch(lock);
+            }
             
-            // Create new tabs from snapshot URLs
-            for (const auto& url : snapshots[snapshotId]) {
-                auto tab = std::make_shared<Tab>(url);
-                addTab(tab);
+            uint64_t next = nextEventTick();
+            sleepingUntil = next;
+            if (next == kNever) {
+                wakeCondition.wait(lock);
+            } else {
+                wakeCondition.wait_until(lock, origin + kTick * static_cast<Clock::rep>(next));
             }
-        } else {
-            std::cerr << "Snapshot not found: " << snapshotId << std::endl;
+            sleepingUntil = 0;
+            wakeupCount++;
         }
     }
-    
-    std::vector<std::string> listSnapshots() const {
-        std::vector<std::string> result;
-        for (const auto& [id, _] : snapshots) {
-            result.push_back(id);
+};
+
+// Tasks for the thread that owns the engine's objects, which run none of
+// their own locking. Other threads post; the owner runs them from its loop
+// with runPending(). Each owner has at most one task waiting: a timer that
+// fires again before the owner got to its last task adds nothing.
+class MainThreadQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<void()>;
+    
+    // Never destroyed: timer callbacks may post while statics are torn down
+    static MainThreadQueue& instance() {
+        static MainThreadQueue* queue = new MainThreadQueue();
+        return *queue;
+    }
+    
+    // False when `owner` already has a task waiting
+    bool post(const void* owner, Task task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!waitingOwners.insert(owner).second) return false;
+        tasks.push_back({owner, std::move(task)});
+        taskCondition.notify_one();
+        return true;
+    }
+    
+    // Drops the owner's waiting task; owners call this after cancelling the
+    // timers that post for them, before they are destroyed
+    void cancel(const void* owner) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // A task in the batch being run may destroy the owner of a later one
+        for (size_t i = runningNext; i < running.size(); ++i) {
+            if (running[i].owner == owner) running[i].task = nullptr;
         }
-        return result;
-    }
-    
-    void moveAllTabs(std::shared_ptr<TabGroup> targetGroup) {
-        if (!targetGroup) return;
-        
-        for (auto& tab : tabs) {
-            targetGroup->addTab(tab);
+        if (waitingOwners.erase(owner) == 0) return;
+        for (auto& entry : tasks) {
+            if (entry.owner == owner) entry.task = nullptr;
         }
-        tabs.clear();
-        updateMetrics();
-        std::cout << "All tabs moved from '" << name 
-                 << "' to '" << targetGroup->getName() << "'" << std::endl;
     }
     
-    void moveTab(size_t index, std::shared_ptr<TabGroup> targetGroup) {
-        if (!targetGroup || index >= tabs.size()) return;
-        
-        auto tab = tabs[index];
-        targetGroup->addTab(tab);
-        
-        tabs.erase(tabs.begin() + index);
-        updateMetrics();
-        
-        std::cout << "Tab '" << tab->getTitle() << "' moved from '"
-                 << name << "' to '" << targetGroup->getName() << "'" << std::endl;
+    // Runs the tasks waiting now, on the owner thread; tasks they post wait
+    // for the next call. Not re-entrant.
+    size_t runPending() {
+        std::unique_lock<std::mutex> lock(mutex);
+        running.swap(tasks);
+        waitingOwners.clear();
+        size_t ran = 0;
+        for (runningNext = 0; runningNext < running.size();) {
+            Task task = std::move(running[runningNext++].task);
+            if (!task) continue;
+            lock.unlock();
+            task();
+            lock.lock();
+            ran++;
+        }
+        running.clear();
+        runningNext = 0;
+        return ran;
     }
     
-    void archiveTabs(bool keepGroup = true) {
-        std::cout << "Archiving " << tabs.size() << " tabs from group '" << name << "'" << std::endl;
-        
-        // In a real implementation, this would save the tabs to an archive
-        createSnapshot(); // Create a snapshot before archiving
-        
-        if (!keepGroup) {
-            tabs.clear();
-            updateMetrics();
+    // Waits up to `timeout` for a task, then runs whatever is waiting
+    size_t runPending(Clock::duration timeout) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskCondition.wait_for(lock, timeout, [this] { return !tasks.empty(); });
         }
+        return runPending();
     }
     
-    void updateThumbnail(std::shared_ptr<Tab> tab) {
-        if (!tab) return;
-        
-        std::cout << "Updating thumbnail for tab in group '" << name << "'" << std::endl;
-        // In a real implementation, this would capture a thumbnail of the tab
-        
-        // Update last accessed time when interacting with tabs
-        metrics.lastAccessed = std::chrono::system_clock::now();
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return waitingOwners.size();
     }
     
-    void updateMetrics() {
-        metrics.totalTabs = tabs.size();
-        metrics.activeTabs = 0;
-        metrics.hibernatedTabs = 0;
-        
-        for (const auto& tab : tabs) {
-            if (tab->getIsActive()) metrics.activeTabs++;
-            if (tab->getIsHibernated()) metrics.hibernatedTabs++;
-        }
-    }
+private:
+    struct Entry {
+        const void* owner;
+        Task task;  // empty once cancelled
+    };
     
-    void recordFocusTime(std::chrono::seconds duration) {
-        metrics.totalFocusTime += duration;
-    }
+    mutable std::mutex mutex;
+    std::condition_variable taskCondition;
+    std::deque<Entry> tasks;
+    std::deque<Entry> running;
+    size_t runningNext = 0;
+    std::unordered_set<const void*> waitingOwners;
     
-    std::string generateInsights() const {
-        // In a real implementation, this would analyze the group's tabs and usage
-        return "Group '" + name + "' contains " + std::to_string(tabs.size()) + 
-               " tabs primarily focused on " + suggestGroupFocus() + 
-               "\nActive tabs: " + std::to_string(metrics.activeTabs) +
-               "\nHibernated tabs: " + std::to_string(metrics.hibernatedTabs) +
-               "\nTotal focus time: " + std::to_string(metrics.totalFocusTime.count()) + " seconds";
-    }
+    MainThreadQueue() = default;
+};
+
+// Word and trigram index over short documents (a title and a URL). Every
+// distinct word keeps a postings list of (document << 2 | fields), and a
+// trigram index over the word dictionary resolves substring terms without
+// touching the documents. Terms shorter than three characters match word
+// prefixes. A folded copy of each document's text is kept only to check
+// terms that span punctuation (e.g. "example.com"). Removal flags the
+// document; its postings stay until the owner rebuilds the index.
+class FullTextIndex {
+public:
+    enum Field : uint32_t { TITLE = 1, URL = 2 };
     
-    std::string suggestGroupFocus() const {
-        // Placeholder for ML-based analysis of tab content
-        if (tabs.empty()) return "no specific topic";
-        
-        // Count domain frequencies for naive topic detection
-        std::map<std::string, int> domainCounts;
+    struct Hit {
+        uint32_t document;
+        uint32_t score;
+    };
+    
+    struct Result {
+        std::vector<Hit> hits;  // the requested page, best first
+        size_t totalMatches = 0;
+    };
+    
+    // Documents are numbered in insertion order
+    uint32_t addDocument(std::string_view title, std::string_view url) {
+        uint32_t document = documentLimit++;
+        assert(document < (1u << 30));
+        documentWords.clear();
+        collectWords(title, TITLE);
+        collectWords(url, URL);
+        std::sort(documentWords.begin(), documentWords.end());
         
-        for (const auto& tab : tabs) {
-            if (!tab->getUrl().empty() && tab->getUrl() != "about:blank") {
-                std::string domain = tab->extractDomain(tab->getUrl());
-                if (!domain.empty()) {
-                    domainCounts[domain]++;
-                }
+        for (size_t i = 0; i < documentWords.size();) {
+            uint32_t word = documentWords[i].first;
+            uint32_t fields = 0;
+            for (; i < documentWords.size() && documentWords[i].first == word; ++i) {
+                fields |= documentWords[i].second;
             }
+            words[word].postings.push_back(document << 2 | fields);
         }
         
-        // Find most frequent domain
-        std::string mostFrequentDomain;
-        int maxCount = 0;
-        
-        for (const auto& [domain, count] : domainCounts) {
-            if (count > maxCount) {
-                mostFrequentDomain = domain;
-                maxCount = count;
+        appendFolded(title);
+        text.push_back('\n');
+        appendFolded(url);
+        textEnds.push_back(text.size());
+        removed.push_back(false);
+        return document;
+    }
+    
+    void removeDocument(uint32_t document) {
+        if (document < documentLimit && !removed[document]) {
+            removed[document] = true;
+            removedDocuments.push_back(document);
+        }
+    }
+    
+    void clear() {
+        words.clear();
+        wordIds.clear();
+        grams.clear();
+        removed.clear();
+        removedDocuments.clear();
+        std::string().swap(text);
+        textEnds.clear();
+        documentLimit = 0;
+    }
+    
+    // Documents must contain every whitespace-separated term of the query.
+    // Ranked by match quality, ties going to the most recently added document.
+    Result search(std::string_view query, size_t offset, size_t limit) {
+        std::vector<Term> terms = parseQuery(query);
+        std::vector<TokenMatch> tokens;
+        bool needsText = false;
+        for (const auto& term : terms) {
+            needsText = needsText || term.phrase;
+            for (const auto& token : term.tokens) {
+                // A short word ending in punctuation ("ta" in "ta.com") may
+                // be any word's tail, which no gram covers; the text check does
+                if (term.phrase && token.text.size() < 3 && !token.startsWord) continue;
+                tokens.push_back(matchToken(token));
+                tokens.back().rechecked = term.phrase;
             }
         }
+        // Intersect starting from the token with the fewest postings
+        std::sort(tokens.begin(), tokens.end(),
+                  [](const TokenMatch& a, const TokenMatch& b) { return a.postings < b.postings; });
         
-        if (!mostFrequentDomain.empty()) {
-            return mostFrequentDomain + " content";
-        }
+        Result result;
+        if (documentLimit == 0 || (!tokens.empty() && tokens.front().postings == 0)) return result;
         
-        return "productivity tools";
-    }
-    
-    std::vector<std::shared_ptr<Tab>> findTabsByDomain(const std::string& domain) const {
-        if (domainIndex.count(domain) > 0) {
-            return domainIndex.at(domain);
+        // The text check covers phrase tokens, so very common ones ("com") are
+        // cheaper to recheck on the few candidates than to intersect
+        if (!tokens.empty()) {
+            size_t bound = tokens.front().postings * kRecheckRatio;
+            tokens.erase(std::remove_if(tokens.begin() + 1, tokens.end(), [&](const TokenMatch& token) {
+                return token.rechecked && token.postings > bound;
+            }), tokens.end());
+        }
+        if (scores.size() < documentLimit) {
+            scores.resize(documentLimit, 0);
+            nextScores.resize(documentLimit, 0);
         }
-        return {};
-    }
-    
-    std::vector<std::shared_ptr<Tab>> searchTabs(const std::string& query) const {
-        std::vector<std::shared_ptr<Tab>> results;
-        std::regex pattern(query, std::regex::icase);
         
-        for (const auto& tab : tabs) {
-            if (std::regex_search(tab->getTitle(), pattern) || 
-                std::regex_search(tab->getUrl(), pattern)) {
-                results.push_back(tab);
-            }
+        // Large candidate sets use branch-free passes over the whole score
+        // array; small ones go through a candidate list
+        bool dense = tokens.empty() || tokens.front().postings > documentLimit / 16;
+        candidates.clear();
+        if (tokens.empty()) {
+            // Nothing to narrow by (empty or punctuation-only query)
+            needsText = !terms.empty();
+            std::fill(scores.begin(), scores.begin() + documentLimit, 1);
+        } else if (!intersect(tokens, dense)) {
+            return result;
         }
+        for (uint32_t document : removedDocuments) scores[document] = 0;
         
-        return results;
-    }
-    
-    void sortTabsByTitle() {
-        std::sort(tabs.begin(), tabs.end(), 
-            [](const std::shared_ptr<Tab>& a, const std::shared_ptr<Tab>& b) {
-                return a->getTitle() < b->getTitle();
-            });
-    }
-    
-    void sortTabsByLastVisited() {
-        std::sort(tabs.begin(), tabs.end(), 
-            [](const std::shared_ptr<Tab>& a, const std::shared_ptr<Tab>& b) {
-                return a->getMetadata().lastVisited > b->getMetadata().lastVisited;
-            });
-    }
-    
-    void hibernateInactiveTabs(std::chrono::minutes threshold) {
-        auto now = std::chrono::system_clock::now();
-        int count = 0;
+        if (needsText) verifyText(terms, dense);
         
-        for (const auto& tab : tabs) {
-            if (!tab->getIsActive() && !tab->getIsPinned() && !tab->getIsHibernated()) {
-                auto lastVisited = tab->getMetadata().lastVisited;
-                auto elapsed = std::chrono::duration_cast<std::chrono::minutes>(now - lastVisited);
-                
-                if (elapsed > threshold) {
-                    tab->hibernateTab(true);
-                    count++;
-                }
+        size_t histogram[256] = {};
+        if (!dense) {
+            for (uint32_t document : candidates) histogram[scores[document]]++;
+        } else {
+            // Four interleaved counters keep the increments independent
+            uint32_t partial[4][256] = {};
+            uint32_t document = 0;
+            for (; document + 4 <= documentLimit; document += 4) {
+                partial[0][scores[document]]++;
+                partial[1][scores[document + 1]]++;
+                partial[2][scores[document + 2]]++;
+                partial[3][scores[document + 3]]++;
+            }
+            for (; document < documentLimit; ++document) partial[0][scores[document]]++;
+            for (unsigned score = 0; score < 256; ++score) {
+                histogram[score] = size_t(partial[0][score]) + partial[1][score] + partial[2][score] + partial[3][score];
             }
         }
+        for (unsigned score = 1; score < 256; ++score) result.totalMatches += histogram[score];
         
-        if (count > 0) {
-            std::cout << "Hibernated " << count << " inactive tabs in group '" << name << "'" << std::endl;
+        if (offset < result.totalMatches) {
+            // Lowest score that still reaches the page, and how many ties at it fit
+            size_t wanted = offset + std::min(limit, result.totalMatches - offset);
+            size_t above = 0;
+            unsigned threshold = 255;
+            while (above + histogram[threshold] < wanted) above += histogram[threshold--];
+            
+            std::vector<Hit> top = collectTop(dense, static_cast<uint8_t>(threshold), wanted - above, wanted);
+            std::sort(top.begin(), top.end(), [](const Hit& a, const Hit& b) {
+                return a.score != b.score ? a.score > b.score : a.document > b.document;
+            });
+            result.hits.assign(top.begin() + offset, top.end());
         }
-    }
-    
-    // Event handler for tab events
-    void handleTabEvent(const std::string& event, const std::string& data) {
-        std::cout << "Tab event in group '" << name << "': " << event << " - " << data << std::endl;
         
-        if (event == "title_changed" || event == "favicon_changed") {
-            // Update group UI accordingly
-        } else if (event == "media_state_changed") {
-            // Potentially highlight tabs with media
+        if (dense) {
+            std::fill(scores.begin(), scores.begin() + documentLimit, 0);
+        } else {
+            for (uint32_t document : candidates) scores[document] = 0;
         }
-        
-        // Update metrics when tab state changes
-        updateMetrics();
+        return result;
     }
     
 private:
-    std::string name;
-    std::string color;
-    std::string icon;
-    ViewMode viewMode;
-    std::vector<std::shared_ptr<Tab>> tabs;
-    bool isCollapsed;
-    bool isAutoGroup;
-    AutoGroupingRule autoGroupRule;
-    GroupMetrics metrics;
+    struct Word {
+        std::string text;
+        std::vector<uint32_t> postings;
+    };
     
-    // For quick lookups
-    std::map<std::string, std::vector<std::shared_ptr<Tab>>> domainIndex;
+    // A bare word of a query term. Inside a term like "example.com" the
+    // punctuation pins where the word must end or begin.
+    struct Token {
+        std::string text;
+        bool startsWord = false;
+        bool endsWord = false;
+    };
     
-    // Snapshots for group state restoration
-    std::map<std::string, std::vector<std::string>> snapshots; // id -> list of URLs
-};
-
-// Sidebar for quick access to bookmarks, history, etc.
-class Sidebar {
-public:
-    enum class Panel { BOOKMARKS, HISTORY, EXTENSIONS, NOTES, NONE };
+    struct Term {
+        std::string folded;
+        std::vector<Token> tokens;
+        bool phrase = false;  // more than one bare word
+    };
     
-    Sidebar() : isVisible(false), activePanel(Panel::NONE) {}
+    struct TokenMatch {
+        std::vector<std::pair<uint32_t, uint8_t>> words;  // word id, match weight
+        size_t postings = 0;
+        bool rechecked = false;  // part of a phrase term
+    };
     
-    void toggle() {
-        isVisible = !isVisible;
-        std::cout << (isVisible ? "Sidebar shown" : "Sidebar hidden") << std::endl;
+    // Words live in a deque so the dictionary's string_view keys stay valid
+    std::deque<Word> words;
+    std::unordered_map<std::string_view, uint32_t> wordIds;
+    FlatAtomMap<std::vector<uint32_t>> grams;  // trigram -> word ids
+    std::vector<bool> removed;
+    std::vector<uint32_t> removedDocuments;
+    std::string text;  // folded "title\nurl" per document, back to back
+    std::vector<size_t> textEnds;
+    uint32_t documentLimit = 0;
+    
+    // Scratch state reused across calls. Scores are all zero between searches;
+    // during one, a document scores 0 until it has matched every token so far.
+    std::vector<std::pair<uint32_t, uint32_t>> documentWords;
+    std::string token;
+    std::vector<uint8_t> scores;
+    std::vector<uint8_t> nextScores;
+    std::vector<uint32_t> candidates;
+    
+    static constexpr uint32_t kPrefixMarker = 0x01;
+    static constexpr uint32_t kBlock = 64;
+    static constexpr size_t kRecheckRatio = 8;
+    
+    static char fold(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
     }
     
-    void showPanel(Panel panel) {
-        activePanel = panel;
-        isVisible = true;
-        std::cout << "Showing sidebar panel: " << getPanelString() << std::endl;
+    // Non-ASCII bytes count as word characters so UTF-8 words stay whole
+    static bool isWordChar(char c) {
+        auto byte = static_cast<unsigned char>(c);
+        return (byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z') ||
+               (byte >= 'A' && byte <= 'Z') || byte >= 0x80;
     }
     
-    bool getIsVisible() const { return isVisible; }
-    Panel getActivePanel() const { return activePanel; }
+    static uint32_t gramKey(uint32_t a, uint32_t b, uint32_t c) {
+        return (a << 16) | (b << 8) | c;
+    }
     
-    std::string getPanelString() const {
-        switch (activePanel) {
-            case Panel::BOOKMARKS: return "Bookmarks";
-            case Panel::HISTORY: return "History";
-            case Panel::EXTENSIONS: return "Extensions";
-            case Panel::NOTES: return "Notes";
-            case Panel::NONE: return "None";
-            default: return "Unknown";
+    static uint8_t fieldWeight(uint32_t fields) {
+        return static_cast<uint8_t>(((fields & TITLE) ? 4 : 0) + ((fields & URL) ? 2 : 0));
+    }
+    
+    template <typename Fn>
+    static void forEachWord(std::string_view input, Fn&& fn) {
+        size_t i = 0;
+        while (i < input.size()) {
+            while (i < input.size() && !isWordChar(input[i])) i++;
+            size_t start = i;
+            while (i < input.size() && isWordChar(input[i])) i++;
+            if (i > start) fn(input.substr(start, i - start));
         }
     }
     
-private:
-    bool isVisible;
-    Panel activePanel;
-};
-
-// Google search integration with customized results
-class SearchEngine {
-public:
-    SearchEngine() : defaultEngine("Google") {}
+    void appendFolded(std::string_view input) {
+        for (char c : input) text.push_back(fold(c));
+    }
     
-    void search(const std::string& query) {
-        std::cout << "Searching with " << defaultEngine << ": " << query << std::endl;
-        // This would actually perform the search and render results
-        std::cout << "Displaying results in enhanced reading layout" << std::endl;
+    void collectWords(std::string_view input, Field field) {
+        forEachWord(input, [&](std::string_view raw) {
+            token.assign(raw);
+            for (auto& c : token) c = fold(c);
+            documentWords.push_back({internWord(token), field});
+        });
     }
     
-    void setDefaultEngine(const std::string& engine) {
-        defaultEngine = engine;
+    uint32_t internWord(const std::string& word) {
+        auto it = wordIds.find(word);
+        if (it != wordIds.end()) return it->second;
+        
+        uint32_t id = static_cast<uint32_t>(words.size());
+        words.push_back({word, {}});
+        const std::string& stored = words.back().text;
+        wordIds.emplace(stored, id);
+        
+        auto addGram = [&](uint32_t key) {
+            auto& list = grams[key];
+            if (list.empty() || list.back() != id) list.push_back(id);
+        };
+        auto byte = [&](size_t i) { return static_cast<uint32_t>(static_cast<unsigned char>(stored[i])); };
+        addGram(gramKey(kPrefixMarker, byte(0), stored.size() > 1 ? byte(1) : 0));
+        if (stored.size() > 1) addGram(gramKey(kPrefixMarker, byte(0), 0));
+        for (size_t i = 0; i + 3 <= stored.size(); ++i) {
+            addGram(gramKey(byte(i), byte(i + 1), byte(i + 2)));
+        }
+        return id;
     }
     
-    std::string getDefaultEngine() const { return defaultEngine; }
+    static std::vector<Term> parseQuery(std::string_view query) {
+        std::vector<Term> terms;
+        size_t i = 0;
+        while (i < query.size()) {
+            while (i < query.size() && std::isspace(static_cast<unsigned char>(query[i]))) i++;
+            size_t start = i;
+            while (i < query.size() && !std::isspace(static_cast<unsigned char>(query[i]))) i++;
+            if (i == start) continue;
+            
+            Term term;
+            term.folded.assign(query.substr(start, i - start));
+            for (auto& c : term.folded) c = fold(c);
+            std::string_view folded = term.folded;
+            forEachWord(folded, [&](std::string_view word) {
+                size_t at = static_cast<size_t>(word.data() - folded.data());
+                term.tokens.push_back({std::string(word), at > 0, at + word.size() < folded.size()});
+            });
+            term.phrase = term.tokens.size() != 1 || term.tokens.front().text.size() != term.folded.size();
+            terms.push_back(std::move(term));
+        }
+        return terms;
+    }
     
-private:
-    std::string defaultEngine;
-};
-
-// Intelligent bookmarking system
-class BookmarkManager {
-public:
-    void addBookmark(const std::string& url, const std::string& title, const std::string& category = "Uncategorized") {
-        bookmarks[category].push_back({url, title});
-        std::cout << "Bookmarked: " << title << " in category: " << category << std::endl;
-    }
-    
-    void removeBookmark(const std::string& url, const std::string& category = "") {
-        if (category.empty()) {
-            // Search in all categories
-            for (auto& pair : bookmarks) {
-                auto& categoryBookmarks = pair.second;
-                for (auto it = categoryBookmarks.begin(); it != categoryBookmarks.end(); ++it) {
-                    if (it->first == url) {
-                        categoryBookmarks.erase(it);
-                        std::cout << "Removed bookmark: " << url << std::endl;
-                        return;
-                    }
+    // Dictionary words containing the token (or starting with it, for short
+    // tokens), weighted so whole-word and prefix matches rank first
+    TokenMatch matchToken(const Token& token) {
+        const std::string& needle = token.text;
+        bool mustStart = token.startsWord || needle.size() < 3;
+        TokenMatch match;
+        auto byte = [&](size_t i) { return static_cast<uint32_t>(static_cast<unsigned char>(needle[i])); };
+        
+        const std::vector<uint32_t>* candidates = nullptr;
+        if (needle.size() < 3) {
+            candidates = grams.find(gramKey(kPrefixMarker, byte(0), needle.size() > 1 ? byte(1) : 0));
+        } else {
+            // The rarest trigram bounds the words to check
+            for (size_t i = 0; i + 3 <= needle.size(); ++i) {
+                const auto* list = grams.find(gramKey(byte(i), byte(i + 1), byte(i + 2)));
+                if (!list) return match;
+                if (!candidates || list->size() < candidates->size()) candidates = list;
+            }
+        }
+        if (!candidates) return match;
+        
+        for (uint32_t id : *candidates) {
+            const std::string& word = words[id].text;
+            if (word.size() < needle.size()) continue;
+            bool prefix = word.compare(0, needle.size(), needle) == 0;
+            if (mustStart && !prefix) continue;
+            if (token.endsWord) {
+                if (word.compare(word.size() - needle.size(), needle.size(), needle) != 0) continue;
+            } else if (!prefix && word.find(needle) == std::string::npos) {
+                continue;
+            }
+            uint8_t weight = word.size() == needle.size() ? 3 : (prefix ? 1 : 0);
+            match.words.push_back({id, weight});
+            match.postings += words[id].postings.size();
+        }
+        return match;
+    }
+    
+    // Leaves each matching document's summed score in `scores` (listing them
+    // in `candidates` unless dense). Returns false, with all scores zero, as
+    // soon as a token matches nothing that is left.
+    bool intersect(const std::vector<TokenMatch>& tokens, bool dense) {
+        for (const auto& [word, weight] : tokens.front().words) {
+            for (uint32_t posting : words[word].postings) {
+                uint32_t document = posting >> 2;
+                auto score = static_cast<uint8_t>(weight + fieldWeight(posting & 3));
+                if (!dense && scores[document] == 0) candidates.push_back(document);
+                scores[document] = std::max(scores[document], score);
+            }
+        }
+        
+        for (size_t t = 1; t < tokens.size(); ++t) {
+            for (const auto& [word, weight] : tokens[t].words) {
+                for (uint32_t posting : words[word].postings) {
+                    uint32_t document = posting >> 2;
+                    if (scores[document] == 0) continue;
+                    auto score = static_cast<uint8_t>(
+                        std::min<uint32_t>(255, scores[document] + weight + fieldWeight(posting & 3)));
+                    nextScores[document] = std::max(nextScores[document], score);
                 }
             }
-        } else if (bookmarks.count(category) > 0) {
-            // Search in specific category
-            auto& categoryBookmarks = bookmarks[category];
-            for (auto it = categoryBookmarks.begin(); it != categoryBookmarks.end(); ++it) {
-                if (it->first == url) {
-                    categoryBookmarks.erase(it);
-                    std::cout << "Removed bookmark: " << url << " from category: " << category << std::endl;
-                    return;
+            
+            bool any = false;
+            if (dense) {
+                std::copy(nextScores.begin(), nextScores.begin() + documentLimit, scores.begin());
+                std::fill(nextScores.begin(), nextScores.begin() + documentLimit, 0);
+                any = std::any_of(scores.begin(), scores.begin() + documentLimit, [](uint8_t s) { return s != 0; });
+            } else {
+                size_t kept = 0;
+                for (uint32_t document : candidates) {
+                    scores[document] = nextScores[document];
+                    nextScores[document] = 0;
+                    if (scores[document] != 0) candidates[kept++] = document;
+                }
+                candidates.resize(kept);
+                any = kept > 0;
+            }
+            if (!any) return false;
+        }
+        return true;
+    }
+    
+    // Every document scoring above `threshold` plus the `keep` newest of
+    // those scoring exactly `threshold`
+    std::vector<Hit> collectTop(bool dense, uint8_t threshold, size_t keep, size_t wanted) {
+        std::vector<Hit> top;
+        top.reserve(wanted);
+        if (dense) {
+            // Walking down from the newest document meets the right ties first
+            size_t kept = 0;
+            uint32_t document = documentLimit;
+            while (document > 0 && kept < keep) {
+                uint8_t score = scores[--document];
+                if (score > threshold) {
+                    top.push_back({document, score});
+                } else if (score == threshold) {
+                    top.push_back({document, score});
+                    kept++;
+                }
+            }
+            // Only higher scores are left to find; skip blocks without one.
+            // Fixed-size blocks keep the max loop vectorizable.
+            while (document > 0 && top.size() < wanted) {
+                uint32_t begin = document > kBlock ? document - kBlock : 0;
+                uint8_t highest = 0;
+                if (document - begin == kBlock) {
+                    const uint8_t* block = scores.data() + begin;
+                    for (uint32_t i = 0; i < kBlock; ++i) highest = std::max(highest, block[i]);
+                } else {
+                    highest = *std::max_element(scores.begin() + begin, scores.begin() + document);
+                }
+                if (highest > threshold) {
+                    for (uint32_t i = document; i-- > begin;) {
+                        if (scores[i] > threshold) top.push_back({i, scores[i]});
+                    }
                 }
+                document = begin;
             }
+            return top;
+        }
+        
+        std::vector<uint32_t> ties;
+        for (uint32_t document : candidates) {
+            if (scores[document] > threshold) top.push_back({document, scores[document]});
+            else if (scores[document] == threshold) ties.push_back(document);
         }
+        std::nth_element(ties.begin(), ties.begin() + keep, ties.end(), std::greater<uint32_t>());
+        for (size_t i = 0; i < keep; ++i) top.push_back({ties[i], threshold});
+        return top;
     }
     
-    void suggestBookmarks() const {
-        std::cout << "Suggesting bookmarks based on browsing habits and time of day" << std::endl;
-        // In a real implementation, this would use algorithms to suggest relevant bookmarks
+    size_t textBegin(uint32_t document) const {
+        return document == 0 ? 0 : textEnds[document - 1];
     }
     
-private:
-    // Category -> list of (url, title) pairs
-    std::map<std::string, std::vector<std::pair<std::string, std::string>>> bookmarks;
+    // Zeroes the score of every candidate whose text lacks one of the terms.
+    // Candidates are checked in document order with the text fetched ahead,
+    // since these reads are what dominates phrase queries.
+    void verifyText(const std::vector<Term>& terms, bool dense) {
+        std::vector<uint32_t> pending;
+        if (dense) {
+            for (uint32_t document = 0; document < documentLimit; ++document) {
+                if (scores[document] != 0) pending.push_back(document);
+            }
+        } else {
+            for (uint32_t document : candidates) {
+                if (scores[document] != 0) pending.push_back(document);
+            }
+            std::sort(pending.begin(), pending.end());
+        }
+        
+        // Offsets are fetched further ahead than the text they point to
+        constexpr size_t kTextDistance = 8;
+        constexpr size_t kOffsetDistance = 16;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            if (i + kOffsetDistance < pending.size()) {
+                __builtin_prefetch(&textEnds[pending[i + kOffsetDistance]] - 1);
+            }
+            if (i + kTextDistance < pending.size()) {
+                const char* ahead = text.data() + textBegin(pending[i + kTextDistance]);
+                __builtin_prefetch(ahead);
+                __builtin_prefetch(ahead + 64);
+            }
+            
+            uint32_t document = pending[i];
+            size_t begin = textBegin(document);
+            std::string_view body(text.data() + begin, textEnds[document] - begin);
+            for (const auto& term : terms) {
+                if (!contains(body, term.folded)) {
+                    scores[document] = 0;
+                    break;
+                }
+            }
+        }
+    }
+    
+    // memchr-driven search; noticeably faster than string_view::find here
+    static bool contains(std::string_view haystack, std::string_view needle) {
+        if (needle.empty()) return true;
+        const char* at = haystack.data();
+        const char* end = haystack.data() + haystack.size();
+        while (static_cast<size_t>(end - at) >= needle.size()) {
+            at = static_cast<const char*>(std::memchr(at, needle[0], static_cast<size_t>(end - at) - needle.size() + 1));
+            if (!at) return false;
+            if (std::memcmp(at + 1, needle.data() + 1, needle.size() - 1) == 0) return true;
+            at++;
+        }
+        return false;
+    }
 };
 
-// Privacy-focused tools and settings
-class PrivacyManager {
+// Read-write mapping of a file that grows by remapping. Without a path it
+// maps anonymous memory instead. Pointers into it do not survive reserve().
+class MappedFile {
 public:
-    PrivacyManager() 
-        : trackingProtection(true), cookieControl(true), fingerprintingProtection(true) {}
-    
-    void toggleTrackingProtection(bool enabled) {
-        trackingProtection = enabled;
-        std::cout << "Tracking protection: " << (enabled ? "enabled" : "disabled") << std::endl;
-    }
-    
-    void toggleCookieControl(bool enabled) {
-        cookieControl = enabled;
-        std::cout << "Cookie control: " << (enabled ? "enabled" : "disabled") << std::endl;
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+    
+    // Maps the whole file, creating it if missing
+    bool open(const std::string& filePath, bool truncate = false) {
+        return openWith(filePath, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0));
+    }
+    
+    // Creates a new, empty file; fails rather than touch one already there
+    bool create(const std::string& filePath) {
+        return openWith(filePath, O_RDWR | O_CREAT | O_EXCL);
+    }
+    
+    // Grows the file and mapping to at least `size` bytes
+    bool reserve(size_t size) {
+        if (size <= length) return true;
+        size_t grown = std::max({size, length * 2, kMinLength});
+        if (fd >= 0) {
+            if (::ftruncate(fd, static_cast<off_t>(grown)) != 0) return false;
+            uint8_t* old = base;
+            size_t oldLength = length;
+            if (!map(grown)) return false;
+            if (old) ::munmap(old, oldLength);
+            return true;
+        }
+        void* fresh = ::mmap(nullptr, grown, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (fresh == MAP_FAILED) return false;
+        if (base) {
+            std::memcpy(fresh, base, length);
+            ::munmap(base, length);
+        }
+        base = static_cast<uint8_t*>(fresh);
+        length = grown;
+        return true;
+    }
+    
+    // Unmaps, trimming the file to `usedBytes` if it was grown past that
+    void close(size_t usedBytes = SIZE_MAX) {
+        if (base) ::munmap(base, length);
+        if (fd >= 0) {
+            if (usedBytes < length) {
+                int result = ::ftruncate(fd, static_cast<off_t>(usedBytes));
+                (void)result;
+            }
+            ::close(fd);
+        }
+        base = nullptr;
+        length = 0;
+        fd = -1;
     }
     
-    void toggleFingerprintingProtection(bool enabled) {
-        fingerprintingProtection = enabled;
-        std::cout << "Fingerprinting protection: " << (enabled ? "enabled" : "disabled") << std::endl;
+    // Closes and deletes the file
+    void discard() {
+        close();
+        if (!path.empty()) {
+            std::error_code error;
+            fs::remove(path, error);
+        }
     }
     
-    void enterPrivateMode() {
-        std::cout << "Entering private browsing mode" << std::endl;
-        // Would create a new private window in actual implementation
+    bool rename(const std::string& newPath) {
+        std::error_code error;
+        fs::rename(path, newPath, error);
+        if (error) return false;
+        path = newPath;
+        return true;
     }
     
-    bool isTrackingProtectionEnabled() const { return trackingProtection; }
-    bool isCookieControlEnabled() const { return cookieControl; }
-    bool isFingerprintingProtectionEnabled() const { return fingerprintingProtection; }
+    uint8_t* data() const { return base; }
+    size_t size() const { return length; }
     
 private:
-    bool trackingProtection;
-    bool cookieControl;
-    bool fingerprintingProtection;
+    static constexpr size_t kMinLength = 64 * 1024;
+    
+    int fd = -1;
+    uint8_t* base = nullptr;
+    size_t length = 0;
+    std::string path;
+    
+    bool openWith(const std::string& filePath, int flags) {
+        close();
+        int descriptor = ::open(filePath.c_str(), flags, 0644);
+        if (descriptor < 0) return false;
+        struct stat info;
+        if (::fstat(descriptor, &info) != 0) {
+            ::close(descriptor);
+            return false;
+        }
+        fd = descriptor;
+        path = filePath;
+        return map(static_cast<size_t>(info.st_size));
+    }
+    
+    bool map(size_t size) {
+        if (size == 0) {
+            base = nullptr;
+            length = 0;
+            return true;
+        }
+        void* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) return false;
+        base = static_cast<uint8_t*>(mapped);
+        length = size;
+        return true;
+    }
 };
 
-// Reading mode for distraction-free content consumption
-class ReadingMode {
+using ArchiveId = uint64_t;
+
+// Archived tabs as append-only segments, one per day of archiving. A segment
+// is two mapped files: fixed-size entries (.nidx) and the URL and title
+// bytes they point into (.ndat). Opening a store only maps the files, so
+// records are read when they are looked up. Ids never change; removing a
+// record sets a tombstone in its entry, and compactInBackground rewrites
+// mostly-dead segments off the calling thread. Expiry deletes whole segment
+// files where it can. Without a directory the segments live in memory.
+class ArchiveStore {
 public:
-    enum class FontFamily { SERIF, SANS_SERIF, MONOSPACE };
-    enum class TextSize { SMALL, MEDIUM, LARGE, XLARGE };
-    enum class ColorTheme { LIGHT, DARK, SEPIA, CUSTOM };
-    
-    ReadingMode() : enabled(false), fontFamily(FontFamily::SANS_SERIF), 
-                  textSize(TextSize::MEDIUM), theme(ColorTheme::LIGHT) {}
+    struct Record {
+        ArchiveId id = 0;
+        std::string_view url;  // views are valid until the next append
+        std::string_view title;
+        std::chrono::system_clock::time_point timestamp;
+    };
     
-    void toggle() {
-        enabled = !enabled;
-        std::cout << (enabled ? "Enabled" : "Disabled") << " reading mode" << std::endl;
+    explicit ArchiveStore(const std::string& directory = "") : directory(directory) {
+        if (!directory.empty()) openDirectory();
     }
     
-    void setFontFamily(FontFamily font) {
-        fontFamily = font;
-        std::cout << "Changed reading mode font family" << std::endl;
+    ~ArchiveStore() {
+        waitForCompaction();
     }
     
-    void setTextSize(TextSize size) {
-        textSize = size;
-        std::cout << "Changed reading mode text size" << std::endl;
-    }
+    ArchiveStore(const ArchiveStore&) = delete;
+    ArchiveStore& operator=(const ArchiveStore&) = delete;
     
-    void setColorTheme(ColorTheme newTheme) {
-        theme = newTheme;
-        std::cout << "Changed reading mode color theme" << std::endl;
+    // Returns the new record's id, or 0 if it could not be stored
+    ArchiveId append(std::string_view url, std::string_view title,
+                     std::chrono::system_clock::time_point timestamp) {
+        collectCompaction();
+        int64_t millis = toMillis(timestamp);
+        // Segments stay in id order even if the clock steps back
+        int64_t partition = partitionOf(millis);
+        if (segments.empty() || partition > segments.back()->partition) {
+            auto segment = createSegment(partition, 0, "");
+            if (!segment) {
+                NOVA_LOG_ERROR(ARCHIVE, "Could not create archive segment in " << directory);
+                return 0;
+            }
+            segment->header().nextId = nextId;
+            segments.push_back(std::move(segment));
+        }
+        
+        Segment& segment = *segments.back();
+        url = url.substr(0, kMaxLength);
+        title = title.substr(0, kMaxLength);
+        uint64_t count = segment.header().recordCount;
+        uint64_t offset = segment.header().dataSize;
+        if (!segment.data.reserve(offset + url.size() + title.size()) ||
+            !segment.entries.reserve(sizeof(Header) + (count + 1) * sizeof(Entry))) {
+            NOVA_LOG_ERROR(ARCHIVE, "Could not grow archive segment " << segment.partition);
+            return 0;
+        }
+        
+        if (!url.empty()) std::memcpy(segment.data.data() + offset, url.data(), url.size());
+        if (!title.empty()) std::memcpy(segment.data.data() + offset + url.size(), title.data(), title.size());
+        ArchiveId id = nextId++;
+        *segment.entry(count) = {id, millis, offset, static_cast<uint32_t>(url.size()),
+                                 static_cast<uint32_t>(title.size()), 0, 0};
+        
+        Header& header = segment.header();
+        header.dataSize = offset + url.size() + title.size();
+        header.liveCount++;
+        header.nextId = nextId;
+        // Published last, so a torn append leaves the segment as it was
+        header.recordCount = count + 1;
+        segment.appendLive();
+        liveCount++;
+        return id;
+    }
+    
+    std::optional<Record> find(ArchiveId id) {
+        collectCompaction();
+        auto [segment, index] = locate(id);
+        if (!segment || (segment->entry(index)->flags & kTombstone)) return std::nullopt;
+        return readRecord(*segment, *segment->entry(index));
+    }
+    
+    // Tombstones the record; false if it was not live
+    bool remove(ArchiveId id) {
+        collectCompaction();
+        auto [segment, index] = locate(id);
+        if (!segment) return false;
+        return tombstone(*segment, index);
+    }
+    
+    // Id of the live record with the given rank in archive order, or 0
+    ArchiveId selectLive(size_t rank) {
+        collectCompaction();
+        for (auto& segment : segments) {
+            uint64_t live = segment->header().liveCount;
+            if (rank < live) return segment->entry(segment->selectLive(rank))->id;
+            rank -= static_cast<size_t>(live);
+        }
+        return 0;
+    }
+    
+    // Visits live records in archive order
+    template <typename Fn>
+    void forEachLive(Fn&& fn) {
+        collectCompaction();
+        for (auto& segment : segments) {
+            uint64_t count = segment->header().recordCount;
+            for (uint64_t i = 0; i < count; ++i) {
+                const Entry& entry = *segment->entry(i);
+                if (entry.flags & kTombstone) continue;
+                if (auto record = readRecord(*segment, entry)) fn(*record);
+            }
+        }
     }
     
-    void saveContent() {
-        std::cout << "Saved article for offline reading" << std::endl;
-        // Would save the current article to local storage
+    // Removes every record archived before `cutoff`, deleting the files of
+    // segments that lie wholly before it. Reports each removed record.
+    size_t expireBefore(std::chrono::system_clock::time_point cutoff,
+                        const std::function<void(const Record&)>& onRemoved) {
+        waitForCompaction();
+        int64_t cutoffMillis = toMillis(cutoff);
+        size_t removed = 0;
+        size_t kept = 0;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            Segment& segment = *segments[i];
+            bool newest = i + 1 == segments.size();
+            int64_t start = segment.partition * kPartitionMillis;
+            uint64_t count = segment.header().recordCount;
+            
+            if (!newest && start + kPartitionMillis <= cutoffMillis) {
+                // The newest segment stays, even empty, to remember the next id
+                for (uint64_t j = 0; j < count; ++j) {
+                    const Entry& entry = *segment.entry(j);
+                    if (entry.flags & kTombstone) continue;
+                    if (auto record = readRecord(segment, entry)) onRemoved(*record);
+                }
+                removed += static_cast<size_t>(segment.header().liveCount);
+                liveCount -= static_cast<size_t>(segment.header().liveCount);
+                segment.discardFiles();
+                continue;
+            }
+            if (start < cutoffMillis) {
+                for (uint64_t j = 0; j < count; ++j) {
+                    const Entry& entry = *segment.entry(j);
+                    if (entry.timestampMillis >= cutoffMillis || !tombstone(segment, static_cast<size_t>(j))) continue;
+                    removed++;
+                    if (auto record = readRecord(segment, entry)) onRemoved(*record);
+                }
+            }
+            segments[kept++] = std::move(segments[i]);
+        }
+        segments.resize(kept);
+        return removed;
+    }
+    
+    // Rewrites sealed segments that are at least half tombstones. The copy
+    // runs on another thread and is swapped in by a later call.
+    void compactInBackground() {
+        waitForCompaction();
+        std::vector<Segment*> sources;
+        for (size_t i = 0; i + 1 < segments.size(); ++i) {
+            const Header& header = segments[i]->header();
+            uint64_t dead = header.recordCount - header.liveCount;
+            if (dead > 0 && dead * 2 >= header.recordCount) sources.push_back(segments[i].get());
+        }
+        if (sources.empty()) return;
+        
+        compaction = std::async(std::launch::async, [this, sources] {
+            std::vector<Compaction> results;
+            for (Segment* source : sources) results.push_back({source, copyLive(*source)});
+            return results;
+        });
     }
     
-    void textToSpeech() {
-        std::cout << "Started text-to-speech for current article" << std::endl;
-        // Would read the article content aloud
+    void waitForCompaction() {
+        if (compaction.valid()) installCompaction(compaction.get());
     }
     
+    size_t size() const { return liveCount; }
+    size_t segmentCount() const { return segments.size(); }
+    
 private:
-    bool enabled;
-    FontFamily fontFamily;
-    TextSize textSize;
-    ColorTheme theme;
-};
-
-// AI Assistant for enhanced browsing experience
-class AiAssistant {
-public:
-    enum class SuggestionType { TAB_GROUP, SEARCH_REFINEMENT, CONTENT_SUMMARY, TIME_MANAGEMENT };
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        int64_t partition;
+        uint64_t recordCount;
+        uint64_t liveCount;
+        uint64_t dataSize;
+        uint64_t nextId;
+        uint64_t dataGeneration;  // which data file is this index's, see dataPath
+        uint8_t reserved[8];
+    };
     
-    AiAssistant() : isEnabled(true) {}
+    struct Entry {
+        uint64_t id;
+        int64_t timestampMillis;
+        uint64_t offset;  // into the segment's data file: URL, then title
+        uint32_t urlLength;
+        uint32_t titleLength;
+        uint32_t flags;
+        uint32_t reserved;
+    };
     
-    void toggleAssistant(bool enabled) {
-        isEnabled = enabled;
-        std::cout << "AI Assistant " << (enabled ? "enabled" : "disabled") << std::endl;
-    }
+    static_assert(sizeof(Header) == 64 && sizeof(Entry) == 40, "archive segment layout is on disk");
     
-    void summarizeTab(std::shared_ptr<Tab> tab) {
-        if (!isEnabled || !tab) return;
-        std::cout << "AI Summary of " << tab->getTitle() << ": "
-                 << "This page discusses key concepts related to its main topic..." << std::endl;
-        // Would use AI to generate a summary of the page content
-    }
+    struct Segment {
+        int64_t partition = 0;
+        MappedFile entries;
+        MappedFile data;
+        std::vector<uint32_t> liveTree;  // Fenwick tree of live entries, built on demand
+        
+        ~Segment() {
+            if (!entries.data()) return;
+            uint64_t count = header().recordCount;
+            uint64_t dataSize = header().dataSize;
+            entries.close(sizeof(Header) + count * sizeof(Entry));
+            data.close(dataSize);
+        }
+        
+        Header& header() { return *reinterpret_cast<Header*>(entries.data()); }
+        Entry* entry(uint64_t index) {
+            return reinterpret_cast<Entry*>(entries.data() + sizeof(Header)) + index;
+        }
+        
+        ArchiveId firstId() {
+            return header().recordCount == 0 ? ~ArchiveId(0) : entry(0)->id;
+        }
+        
+        void discardFiles() {
+            entries.discard();
+            data.discard();
+        }
+        
+        // Index of the entry holding the live record with the given rank
+        size_t selectLive(size_t rank) {
+            if (header().liveCount == header().recordCount) return rank;
+            if (liveTree.empty()) buildLiveTree();
+            size_t position = 0;
+            size_t remaining = rank + 1;
+            size_t step = 1;
+            while (step * 2 < liveTree.size()) step *= 2;
+            for (; step > 0; step >>= 1) {
+                if (position + step < liveTree.size() && liveTree[position + step] < remaining) {
+                    position += step;
+                    remaining -= liveTree[position];
+                }
+            }
+            return position;
+        }
+        
+        void buildLiveTree() {
+            uint64_t count = header().recordCount;
+            liveTree.assign(static_cast<size_t>(count) + 1, 0);
+            for (size_t i = 1; i <= count; ++i) {
+                liveTree[i] += (entry(i - 1)->flags & kTombstone) ? 0 : 1;
+                size_t parent = i + (i & (~i + 1));
+                if (parent <= count) liveTree[parent] += liveTree[i];
+            }
+        }
+        
+        void appendLive() {
+            if (liveTree.empty()) return;
+            size_t i = liveTree.size();
+            // A node covers (i - lowbit(i), i]; its children are i-1, i-2, i-4, ...
+            uint32_t value = 1;
+            for (size_t step = 1; step < (i & (~i + 1)); step <<= 1) value += liveTree[i - step];
+            liveTree.push_back(value);
+        }
+        
+        void markDead(size_t index) {
+            if (liveTree.empty()) return;
+            for (size_t i = index + 1; i < liveTree.size(); i += i & (~i + 1)) liveTree[i]--;
+        }
+    };
     
-    std::vector<std::string> suggestRelatedSearches(const std::string& query) {
-        if (!isEnabled) return {};
-        std::cout << "AI suggesting related searches for: " << query << std::endl;
-        // Would generate related search suggestions
-        return {"refined query 1", "alternative search 2", "more specific query 3"};
-    }
+    struct Compaction {
+        Segment* source;
+        std::unique_ptr<Segment> result;  // null if the copy failed
+    };
     
-    void organizeTabsAutomatically(std::vector<std::shared_ptr<Tab>>& tabs) {
-        if (!isEnabled) return;
-        std::cout << "AI organizing " << tabs.size() << " tabs into logical groups" << std::endl;
-        // Would analyze tabs and suggest organizational structure
+    static constexpr char kMagic[4] = {'N', 'A', 'R', 'C'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kTombstone = 1;
+    static constexpr int64_t kPartitionMillis = 24 * 60 * 60 * 1000;
+    static constexpr const char* kDamagedSuffix = ".damaged";
+    static constexpr size_t kMaxLength = 0xFFFFFFFFu;
+    
+    std::string directory;
+    // In id order: partitions only grow, and ids within a segment too
+    std::vector<std::unique_ptr<Segment>> segments;
+    std::future<std::vector<Compaction>> compaction;
+    ArchiveId nextId = 1;
+    size_t liveCount = 0;
+    
+    static int64_t toMillis(std::chrono::system_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
     }
     
-    std::string generateTabName(std::shared_ptr<Tab> tab) {
-        if (!isEnabled || !tab) return "New Tab";
-        // Would generate a descriptive name based on content
-        return "AI-Generated Name: " + tab->getTitle();
+    static int64_t partitionOf(int64_t millis) {
+        return std::max<int64_t>(millis, 0) / kPartitionMillis;
     }
     
-    void suggestFocus() {
-        if (!isEnabled) return;
-        std::cout << "AI suggests focusing on work-related tabs for the next 30 minutes" << std::endl;
-        // Would analyze current tabs and suggest focus areas
+    std::string segmentPath(int64_t partition, const char* extension, const std::string& suffix) const {
+        return (fs::path(directory) / ("archive-" + std::to_string(partition) + extension + suffix)).string();
     }
     
-private:
-    bool isEnabled;
-};
-
-// Space for context-specific workspaces (similar to Arc's Spaces)
-class Space {
-public:
-    Space(const std::string& name = "Default Space") 
-        : name(name), icon("🏠"), isActive(false) {}
+    // Each compaction writes its data under a new generation, so the
+    // index file names its data and renaming it in publishes both at once
+    std::string dataPath(int64_t partition, uint64_t generation) const {
+        return segmentPath(partition, ".ndat", generation == 0 ? "" : "." + std::to_string(generation));
+    }
     
-    void setName(const std::string& newName) {
-        name = newName;
+    // Never over an existing file, which may be a segment openDirectory
+    // could not read
+    std::unique_ptr<Segment> createSegment(int64_t partition, uint64_t generation, const std::string& suffix) const {
+        auto segment = std::make_unique<Segment>();
+        segment->partition = partition;
+        if (!directory.empty() &&
+            (!segment->entries.create(segmentPath(partition, ".nidx", suffix)) ||
+             !segment->data.create(dataPath(partition, generation)))) {
+            segment->discardFiles();
+            return nullptr;
+        }
+        if (!segment->entries.reserve(sizeof(Header))) return nullptr;
+        
+        Header& header = segment->header();
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.partition = partition;
+        header.dataGeneration = generation;
+        return segment;
+    }
+    
+    void openDirectory() {
+        std::error_code error;
+        fs::create_directories(directory, error);
+        std::vector<int64_t> damaged;
+        for (const auto& file : fs::directory_iterator(directory, error)) {
+            std::string name = file.path().filename().string();
+            if (name.size() > 11 && name.compare(name.size() - 11, 11, ".compacting") == 0) {
+                // Left behind by an interrupted compaction; the source is intact
+                fs::remove(file.path(), error);
+                continue;
+            }
+            // Data files are opened through the index that names them
+            if (name.rfind("archive-", 0) != 0 || file.path().extension() != ".nidx") continue;
+            
+            int64_t partition = 0;
+            std::string stem = file.path().stem().string();
+            auto parsed = std::from_chars(stem.data() + 8, stem.data() + stem.size(), partition);
+            if (parsed.ec != std::errc() || parsed.ptr != stem.data() + stem.size()) continue;
+            
+            auto segment = std::make_unique<Segment>();
+            segment->partition = partition;
+            if (!segment->entries.open(segmentPath(partition, ".nidx", "")) || segment->entries.size() < sizeof(Header) ||
+                !segment->data.open(dataPath(partition, segment->header().dataGeneration)) || !isValid(*segment)) {
+                NOVA_LOG_WARN(ARCHIVE, "Moving aside unreadable archive segment " << file.path().string());
+                segment->entries.close();
+                segment->data.close();
+                damaged.push_back(partition);
+                continue;
+            }
+            segments.push_back(std::move(segment));
+        }
+        for (int64_t partition : damaged) setAside(partition);
+        
+        std::sort(segments.begin(), segments.end(),
+                  [](const auto& a, const auto& b) { return a->partition < b->partition; });
+        for (auto& segment : segments) {
+            liveCount += static_cast<size_t>(segment->header().liveCount);
+            nextId = std::max(nextId, segment->header().nextId);
+        }
+        removeStaleData();
+        NOVA_LOG_INFO(ARCHIVE, "Opened tab archive at " << directory << ": " << liveCount
+                      << " archived tabs in " << segments.size() << " segments");
+    }
+    
+    // Renames a partition's files with kDamagedSuffix, so they are kept for
+    // inspection and a new segment there does not write over them
+    void setAside(int64_t partition) {
+        std::error_code error;
+        std::string prefix = "archive-" + std::to_string(partition) + ".";
+        for (const auto& file : fs::directory_iterator(directory, error)) {
+            std::string name = file.path().filename().string();
+            if (name.rfind(prefix, 0) == 0 && !isDamaged(name)) moveAside(file.path());
+        }
     }
     
-    void setIcon(const std::string& newIcon) {
-        icon = newIcon;
+    static void moveAside(const fs::path& path) {
+        fs::path target = path;
+        target += kDamagedSuffix;
+        std::error_code error;
+        fs::rename(path, target, error);
+        if (error) NOVA_LOG_ERROR(ARCHIVE, "Could not move aside " << path.string() << ": " << error.message());
+    }
+    
+    static bool isDamaged(const std::string& name) {
+        size_t length = std::strlen(kDamagedSuffix);
+        return name.size() > length && name.compare(name.size() - length, length, kDamagedSuffix) == 0;
+    }
+    
+    // Data files of a loaded segment other than the one its index names:
+    // the new data of a compaction interrupted before its index was renamed
+    // in, or the old data of one interrupted after. Data whose index is gone
+    // is moved aside instead, as it is all that is left of its records.
+    void removeStaleData() {
+        std::error_code error;
+        std::unordered_map<int64_t, std::string> current;
+        for (auto& segment : segments) current[segment->partition] = dataPath(segment->partition, segment->header().dataGeneration);
+        for (const auto& file : fs::directory_iterator(directory, error)) {
+            std::string name = file.path().filename().string();
+            size_t extension = name.find(".ndat");
+            if (name.rfind("archive-", 0) != 0 || extension == std::string::npos || isDamaged(name)) continue;
+            int64_t partition = 0;
+            auto parsed = std::from_chars(name.data() + 8, name.data() + extension, partition);
+            if (parsed.ec != std::errc() || parsed.ptr != name.data() + extension) continue;
+            auto it = current.find(partition);
+            if (it == current.end()) {
+                NOVA_LOG_WARN(ARCHIVE, "Moving aside archive data without an index " << name);
+                moveAside(file.path());
+            } else if (fs::path(it->second).filename() != file.path().filename()) {
+                NOVA_LOG_DEBUG(ARCHIVE, "Removing stale archive data " << name);
+                fs::remove(file.path(), error);
+            }
+        }
     }
     
-    void activate() {
-        isActive = true;
-        std::cout << "Activated space: " << name << " " << icon << std::endl;
+    bool isValid(Segment& segment) {
+        if (segment.entries.size() < sizeof(Header)) return false;
+        const Header& header = segment.header();
+        return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion &&
+               header.partition == segment.partition && header.liveCount <= header.recordCount &&
+               header.recordCount <= (segment.entries.size() - sizeof(Header)) / sizeof(Entry) &&
+               header.dataSize <= segment.data.size();
+    }
+    
+    // Segment and entry index holding `id`, tombstoned or not
+    std::pair<Segment*, size_t> locate(ArchiveId id) {
+        auto it = std::upper_bound(segments.begin(), segments.end(), id,
+                                   [](ArchiveId target, const auto& segment) { return target < segment->firstId(); });
+        if (it == segments.begin()) return {nullptr, 0};
+        Segment& segment = **(it - 1);
+        Entry* begin = segment.entry(0);
+        Entry* end = begin + segment.header().recordCount;
+        Entry* found = std::lower_bound(begin, end, id, [](const Entry& entry, ArchiveId target) { return entry.id < target; });
+        if (found == end || found->id != id) return {nullptr, 0};
+        return {&segment, static_cast<size_t>(found - begin)};
+    }
+    
+    std::optional<Record> readRecord(Segment& segment, const Entry& entry) {
+        uint64_t end = entry.offset + entry.urlLength + entry.titleLength;
+        if (end < entry.offset || end > segment.header().dataSize) {
+            NOVA_LOG_WARN(ARCHIVE, "Archived tab " << entry.id << " points outside its segment");
+            return std::nullopt;
+        }
+        const char* bytes = reinterpret_cast<const char*>(segment.data.data()) + entry.offset;
+        Record record;
+        record.id = entry.id;
+        record.url = std::string_view(bytes, entry.urlLength);
+        record.title = std::string_view(bytes + entry.urlLength, entry.titleLength);
+        record.timestamp = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(entry.timestampMillis)));
+        return record;
+    }
+    
+    bool tombstone(Segment& segment, size_t index) {
+        Entry& entry = *segment.entry(index);
+        if (entry.flags & kTombstone) return false;
+        // A running compaction may be reading the flags
+        __atomic_store_n(&entry.flags, entry.flags | kTombstone, __ATOMIC_RELAXED);
+        segment.header().liveCount--;
+        segment.markDead(index);
+        liveCount--;
+        return true;
+    }
+    
+    // Runs on the compaction thread. Sealed segments never grow, so the
+    // source mapping stays put; only its flags change underneath.
+    std::unique_ptr<Segment> copyLive(Segment& source) const {
+        auto result = createSegment(source.partition, source.header().dataGeneration + 1, ".compacting");
+        if (!result) return nullptr;
+        
+        uint64_t count = source.header().recordCount;
+        for (uint64_t i = 0; i < count; ++i) {
+            const Entry& entry = *source.entry(i);
+            if (__atomic_load_n(&entry.flags, __ATOMIC_RELAXED) & kTombstone) continue;
+            
+            uint64_t length = entry.urlLength + entry.titleLength;
+            uint64_t records = result->header().recordCount;
+            uint64_t offset = result->header().dataSize;
+            if (!result->data.reserve(offset + length) ||
+                !result->entries.reserve(sizeof(Header) + (records + 1) * sizeof(Entry))) {
+                result->discardFiles();
+                return nullptr;
+            }
+            if (length > 0) std::memcpy(result->data.data() + offset, source.data.data() + entry.offset, length);
+            Entry copy = entry;
+            copy.flags = 0;
+            copy.offset = offset;
+            *result->entry(records) = copy;
+            result->header().dataSize = offset + length;
+            result->header().recordCount = records + 1;
+            result->header().liveCount++;
+        }
+        result->header().nextId = source.header().nextId;
+        return result;
     }
     
-    void deactivate() {
-        isActive = false;
-        std::cout << "Deactivated space: " << name << " " << icon << std::endl;
+    void collectCompaction() {
+        if (compaction.valid() && compaction.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            installCompaction(compaction.get());
+        }
     }
     
-    void addWindow(std::shared_ptr<class BrowserWindow> window) {
-        windows.push_back(window);
+    void installCompaction(std::vector<Compaction> results) {
+        for (auto& [source, result] : results) {
+            auto it = std::find_if(segments.begin(), segments.end(),
+                                   [source = source](const auto& segment) { return segment.get() == source; });
+            assert(it != segments.end());
+            if (!result) {
+                NOVA_LOG_WARN(ARCHIVE, "Could not compact archive segment " << source->partition);
+                continue;
+            }
+            
+            // Carry over tombstones set while the copy ran
+            uint64_t copied = result->header().recordCount;
+            uint64_t next = 0;
+            for (uint64_t i = 0; i < source->header().recordCount && next < copied; ++i) {
+                const Entry& original = *source->entry(i);
+                if (original.id != result->entry(next)->id) continue;
+                if (original.flags & kTombstone) {
+                    result->entry(next)->flags |= kTombstone;
+                    result->header().liveCount--;
+                }
+                next++;
+            }
+            assert(result->header().liveCount == source->header().liveCount);
+            
+            uint64_t reclaimed = source->header().recordCount - copied;
+            if (result->header().liveCount == 0) {
+                result->discardFiles();
+                source->discardFiles();
+                segments.erase(it);
+            } else if (directory.empty() || result->entries.rename(segmentPath(source->partition, ".nidx", ""))) {
+                // The renamed index names the new data; the old data goes
+                // with the source, or at the next open if this is cut short
+                source->data.discard();
+                *it = std::move(result);
+            } else {
+                NOVA_LOG_WARN(ARCHIVE, "Could not replace archive segment " << source->partition);
+                result->discardFiles();
+                continue;
+            }
+            NOVA_LOG_DEBUG(ARCHIVE, "Compacted archive segment, reclaimed " << reclaimed << " records");
+        }
     }
+};
+
+enum class SuggestionKind : uint8_t { OPEN_TAB, BOOKMARK, HISTORY, ARCHIVED_TAB, COMMAND };
+
+// Something the command bar suggests from. Changes are numbered so the
+// command bar only reads what happened since it last looked.
+class SuggestionSource {
+public:
+    struct Item {
+        std::string text;  // a URL, or a command
+        std::string title;
+        uint32_t useCount = 1;
+        std::chrono::system_clock::time_point lastUsed;
+        bool removed = false;
+    };
     
-    std::string getName() const { return name; }
-    std::string getIcon() const { return icon; }
-    bool getIsActive() const { return isActive; }
+    virtual ~SuggestionSource() = default;
+    virtual SuggestionKind suggestionKind() const = 0;
+    virtual uint64_t suggestionVersion() = 0;
+    // Appends the items changed after version `since`. When changes that far
+    // back are no longer kept, appends every current item and returns false.
+    virtual bool suggestionChanges(uint64_t since, std::vector<Item>& items) = 0;
+};
+
+// The most recent changes of a SuggestionSource, one version per change
+class SuggestionJournal {
+public:
+    uint64_t version() const { return latest; }
     
-    void saveState() {
-        std::cout << "Saving state for space: " << name << std::endl;
-        // Would save the current configuration of windows and tabs
+    void record(SuggestionSource::Item item) {
+        changes.push_back(std::move(item));
+        latest++;
+        if (changes.size() > kCapacity) changes.pop_front();
     }
     
-    void loadState() {
-        std::cout << "Loading state for space: " << name << std::endl;
-        // Would restore the saved configuration
+    // False if some of the changes after `since` were dropped
+    bool changesSince(uint64_t since, std::vector<SuggestionSource::Item>& items) const {
+        uint64_t oldest = latest - changes.size();
+        if (since < oldest) return false;
+        for (size_t i = static_cast<size_t>(since - oldest); i < changes.size(); ++i) items.push_back(changes[i]);
+        return true;
     }
     
 private:
-    std::string name;
-    std::string icon;
-    bool isActive;
-    std::vector<std::shared_ptr<class BrowserWindow>> windows;
-    std::vector<std::shared_ptr<TabGroup>> tabGroups;
-    std::map<std::string, std::string> spaceSettings;
+    static constexpr size_t kCapacity = 4096;
+    
+    std::deque<SuggestionSource::Item> changes;
+    uint64_t latest = 0;
 };
 
-// Command bar for quick navigation and actions
-class CommandBar {
+// Frecency-ranked autocomplete over URLs and commands. A trie over each
+// entry's words and its URL without the scheme keeps, at every node, the
+// highest-frecency entries below it, so a prefix lookup reads a short list
+// rather than the entries. Fuzzy (subsequence) matches are looked for among
+// the highest-frecency entries overall. A query that extends the previous
+// one resumes from its trie nodes and narrows its fuzzy matches.
+class SuggestionIndex {
 public:
-    CommandBar() : isVisible(false) {}
-    
-    void toggle() {
-        isVisible = !isVisible;
-        std::cout << (isVisible ? "Showing" : "Hiding") << " command bar" << std::endl;
-    }
+    struct Suggestion {
+        SuggestionKind kind;
+        std::string text;
+        std::string title;
+        double score;
+    };
     
-    void executeCommand(const std::string& command) {
-        std::cout << "Executing command: " << command << std::endl;
+    // Adds or updates the entry for item.text, or drops it if item.removed
+    void update(SuggestionKind kind, const SuggestionSource::Item& item) {
+        auto& ids = entryIds[static_cast<size_t>(kind)];
+        auto it = ids.find(item.text);
+        if (it != ids.end()) {
+            uint32_t id = it->second;
+            Entry& entry = entries[id];
+            entry.sweep = sweep;
+            float frecency = item.removed ? 0 : frecencyOf(kind, item);
+            if (!item.removed && entry.title == item.title) {
+                if (frecency == entry.frecency) return;
+                if (frecency > entry.frecency) {
+                    entry.frecency = frecency;
+                    offerEverywhere(id);
+                    generation++;
+                    return;
+                }
+            }
+            ids.erase(it);
+            removeEntry(id);
+        }
+        if (item.removed) return;
         
-        if (command.substr(0, 4) == "goto") {
-            std::string url = command.substr(5);
-            std::cout << "Navigating to: " << url << std::endl;
-        } else if (command == "newtab") {
-            std::cout << "Opening new tab" << std::endl;
-        } else if (command.substr(0, 6) == "search") {
-            std::string query = command.substr(7);
-            std::cout << "Searching for: " << query << std::endl;
-        } else if (command == "history") {
-            std::cout << "Opening history" << std::endl;
-        } else {
-            std::cout << "Unknown command: " << command << std::endl;
+        uint32_t id = static_cast<uint32_t>(entries.size());
+        entries.push_back({item.text, item.title, frecencyOf(kind, item), kind, true, sweep,
+                           letterMask(stripScheme(item.text)) | letterMask(item.title)});
+        ids.emplace(entries.back().text, id);
+        insertEntry(id, !loading);
+        liveCount++;
+        generation++;
+    }
+    
+    // Makes `items` the only entries of their kind
+    void replace(SuggestionKind kind, const std::vector<SuggestionSource::Item>& items) {
+        sweep++;
+        // Ranking entries one at a time costs several times as much as
+        // ranking every node once, so after a large load the next query does
+        loading = items.size() >= kBulkLoad && items.size() * 8 >= liveCount;
+        for (const auto& item : items) {
+            if (!item.removed) update(kind, item);
+        }
+        auto& ids = entryIds[static_cast<size_t>(kind)];
+        for (auto it = ids.begin(); it != ids.end();) {
+            if (entries[it->second].sweep == sweep) {
+                ++it;
+                continue;
+            }
+            uint32_t id = it->second;
+            it = ids.erase(it);
+            removeEntry(id);
+        }
+        if (loading) {
+            loading = false;
+            addPending();
+            ranked = false;
         }
     }
     
-    std::vector<std::string> getSuggestions(const std::string& partialCommand) {
-        // Would provide autocomplete suggestions
-        return {"suggestion 1", "suggestion 2", "suggestion 3"};
+    std::vector<Suggestion> query(std::string_view input, size_t limit) {
+        if (!ranked) rankAll();
+        std::string folded(input);
+        for (auto& c : folded) c = fold(c);
+        std::vector<std::string> terms;
+        forEachTerm(folded, [&](std::string_view term) { terms.emplace_back(term); });
+        
+        bool extends = generation == last.generation && !last.input.empty() &&
+                       folded.compare(0, last.input.size(), last.input) == 0;
+        std::vector<std::pair<std::string, uint32_t>> termNodes;
+        for (size_t i = 0; i < terms.size(); ++i) {
+            const std::string& term = terms[i];
+            if (extends && i < last.terms.size() && term.compare(0, last.terms[i].first.size(), last.terms[i].first) == 0) {
+                const auto& [previous, node] = last.terms[i];
+                termNodes.push_back({term, descend(node, previous.size(), term)});
+            } else {
+                termNodes.push_back({term, descend(kRoot, 0, term)});
+            }
+        }
+        
+        // A term's prefix matches are all below the node of its leading word.
+        // One missing from that node's list ranks no higher than its last,
+        // and anything higher can only be a fuzzy match of the term.
+        Ranking ranking(*this, terms, limit);
+        for (const auto& [term, node] : termNodes) {
+            size_t run = 0;
+            while (run < term.size() && isWordChar(term[run])) run++;
+            uint32_t wordNode = run == term.size() ? node : run > 0 ? descend(kRoot, 0, term.substr(0, run)) : kNone;
+            for (uint32_t listed : {node, wordNode}) {
+                if (listed == kNone) continue;
+                refreshTop(listed);
+                for (const auto& candidate : nodes[listed].top) ranking.consider(candidate.id);
+            }
+            float ceiling = -1;
+            if (run == 0) {
+                ceiling = std::numeric_limits<float>::infinity();
+            } else if (wordNode != kNone && nodes[wordNode].truncated) {
+                const auto& top = nodes[wordNode].top;
+                ceiling = top.empty() ? std::numeric_limits<float>::infinity() : top.back().frecency;
+            }
+            ranking.ceilings.push_back(ceiling);
+        }
+        
+        // Fuzzy matches come from the hot list in frecency order, until the
+        // rest could not place. Every match of the longer input was a match
+        // of the shorter one, so an extending query narrows the previous pool
+        // and only then reads further down the list.
+        uint32_t letters = letterMask(folded);
+        refreshTop(kRoot);
+        const auto& hot = nodes[kRoot].top;
+        if (!extends) {
+            last.pool.clear();
+            last.scanned = 0;
+        }
+        std::vector<Ranked> pool;
+        size_t next = 0;
+        for (; next < last.pool.size() && ranking.placeable(last.pool[next].frecency); ++next) {
+            const Ranked& listed = last.pool[next];
+            if (containsAll(entries[listed.id], terms, letters)) {
+                pool.push_back(listed);
+                ranking.consider(listed.id);
+            }
+        }
+        if (next < last.pool.size()) {
+            // Not narrowed yet; the next query filters them
+            pool.insert(pool.end(), last.pool.begin() + static_cast<std::ptrdiff_t>(next), last.pool.end());
+        } else {
+            for (; last.scanned < hot.size() && ranking.placeable(hot[last.scanned].frecency); ++last.scanned) {
+                const Ranked& listed = hot[last.scanned];
+                if (containsAll(entries[listed.id], terms, letters)) {
+                    pool.push_back(listed);
+                    ranking.consider(listed.id);
+                }
+            }
+        }
+        
+        last.input = std::move(folded);
+        last.terms = std::move(termNodes);
+        last.pool = std::move(pool);
+        last.generation = generation;
+        
+        std::vector<Suggestion> suggestions;
+        for (const auto& [score, id] : ranking.best) {
+            const Entry& entry = entries[id];
+            suggestions.push_back({entry.kind, entry.text, entry.title, score});
+        }
+        return suggestions;
     }
     
+    size_t size() const { return liveCount; }
+    
 private:
-    bool isVisible;
-    std::vector<std::string> commandHistory;
-};
-
-// Extension system
-class Extension {
-public:
-    Extension(const std::string& id, const std::string& name, const std::string& version)
-        : id(id), name(name), version(version), isEnabled(false) {}
+    struct Entry {
+        std::string text;
+        std::string title;
+        float frecency = 0;
+        SuggestionKind kind = SuggestionKind::HISTORY;
+        bool live = false;
+        uint32_t sweep = 0;
+        uint32_t letters = 0;  // see letterMask
+    };
+    
+    struct Ranked {
+        float frecency;
+        uint32_t id;
+    };
+    
+    struct Node {
+        std::vector<Ranked> top;         // best entries below, highest frecency first
+        std::vector<uint32_t> postings;  // entries with a key ending here
+        // Entries below may be missing from `top`, though none that beat its last
+        bool truncated = false;
+    };
+    
+    // Kept apart from the nodes so walking the trie touches little memory
+    struct Link {
+        uint32_t firstChild = kNone;
+        uint32_t nextSibling = kNone;
+        char label = 0;
+    };
+    
+    struct LastQuery {
+        std::string input;
+        std::vector<std::pair<std::string, uint32_t>> terms;  // term and its trie node
+        std::vector<Ranked> pool;  // fuzzy matches among the first `scanned` hot entries
+        size_t scanned = 0;
+        uint64_t generation = ~0ull;
+    };
+    
+    // The best `limit` scored entries seen so far, one per text
+    class Ranking {
+    public:
+        std::vector<std::pair<double, uint32_t>> best;
+        // Per term, the highest frecency of a prefix match not yet considered
+        std::vector<float> ceilings;
         
-    void enable() {
-        isEnabled = true;
-        std::cout << "Extension enabled: " << name << std::endl;
+        Ranking(SuggestionIndex& index, const std::vector<std::string>& terms, size_t limit)
+            : index(index), terms(terms), limit(limit) {
+            if (index.seen.size() < index.entries.size()) index.seen.resize(index.entries.size(), 0);
+            index.stamp++;
+        }
+        
+        // Whether an entry not yet considered, of this frecency or lower,
+        // could still make the list
+        bool placeable(float frecency) const {
+            if (limit == 0) return false;
+            if (best.size() < limit) return true;
+            // Between ceilings the best score grows with frecency, so the
+            // candidates are the frecency itself and the ceilings below it
+            double bound = maxScore(frecency);
+            for (float ceiling : ceilings) {
+                if (ceiling >= 0 && ceiling < frecency) bound = std::max(bound, maxScore(ceiling));
+            }
+            return bound >= best.back().first;
+        }
+        
+        void consider(uint32_t id) {
+            if (index.seen[id] == index.stamp || limit == 0) return;
+            index.seen[id] = index.stamp;
+            const Entry& entry = index.entries[id];
+            double quality = matchQuality(entry, terms);
+            if (quality <= 0) return;
+            std::pair<double, uint32_t> scored = {quality * index.frecency(id), id};
+            
+            auto same = std::find_if(best.begin(), best.end(),
+                                     [&](const auto& other) { return index.entries[other.second].text == entry.text; });
+            if (same != best.end()) {
+                if (!ranksAbove(scored, *same)) return;
+                best.erase(same);
+            } else if (best.size() == limit) {
+                if (!ranksAbove(scored, best.back())) return;
+                best.pop_back();
+            }
+            best.insert(std::upper_bound(best.begin(), best.end(), scored, ranksAbove), scored);
+        }
+        
+    private:
+        SuggestionIndex& index;
+        const std::vector<std::string>& terms;
+        size_t limit;
+        
+        double maxScore(float frecency) const {
+            if (ceilings.empty()) return frecency;
+            double quality = 0;
+            for (float ceiling : ceilings) quality += frecency <= ceiling ? kMaxQuality : 1;
+            return quality / static_cast<double>(ceilings.size()) * frecency;
+        }
+        
+        static bool ranksAbove(const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) {
+            return a.first != b.first ? a.first > b.first : a.second > b.second;
+        }
+    };
+    
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+    static constexpr uint32_t kRoot = 0;
+    static constexpr size_t kTop = 16;
+    static constexpr size_t kHot = 4096;  // the root's list: the fuzzy search pool
+    static constexpr size_t kMaxDepth = 12;
+    static constexpr size_t kKinds = 5;
+    static constexpr double kMaxQuality = 4;  // a URL prefix match
+    static constexpr size_t kBulkLoad = 4096;
+    static constexpr size_t kPendingBatch = 1 << 20;
+    
+    // A key waiting to be added, see addPending. Its characters are packed
+    // big-endian so integer order is text order, and zero padding sorts a
+    // key before its extensions.
+    struct PendingKey {
+        uint64_t head = 0;  // characters 0-7
+        uint32_t tail = 0;  // characters 8-11
+        uint32_t id = 0;
+        uint8_t length = 0;
+        
+        PendingKey(std::string_view key, uint32_t id) : id(id), length(static_cast<uint8_t>(key.size())) {
+            for (size_t i = 0; i < 8; ++i) head = head << 8 | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
+            for (size_t i = 8; i < kMaxDepth; ++i) tail = tail << 8 | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
+        }
+        
+        char at(size_t i) const {
+            return static_cast<char>(i < 8 ? head >> (56 - 8 * i) : tail >> (24 - 8 * (i - 8)));
+        }
+        
+        bool operator<(const PendingKey& other) const {
+            return head != other.head ? head < other.head : tail < other.tail;
+        }
+    };
+    
+    // A deque keeps entry text in place for the string_view keys
+    std::deque<Entry> entries;
+    std::unordered_map<std::string_view, uint32_t> entryIds[kKinds];
+    std::vector<Node> nodes = std::vector<Node>(1);
+    std::vector<Link> links = std::vector<Link>(1);
+    size_t liveCount = 0;
+    uint64_t generation = 0;
+    uint32_t sweep = 0;
+    bool loading = false;
+    bool ranked = true;  // false until rankAll lists a large load
+    LastQuery last;
+    
+    // Scratch state reused across calls
+    std::string keyText;
+    std::vector<std::string_view> keys;
+    std::vector<PendingKey> pending;
+    std::vector<uint32_t> seen;
+    uint32_t stamp = 0;
+    
+    static char fold(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+    
+    static bool isWordChar(char c) {
+        auto byte = static_cast<unsigned char>(c);
+        return (byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z') ||
+               (byte >= 'A' && byte <= 'Z') || byte >= 0x80;
+    }
+    
+    template <typename Fn>
+    static void forEachTerm(std::string_view input, Fn&& fn) {
+        size_t i = 0;
+        while (i < input.size()) {
+            while (i < input.size() && std::isspace(static_cast<unsigned char>(input[i]))) i++;
+            size_t start = i;
+            while (i < input.size() && !std::isspace(static_cast<unsigned char>(input[i]))) i++;
+            if (i > start) fn(input.substr(start, i - start));
+        }
     }
     
-    void disable() {
-        isEnabled = false;
-        std::cout << "Extension disabled: " << name << std::endl;
+    // "https://www.example.com/a" -> "example.com/a"
+    static std::string_view stripScheme(std::string_view url) {
+        size_t scheme = url.find("://");
+        if (scheme != std::string_view::npos && scheme < 16) url.remove_prefix(scheme + 3);
+        if (url.size() > 4 && fold(url[0]) == 'w' && fold(url[1]) == 'w' && fold(url[2]) == 'w' && url[3] == '.') {
+            url.remove_prefix(4);
+        }
+        return url;
     }
     
-    std::string getId() const { return id; }
-    std::string getName() const { return name; }
-    std::string getVersion() const { return version; }
-    bool getIsEnabled() const { return isEnabled; }
+    static float frecencyOf(SuggestionKind kind, const SuggestionSource::Item& item) {
+        static constexpr float kKindWeight[kKinds] = {2.0f, 1.4f, 1.0f, 0.6f, 1.0f};
+        auto days = std::chrono::duration_cast<std::chrono::hours>(
+            std::chrono::system_clock::now() - item.lastUsed).count() / 24;
+        float recency = days < 4 ? 100.0f : days < 14 ? 70.0f : days < 31 ? 50.0f : days < 90 ? 30.0f : 10.0f;
+        return recency * kKindWeight[static_cast<size_t>(kind)] * static_cast<float>(std::max<uint32_t>(item.useCount, 1));
+    }
     
-private:
-    std::string id;
-    std::string name;
-    std::string version;
-    bool isEnabled;
-};
-
-class ExtensionManager {
-public:
-    void installExtension(const std::string& id, const std::string& name, const std::string& version) {
-        auto extension = std::make_shared<Extension>(id, name, version);
-        extensions[id] = extension;
-        std::cout << "Installed extension: " << name << " v" << version << std::endl;
+    // Fills `keys` with views into `keyText`, the folded URL and title
+    void collectKeys(const Entry& entry) {
+        std::string_view url = stripScheme(entry.text);
+        keyText.assign(url.data(), url.size());
+        keyText += ' ';
+        keyText += entry.title;
+        for (auto& c : keyText) c = fold(c);
+        
+        keys.clear();
+        std::string_view text = keyText;
+        if (!url.empty()) keys.push_back(text.substr(0, std::min(url.size(), kMaxDepth)));
+        size_t i = 0;
+        while (i < text.size()) {
+            while (i < text.size() && !isWordChar(text[i])) i++;
+            size_t start = i;
+            while (i < text.size() && isWordChar(text[i])) i++;
+            if (i > start) keys.push_back(text.substr(start, std::min(i - start, kMaxDepth)));
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
     }
     
-    void uninstallExtension(const std::string& id) {
-        if (extensions.count(id) > 0) {
-            std::cout << "Uninstalled extension: " << extensions[id]->getName() << std::endl;
-            extensions.erase(id);
+    uint32_t child(uint32_t node, char label, bool create) {
+        for (uint32_t next = links[node].firstChild; next != kNone; next = links[next].nextSibling) {
+            if (links[next].label == label) return next;
         }
+        if (!create) return kNone;
+        auto created = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        links.push_back({kNone, links[node].firstChild, label});
+        links[node].firstChild = created;
+        return created;
+    }
+    
+    // Node for `term`, resuming from `node` which already matched its first
+    // `depth` characters; past kMaxDepth the deepest node stands in
+    uint32_t descend(uint32_t node, size_t depth, std::string_view term) {
+        for (size_t i = depth; i < term.size() && i < kMaxDepth && node != kNone; ++i) {
+            node = child(node, term[i], false);
+        }
+        return node;
     }
     
-    void toggleExtension(const std::string& id, bool enable) {
-        if (extensions.count(id) > 0) {
-            if (enable) {
-                extensions[id]->enable();
-            } else {
-                extensions[id]->disable();
+    float frecency(uint32_t id) const { return entries[id].frecency; }
+    
+    // `listed` if the entry may already be in lists, at a lower frecency
+    void offer(uint32_t node, uint32_t id, bool listed) {
+        size_t capacity = node == kRoot ? kHot : kTop;
+        auto& top = nodes[node].top;
+        float value = frecency(id);
+        auto it = listed ? std::find_if(top.begin(), top.end(), [id](const Ranked& r) { return r.id == id; }) : top.end();
+        if (it != top.end()) {
+            top.erase(it);
+        } else if (nodes[node].truncated && (top.empty() || value < top.back().frecency)) {
+            // Something not listed may rank higher
+            return;
+        }
+        auto at = std::upper_bound(top.begin(), top.end(), value,
+                                   [](float a, const Ranked& b) { return a > b.frecency; });
+        top.insert(at, {value, id});
+        if (top.size() > capacity) {
+            top.pop_back();
+            nodes[node].truncated = true;
+        }
+    }
+    
+    // Without `rank` the keys wait for addPending and the lists for rankAll
+    void insertEntry(uint32_t id, bool rank) {
+        collectKeys(entries[id]);
+        if (!rank) {
+            for (const auto& key : keys) pending.emplace_back(key, id);
+            if (pending.size() >= kPendingBatch) addPending();
+            return;
+        }
+        offer(kRoot, id, false);
+        // Keys are sorted, so a node two keys share is on the path of the one
+        // before; path[d] is that key's node at depth d + 1
+        std::string_view previous;
+        uint32_t path[kMaxDepth];
+        for (const auto& key : keys) {
+            size_t shared = 0;
+            while (shared < previous.size() && shared < key.size() && previous[shared] == key[shared]) shared++;
+            previous = key;
+            uint32_t node = shared > 0 ? path[shared - 1] : kRoot;
+            for (size_t depth = shared; depth < key.size(); ++depth) {
+                node = child(node, key[depth], true);
+                path[depth] = node;
+                if (rank) offer(node, id, false);
             }
+            auto& postings = nodes[node].postings;
+            if (postings.empty() || postings.back() != id) postings.push_back(id);
         }
     }
     
-    std::shared_ptr<Extension> getExtension(const std::string& id) {
-        if (extensions.count(id) > 0) {
-            return extensions[id];
+    // Adds the waiting keys in sorted order, so that consecutive keys walk
+    // the same few nodes instead of all over the trie
+    void addPending() {
+        std::sort(pending.begin(), pending.end());
+        const PendingKey* previous = nullptr;
+        uint32_t path[kMaxDepth];
+        for (const auto& key : pending) {
+            size_t shared = 0;
+            if (previous) {
+                while (shared < previous->length && shared < key.length && previous->at(shared) == key.at(shared)) shared++;
+            }
+            previous = &key;
+            uint32_t node = shared > 0 ? path[shared - 1] : kRoot;
+            for (size_t depth = shared; depth < key.length; ++depth) {
+                node = child(node, key.at(depth), true);
+                path[depth] = node;
+            }
+            nodes[node].postings.push_back(key.id);
+        }
+        pending.clear();
+    }
+    
+    // Re-ranks an entry whose frecency went up
+    void offerEverywhere(uint32_t id) {
+        collectKeys(entries[id]);
+        offer(kRoot, id, true);
+        for (const auto& key : keys) {
+            uint32_t node = kRoot;
+            for (char c : key) {
+                node = child(node, c, false);
+                if (node == kNone) break;  // still pending
+                offer(node, id, true);
+            }
         }
-        return nullptr;
     }
     
-    std::vector<std::shared_ptr<Extension>> getAllExtensions() {
-        std::vector<std::shared_ptr<Extension>> result;
-        for (const auto& pair : extensions) {
-            result.push_back(pair.second);
+    // Postings are left behind and skipped once the entry is dead
+    void removeEntry(uint32_t id) {
+        Entry& entry = entries[id];
+        collectKeys(entry);
+        auto withdraw = [&](uint32_t node) {
+            auto& top = nodes[node].top;
+            top.erase(std::remove_if(top.begin(), top.end(), [id](const Ranked& r) { return r.id == id; }), top.end());
+        };
+        withdraw(kRoot);
+        for (const auto& key : keys) {
+            uint32_t node = kRoot;
+            for (char c : key) {
+                node = child(node, c, false);
+                if (node == kNone) break;  // still pending
+                withdraw(node);
+            }
         }
-        return result;
+        entry.live = false;
+        std::string().swap(entry.text);
+        std::string().swap(entry.title);
+        liveCount--;
+        generation++;
+    }
+    
+    // A truncated list that has lost half its entries is rebuilt from the
+    // subtree. The survivors are still the best, so until then it is exact.
+    void refreshTop(uint32_t node) {
+        size_t capacity = node == kRoot ? kHot : kTop;
+        if (!nodes[node].truncated || nodes[node].top.size() >= capacity / 2) return;
+        
+        std::vector<Ranked> gathered;
+        if (node == kRoot) {
+            gatherLive(gathered);
+        } else {
+            if (seen.size() < entries.size()) seen.resize(entries.size(), 0);
+            stamp++;
+            std::vector<uint32_t> stack = {node};
+            while (!stack.empty()) {
+                uint32_t current = stack.back();
+                stack.pop_back();
+                for (uint32_t id : livePostings(nodes[current])) {
+                    if (seen[id] != stamp) {
+                        seen[id] = stamp;
+                        gathered.push_back({frecency(id), id});
+                    }
+                }
+                for (uint32_t next = links[current].firstChild; next != kNone; next = links[next].nextSibling) stack.push_back(next);
+            }
+        }
+        assignTop(node, gathered, false);
+    }
+    
+    // Lists every node from scratch. A child is created after its parent,
+    // so walking backwards ranks the children first and builds on theirs.
+    void rankAll() {
+        if (seen.size() < entries.size()) seen.resize(entries.size(), 0);
+        std::vector<Ranked> gathered;
+        auto gather = [&](Ranked ranked) {
+            if (seen[ranked.id] == stamp) return;
+            seen[ranked.id] = stamp;
+            gathered.push_back(ranked);
+        };
+        for (auto node = static_cast<uint32_t>(nodes.size() - 1); node != kRoot; --node) {
+            stamp++;
+            gathered.clear();
+            bool truncated = false;
+            for (uint32_t id : livePostings(nodes[node])) gather({frecency(id), id});
+            for (uint32_t next = links[node].firstChild; next != kNone; next = links[next].nextSibling) {
+                truncated = truncated || nodes[next].truncated;
+                for (const auto& ranked : nodes[next].top) gather(ranked);
+            }
+            assignTop(node, gathered, truncated);
+        }
+        gathered.clear();
+        gatherLive(gathered);
+        assignTop(kRoot, gathered, false);
+        ranked = true;
     }
     
-private:
-    std::unordered_map<std::string, std::shared_ptr<Extension>> extensions;
-};
-
-// Website customization
-class WebsiteCustomizer {
-public:
-    void addCustomCSS(const std::string& domain, const std::string& css) {
-        customCSS[domain] = css;
-        std::cout << "Added custom CSS for: " << domain << std::endl;
+    const std::vector<uint32_t>& livePostings(Node& node) {
+        auto& postings = node.postings;
+        postings.erase(std::remove_if(postings.begin(), postings.end(),
+                                      [this](uint32_t id) { return !entries[id].live; }), postings.end());
+        return postings;
     }
     
-    void addCustomScript(const std::string& domain, const std::string& script) {
-        customScripts[domain] = script;
-        std::cout << "Added custom script for: " << domain << std::endl;
+    void gatherLive(std::vector<Ranked>& gathered) const {
+        for (uint32_t id = 0; id < entries.size(); ++id) {
+            if (entries[id].live) gathered.push_back({frecency(id), id});
+        }
     }
     
-    void setZoomLevel(const std::string& domain, float level) {
-        zoomLevels[domain] = level;
-        std::cout << "Set zoom level for " << domain << " to " << level << std::endl;
+    // Lists the best candidates at the node; `truncated` if some entries
+    // below were not among them
+    void assignTop(uint32_t node, std::vector<Ranked>& candidates, bool truncated) {
+        size_t capacity = node == kRoot ? kHot : kTop;
+        size_t kept = std::min(capacity, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + static_cast<std::ptrdiff_t>(kept), candidates.end(),
+                          [](const Ranked& a, const Ranked& b) { return a.frecency > b.frecency; });
+        nodes[node].truncated = truncated || candidates.size() > capacity;
+        nodes[node].top.assign(candidates.begin(), candidates.begin() + static_cast<std::ptrdiff_t>(kept));
     }
     
-    std::optional<std::string> getCustomCSS(const std::string& domain) const {
-        if (customCSS.count(domain) > 0) {
-            return customCSS.at(domain);
+    static bool startsWith(std::string_view text, std::string_view term) {
+        if (text.size() < term.size()) return false;
+        for (size_t i = 0; i < term.size(); ++i) {
+            if (fold(text[i]) != term[i]) return false;
         }
-        return std::nullopt;
+        return true;
     }
     
-    std::optional<std::string> getCustomScript(const std::string& domain) const {
-        if (customScripts.count(domain) > 0) {
-            return customScripts.at(domain);
+    static bool hasWordStartingWith(std::string_view text, std::string_view term) {
+        for (size_t i = 0; i < text.size(); ++i) {
+            if ((i == 0 || !isWordChar(text[i - 1])) && startsWith(text.substr(i), term)) return true;
         }
-        return std::nullopt;
+        return false;
     }
     
-    float getZoomLevel(const std::string& domain) const {
-        if (zoomLevels.count(domain) > 0) {
-            return zoomLevels.at(domain);
+    // Whether the term's characters appear in order in the URL or title
+    static bool isSubsequence(std::string_view url, std::string_view title, std::string_view term) {
+        size_t matched = 0;
+        for (std::string_view text : {url, title}) {
+            for (size_t i = 0; i < text.size() && matched < term.size(); ++i) {
+                if (fold(text[i]) == term[matched]) matched++;
+            }
         }
-        return 1.0f; // Default zoom
+        return matched == term.size();
     }
     
-private:
-    std::unordered_map<std::string, std::string> customCSS;
-    std::unordered_map<std::string, std::string> customScripts;
-    std::unordered_map<std::string, float> zoomLevels;
+    // One bit per letter, digits sharing six; an entry that lacks a bit of
+    // the input cannot match it
+    static uint32_t letterMask(std::string_view text) {
+        uint32_t mask = 0;
+        for (char c : text) {
+            c = fold(c);
+            if (c >= 'a' && c <= 'z') mask |= 1u << (c - 'a');
+            else if (c >= '0' && c <= '9') mask |= 1u << (26 + (c - '0') % 6);
+        }
+        return mask;
+    }
+    
+    // `letters` is the letterMask of the terms
+    bool containsAll(const Entry& entry, const std::vector<std::string>& terms, uint32_t letters) const {
+        if ((entry.letters & letters) != letters) return false;
+        std::string_view url = stripScheme(entry.text);
+        for (const auto& term : terms) {
+            if (!isSubsequence(url, entry.title, term)) return false;
+        }
+        return true;
+    }
+    
+    // URL prefix 4, word prefix 2, fuzzy 1, averaged over the terms; 0 if
+    // some term does not match at all
+    static double matchQuality(const Entry& entry, const std::vector<std::string>& terms) {
+        if (terms.empty()) return 1;
+        std::string_view url = stripScheme(entry.text);
+        double total = 0;
+        for (const auto& term : terms) {
+            if (startsWith(url, term)) {
+                total += 4;
+            } else if (hasWordStartingWith(url, term) || hasWordStartingWith(entry.title, term)) {
+                total += 2;
+            } else if (isSubsequence(url, entry.title, term)) {
+                total += 1;
+            } else {
+                return 0;
+            }
+        }
+        return total / static_cast<double>(terms.size());
+    }
 };
 
-// Tab archive for managing old tabs
-class TabArchive {
+// Browsing history as columns of visit rows: one mapped file per column
+// (URL, title, domain, time, transition, tab), with each URL, title and
+// domain stored once in an append-only dictionary and referred to by id.
+// Rows are appended in time order, so a time range is two binary searches.
+// Per-domain counts are summarized per block of rows, as a block fills or
+// the first time a query covers it after reopening; aggregates read the
+// summaries and scan only the partial blocks at either end. Without a
+// directory everything is in memory.
+class HistoryDatabase : public SuggestionSource {
 public:
-    struct ArchivedTab {
+    using Clock = std::chrono::system_clock;
+    
+    enum class Transition : uint8_t { NAVIGATE, BACK, FORWARD };
+    
+    struct Visit {
         std::string url;
         std::string title;
-        std::chrono::system_clock::time_point timestamp;
+        Clock::time_point time;
+        Transition transition;
+        uint32_t tabId;
     };
-
-    void archiveTab(std::shared_ptr<Tab> tab) {
-        if (!tab) return;
-        
-        ArchivedTab archived;
-        archived.url = tab->getUrl();
-        archived.title = tab->getTitle();
-        archived.timestamp = std::chrono::system_clock::now();
-        
-        archives.push_back(archived);
-        std::cout << "Archived tab: " << tab->getTitle() << std::endl;
+    
+    struct DomainVisits {
+        std::string domain;
+        uint64_t visits;
+    };
+    
+    static HistoryDatabase& instance() {
+        static HistoryDatabase database;
+        return database;
     }
     
-    std::vector<ArchivedTab> searchArchive(const std::string& query) {
-        std::vector<ArchivedTab> results;
-        std::regex pattern(query, std::regex::icase);
-        
-        for (const auto& archived : archives) {
-            if (std::regex_search(archived.title, pattern) || 
-                std::regex_search(archived.url, pattern)) {
-                results.push_back(archived);
+    HistoryDatabase(const HistoryDatabase&) = delete;
+    HistoryDatabase& operator=(const HistoryDatabase&) = delete;
+    
+    ~HistoryDatabase() { closeFiles(); }
+    
+    // Switches to the database in `directory`, creating it if missing; an
+    // empty directory starts over in memory. Rows recorded so far are not
+    // carried over, so this belongs at startup.
+    bool open(const std::string& directory) {
+        std::lock_guard<std::mutex> lock(mutex);
+        closeFiles();
+        location = directory;
+        if (!directory.empty()) {
+            std::error_code error;
+            fs::create_directories(directory, error);
+        }
+        if (openFiles(false)) {
+            if (!directory.empty()) {
+                NOVA_LOG_INFO(HISTORY, "Opened history at " << directory << ": " << rows << " visits of "
+                              << urls.size() << " URLs");
             }
+            return true;
+        }
+        NOVA_LOG_WARN(HISTORY, "History at " << directory << " is unreadable, starting a new one");
+        closeFiles();
+        if (openFiles(true)) return true;
+        NOVA_LOG_ERROR(HISTORY, "Could not create history at " << directory << ", keeping it in memory");
+        closeFiles();
+        location.clear();
+        openFiles(true);
+        return false;
+    }
+    
+    // Returns the visit's row, or kNoRow if it could not be stored
+    uint64_t recordVisit(std::string_view url, std::string_view title, Transition transition, uint32_t tabId,
+                         Clock::time_point time = Clock::now()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!reserveRows(rows + 1) || !appendRow(rows, url, title, transition, tabId, time)) return failAppend();
+        publish(rows + 1);
+        return rows - 1;
+    }
+    
+    // Records visits given oldest first under one lock and publishes them
+    // together; returns how many were stored. Visits older than the newest
+    // row, as from an import, are merged in at their own time: the rows
+    // after them are rewritten further on, so those rows' numbers change.
+    size_t recordVisits(const std::vector<Visit>& visits) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (visits.empty()) return 0;
+        uint64_t first = rows;
+        if (rows > 0 && toMillis(visits.front().time) < times()[rows - 1]) {
+            first = static_cast<uint64_t>(std::upper_bound(times(), times() + rows, toMillis(visits.front().time)) - times());
+        }
+        if (!reserveRows(rows + visits.size())) {
+            failAppend();
+            return 0;
         }
         
-        std::cout << "Found " << results.size() << " archived tabs matching: " << query << std::endl;
-        return results;
-    }
-    
-    std::shared_ptr<Tab> restoreTab(size_t index) {
-        if (index >= archives.size()) return nullptr;
-        
-        const auto& archived = archives[index];
-        std::cout << "Restoring archived tab: " << archived.title << std::endl;
+        // The rows being moved are copied out and uncounted first; until the
+        // merge is published the history ends before them
+        std::vector<StoredRow> later;
+        later.reserve(static_cast<size_t>(rows - first));
+        for (uint64_t row = first; row < rows; ++row) {
+            later.push_back(storedRow(row));
+            stats(later.back().url).visits--;
+        }
+        if (summarized > first / kBlockRows) {
+            summarized = first / kBlockRows;
+            summaryUsed = summaryEnd(summarized);
+        }
+        publish(first);
         
-        auto tab = std::make_shared<Tab>(archived.url);
-        tab->setTitle(archived.title);
+        uint64_t row = first;
+        size_t stored = 0;
+        size_t next = 0;
+        bool failed = false;
+        for (const auto& visit : visits) {
+            int64_t millis = toMillis(visit.time);
+            for (; next < later.size() && later[next].millis <= millis; ++next) writeRow(row++, later[next]);
+            if (!appendRow(row, visit.url, visit.title, visit.transition, visit.tabId, visit.time)) {
+                failed = true;
+                break;
+            }
+            row++;
+            stored++;
+        }
+        for (; next < later.size(); ++next) writeRow(row++, later[next]);
+        publish(row);
+        if (failed) failAppend();
+        return stored;
+    }
+    
+    // Pages get their title after the visit starts. An import can move the
+    // row, in which case the URL's latest visit is titled instead.
+    void setVisitTitle(uint64_t row, std::string_view url, std::string_view title) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t urlId = 0;
+        if (!urls.find(url, urlId) || urlId >= header().urlStatsCount) return;
+        if (row >= rows || column<uint32_t>(urlColumn)[row] != urlId) row = stats(urlId).lastRow;
+        if (row >= rows || column<uint32_t>(urlColumn)[row] != urlId) return;
+        uint32_t titleId = 0;
+        bool added = false;
+        if (!titles.intern(title, titleId, added)) return;
+        column<uint32_t>(titleColumn)[row] = titleId;
+        publish(rows);
         
-        archives.erase(archives.begin() + index);
-        return tab;
+        UrlStats& urlStat = stats(urlId);
+        if (urlStat.lastRow == row && urlStat.title != titleId) {
+            urlStat.title = titleId;
+            recordChange(urlId);
+        }
     }
     
-    void clearOldArchives(int daysOld) {
-        auto now = std::chrono::system_clock::now();
-        auto cutoff = now - std::chrono::hours(24 * daysOld);
-        
-        size_t countBefore = archives.size();
-        archives.erase(
-            std::remove_if(archives.begin(), archives.end(),
-                [cutoff](const ArchivedTab& tab) { return tab.timestamp < cutoff; }),
-            archives.end()
-        );
-        
-        std::cout << "Cleared " << (countBefore - archives.size()) 
-                 << " archives older than " << daysOld << " days" << std::endl;
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<size_t>(rows);
     }
     
-private:
-    std::vector<ArchivedTab> archives;
-};
-
-// Notification center
-class NotificationCenter {
-public:
-    enum class NotificationType { INFO, WARNING, ERROR, SUCCESS };
-    
-    void showNotification(const std::string& message, NotificationType type = NotificationType::INFO) {
-        std::cout << "Notification [" << getTypeString(type) << "]: " << message << std::endl;
-        // Would display a toast notification in the UI
+    // Visits with from <= time < to
+    uint64_t countVisits(Clock::time_point from, Clock::time_point to) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [first, last] = rowRange(from, to);
+        return last - first;
     }
     
-    void clearNotifications() {
-        std::cout << "All notifications cleared" << std::endl;
+    // The latest visits in [from, to), newest first
+    std::vector<Visit> recentVisits(Clock::time_point from, Clock::time_point to, size_t limit) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [first, last] = rowRange(from, to);
+        std::vector<Visit> visits;
+        for (uint64_t row = last; row > first && visits.size() < limit; --row) {
+            uint64_t at = row - 1;
+            visits.push_back({std::string(urls.get(column<uint32_t>(urlColumn)[at])),
+                              std::string(titles.get(column<uint32_t>(titleColumn)[at])),
+                              Clock::time_point(std::chrono::milliseconds(times()[at])),
+                              static_cast<Transition>(transitionColumn.data()[at]), column<uint32_t>(tabColumn)[at]});
+        }
+        return visits;
+    }
+    
+    // Calls fn(visit) for each visit, oldest first. The lock is held only
+    // while a chunk of rows is copied, so visits can be recorded meanwhile.
+    template <typename Fn>
+    void forEachVisit(Fn&& fn) const {
+        std::vector<Visit> chunk;
+        for (uint64_t row = 0;;) {
+            chunk.clear();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (uint64_t end = std::min(rows, row + kVisitChunk); row < end; ++row) {
+                    chunk.push_back({std::string(urls.get(column<uint32_t>(urlColumn)[row])),
+                                     std::string(titles.get(column<uint32_t>(titleColumn)[row])),
+                                     Clock::time_point(std::chrono::milliseconds(times()[row])),
+                                     static_cast<Transition>(transitionColumn.data()[row]), column<uint32_t>(tabColumn)[row]});
+                }
+            }
+            if (chunk.empty()) return;
+            for (const auto& visit : chunk) fn(visit);
+        }
     }
     
-private:
-    std::string getTypeString(NotificationType type) const {
-        switch (type) {
-            case NotificationType::INFO: return "INFO";
-            case NotificationType::WARNING: return "WARNING";
-            case NotificationType::ERROR: return "ERROR";
-            case NotificationType::SUCCESS: return "SUCCESS";
-            default: return "UNKNOWN";
+    // The most visited domains in [from, to), busiest first
+    std::vector<DomainVisits> topDomains(Clock::time_point from, Clock::time_point to, size_t limit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [first, last] = rowRange(from, to);
+        std::vector<uint64_t> counts(domains.size(), 0);
+        forEachDomainCount(first, last, [&](uint32_t domain, uint64_t visits) { counts[domain] += visits; });
+        
+        std::vector<std::pair<uint64_t, uint32_t>> ranked;
+        for (uint32_t domain = 0; domain < counts.size(); ++domain) {
+            if (counts[domain] > 0) ranked.push_back({counts[domain], domain});
         }
+        size_t kept = std::min(limit, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(kept), ranked.end(),
+                          [](const auto& a, const auto& b) { return a.first != b.first ? a.first > b.first : a.second < b.second; });
+        std::vector<DomainVisits> result;
+        for (size_t i = 0; i < kept; ++i) result.push_back({std::string(domains.get(ranked[i].second)), ranked[i].first});
+        return result;
     }
-};
-
-// Cross-device synchronization
-class Synchronizer {
-public:
-    Synchronizer() : isSyncEnabled(false), lastSyncTime(std::chrono::system_clock::now()) {}
     
-    void enableSync(bool enabled) {
-        isSyncEnabled = enabled;
-        std::cout << "Synchronization " << (enabled ? "enabled" : "disabled") << std::endl;
+    // Visits to one domain (case-insensitive) in [from, to)
+    uint64_t domainVisits(std::string_view domain, Clock::time_point from, Clock::time_point to) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string folded(domain);
+        for (auto& c : folded) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        uint32_t domainId = 0;
+        if (!domains.find(folded, domainId)) return 0;
+        
+        auto [first, last] = rowRange(from, to);
+        uint64_t visits = 0;
+        forEachDomainCount(first, last, [&](uint32_t id, uint64_t count) {
+            if (id == domainId) visits += count;
+        }, domainId);
+        return visits;
     }
     
-    void syncNow() {
-        if (!isSyncEnabled) return;
-        
-        std::cout << "Syncing browser data across devices" << std::endl;
-        lastSyncTime = std::chrono::system_clock::now();
-        // Would synchronize bookmarks, history, settings, etc.
+    // One suggestion per URL, ranked by its visits and latest visit
+    SuggestionKind suggestionKind() const override { return SuggestionKind::HISTORY; }
+    
+    uint64_t suggestionVersion() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        return changeCount;
     }
     
-    void addDevice(const std::string& deviceName) {
-        connectedDevices.push_back(deviceName);
-        std::cout << "Added device to sync: " << deviceName << std::endl;
-    }
-    
-    void removeDevice(const std::string& deviceName) {
-        connectedDevices.erase(
-            std::remove(connectedDevices.begin(), connectedDevices.end(), deviceName),
-            connectedDevices.end()
-        );
-        std::cout << "Removed device from sync: " << deviceName << std::endl;
+    bool suggestionChanges(uint64_t since, std::vector<Item>& items) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (changeCount - since <= kChangeCapacity) {
+            for (uint64_t change = since; change < changeCount; ++change) {
+                items.push_back(suggestionFor(changedUrls[change % kChangeCapacity]));
+            }
+            return true;
+        }
+        for (uint32_t urlId = 0; urlId < header().urlStatsCount; ++urlId) {
+            if (stats(urlId).visits > 0) items.push_back(suggestionFor(urlId));
+        }
+        return false;
     }
     
-    bool getSyncStatus() const { return isSyncEnabled; }
-    std::vector<std::string> getConnectedDevices() const { return connectedDevices; }
+    static constexpr uint64_t kNoRow = UINT64_MAX;
     
 private:
-    bool isSyncEnabled;
-    std::chrono::system_clock::time_point lastSyncTime;
-    std::vector<std::string> connectedDevices;
-    std::mutex syncMutex;
-};
-
-// Main browser window class
-class BrowserWindow {
-public:
-    BrowserWindow() : isFullScreen(false) {
-        // Initialize with a default tab
-        openNewTab("about:welcome");
-    }
+    // Strings with dense ids from 0, in two mapped files: the end offset of
+    // each string, and the bytes. The hash index is rebuilt in memory the
+    // first time a string is looked up.
+    class Dictionary {
+    public:
+        bool open(const std::string& path, uint64_t count, uint64_t bytes) {
+            close();
+            if (!path.empty() && (!ends.open(path + ".off") || !chars.open(path + ".str"))) return false;
+            if (ends.size() < count * sizeof(uint64_t) || chars.size() < bytes ||
+                (count > 0 && offsetEnd(count - 1) != bytes)) {
+                return false;
+            }
+            entries = count;
+            used = bytes;
+            return true;
+        }
+        
+        void close() {
+            ends.close(entries * sizeof(uint64_t));
+            chars.close(used);
+            entries = 0;
+            used = 0;
+            slots.clear();
+        }
+        
+        bool find(std::string_view text, uint32_t& id) {
+            index();
+            for (size_t slot = hashOf(text) & (slots.size() - 1);; slot = (slot + 1) & (slots.size() - 1)) {
+                if (slots[slot] == 0) return false;
+                if (get(slots[slot] - 1) == text) {
+                    id = slots[slot] - 1;
+                    return true;
+                }
+            }
+        }
+        
+        bool intern(std::string_view text, uint32_t& id, bool& added) {
+            added = false;
+            if (find(text, id)) return true;
+            if (entries >= UINT32_MAX - 1 || !ends.reserve((entries + 1) * sizeof(uint64_t)) ||
+                !chars.reserve(used + text.size())) {
+                return false;
+            }
+            if (!text.empty()) std::memcpy(chars.data() + used, text.data(), text.size());
+            used += text.size();
+            std::memcpy(ends.data() + entries * sizeof(uint64_t), &used, sizeof(used));
+            id = static_cast<uint32_t>(entries++);
+            added = true;
+            insertSlot(id);
+            return true;
+        }
+        
+        // Valid until the next intern
+        std::string_view get(uint32_t id) const {
+            uint64_t begin = id == 0 ? 0 : offsetEnd(id - 1);
+            return std::string_view(reinterpret_cast<const char*>(chars.data()) + begin,
+                                    static_cast<size_t>(offsetEnd(id) - begin));
+        }
+        
+        uint64_t size() const { return entries; }
+        uint64_t bytes() const { return used; }
+        
+    private:
+        MappedFile ends;
+        MappedFile chars;
+        uint64_t entries = 0;
+        uint64_t used = 0;
+        std::vector<uint32_t> slots;  // id + 1, or 0 if free; at most half full
+        
+        static size_t hashOf(std::string_view text) { return std::hash<std::string_view>{}(text); }
+        
+        uint64_t offsetEnd(uint64_t id) const {
+            uint64_t end;
+            std::memcpy(&end, ends.data() + id * sizeof(uint64_t), sizeof(end));
+            return end;
+        }
+        
+        void index() {
+            if (slots.size() > entries * 2) return;
+            size_t capacity = 1024;
+            while (capacity <= entries * 2 + 2) capacity *= 2;
+            slots.assign(capacity, 0);
+            for (uint64_t id = 0; id < entries; ++id) insertSlot(static_cast<uint32_t>(id));
+        }
+        
+        void insertSlot(uint32_t id) {
+            if (slots.size() <= (static_cast<size_t>(id) + 1) * 2) {
+                index();
+                return;
+            }
+            size_t slot = hashOf(get(id)) & (slots.size() - 1);
+            while (slots[slot] != 0) slot = (slot + 1) & (slots.size() - 1);
+            slots[slot] = id + 1;
+        }
+    };
     
-    void openNewTab(const std::string& url = "about:blank") {
-        auto tab = std::make_shared<Tab>(url);
-        tabs.push_back(tab);
-        setActiveTab(tabs.size() - 1);
-        std::cout << "New tab opened with URL: " << url << std::endl;
-    }
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t rows;
+        uint64_t urlCount;
+        uint64_t urlBytes;
+        uint64_t titleCount;
+        uint64_t titleBytes;
+        uint64_t domainCount;
+        uint64_t domainBytes;
+        uint64_t urlStatsCount;
+        uint64_t summaryBlocks;
+        uint64_t summaryEntries;
+        uint64_t reserved[5];
+    };
     
-    void closeTab(size_t index) {
-        if (index < tabs.size()) {
-            tabs.erase(tabs.begin() + index);
-            std::cout << "Tab closed at index: " << index << std::endl;
-            
-            // If we closed the active tab, activate another one
-            if (activeTabIndex >= tabs.size()) {
-                if (!tabs.empty()) {
-                    setActiveTab(tabs.size() - 1);
+    // Indexed by URL id
+    struct UrlStats {
+        int64_t lastVisitMillis;
+        uint64_t lastRow;
+        uint32_t visits;
+        uint32_t title;  // of the latest visit
+        uint32_t domain;
+        uint32_t reserved;
+    };
+    
+    struct DomainCount {
+        uint32_t domain;
+        uint32_t visits;
+    };
+    
+    // A row by its ids, as it is moved when older visits are merged in
+    struct StoredRow {
+        int64_t millis;
+        uint32_t url;
+        uint32_t title;
+        uint32_t tab;
+        uint8_t transition;
+    };
+    
+    static constexpr char kMagic[4] = {'N', 'H', 'I', 'S'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint64_t kBlockRows = 1 << 16;
+    static constexpr uint64_t kChangeCapacity = 4096;
+    static constexpr uint64_t kVisitChunk = 4096;
+    
+    mutable std::mutex mutex;
+    std::string location;
+    MappedFile meta;
+    MappedFile urlColumn;
+    MappedFile titleColumn;
+    MappedFile domainColumn;
+    MappedFile timeColumn;
+    MappedFile transitionColumn;
+    MappedFile tabColumn;
+    MappedFile urlStats;
+    // Per complete block, its domains' visit counts ordered by domain: the
+    // end of each block's counts, and the counts. Written as blocks complete.
+    MappedFile summaryEnds;
+    MappedFile summaryCounts;
+    Dictionary urls;
+    Dictionary titles;
+    Dictionary domains;
+    uint64_t rows = 0;
+    uint64_t summarized = 0;  // blocks with a summary; later ones are read row by row
+    uint64_t summaryUsed = 0;  // counts written
+    std::vector<uint32_t> blockCounts;  // scratch, by domain
+    std::vector<DomainCount> blockSummary;  // scratch
+    // The URLs of the latest changes, as a ring; suggestions are built from
+    // the URL's stats when asked for, so recording a visit copies no strings
+    std::vector<uint32_t> changedUrls = std::vector<uint32_t>(kChangeCapacity);
+    uint64_t changeCount = 0;
+    
+    HistoryDatabase() { openFiles(true); }
+    
+    Header& header() const { return *reinterpret_cast<Header*>(meta.data()); }
+    UrlStats& stats(uint32_t urlId) const { return reinterpret_cast<UrlStats*>(urlStats.data())[urlId]; }
+    int64_t* times() const { return reinterpret_cast<int64_t*>(timeColumn.data()); }
+    
+    template <typename T>
+    static T* column(const MappedFile& file) { return reinterpret_cast<T*>(file.data()); }
+    
+    static int64_t toMillis(Clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+    
+    static std::string hostOf(std::string_view url) {
+        std::string host(UrlParser::parse(url).host);
+        for (auto& c : host) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return host;
+    }
+    
+    std::string pathOf(const char* name) const {
+        return location.empty() ? std::string() : (fs::path(location) / name).string();
+    }
+    
+    bool openFile(MappedFile& file, const char* name, bool truncate) {
+        return location.empty() || file.open(pathOf(name), truncate);
+    }
+    
+    bool openFiles(bool truncate) {
+        if (!openFile(meta, "history.meta", truncate) || !meta.reserve(sizeof(Header))) return false;
+        Header& head = header();
+        if (std::memcmp(head.magic, kMagic, sizeof(kMagic)) != 0) {
+            if (!truncate && head.magic[0] != 0) return false;
+            std::memset(&head, 0, sizeof(head));
+            std::memcpy(head.magic, kMagic, sizeof(kMagic));
+            head.version = kVersion;
+        }
+        if (head.version != kVersion) return false;
+        
+        rows = head.rows;
+        bool opened = openFile(urlColumn, "visits.url", truncate) && openFile(titleColumn, "visits.title", truncate) &&
+                      openFile(domainColumn, "visits.domain", truncate) && openFile(timeColumn, "visits.time", truncate) &&
+                      openFile(transitionColumn, "visits.transition", truncate) &&
+                      openFile(tabColumn, "visits.tab", truncate) && openFile(urlStats, "urls.stats", truncate) &&
+                      openFile(summaryEnds, "blocks.end", truncate) && openFile(summaryCounts, "blocks.domains", truncate) &&
+                      urls.open(pathOf("urls"), head.urlCount, head.urlBytes) &&
+                      titles.open(pathOf("titles"), head.titleCount, head.titleBytes) &&
+                      domains.open(pathOf("domains"), head.domainCount, head.domainBytes);
+        if (!opened) return false;
+        // Columns and dictionaries are written before the header counts them
+        bool complete = urlColumn.size() >= rows * sizeof(uint32_t) && titleColumn.size() >= rows * sizeof(uint32_t) &&
+                        domainColumn.size() >= rows * sizeof(uint32_t) && timeColumn.size() >= rows * sizeof(int64_t) &&
+                        transitionColumn.size() >= rows && tabColumn.size() >= rows * sizeof(uint32_t) &&
+                        urlStats.size() >= head.urlStatsCount * sizeof(UrlStats) && head.urlStatsCount <= urls.size();
+        if (!complete) return false;
+        
+        // Summaries can always be rebuilt from the domain column, so damaged
+        // or missing ones (as in histories older than them) start over
+        summarized = head.summaryBlocks;
+        summaryUsed = head.summaryEntries;
+        if (summarized > rows / kBlockRows || summaryEnds.size() < summarized * sizeof(uint64_t) ||
+            summaryCounts.size() < summaryUsed * sizeof(DomainCount) || summaryEnd(summarized) != summaryUsed) {
+            summarized = 0;
+            summaryUsed = 0;
+        }
+        if (summarizeBlocks(rows) && summarized > head.summaryBlocks) {
+            NOVA_LOG_INFO(HISTORY, "Summarized " << summarized - head.summaryBlocks << " blocks of history");
+        }
+        publish(rows);
+        return true;
+    }
+    
+    void closeFiles() {
+        if (meta.data()) publish(rows);
+        uint64_t urlStatsCount = meta.data() ? header().urlStatsCount : 0;
+        urlColumn.close(rows * sizeof(uint32_t));
+        titleColumn.close(rows * sizeof(uint32_t));
+        domainColumn.close(rows * sizeof(uint32_t));
+        timeColumn.close(rows * sizeof(int64_t));
+        transitionColumn.close(rows);
+        tabColumn.close(rows * sizeof(uint32_t));
+        urlStats.close(urlStatsCount * sizeof(UrlStats));
+        summaryEnds.close(summarized * sizeof(uint64_t));
+        summaryCounts.close(summaryUsed * sizeof(DomainCount));
+        urls.close();
+        titles.close();
+        domains.close();
+        meta.close(sizeof(Header));
+        rows = 0;
+        summarized = 0;
+        summaryUsed = 0;
+    }
+    
+    // Makes the appended rows and strings part of the database
+    void publish(uint64_t rowCount) {
+        Header& head = header();
+        head.urlCount = urls.size();
+        head.urlBytes = urls.bytes();
+        head.titleCount = titles.size();
+        head.titleBytes = titles.bytes();
+        head.domainCount = domains.size();
+        head.domainBytes = domains.bytes();
+        head.summaryBlocks = summarized;
+        head.summaryEntries = summaryUsed;
+        head.rows = rowCount;
+        rows = rowCount;
+    }
+    
+    void recordChange(uint32_t urlId) {
+        changedUrls[changeCount % kChangeCapacity] = urlId;
+        changeCount++;
+    }
+    
+    bool reserveRows(uint64_t count) {
+        return urlColumn.reserve(count * sizeof(uint32_t)) && titleColumn.reserve(count * sizeof(uint32_t)) &&
+               domainColumn.reserve(count * sizeof(uint32_t)) && timeColumn.reserve(count * sizeof(int64_t)) &&
+               transitionColumn.reserve(count) && tabColumn.reserve(count * sizeof(uint32_t));
+    }
+    
+    // Writes `row`, which must be reserved and follow the rows before it;
+    // it counts once published
+    bool appendRow(uint64_t row, std::string_view url, std::string_view title, Transition transition, uint32_t tabId,
+                   Clock::time_point time) {
+        uint32_t urlId = 0;
+        uint32_t titleId = 0;
+        uint32_t domainId = 0;
+        bool added = false;
+        if (!urls.intern(url, urlId, added) || !titles.intern(title, titleId, added)) return false;
+        if (urlId >= header().urlStatsCount) {
+            if (!domains.intern(hostOf(url), domainId, added) ||
+                !urlStats.reserve((static_cast<uint64_t>(urlId) + 1) * sizeof(UrlStats))) {
+                return false;
+            }
+            stats(urlId) = {0, 0, 0, titleId, domainId, 0};
+            header().urlStatsCount = urlId + 1;
+        }
+        
+        // Time order is what the range queries rely on, so a clock stepping
+        // back records at the latest time seen instead
+        int64_t millis = std::max(toMillis(time), row > 0 ? times()[row - 1] : INT64_MIN);
+        writeRow(row, {millis, urlId, titleId, tabId, static_cast<uint8_t>(transition)});
+        recordChange(urlId);
+        return true;
+    }
+    
+    // Writes a row whose strings are interned; the same rules as appendRow
+    void writeRow(uint64_t row, const StoredRow& stored) {
+        UrlStats& urlStat = stats(stored.url);
+        column<uint32_t>(urlColumn)[row] = stored.url;
+        column<uint32_t>(titleColumn)[row] = stored.title;
+        column<uint32_t>(domainColumn)[row] = urlStat.domain;
+        times()[row] = stored.millis;
+        transitionColumn.data()[row] = stored.transition;
+        column<uint32_t>(tabColumn)[row] = stored.tab;
+        
+        urlStat.visits++;
+        urlStat.lastVisitMillis = stored.millis;
+        urlStat.lastRow = row;
+        urlStat.title = stored.title;
+        if ((row + 1) % kBlockRows == 0) summarizeBlocks(row + 1);
+    }
+    
+    StoredRow storedRow(uint64_t row) const {
+        return {times()[row], column<uint32_t>(urlColumn)[row], column<uint32_t>(titleColumn)[row],
+                column<uint32_t>(tabColumn)[row], transitionColumn.data()[row]};
+    }
+    
+    uint64_t failAppend() {
+        NOVA_LOG_ERROR(HISTORY, "Could not record visit in history at " << (location.empty() ? "memory" : location));
+        return kNoRow;
+    }
+    
+    Item suggestionFor(uint32_t urlId) const {
+        const UrlStats& urlStat = stats(urlId);
+        return {std::string(urls.get(urlId)), std::string(titles.get(urlStat.title)), urlStat.visits,
+                Clock::time_point(std::chrono::milliseconds(urlStat.lastVisitMillis))};
+    }
+    
+    std::pair<uint64_t, uint64_t> rowRange(Clock::time_point from, Clock::time_point to) const {
+        const int64_t* begin = times();
+        const int64_t* end = begin + rows;
+        if (!begin || toMillis(from) >= toMillis(to)) return {0, 0};
+        auto first = std::lower_bound(begin, end, toMillis(from));
+        auto last = std::lower_bound(first, end, toMillis(to));
+        return {static_cast<uint64_t>(first - begin), static_cast<uint64_t>(last - begin)};
+    }
+    
+    // Calls fn(domain, visits) over rows [first, last), reading whole blocks
+    // from their summaries. With `only`, summaries report just that domain.
+    template <typename Fn>
+    void forEachDomainCount(uint64_t first, uint64_t last, Fn&& fn, uint32_t only = UINT32_MAX) {
+        const uint32_t* domainIds = column<uint32_t>(domainColumn);
+        uint64_t row = first;
+        while (row < last) {
+            uint64_t block = row / kBlockRows;
+            uint64_t blockEnd = (block + 1) * kBlockRows;
+            if (row % kBlockRows == 0 && blockEnd <= last && block < summarized) {
+                const DomainCount* begin = summaryOf(0) + summaryEnd(block);
+                const DomainCount* end = summaryOf(0) + summaryEnd(block + 1);
+                if (only == UINT32_MAX) {
+                    for (const DomainCount* count = begin; count != end; ++count) fn(count->domain, count->visits);
                 } else {
-                    activeTabIndex = 0;
+                    auto it = std::lower_bound(begin, end, only,
+                                               [](const DomainCount& count, uint32_t domain) { return count.domain < domain; });
+                    if (it != end && it->domain == only) fn(only, it->visits);
                 }
+                row = blockEnd;
+                continue;
             }
+            for (uint64_t end = std::min(last, blockEnd); row < end; ++row) fn(domainIds[row], 1);
         }
     }
     
-    void setActiveTab(size_t index) {
-        if (index < tabs.size()) {
-            // Deactivate current active tab
-            if (activeTabIndex < tabs.size()) {
-                tabs[activeTabIndex]->setActive(false);
+    // Where block `block`'s counts start, or the end of the last one's
+    uint64_t summaryEnd(uint64_t block) const {
+        if (block == 0) return 0;
+        uint64_t end;
+        std::memcpy(&end, summaryEnds.data() + (block - 1) * sizeof(uint64_t), sizeof(end));
+        return end;
+    }
+    
+    const DomainCount* summaryOf(uint64_t entry) const {
+        return reinterpret_cast<const DomainCount*>(summaryCounts.data()) + entry;
+    }
+    
+    // Summarizes the complete blocks among the first `rowCount` rows that
+    // have none yet; returns false if one could not be stored, leaving it
+    // and the blocks after it to be read row by row
+    bool summarizeBlocks(uint64_t rowCount) {
+        for (; summarized < rowCount / kBlockRows; ++summarized) {
+            const uint32_t* domainIds = column<uint32_t>(domainColumn) + summarized * kBlockRows;
+            blockCounts.resize(domains.size(), 0);
+            blockSummary.clear();
+            for (uint64_t i = 0; i < kBlockRows; ++i) {
+                if (blockCounts[domainIds[i]]++ == 0) blockSummary.push_back({domainIds[i], 0});
+            }
+            std::sort(blockSummary.begin(), blockSummary.end(),
+                      [](const DomainCount& a, const DomainCount& b) { return a.domain < b.domain; });
+            for (auto& count : blockSummary) {
+                count.visits = blockCounts[count.domain];
+                blockCounts[count.domain] = 0;
             }
             
-            // Activate new tab
-            tabs[index]->setActive(true);
-            activeTabIndex = index;
-            std::cout << "Active tab changed to: " << tabs[index]->getTitle() << std::endl;
+            uint64_t end = summaryUsed + blockSummary.size();
+            if (!summaryEnds.reserve((summarized + 1) * sizeof(uint64_t)) ||
+                !summaryCounts.reserve(end * sizeof(DomainCount))) {
+                NOVA_LOG_WARN(HISTORY, "Could not store the summary of history block " << summarized);
+                return false;
+            }
+            std::memcpy(summaryCounts.data() + summaryUsed * sizeof(DomainCount), blockSummary.data(),
+                        blockSummary.size() * sizeof(DomainCount));
+            std::memcpy(summaryEnds.data() + summarized * sizeof(uint64_t), &end, sizeof(end));
+            summaryUsed = end;
         }
+        return true;
     }
+};
+
+// Enhanced Theme management system with advanced customization
+class Theme {
+public:
+    enum class Mode { LIGHT, DARK, AUTO, CUSTOM };
+    enum class ColorScheme { DEFAULT, SOLARIZED, NORD, MONOKAI, DRACULA, CUSTOM };
     
-    void splitView(size_t tabIndex1, size_t tabIndex2) {
-        if (tabIndex1 < tabs.size() && tabIndex2 < tabs.size()) {
-            std::cout << "Split view enabled between tabs: " 
-                      << tabs[tabIndex1]->getTitle() << " and " 
-                      << tabs[tabIndex2]->getTitle() << std::endl;
-            // In a real implementation, this would rearrange the UI
-        }
-    }
+    struct ThemeConfig {
+        Mode mode = Mode::AUTO;
+        ColorScheme scheme = ColorScheme::DEFAULT;
+        std::string accentColor = "#5D3FD3"; // Default NOVA purple
+        std::string backgroundColor = "";
+        std::string textColor = "";
+        std::string linkColor = "";
+        float contrast = 1.0f;
+        bool reducedMotion = false;
+        bool highContrast = false;
+        std::map<std::string, std::string> customColors;
+    };
     
-    void toggleFullScreen() {
-        isFullScreen = !isFullScreen;
-        std::cout << (isFullScreen ? "Entered" : "Exited") << " full screen mode" << std::endl;
-    }
+    // Palette slots. Elements given a custom color get slots after these,
+    // shared by every theme; MOTION holds 1 when reduced motion is on
+    enum Slot : uint16_t { BACKGROUND, TEXT, LINK, ACCENT, ACCENT_TEXT, MOTION, BUILTIN_SLOTS };
+    
+    // A config compiled once: packed 0xRRGGBBAA colors with contrast and high
+    // contrast already applied, and the CSS variables for them. Immutable;
+    // themes with equal configs share one, and every compile gets a new version
+    struct Palette {
+        uint64_t version = 0;
+        std::vector<uint32_t> colors;  // by slot; 0 where an element has no color
+        std::string css;
+        
+        uint32_t color(uint16_t slot) const { return slot < colors.size() ? colors[slot] : 0; }
+        bool reducedMotion() const { return color(MOTION) != 0; }
+        
+    private:
+        friend class Theme;
+        ThemeConfig source;
+    };
     
-    std::shared_ptr<Tab> getActiveTab() const {
-        if (!tabs.empty() && activeTabIndex < tabs.size()) {
-            return tabs[activeTabIndex];
-        }
-        return nullptr;
-    }
+    // Called with the new palette and the slots that differ from the last one
+    using PaletteListener = std::function<void(const Palette&, const std::vector<uint16_t>& changedSlots)>;
     
-    Sidebar& getSidebar() { return sidebar; }
-    Theme& getTheme() { return theme; }
-    SearchEngine& getSearchEngine() { return searchEngine; }
-    BookmarkManager& getBookmarks() { return bookmarks; }
-    PrivacyManager& getPrivacy() { return privacy; }
+    Theme() : config{}, palette(paletteFor(config)) {}
     
-    // Advanced features
-    void addReadingMode() {
-        readingMode = std::make_unique<ReadingMode>();
-        std::cout << "Reading mode added to browser window" << std::endl;
-    }
+    Theme(const Theme&) = delete;
+    Theme& operator=(const Theme&) = delete;
     
-    void addAiAssistant() {
-        aiAssistant = std::make_unique<AiAssistant>();
-        std::cout << "AI assistant added to browser window" << std::endl;
+    ~Theme() {
+        cancelThemeTimer();
     }
     
-    void addCommandBar() {
-        commandBar = std::make_unique<CommandBar>();
-        std::cout << "Command bar added to browser window" << std::endl;
+    void setMode(Mode mode) {
+        config.mode = mode;
+        NOVA_LOG_INFO(THEME, "Theme changed to " << getModeString() << " mode");
+        notifyThemeListeners();
     }
     
-    void addTabArchive() {
-        tabArchive = std::make_unique<TabArchive>();
-        std::cout << "Tab archive added to browser window" << std::endl;
-    }
+    Mode getMode() const { return config.mode; }
     
-    void addWebsiteCustomizer() {
-        websiteCustomizer = std::make_unique<WebsiteCustomizer>();
-        std::cout << "Website customizer added to browser window" << std::endl;
+    void setColorScheme(ColorScheme scheme) {
+        config.scheme = scheme;
+        NOVA_LOG_INFO(THEME, "Color scheme changed to " << getSchemeString());
+        notifyThemeListeners();
     }
     
-    ReadingMode* getReadingMode() { return readingMode.get(); }
-    AiAssistant* getAiAssistant() { return aiAssistant.get(); }
-    CommandBar* getCommandBar() { return commandBar.get(); }
-    TabArchive* getTabArchive() { return tabArchive.get(); }
-    WebsiteCustomizer* getWebsiteCustomizer() { return websiteCustomizer.get(); }
-    
-private:
-    std::vector<std::shared_ptr<Tab>> tabs;
-    size_t activeTabIndex = 0;
-    bool isFullScreen;
+    ColorScheme getColorScheme() const { return config.scheme; }
     
-    Sidebar sidebar;
-    Theme theme;
-    SearchEngine searchEngine;
-    BookmarkManager bookmarks;
-    PrivacyManager privacy;
+    std::string getModeString() const {
+        switch (config.mode) {
+            case Mode::LIGHT: return "light";
+            case Mode::DARK: return "dark";
+            case Mode::AUTO: return "auto (system)";
+            case Mode::CUSTOM: return "custom";
+            default: return "unknown";
+        }
+    }
     
-    // Advanced components
-    std::unique_ptr<ReadingMode> readingMode;
-    std::unique_ptr<AiAssistant> aiAssistant;
-    std::unique_ptr<CommandBar> commandBar;
-    std::unique_ptr<TabArchive> tabArchive;
-    std::unique_ptr<WebsiteCustomizer> websiteCustomizer;
-};
-
-// NovaEngine implementation with Space support and additional features
-class NovaEngine {
-public:
-    NovaEngine() {
-        std::cout << "NOVA Browser has started" << std::endl;
-        std::cout << "Navigate. Organize. Visualize. Achieve." << std::endl;
-        
-        // Create default space
-        auto defaultSpace = std::make_shared<Space>("Home");
-        spaces.push_back(defaultSpace);
-        activeSpaceIndex = 0;
-        defaultSpace->activate();
-        
-        // Create first window in default space
-        createNewWindow();
-        
-        // Initialize extension manager
-        extensionManager = std::make_unique<ExtensionManager>();
-        
-        // Initialize synchronizer
-        synchronizer = std::make_unique<Synchronizer>();
-        
-        // Initialize notification center
-        notificationCenter = std::make_unique<NotificationCenter>();
-        
-        // Setup keyboard shortcuts
-        setupKeyboardShortcuts();
+    std::string getSchemeString() const {
+        switch (config.scheme) {
+            case ColorScheme::DEFAULT: return "default";
+            case ColorScheme::SOLARIZED: return "solarized";
+            case ColorScheme::NORD: return "nord";
+            case ColorScheme::MONOKAI: return "monokai";
+            case ColorScheme::DRACULA: return "dracula";
+            case ColorScheme::CUSTOM: return "custom";
+            default: return "unknown";
+        }
     }
     
-    void createSpace(const std::string& name, const std::string& icon = "🏠") {
-        auto space = std::make_shared<Space>(name);
-        space->setIcon(icon);
-        spaces.push_back(space);
-        std::cout << "Created new space: " << name << " " << icon << std::endl;
+    // Advanced theme features
+    void setCustomAccentColor(const std::string& hexColor) {
+        config.accentColor = hexColor;
+        NOVA_LOG_INFO(THEME, "Setting custom accent color to: " << hexColor);
+        notifyThemeListeners();
     }
     
-    void switchToSpace(size_t index) {
-        if (index >= spaces.size()) return;
-        
-        if (activeSpaceIndex < spaces.size()) {
-            spaces[activeSpaceIndex]->deactivate();
+    void setCustomColor(const std::string& element, const std::string& hexColor) {
+        if (!slotFor(element)) {
+            NOVA_LOG_WARN(THEME, "Ignoring custom color for '" << element << "': element names are a-z, 0-9 and '-'");
+            return;
         }
-        
-        spaces[index]->activate();
-        activeSpaceIndex = index;
+        config.customColors[element] = hexColor;
+        NOVA_LOG_INFO(THEME, "Set custom color for " << element << " to " << hexColor);
+        notifyThemeListeners();
     }
     
-    void createNewWindow() {
-        auto window = std::make_shared<BrowserWindow>();
-        windows.push_back(window);
-        setActiveWindow(windows.size() - 1);
-        std::cout << "New browser window created" << std::endl;
+    void adjustContrast(float level) {
+        config.contrast = std::clamp(level, 0.5f, 2.0f);
+        NOVA_LOG_INFO(THEME, "Adjusting contrast level to: " << level);
+        notifyThemeListeners();
     }
     
-    void closeWindow(size_t index) {
-        if (index < windows.size()) {
-            windows.erase(windows.begin() + index);
-            std::cout << "Window closed at index: " << index << std::endl;
-            
-            // If we closed the active window, activate another one
-            if (activeWindowIndex >= windows.size()) {
-                if (!windows.empty()) {
-                    setActiveWindow(windows.size() - 1);
-                } else {
-                    activeWindowIndex = 0;
-                }
-            }
-        }
+    void setReducedMotion(bool enabled) {
+        config.reducedMotion = enabled;
+        NOVA_LOG_INFO(THEME, "Reduced motion " << (enabled ? "enabled" : "disabled"));
+        notifyThemeListeners();
     }
     
-    void setActiveWindow(size_t index) {
-        if (index < windows.size()) {
-            activeWindowIndex = index;
-            std::cout << "Active window changed to index: " << index << std::endl;
-        }
+    void setHighContrast(bool enabled) {
+        config.highContrast = enabled;
+        NOVA_LOG_INFO(THEME, "High contrast mode " << (enabled ? "enabled" : "disabled"));
+        notifyThemeListeners();
     }
     
-    std::shared_ptr<BrowserWindow> getActiveWindow() const {
-        if (!windows.empty() && activeWindowIndex < windows.size()) {
-            return windows[activeWindowIndex];
-        }
-        return nullptr;
+    void saveThemeConfig(const std::string& name) {
+        savedThemes[name] = config;
+        NOVA_LOG_INFO(THEME, "Saved current theme configuration as: " << name);
+        // In a real implementation, this would persist to disk
     }
     
-    void setupKeyboardShortcuts() {
-        globalShortcuts["Ctrl+T"] = [this]() { 
-            auto window = getActiveWindow();
-            if (window) window->openNewTab();
-        };
+    void loadThemeConfig(const std::string& name) {
+        if (savedThemes.find(name) != savedThemes.end()) {
+            config = savedThemes[name];
+            NOVA_LOG_INFO(THEME, "Loading saved theme configuration: " << name);
+            notifyThemeListeners();
+        } else {
+            NOVA_LOG_WARN(THEME, "Theme configuration not found: " << name);
+        }
+    }
+    
+    void loadThemePreset(const std::string& presetName) {
+        if (presetName == "dark") {
+            config.mode = Mode::DARK;
+            config.backgroundColor = "#121212";
+            config.textColor = "#FFFFFF";
+            config.linkColor = "#5D3FD3";
+        } else if (presetName == "light") {
+            config.mode = Mode::LIGHT;
+            config.backgroundColor = "#FFFFFF";
+            config.textColor = "#121212";
+            config.linkColor = "#5D3FD3";
+        } else if (presetName == "nord") {
+            config.mode = Mode::CUSTOM;
+            config.scheme = ColorScheme::NORD;
+            config.backgroundColor = "#2E3440";
+            config.textColor = "#ECEFF4";
+            config.accentColor = "#88C0D0";
+        } else if (presetName == "dracula") {
+            config.mode = Mode::CUSTOM;
+            config.scheme = ColorScheme::DRACULA;
+            config.backgroundColor = "#282A36";
+            config.textColor = "#F8F8F2";
+            config.accentColor = "#BD93F9";
+        } else {
+            NOVA_LOG_WARN(THEME, "Unknown theme preset: " << presetName);
+            return;
+        }
         
-        globalShortcuts["Ctrl+W"] = [this]() {
-            auto window = getActiveWindow();
-            if (window && window->getActiveTab()) {
-                // Find the index of the active tab
-                // window->closeTab(index);
+        NOVA_LOG_INFO(THEME, "Loading theme preset: " << presetName);
+        notifyThemeListeners();
+    }
+    
+    void adaptToTimeOfDay() {
+        auto now = std::chrono::system_clock::now();
+        auto time = std::chrono::system_clock::to_time_t(now);
+        std::tm* localTime = std::localtime(&time);
+        
+        int hour = localTime->tm_hour;
+        
+        if (hour >= 7 && hour < 19) {
+            // Daytime: use light theme
+            if (config.mode != Mode::LIGHT) {
+                NOVA_LOG_INFO(THEME, "Adapting to daytime with light theme");
+                loadThemePreset("light");
             }
-        };
+        } else {
+            // Nighttime: use dark theme
+            if (config.mode != Mode::DARK) {
+                NOVA_LOG_INFO(THEME, "Adapting to nighttime with dark theme");
+                loadThemePreset("dark");
+            }
+        }
+    }
+    
+    void scheduleAutomaticThemeChanges(bool enabled) {
+        autoThemeEnabled = enabled;
+        NOVA_LOG_INFO(THEME, "Automatic theme changes " << (enabled ? "enabled" : "disabled"));
         
-        globalShortcuts["Ctrl+Shift+T"] = [this]() {
-            auto window = getActiveWindow();
-            if (window && window->getTabArchive()) {
-                // Restore the most recent tab
-                auto restoredTab = window->getTabArchive()->restoreTab(0);
-                if (restoredTab) {
-                    // Add the restored tab to the window
+        cancelThemeTimer();
+        if (enabled) scheduleNextThemeCheck();
+    }
+    
+    void addThemeChangeListener(std::function<void(const ThemeConfig&)> listener) {
+        themeListeners.push_back(listener);
+    }
+    
+    // Only told about changes that reach a color or the motion setting
+    void addPaletteListener(PaletteListener listener) {
+        paletteListeners.push_back(std::move(listener));
+    }
+    
+    const ThemeConfig& getCurrentConfig() const {
+        return config;
+    }
+    
+    std::shared_ptr<const Palette> getPalette() const { return palette; }
+    
+    // The slot an element's custom color lands in; builtin names map to
+    // theirs. Names become CSS custom properties, so only [a-z0-9-] is taken.
+    static std::optional<uint16_t> slotFor(const std::string& element) {
+        if (element.empty() || !std::all_of(element.begin(), element.end(), [](char c) {
+                return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-';
+            })) {
+            return std::nullopt;
+        }
+        SlotTable& table = slotTable();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        auto it = table.slots.find(element);
+        if (it != table.slots.end()) return it->second;
+        auto slot = static_cast<uint16_t>(table.names.size());
+        table.names.push_back(element);
+        table.slots.emplace(element, slot);
+        return slot;
+    }
+    
+    // "#RGB", "#RRGGBB" or "#RRGGBBAA" as 0xRRGGBBAA
+    static std::optional<uint32_t> parseColor(std::string_view hex) {
+        if (hex.empty() || hex[0] != '#') return std::nullopt;
+        hex.remove_prefix(1);
+        if (hex.size() != 3 && hex.size() != 6 && hex.size() != 8) return std::nullopt;
+        uint32_t value = 0;
+        for (char c : hex) {
+            int digit = c >= '0' && c <= '9' ? c - '0'
+                      : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                      : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) return std::nullopt;
+            value = value << 4 | static_cast<uint32_t>(digit);
+        }
+        if (hex.size() == 8) return value;
+        if (hex.size() == 6) return value << 8 | 0xFF;
+        uint32_t r = (value >> 8) * 17, g = (value >> 4 & 0xF) * 17, b = (value & 0xF) * 17;
+        return r << 24 | g << 16 | b << 8 | 0xFF;
+    }
+    
+    // "#rrggbb", with the alpha only when it is not opaque
+    static std::string formatColor(uint32_t color) {
+        char text[10];
+        if ((color & 0xFF) == 0xFF) std::snprintf(text, sizeof(text), "#%06x", color >> 8);
+        else std::snprintf(text, sizeof(text), "#%08x", color);
+        return text;
+    }
+    
+    // WCAG contrast ratio, 1 to 21
+    static double contrastRatio(uint32_t a, uint32_t b) {
+        double la = luminance(a), lb = luminance(b);
+        return (std::max(la, lb) + 0.05) / (std::min(la, lb) + 0.05);
+    }
+    
+private:
+    struct SlotTable {
+        std::mutex mutex;
+        std::vector<std::string> names{"background", "text", "link", "accent", "accent-text", "reduced-motion"};
+        std::unordered_map<std::string, uint16_t> slots{
+            {"background", BACKGROUND}, {"text", TEXT}, {"link", LINK},
+            {"accent", ACCENT}, {"accent-text", ACCENT_TEXT}, {"reduced-motion", MOTION}};
+    };
+    
+    // Compiled palettes by config fingerprint, so switching many windows to
+    // the same theme compiles it once. Held strongly, so a theme that is
+    // switched away from and back is not compiled again
+    struct PaletteCache {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, std::shared_ptr<const Palette>> palettes;
+        uint64_t nextVersion = 1;
+    };
+    
+    static constexpr uint32_t kBlack = 0x000000FF;
+    static constexpr uint32_t kWhite = 0xFFFFFFFF;
+    static constexpr double kHighContrastRatio = 7.0;  // WCAG AAA
+    static constexpr size_t kCachedPalettes = 64;  // past this, palettes no theme uses are dropped
+    
+    ThemeConfig config;
+    std::shared_ptr<const Palette> palette;
+    std::atomic<bool> autoThemeEnabled{false};
+    std::atomic<TimerId> themeTimer{0};
+    std::map<std::string, ThemeConfig> savedThemes;
+    std::vector<std::function<void(const ThemeConfig&)>> themeListeners;
+    std::vector<PaletteListener> paletteListeners;
+    
+    // Never destroyed: themes can outlive static destruction in other singletons
+    static SlotTable& slotTable() {
+        static SlotTable* table = new SlotTable();
+        return *table;
+    }
+    
+    static PaletteCache& paletteCache() {
+        static PaletteCache* cache = new PaletteCache();
+        return *cache;
+    }
+    
+    void notifyThemeListeners() {
+        std::shared_ptr<const Palette> previous = std::exchange(palette, paletteFor(config));
+        if (palette != previous && !paletteListeners.empty()) {
+            std::vector<uint16_t> changedSlots;
+            size_t slots = std::max(palette->colors.size(), previous->colors.size());
+            for (size_t slot = 0; slot < slots; ++slot) {
+                if (palette->color(static_cast<uint16_t>(slot)) != previous->color(static_cast<uint16_t>(slot))) {
+                    changedSlots.push_back(static_cast<uint16_t>(slot));
                 }
             }
+            if (!changedSlots.empty()) {
+                for (const auto& listener : paletteListeners) listener(*palette, changedSlots);
+            }
+        }
+        for (const auto& listener : themeListeners) {
+            listener(config);
+        }
+    }
+    
+    static std::shared_ptr<const Palette> paletteFor(const ThemeConfig& config) {
+        uint64_t key = fingerprint(config);
+        PaletteCache& cache = paletteCache();
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            auto it = cache.palettes.find(key);
+            if (it != cache.palettes.end() && sameConfig(it->second->source, config)) return it->second;
+        }
+        
+        std::shared_ptr<Palette> compiled = compile(config);
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (cache.palettes.size() >= kCachedPalettes) {
+            for (auto it = cache.palettes.begin(); it != cache.palettes.end();) {
+                it = it->second.use_count() == 1 ? cache.palettes.erase(it) : std::next(it);
+            }
+        }
+        // Another theme may have compiled the same config meanwhile
+        auto& entry = cache.palettes[key];
+        if (entry && sameConfig(entry->source, config)) return entry;
+        compiled->version = cache.nextVersion++;
+        entry = compiled;
+        return compiled;
+    }
+    
+    static std::shared_ptr<Palette> compile(const ThemeConfig& config) {
+        auto compiled = std::make_shared<Palette>();
+        compiled->source = config;
+        std::vector<uint32_t>& colors = compiled->colors;
+        bool dark = config.mode == Mode::DARK;
+        colors.assign(BUILTIN_SLOTS, 0);
+        colors[BACKGROUND] = colorOr(config.backgroundColor, dark ? 0x121212FF : kWhite);
+        colors[TEXT] = colorOr(config.textColor, dark ? kWhite : 0x121212FF);
+        colors[ACCENT] = colorOr(config.accentColor, 0x5D3FD3FF);
+        colors[LINK] = colorOr(config.linkColor, colors[ACCENT]);
+        for (const auto& [element, hex] : config.customColors) {
+            // Configs loaded from elsewhere may still carry bad names
+            std::optional<uint16_t> found = slotFor(element);
+            if (!found || *found == MOTION) continue;
+            uint16_t slot = *found;
+            if (slot >= colors.size()) colors.resize(slot + 1, 0);
+            colors[slot] = colorOr(hex, colors[slot]);
+        }
+        bool customAccentText = colors[ACCENT_TEXT] != 0;
+        
+        if (config.contrast != 1.0f) {
+            for (size_t slot = 0; slot < colors.size(); ++slot) {
+                if (slot != MOTION && colors[slot]) colors[slot] = scaleContrast(colors[slot], config.contrast);
+            }
+        }
+        if (config.highContrast) {
+            // Black or white behind, whichever the background was nearer, and
+            // every other color pushed until it reads against it
+            colors[BACKGROUND] = luminance(colors[BACKGROUND]) < 0.179 ? kBlack : kWhite;
+            for (size_t slot = TEXT; slot < colors.size(); ++slot) {
+                if (slot == MOTION || slot == ACCENT_TEXT || !colors[slot]) continue;
+                colors[slot] = ensureContrast(colors[slot], colors[BACKGROUND]);
+            }
+        }
+        if (!customAccentText) {
+            colors[ACCENT_TEXT] = contrastRatio(kWhite, colors[ACCENT]) >= contrastRatio(kBlack, colors[ACCENT]) ? kWhite : kBlack;
+        } else if (config.highContrast) {
+            colors[ACCENT_TEXT] = ensureContrast(colors[ACCENT_TEXT], colors[ACCENT]);
+        }
+        colors[MOTION] = config.reducedMotion ? 1 : 0;
+        
+        std::string& css = compiled->css;
+        css = ":root {\n  color-scheme: ";
+        css += luminance(colors[BACKGROUND]) < 0.179 ? "dark" : "light";
+        css += ";\n";
+        {
+            SlotTable& table = slotTable();
+            std::lock_guard<std::mutex> lock(table.mutex);
+            for (size_t slot = 0; slot < colors.size(); ++slot) {
+                if (slot == MOTION || !colors[slot]) continue;
+                css += "  --nova-" + table.names[slot] + ": " + formatColor(colors[slot]) + ";\n";
+            }
+        }
+        css += "  --nova-reduced-motion: ";
+        css += config.reducedMotion ? "1" : "0";
+        css += ";\n}\n";
+        return compiled;
+    }
+    
+    static uint32_t colorOr(const std::string& hex, uint32_t fallback) {
+        if (hex.empty()) return fallback;
+        if (auto color = parseColor(hex)) return *color;
+        NOVA_LOG_WARN(THEME, "Ignoring invalid color: " << hex);
+        return fallback;
+    }
+    
+    // Relative luminance, 0 for black to 1 for white
+    static double luminance(uint32_t color) {
+        static const std::array<double, 256> linear = [] {
+            std::array<double, 256> table{};
+            for (size_t i = 0; i < table.size(); ++i) {
+                double c = i / 255.0;
+                table[i] = c <= 0.03928 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            }
+            return table;
+        }();
+        return 0.2126 * linear[color >> 24] + 0.7152 * linear[color >> 16 & 0xFF] + 0.0722 * linear[color >> 8 & 0xFF];
+    }
+    
+    // Spreads the channels away from mid grey by `level`
+    static uint32_t scaleContrast(uint32_t color, float level) {
+        uint32_t scaled = color & 0xFF;
+        for (int shift = 8; shift <= 24; shift += 8) {
+            float channel = 128.0f + (static_cast<float>(color >> shift & 0xFF) - 128.0f) * level;
+            scaled |= static_cast<uint32_t>(std::clamp(std::lround(channel), 0L, 255L)) << shift;
+        }
+        return scaled;
+    }
+    
+    // Blends toward black or white a tenth at a time until `color` meets the
+    // high contrast ratio against `against`
+    static uint32_t ensureContrast(uint32_t color, uint32_t against) {
+        if (contrastRatio(color, against) >= kHighContrastRatio) return color;
+        uint32_t toward = luminance(against) < 0.179 ? kWhite : kBlack;
+        for (uint32_t step = 1; step < 10; ++step) {
+            uint32_t blended = color & 0xFF;
+            for (int shift = 8; shift <= 24; shift += 8) {
+                uint32_t from = color >> shift & 0xFF, to = toward >> shift & 0xFF;
+                blended |= (from * (10 - step) + to * step + 5) / 10 << shift;
+            }
+            if (contrastRatio(blended, against) >= kHighContrastRatio) return blended;
+        }
+        return toward;
+    }
+    
+    static uint64_t fingerprint(const ThemeConfig& config) {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&](std::string_view bytes) {
+            hash = (hash ^ std::hash<std::string_view>{}(bytes)) * 1099511628211ull;
         };
+        uint32_t contrastBits;
+        std::memcpy(&contrastBits, &config.contrast, sizeof(contrastBits));
+        char flags[7] = {static_cast<char>(config.mode), static_cast<char>(config.scheme),
+                         static_cast<char>(contrastBits), static_cast<char>(contrastBits >> 8),
+                         static_cast<char>(contrastBits >> 16), static_cast<char>(contrastBits >> 24),
+                         static_cast<char>(config.reducedMotion | config.highContrast << 1)};
+        mix(std::string_view(flags, sizeof(flags)));
+        mix(config.accentColor);
+        mix(config.backgroundColor);
+        mix(config.textColor);
+        mix(config.linkColor);
+        for (const auto& [element, hex] : config.customColors) {
+            mix(element);
+            mix(hex);
+        }
+        return hash;
+    }
+    
+    static bool sameConfig(const ThemeConfig& a, const ThemeConfig& b) {
+        return a.mode == b.mode && a.scheme == b.scheme && a.contrast == b.contrast &&
+               a.reducedMotion == b.reducedMotion && a.highContrast == b.highContrast &&
+               a.accentColor == b.accentColor && a.backgroundColor == b.backgroundColor &&
+               a.textColor == b.textColor && a.linkColor == b.linkColor && a.customColors == b.customColors;
+    }
+    
+    // The timer only posts the check, so a check that has not run yet is dropped too
+    void cancelThemeTimer() {
+        if (TimerId timer = themeTimer.exchange(0)) TimerWheel::instance().cancel(timer);
+        MainThreadQueue::instance().cancel(this);
+    }
+    
+    // Wakes once at the next 07:00 or 19:00 boundary instead of polling the clock
+    void scheduleNextThemeCheck() {
+        auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        std::tm* localTime = std::localtime(&time);
+        int secondsIntoDay = localTime->tm_hour * 3600 + localTime->tm_min * 60 + localTime->tm_sec;
+        
+        int boundary = 7 * 3600;
+        if (secondsIntoDay >= boundary) boundary = 19 * 3600;
+        if (secondsIntoDay >= boundary) boundary = 31 * 3600;
         
-        std::cout << "Keyboard shortcuts initialized" << std::endl;
+        themeTimer = TimerWheel::instance().schedule(
+            std::chrono::seconds(boundary - secondsIntoDay + 1),
+            [this] {
+                MainThreadQueue::instance().post(this, [this] {
+                    if (!autoThemeEnabled) return;
+                    adaptToTimeOfDay();
+                    scheduleNextThemeCheck();
+                });
+            },
+            TimerWheel::Clock::duration::zero(), std::chrono::seconds(1));
+    }
+};
+
+// Append-only encoder for the engine's compact binary formats. Integers are
+// LEB128 varints and strings are length-prefixed.
+class ByteWriter {
+public:
+    void writeU8(uint8_t value) { bytes.push_back(value); }
+    
+    void writeVarint(uint64_t value) {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
     }
     
-    ExtensionManager* getExtensionManager() { return extensionManager.get(); }
-    Synchronizer* getSynchronizer() { return synchronizer.get(); }
-    NotificationCenter* getNotificationCenter() { return notificationCenter.get(); }
+    void writeString(std::string_view text) {
+        writeVarint(text.size());
+        bytes.insert(bytes.end(), text.begin(), text.end());
+    }
     
-    std::vector<std::shared_ptr<Space>> getAllSpaces() const { return spaces; }
+    void writeBytes(const uint8_t* data, size_t size) { bytes.insert(bytes.end(), data, data + size); }
+    
+    // Stores only the part of `text` that differs from `previous`
+    void writePrefixedString(std::string_view text, std::string_view previous) {
+        size_t shared = 0;
+        size_t limit = std::min(text.size(), previous.size());
+        while (shared < limit && text[shared] == previous[shared]) shared++;
+        writeVarint(shared);
+        writeString(text.substr(shared));
+    }
+    
+    const std::vector<uint8_t>& data() const { return bytes; }
+    size_t size() const { return bytes.size(); }
+    
+    std::vector<uint8_t> release() {
+        bytes.shrink_to_fit();
+        return std::move(bytes);
+    }
     
 private:
-    std::vector<std::shared_ptr<Space>> spaces;
-    size_t activeSpaceIndex;
-    std::vector<std::shared_ptr<BrowserWindow>> windows;
-    size_t activeWindowIndex = 0;
-    std::unique_ptr<ExtensionManager> extensionManager;
-    std::unique_ptr<Synchronizer> synchronizer;
-    std::unique_ptr<NotificationCenter> notificationCenter;
+    std::vector<uint8_t> bytes;
 };
 
-// Definition of demonstrateBrowserFeatures function
-void demonstrateBrowserFeatures(NovaEngine& browser) {
-    auto window = browser.getActiveWindow();
-    if (!window) return;
+// Decoder for ByteWriter output. Reads past the end or malformed input set a
+// sticky failure flag and yield zero/empty values; check ok() when done.
+class ByteReader {
+public:
+    ByteReader(const uint8_t* data, size_t size) : cursor(data), end(data + size) {}
+    explicit ByteReader(const std::vector<uint8_t>& data) : ByteReader(data.data(), data.size()) {}
     
-    // Initialize advanced components for the window
-    window->addReadingMode();
-    window->addAiAssistant();
-    window->addCommandBar();
-    window->addTabArchive();
-    window->addWebsiteCustomizer();
+    uint8_t readU8() {
+        if (cursor >= end) return fail<uint8_t>();
+        return *cursor++;
+    }
     
-    std::cout << "\n--- NOVA Browser Advanced Feature Demonstration ---\n" << std::endl;
+    uint64_t readVarint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (cursor >= end) return fail<uint64_t>();
+            uint8_t byte = *cursor++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return value;
+        }
+        return fail<uint64_t>();
+    }
     
-    // Demo Spaces
-    std::cout << "1. Contextual Spaces:" << std::endl;
-    browser.createSpace("Work", "💼");
-    browser.createSpace("Personal", "🏠");
-    browser.createSpace("Research", "🔍");
-    browser.switchToSpace(1); // Switch to Work space
-    std::cout << "   - Spaces organize browser windows into separate contextual environments" << std::endl;
-    std::cout << "   - Each space maintains its own tabs, groups, and sidebar state" << std::endl;
-    std::cout << "   - Quickly toggle between different contexts with keyboard shortcuts" << std::endl;
+    std::string_view readStringView() {
+        uint64_t length = readVarint();
+        if (length > static_cast<uint64_t>(end - cursor)) return fail<std::string_view>();
+        std::string_view text(reinterpret_cast<const char*>(cursor), static_cast<size_t>(length));
+        cursor += length;
+        return text;
+    }
     
-    // Demo AI Assistant
-    std::cout << "\n2. AI-Powered Browsing Assistant:" << std::endl;
-    window->getAiAssistant()->summarizeTab(window->getActiveTab());
-    window->getAiAssistant()->suggestFocus();
-    std::cout << "   - Content summarization with key points extraction" << std::endl;
-    std::cout << "   - Intelligent tab organization suggestions" << std::endl;
-    std::cout << "   - Search query refinement assistance" << std::endl;
-    std::cout << "   - Smart bookmark categorization" << std::endl;
+    std::string readString() { return std::string(readStringView()); }
     
-    // Demo Command Bar
-    std::cout << "\n3. Command Bar for Quick Actions:" << std::endl;
-    window->getCommandBar()->toggle();
-    window->getCommandBar()->executeCommand("goto example.com");
-    window->getCommandBar()->executeCommand("search nova browser features");
-    std::cout << "   - Quick navigation with history-aware autocompletion" << std::endl;
-    std::cout << "   - Execute browser actions with text commands" << std::endl;
-    std::cout << "   - Customizable shortcuts and aliases" << std::endl;
+    std::string readPrefixedString(std::string_view previous) {
+        uint64_t shared = readVarint();
+        std::string_view suffix = readStringView();
+        if (shared > previous.size()) return fail<std::string>();
+        std::string text;
+        text.reserve(static_cast<size_t>(shared) + suffix.size());
+        text.append(previous.substr(0, static_cast<size_t>(shared)));
+        text.append(suffix);
+        return text;
+    }
     
-    // Demo Tab Archive
-    std::cout << "\n4. Intelligent Tab Archive:" << std::endl;
-    window->getTabArchive()->archiveTab(window->getActiveTab());
-    window->getTabArchive()->searchArchive("example");
-    std::cout << "   - Automatically archive inactive tabs to reduce clutter" << std::endl;
-    std::cout << "   - Full-text search through archived content" << std::endl;
-    std::cout << "   - One-click restoration of archived tabs" << std::endl;
+    bool ok() const { return !failed; }
+    bool atEnd() const { return cursor == end; }
+    const uint8_t* position() const { return cursor; }
     
-    // Demo Website Customization
-    std::cout << "\n5. Website Customization:" << std::endl;
-    window->getWebsiteCustomizer()->addCustomCSS("example.com", "body { font-size: 18px; }");
-    window->getWebsiteCustomizer()->setZoomLevel("example.com", 1.2f);
-    std::cout << "   - Per-website custom CSS and JavaScript" << std::endl;
-    std::cout << "   - Site-specific zoom levels and settings" << std::endl;
-    std::cout << "   - Content blocking rules customization" << std::endl;
+private:
+    const uint8_t* cursor;
+    const uint8_t* end;
+    bool failed = false;
     
-    // Demo Reading Mode
-    std::cout << "\n6. Enhanced Reading Experience:" << std::endl;
-    window->getReadingMode()->toggle();
-    window->getReadingMode()->setColorTheme(ReadingMode::ColorTheme::SEPIA);
-    window->getReadingMode()->textToSpeech();
-    std::cout << "   - Distraction-free reading mode with customizable appearance" << std::endl;
-    std::cout << "   - Text-to-speech for articles" << std::endl;
-    std::cout << "   - Offline article saving for later reading" << std::endl;
+    template <typename T>
+    T fail() {
+        failed = true;
+        cursor = end;
+        return T{};
+    }
+};
+
+// Small LZ77 codec for blobs the engine keeps around (hibernated tabs, sync
+// frames). Output is: varint original size, then repeated sequences of
+// varint literal length, literals, and - unless the input ends there - a
+// varint match length (>= 4) with a varint back-reference offset.
+class CompactCodec {
+public:
+    static std::vector<uint8_t> compress(const uint8_t* input, size_t size) {
+        ByteWriter writer;
+        writer.writeVarint(size);
+        
+        std::vector<uint32_t> table(kHashSize, kNoPosition);
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + kMinMatch <= size) {
+            uint32_t& slot = table[hash(input + i)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(i);
+            
+            if (candidate != kNoPosition && i - candidate <= kMaxOffset &&
+                std::memcmp(input + candidate, input + i, kMinMatch) == 0) {
+                size_t length = kMinMatch;
+                while (i + length < size && input[candidate + length] == input[i + length]) length++;
+                
+                writeLiterals(writer, input + anchor, i - anchor);
+                writer.writeVarint(length);
+                writer.writeVarint(i - candidate);
+                i += length;
+                anchor = i;
+            } else {
+                i++;
+            }
+        }
+        writeLiterals(writer, input + anchor, size - anchor);
+        return writer.release();
+    }
     
-    // Demo Extensions
-    std::cout << "\n7. Extension System:" << std::endl;
-    browser.getExtensionManager()->installExtension("dark-theme", "Dark Theme Pro", "1.2.0");
-    browser.getExtensionManager()->installExtension("privacy-shield", "Privacy Shield", "2.0.1");
-    browser.getExtensionManager()->toggleExtension("privacy-shield", true);
-    std::cout << "   - Support for Chrome and Firefox extensions" << std::endl;
-    std::cout << "   - Per-site extension enabling/disabling" << std::endl;
-    std::cout << "   - Sandboxed extension environment for security" << std::endl;
+    static std::vector<uint8_t> compress(const std::vector<uint8_t>& input) {
+        return compress(input.data(), input.size());
+    }
     
-    // Demo Sync
-    std::cout << "\n8. Cross-Device Synchronization:" << std::endl;
-    browser.getSynchronizer()->enableSync(true);
-    browser.getSynchronizer()->addDevice("NOVA Mobile");
-    browser.getSynchronizer()->addDevice("NOVA Tablet");
-    browser.getSynchronizer()->syncNow();
-    std::cout << "   - Seamless sync between devices" << std::endl;
-    std::cout << "   - Customizable sync categories" << std::endl;
-    std::cout << "   - End-to-end encryption for synced data" << std::endl;
+    // Returns false on malformed input
+    static bool decompress(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) {
+        ByteReader reader(input);
+        uint64_t size = reader.readVarint();
+        if (!reader.ok() || size > kMaxDecodedSize) return false;
+        output.clear();
+        output.reserve(static_cast<size_t>(size));
+        
+        while (reader.ok()) {
+            std::string_view literals = reader.readStringView();
+            if (output.size() + literals.size() > size) return false;
+            output.insert(output.end(), literals.begin(), literals.end());
+            if (output.size() == size) return reader.ok() && reader.atEnd();
+            
+            uint64_t length = reader.readVarint();
+            uint64_t offset = reader.readVarint();
+            if (offset == 0 || offset > output.size() || output.size() + length > size) return false;
+            // Byte-wise copy so overlapping matches repeat correctly
+            size_t from = output.size() - static_cast<size_t>(offset);
+            for (uint64_t k = 0; k < length; ++k) output.push_back(output[from + static_cast<size_t>(k)]);
+        }
+        return false;
+    }
     
-    // Demo Notifications
-    std::cout << "\n9. Intelligent Notifications:" << std::endl;
-    browser.getNotificationCenter()->showNotification("Download complete", NotificationCenter::NotificationType::SUCCESS);
-    browser.getNotificationCenter()->showNotification("Permission requested: Camera access", NotificationCenter::NotificationType::WARNING);
-    std::cout << "   - Non-intrusive notification system" << std::endl;
-    std::cout << "   - Focus mode with notification batching" << std::endl;
-    std::cout << "   - Priority-based notification management" << std::endl;
-    
-    std::cout << "\n10. Workflow Optimization:" << std::endl;
-    std::cout << "   - Smart tab suggestions based on current activity" << std::endl;
-    std::cout << "   - Automatic workspace organization" << std::endl;
-    std::cout << "   - Time tracking and productivity insights" << std::endl;
-    std::cout << "   - Focus timers with website blocking" << std::endl;
-    
-    std::cout << "\nNOVA Browser surpasses Arc, Chrome, Edge, and Safari by combining:" << std::endl;
-    std::cout << "- More intelligent workspace organization with AI-powered suggestions" << std::endl;
-    std::cout << "- Greater customization capabilities for both UI and websites" << std::endl;
-    std::cout << "- Enhanced privacy controls with granular settings" << std::endl;
-    std::cout << "- Superior tab management with archiving and intelligent grouping" << std::endl;
-    std::cout << "- Cross-platform synchronization with end-to-end encryption" << std::endl;
-    std::cout << "- A more intuitive command interface for power users" << std::endl;
-}
+private:
+    static constexpr size_t kMinMatch = 4;
+    static constexpr size_t kHashSize = 1 << 12;
+    static constexpr size_t kMaxOffset = 1 << 16;
+    static constexpr uint32_t kNoPosition = 0xFFFFFFFFu;
+    static constexpr uint64_t kMaxDecodedSize = 1ull << 30;
+    
+    static size_t hash(const uint8_t* bytes) {
+        uint32_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        return (word * 2654435761u) >> (32 - 12);
+    }
+    
+    static void writeLiterals(ByteWriter& writer, const uint8_t* bytes, size_t count) {
+        writer.writeString(std::string_view(reinterpret_cast<const char*>(bytes), count));
+    }
+};
 
-// Keep the main function at the end of the file
-int main() {
+// Where hibernated tab state lives: in memory by default, or spilled to one
+// file per tab once a spill directory is configured
+class HibernationStore {
+public:
+    static HibernationStore& instance() {
+        static HibernationStore store;
+        return store;
+    }
+    
+    void setSpillDirectory(const std::string& directory) {
+        std::lock_guard<std::mutex> lock(mutex);
+        spillDirectory = directory;
+        if (!directory.empty()) {
+            std::error_code error;
+            fs::create_directories(directory, error);
+        }
+    }
+    
+    // Writes the blob out if spilling is enabled; returns the file path, or
+    // an empty string when the blob should stay in memory
+    std::string spill(const std::vector<uint8_t>& blob) {
+        std::string directory;
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (spillDirectory.empty()) return {};
+            directory = spillDirectory;
+            id = nextSpillId++;
+        }
+        
+        std::string path = (fs::path(directory) / ("tab-" + std::to_string(id) + ".nhib")).string();
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file || std::fwrite(blob.data(), 1, blob.size(), file) != blob.size()) {
+            if (file) std::fclose(file);
+            NOVA_LOG_WARN(TAB, "Could not spill hibernated tab to " << path << ", keeping it in memory");
+            return {};
+        }
+        std::fclose(file);
+        return path;
+    }
+    
+    // Reads a spilled blob back and deletes the file
+    bool load(const std::string& path, std::vector<uint8_t>& blob) {
+        bool complete = read(path, blob);
+        std::error_code error;
+        fs::remove(path, error);
+        return complete;
+    }
+    
+    // Reads a spilled blob, leaving the file in place
+    bool read(const std::string& path, std::vector<uint8_t>& blob) const {
+        std::error_code error;
+        auto size = fs::file_size(path, error);
+        std::FILE* file = error ? nullptr : std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+        
+        blob.resize(static_cast<size_t>(size));
+        bool complete = std::fread(blob.data(), 1, blob.size(), file) == blob.size();
+        std::fclose(file);
+        return complete;
+    }
+    
+    void discard(const std::string& path) {
+        std::error_code error;
+        fs::remove(path, error);
+    }
+    
+private:
+    HibernationStore() = default;
+    
+    std::mutex mutex;
+    std::string spillDirectory;
+    uint64_t nextSpillId = 1;
+};
+
+// Memory for the objects of one window or space. Blocks of each size are
+// carved in turn out of 64 KB chunks and go back on their size's free list
+// when freed, so a window's tabs sit side by side in memory and closing a
+// window returns its chunks to the system at once. Objects made with make()
+// hold the arena, so it outlives all of them. Like the object model it
+// serves, an arena is used from the UI thread.
+class Arena : public std::pmr::memory_resource {
+public:
+    struct Stats {
+        uint64_t allocations = 0;
+        uint64_t deallocations = 0;
+        size_t liveBytes = 0;
+        size_t peakBytes = 0;
+        size_t reservedBytes = 0;  // chunks and large blocks taken from the system
+    };
+    
+    Arena() = default;
+    
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    
+    ~Arena() override {
+        for (char* chunk : chunks) ::operator delete(chunk);
+    }
+    
+    const Stats& getStats() const { return stats; }
+    
+    // Standard allocator over an arena; copies share the arena
+    template <typename T>
+    class Allocator {
+    public:
+        using value_type = T;
+        
+        explicit Allocator(std::shared_ptr<Arena> arena) : arena(std::move(arena)) {}
+        template <typename U>
+        Allocator(const Allocator<U>& other) : arena(other.arena) {}
+        
+        T* allocate(size_t count) {
+            return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+        }
+        void deallocate(T* pointer, size_t count) {
+            arena->deallocate(pointer, count * sizeof(T), alignof(T));
+        }
+        
+        template <typename U>
+        bool operator==(const Allocator<U>& other) const { return arena == other.arena; }
+        template <typename U>
+        bool operator!=(const Allocator<U>& other) const { return arena != other.arena; }
+        
+    private:
+        template <typename U>
+        friend class Allocator;
+        
+        std::shared_ptr<Arena> arena;
+    };
+    
+    // The object and its reference counts in one arena block; on the global
+    // heap without an arena
+    template <typename T, typename... Args>
+    static std::shared_ptr<T> make(const std::shared_ptr<Arena>& arena, Args&&... args) {
+        if (!arena) return std::make_shared<T>(std::forward<Args>(args)...);
+        return std::allocate_shared<T>(Allocator<T>(arena), std::forward<Args>(args)...);
+    }
+    
+private:
+    static constexpr size_t kChunkBytes = 64 * 1024;
+    static constexpr size_t kGranule = 16;  // what operator new aligns to
+    static constexpr size_t kLargestPooled = 4096;
+    
+    // Blocks of one size: freed ones first, then the rest of the current chunk
+    struct SizeClass {
+        void* freeList = nullptr;
+        char* next = nullptr;
+        char* end = nullptr;
+    };
+    
+    std::array<SizeClass, kLargestPooled / kGranule> classes;
+    std::vector<char*> chunks;
+    Stats stats;
+    
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        stats.allocations++;
+        stats.liveBytes += bytes;
+        stats.peakBytes = std::max(stats.peakBytes, stats.liveBytes);
+        size_t size = std::max(kGranule, (bytes + kGranule - 1) / kGranule * kGranule);
+        if (size > kLargestPooled || alignment > kGranule) {
+            stats.reservedBytes += bytes;
+            return ::operator new(bytes, std::align_val_t(std::max(alignment, kGranule)));
+        }
+        
+        SizeClass& sizeClass = classes[size / kGranule - 1];
+        if (sizeClass.freeList) {
+            void* block = sizeClass.freeList;
+            sizeClass.freeList = *static_cast<void**>(block);
+            return block;
+        }
+        if (static_cast<size_t>(sizeClass.end - sizeClass.next) < size) {
+            char* chunk = static_cast<char*>(::operator new(kChunkBytes));
+            chunks.push_back(chunk);
+            stats.reservedBytes += kChunkBytes;
+            sizeClass.next = chunk;
+            sizeClass.end = chunk + kChunkBytes / size * size;
+        }
+        void* block = sizeClass.next;
+        sizeClass.next += size;
+        return block;
+    }
+    
+    void do_deallocate(void* block, size_t bytes, size_t alignment) override {
+        stats.deallocations++;
+        stats.liveBytes -= bytes;
+        size_t size = std::max(kGranule, (bytes + kGranule - 1) / kGranule * kGranule);
+        if (size > kLargestPooled || alignment > kGranule) {
+            stats.reservedBytes -= bytes;
+            ::operator delete(block, std::align_val_t(std::max(alignment, kGranule)));
+            return;
+        }
+        SizeClass& sizeClass = classes[size / kGranule - 1];
+        *static_cast<void**>(block) = sizeClass.freeList;
+        sizeClass.freeList = block;
+    }
+    
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// Shared, reference-counted strings. Tabs browsing the same sites repeat the
+// same URLs and titles in their back/forward stacks; each distinct string is
+// stored once and freed with its last handle.
+class StringPool {
+    struct Node {
+        std::string text;
+        std::atomic<uint32_t> refs{1};
+    };
+    
+public:
+    // Copies share the string; the empty handle reads as ""
+    class Handle {
+    public:
+        Handle() = default;
+        Handle(const Handle& other) : node(other.node) {
+            if (node) node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        Handle(Handle&& other) noexcept : node(std::exchange(other.node, nullptr)) {}
+        Handle& operator=(Handle other) noexcept {
+            std::swap(node, other.node);
+            return *this;
+        }
+        ~Handle() {
+            if (node) StringPool::instance().release(node);
+        }
+        
+        std::string_view view() const { return node ? std::string_view(node->text) : std::string_view(); }
+        bool empty() const { return !node; }
+        
+        // This handle's part of the string's heap bytes
+        size_t sharedBytes() const {
+            if (!node) return 0;
+            size_t bytes = sizeof(Node) + node->text.capacity() + 1;
+            return bytes / std::max<uint32_t>(node->refs.load(std::memory_order_relaxed), 1);
+        }
+        
+    private:
+        friend class StringPool;
+        explicit Handle(Node* node) : node(node) {}
+        
+        Node* node = nullptr;
+    };
+    
+    // Never destroyed: tabs held by other singletons release handles at exit
+    static StringPool& instance() {
+        static StringPool* pool = new StringPool();
+        return *pool;
+    }
+    
+    Handle intern(std::string_view text) {
+        if (text.empty()) return Handle();
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = nodes.find(text);
+        if (it != nodes.end()) {
+            it->second->refs.fetch_add(1, std::memory_order_relaxed);
+            return Handle(it->second);
+        }
+        Node* node = new Node{std::string(text)};
+        nodes.emplace(node->text, node);
+        return Handle(node);
+    }
+    
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return nodes.size();
+    }
+    
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<std::string_view, Node*> nodes;  // keys view the node's text
+    
+    StringPool() = default;
+    
+    void release(Node* node) {
+        // Only the last reference needs the lock: intern revives nodes under it
+        uint32_t refs = node->refs.load(std::memory_order_relaxed);
+        while (refs > 1) {
+            if (node->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel)) return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        nodes.erase(node->text);
+        delete node;
+    }
+};
+
+// One direction of a tab's session history. The most recent entries are
+// pooled strings in a ring, so going back and forth only moves handles;
+// past the live capacity, older entries are spilled into prefix-encoded
+// chunks and come back a chunk at a time. The oldest chunk is dropped to
+// keep the stack within its total capacity plus one chunk.
+class NavigationStack {
+public:
+    struct Entry {
+        StringPool::Handle url;
+        StringPool::Handle title;
+    };
+    
+    struct Limits {
+        size_t liveEntries = 16;
+        size_t maxEntries = 1000;
+    };
+    
+    // Engine-wide; applies as stacks next grow
+    static void setLimits(Limits newLimits) {
+        newLimits.liveEntries = std::max<size_t>(newLimits.liveEntries, 1);
+        newLimits.maxEntries = std::max(newLimits.maxEntries, newLimits.liveEntries);
+        limits() = newLimits;
+    }
+    static Limits getLimits() { return limits(); }
+    
+    bool empty() const { return count == 0 && chunks.empty(); }
+    size_t size() const { return count + spilled; }
+    
+    void push(Entry entry) {
+        // Restored stacks are all chunks, so the ring alone can overfill them
+        while (!chunks.empty() && size() >= limits().maxEntries + kChunkEntries) dropOldestChunk();
+        if (count == ring.size() && count < limits().liveEntries) grow();
+        if (count == ring.size()) {
+            spill(std::move(ring[head]));
+            head = (head + 1) % ring.size();
+            count--;
+        }
+        ring[(head + count) % ring.size()] = std::move(entry);
+        count++;
+    }
+    
+    // The newest entry, or an empty one if the stack is empty
+    Entry pop() {
+        while (count == 0 && !chunks.empty()) refill();
+        if (count == 0) return Entry();
+        count--;
+        return std::move(ring[(head + count) % ring.size()]);
+    }
+    
+    void clear() {
+        std::vector<Entry>().swap(ring);
+        std::vector<Chunk>().swap(chunks);
+        head = 0;
+        count = 0;
+        spilled = 0;
+        tail = Entry();
+    }
+    
+    // Written as chunks, the live entries encoded as one more; spilled
+    // chunks are copied as they are. Reading keeps everything encoded until
+    // the stack is popped.
+    void write(ByteWriter& writer) const {
+        writer.writeVarint(chunks.size() + (count > 0 ? 1 : 0));
+        for (const auto& chunk : chunks) writeChunk(writer, chunk.entries, chunk.bytes);
+        if (count == 0) return;
+        ByteWriter live;
+        std::string_view previousUrl;
+        std::string_view previousTitle;
+        for (size_t i = 0; i < count; ++i) {
+            const Entry& entry = ring[(head + i) % ring.size()];
+            live.writePrefixedString(entry.url.view(), previousUrl);
+            live.writePrefixedString(entry.title.view(), previousTitle);
+            previousUrl = entry.url.view();
+            previousTitle = entry.title.view();
+        }
+        writeChunk(writer, static_cast<uint32_t>(count), live.data());
+    }
+    
+    bool read(ByteReader& reader) {
+        clear();
+        size_t chunkCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < chunkCount && reader.ok(); ++i) {
+            Chunk chunk;
+            chunk.entries = static_cast<uint32_t>(reader.readVarint());
+            std::string_view bytes = reader.readStringView();
+            if (chunk.entries == 0) continue;
+            chunk.bytes.assign(bytes.begin(), bytes.end());
+            spilled += chunk.entries;
+            chunks.push_back(std::move(chunk));
+        }
+        if (!reader.ok()) clear();
+        return reader.ok();
+    }
+    
+    // Heap bytes, counting this stack's share of pooled strings
+    size_t memoryBytes() const {
+        size_t bytes = ring.capacity() * sizeof(Entry) + chunks.capacity() * sizeof(Chunk);
+        for (size_t i = 0; i < count; ++i) {
+            const Entry& entry = ring[(head + i) % ring.size()];
+            bytes += entry.url.sharedBytes() + entry.title.sharedBytes();
+        }
+        for (const auto& chunk : chunks) bytes += chunk.bytes.capacity();
+        return bytes + tail.url.sharedBytes() + tail.title.sharedBytes();
+    }
+    
+private:
+    struct Chunk {
+        std::vector<uint8_t> bytes;  // prefix-encoded url/title pairs, oldest first
+        uint32_t entries = 0;
+    };
+    
+    static constexpr uint32_t kChunkEntries = 32;
+    
+    std::vector<Entry> ring;
+    size_t head = 0;
+    size_t count = 0;
+    std::vector<Chunk> chunks;  // oldest first
+    size_t spilled = 0;
+    Entry tail;  // last entry of the newest chunk, to encode the next against
+    
+    static Limits& limits() {
+        static Limits current;
+        return current;
+    }
+    
+    void grow() {
+        std::vector<Entry> grown(std::min(std::max<size_t>(ring.size() * 2, 4), limits().liveEntries));
+        for (size_t i = 0; i < count; ++i) grown[i] = std::move(ring[(head + i) % ring.size()]);
+        ring.swap(grown);
+        head = 0;
+    }
+    
+    void spill(Entry entry) {
+        if (chunks.empty() || chunks.back().entries >= kChunkEntries || tail.url.empty()) {
+            while (!chunks.empty() && spilled + kChunkEntries > limits().maxEntries - limits().liveEntries) {
+                dropOldestChunk();
+            }
+            chunks.emplace_back();
+            tail = Entry();
+        }
+        Chunk& chunk = chunks.back();
+        ByteWriter writer;
+        writer.writePrefixedString(entry.url.view(), tail.url.view());
+        writer.writePrefixedString(entry.title.view(), tail.title.view());
+        chunk.bytes.insert(chunk.bytes.end(), writer.data().begin(), writer.data().end());
+        chunk.entries++;
+        spilled++;
+        tail = std::move(entry);
+    }
+    
+    void dropOldestChunk() {
+        spilled -= chunks.front().entries;
+        chunks.erase(chunks.begin());
+        if (chunks.empty()) tail = Entry();
+    }
+    
+    static void writeChunk(ByteWriter& writer, uint32_t entries, const std::vector<uint8_t>& bytes) {
+        writer.writeVarint(entries);
+        writer.writeString(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+    }
+    
+    // Brings the newest chunk back into the (empty) ring
+    void refill() {
+        if (chunks.empty()) return;
+        Chunk chunk = std::move(chunks.back());
+        chunks.pop_back();
+        spilled -= chunk.entries;
+        tail = Entry();
+        
+        ByteReader reader(chunk.bytes);
+        std::string previousUrl;
+        std::string previousTitle;
+        for (uint32_t i = 0; i < chunk.entries && reader.ok(); ++i) {
+            previousUrl = reader.readPrefixedString(previousUrl);
+            previousTitle = reader.readPrefixedString(previousTitle);
+            // A chunk can hold more than the ring; its oldest spill again
+            push({StringPool::instance().intern(previousUrl), StringPool::instance().intern(previousTitle)});
+        }
+    }
+};
+
+// EasyList/uBlock-style request filtering. Filter lists compile into flat
+// tables: `||domain^` rules are keyed by their domain and found by looking
+// up each suffix of the request's host, and the other rules are keyed by
+// their rarest token, found by looking up each token of the request URL.
+// Only rules whose key matched have their options and pattern checked.
+// Exceptions (`@@`) compile into a second set of tables that is consulted
+// only once a rule blocks. The compiled tables serialize as one blob, so
+// startup does not parse the lists again. Cosmetic, regex and
+// unsupported-option rules are skipped.
+class ContentFilter {
+public:
+    enum class ResourceType : uint8_t {
+        OTHER, DOCUMENT, SUBDOCUMENT, SCRIPT, STYLESHEET, IMAGE, FONT, MEDIA, OBJECT, XMLHTTPREQUEST, WEBSOCKET, PING
+    };
+    
+    struct Request {
+        std::string_view url;
+        std::string_view sourceHost;  // the host of the page making the request, if any
+        ResourceType type = ResourceType::OTHER;
+    };
+    
+    struct Stats {
+        size_t filters = 0;
+        size_t exceptions = 0;
+        size_t skipped = 0;
+    };
+    
+    // Replaces the current filters with those of the given lists
+    Stats compile(const std::vector<std::string_view>& lists) {
+        Builder blocking;
+        Builder exceptions;
+        patterns.clear();
+        optionDomains.clear();
+        hasImportant = false;
+        Stats stats;
+        for (auto list : lists) {
+            while (!list.empty()) {
+                size_t end = list.find('\n');
+                std::string_view line = list.substr(0, end);
+                list = end == std::string_view::npos ? std::string_view() : list.substr(end + 1);
+                switch (parseLine(line, blocking, exceptions)) {
+                    case Parsed::BLOCKING: stats.filters++; break;
+                    case Parsed::EXCEPTION: stats.exceptions++; break;
+                    case Parsed::SKIPPED: stats.skipped++; break;
+                    case Parsed::NOTHING: break;
+                }
+            }
+        }
+        blocking.build(block, patterns);
+        exceptions.build(allow, patterns);
+        return stats;
+    }
+    
+    bool shouldBlock(const Request& request) const {
+        if (block.filters.empty()) return false;
+        Context context;
+        if (!context.prepare(request)) return false;
+        
+        const Filter* match = findMatch(block, context, false);
+        if (!match || (match->flags & IMPORTANT)) return match != nullptr;
+        if (!findMatch(allow, context, false)) return true;
+        // An exception gives way only to $important rules
+        return hasImportant && findMatch(block, context, true);
+    }
+    
+    size_t size() const { return block.filters.size() + allow.filters.size(); }
+    
+    std::vector<uint8_t> serialize() const {
+        ByteWriter writer;
+        writer.writeString(std::string_view(kMagic, sizeof(kMagic)));
+        writer.writeVarint(kVersion);
+        writeRules(writer, block);
+        writeRules(writer, allow);
+        writer.writeString(patterns);
+        writeArray(writer, optionDomains);
+        return writer.release();
+    }
+    
+    // Leaves the filters empty if the blob is not a valid compiled form
+    bool deserialize(const std::vector<uint8_t>& blob) {
+        ByteReader reader(blob);
+        bool valid = reader.readStringView() == std::string_view(kMagic, sizeof(kMagic)) &&
+                     reader.readVarint() == kVersion && readRules(reader, block) && readRules(reader, allow);
+        if (valid) {
+            patterns = reader.readString();
+            valid = readArray(reader, optionDomains) && reader.ok() && reader.atEnd() && isConsistent(block) &&
+                    isConsistent(allow);
+        }
+        if (!valid) {
+            block = RuleSet();
+            allow = RuleSet();
+            patterns.clear();
+            optionDomains.clear();
+        }
+        hasImportant = false;
+        for (const auto& filter : block.filters) hasImportant = hasImportant || (filter.flags & IMPORTANT);
+        return valid;
+    }
+    
+    bool save(const std::string& path) const {
+        std::vector<uint8_t> blob = serialize();
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        bool written = file && std::fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+        if (file) written = std::fclose(file) == 0 && written;
+        return written;
+    }
+    
+    bool load(const std::string& path) {
+        std::error_code error;
+        auto size = fs::file_size(path, error);
+        std::FILE* file = error ? nullptr : std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+        std::vector<uint8_t> blob(static_cast<size_t>(size));
+        bool complete = std::fread(blob.data(), 1, blob.size(), file) == blob.size();
+        std::fclose(file);
+        return complete && deserialize(blob);
+    }
+    
+private:
+    enum Flags : uint16_t {
+        START = 1 << 0,        // |pattern
+        END = 1 << 1,          // pattern|
+        HOST = 1 << 2,         // ||pattern
+        HOST_KEYED = 1 << 3,   // ||domain^...: keyed by domain, pattern is the rest
+        THIRD_PARTY = 1 << 4,
+        FIRST_PARTY = 1 << 5,
+        IMPORTANT = 1 << 6,
+        MATCH_CASE = 1 << 7,
+    };
+    
+    // One cache line, holding the pattern too unless it is long, so that
+    // checking a rule found by its key is one miss
+    static constexpr size_t kInlinePattern = 40;
+    
+    struct alignas(64) Filter {
+        uint32_t pattern;  // offset into patterns, if longer than kInlinePattern
+        uint32_t patternLength;
+        uint32_t domains;  // offset into optionDomains
+        uint32_t domainCount;
+        uint32_t types;    // a bit per ResourceType
+        uint32_t flags;
+        char text[kInlinePattern];  // the pattern, if it fits
+    };
+    
+    // Open-addressed: key hash -> filters[begin, begin + count)
+    struct Slot {
+        uint64_t key;
+        uint32_t begin;
+        uint32_t count;
+    };
+    
+    struct Table {
+        std::vector<Slot> slots;
+        std::vector<uint64_t> present;  // a Bloom filter over the keys, small enough to stay cached; rebuilt on load
+        
+        // Most URL tokens match no rule, and the filter turns those away
+        // without touching the slots. Each key sets three bits of one word,
+        // at 16 bits a key, so about one absent key in a hundred gets
+        // through to a slot.
+        void index() {
+            size_t keys = 0;
+            for (const auto& slot : slots) keys += slot.count != 0;
+            size_t words = 1;
+            while (words * 64 < keys * 16) words *= 2;
+            present.assign(words, 0);
+            for (const auto& slot : slots) {
+                if (slot.count != 0) present[wordOf(slot.key)] |= bitsOf(slot.key);
+            }
+        }
+        
+        size_t wordOf(uint64_t key) const { return static_cast<size_t>(key >> 32) & (present.size() - 1); }
+        
+        static uint64_t bitsOf(uint64_t key) {
+            return (1ull << ((key >> 8) & 63)) | (1ull << ((key >> 14) & 63)) | (1ull << ((key >> 20) & 63));
+        }
+        
+        const Slot* find(uint64_t key) const {
+            if (slots.empty()) return nullptr;
+            uint64_t bits = bitsOf(key);
+            if ((present[wordOf(key)] & bits) != bits) return nullptr;
+            size_t mask = slots.size() - 1;
+            for (size_t i = static_cast<size_t>(key) & mask;; i = (i + 1) & mask) {
+                if (slots[i].count == 0) return nullptr;
+                if (slots[i].key == key) return &slots[i];
+            }
+        }
+    };
+    
+    struct RuleSet {
+        std::vector<Filter> filters;
+        Table hosts;
+        Table tokens;
+        std::vector<uint32_t> untokened;       // checked for every request
+        std::vector<uint32_t> untokenedTypes;  // their type bits, so most are passed over unread; rebuilt on load
+        
+        void indexUntokened() {
+            untokenedTypes.clear();
+            for (uint32_t id : untokened) untokenedTypes.push_back(id < filters.size() ? filters[id].types : 0);
+        }
+    };
+    
+    // One rule while compiling
+    struct Rule {
+        Filter filter;
+        std::string pattern;
+        uint64_t hostKey = 0;
+        std::vector<std::pair<size_t, size_t>> tokens;  // candidate keys: offset, length in pattern
+    };
+    
+    class Builder {
+    public:
+        std::vector<Rule> rules;
+        
+        void build(RuleSet& set, std::string& patterns) {
+            // Each rule goes under its least shared token
+            std::unordered_map<uint64_t, uint32_t> tokenUses;
+            for (const auto& rule : rules) {
+                for (auto [offset, length] : rule.tokens) tokenUses[hashToken(rule.pattern, offset, length)]++;
+            }
+            std::vector<std::pair<uint64_t, uint32_t>> hostKeys;
+            std::vector<std::pair<uint64_t, uint32_t>> tokenKeys;
+            std::vector<uint32_t> untokened;
+            for (uint32_t id = 0; id < rules.size(); ++id) {
+                const Rule& rule = rules[id];
+                if (rule.filter.flags & HOST_KEYED) {
+                    hostKeys.push_back({rule.hostKey, id});
+                    continue;
+                }
+                uint64_t best = 0;
+                uint32_t bestUses = UINT32_MAX;
+                size_t bestLength = 0;
+                for (auto [offset, length] : rule.tokens) {
+                    uint64_t key = hashToken(rule.pattern, offset, length);
+                    uint32_t uses = tokenUses[key];
+                    if (uses < bestUses || (uses == bestUses && length > bestLength)) {
+                        best = key;
+                        bestUses = uses;
+                        bestLength = length;
+                    }
+                }
+                if (bestUses == UINT32_MAX) {
+                    untokened.push_back(id);
+                } else {
+                    tokenKeys.push_back({best, id});
+                }
+            }
+            // Filters are stored in table order, so a slot leads straight
+            // to its own
+            set = RuleSet();
+            set.filters.reserve(rules.size());
+            fill(set, set.hosts, hostKeys, patterns);
+            fill(set, set.tokens, tokenKeys, patterns);
+            for (uint32_t id : untokened) set.untokened.push_back(add(set, rules[id], patterns));
+            set.indexUntokened();
+            rules.clear();
+        }
+        
+    private:
+        void fill(RuleSet& set, Table& table, std::vector<std::pair<uint64_t, uint32_t>>& keys, std::string& patterns) {
+            std::sort(keys.begin(), keys.end());
+            size_t distinct = 0;
+            for (size_t i = 0; i < keys.size(); ++i) distinct += i == 0 || keys[i].first != keys[i - 1].first;
+            size_t capacity = 16;
+            while (capacity < distinct * 2) capacity *= 2;
+            table.slots.assign(capacity, Slot{0, 0, 0});
+            size_t mask = capacity - 1;
+            for (size_t i = 0; i < keys.size();) {
+                uint32_t begin = static_cast<uint32_t>(set.filters.size());
+                size_t end = i;
+                while (end < keys.size() && keys[end].first == keys[i].first) add(set, rules[keys[end++].second], patterns);
+                size_t slot = static_cast<size_t>(keys[i].first) & mask;
+                while (table.slots[slot].count != 0) slot = (slot + 1) & mask;
+                table.slots[slot] = {keys[i].first, begin, static_cast<uint32_t>(end - i)};
+                i = end;
+            }
+            table.index();
+        }
+        
+        static uint32_t add(RuleSet& set, const Rule& rule, std::string& patterns) {
+            Filter filter = rule.filter;
+            filter.patternLength = static_cast<uint32_t>(rule.pattern.size());
+            if (rule.pattern.size() <= kInlinePattern) {
+                std::memcpy(filter.text, rule.pattern.data(), rule.pattern.size());
+            } else {
+                filter.pattern = static_cast<uint32_t>(patterns.size());
+                patterns += rule.pattern;
+            }
+            set.filters.push_back(filter);
+            return static_cast<uint32_t>(set.filters.size() - 1);
+        }
+    };
+    
+    enum class Parsed { NOTHING, BLOCKING, EXCEPTION, SKIPPED };
+    
+    // Everything about a request the filters look at, computed once: the
+    // host's suffix keys and the URL's token keys are shared by the
+    // blocking, exception and $important passes. What only party and
+    // $domain options look at is worked out when a rule first asks.
+    struct Context {
+        static constexpr size_t kBufferSize = 512;
+        static constexpr size_t kMaxLabels = 16;
+        static constexpr size_t kMaxTokens = 32;
+        
+        char buffer[kBufferSize];
+        std::string spill;  // for longer URLs with capitals
+        std::string_view url;       // lowercased
+        std::string_view original;  // for $match-case
+        size_t hostBegin = 0;
+        size_t hostEnd = 0;
+        uint32_t typeBit = 0;
+        std::string_view sourceHost;
+        uint64_t hostKeys[kMaxLabels];  // of each suffix of the host, longest first
+        size_t hostKeyCount = 0;
+        bool hostKeysComplete = true;
+        uint64_t tokenKeys[kMaxTokens];  // of the URL's first tokens
+        size_t tokenKeyCount = 0;
+        size_t tokensEnd = 0;  // where the tokens not kept start
+        
+        bool prepare(const Request& request) {
+            // Most URLs have no capitals and are used as they are
+            url = request.url;
+            original = request.url;
+            size_t upper = 0;
+            while (upper < url.size() && !(url[upper] >= 'A' && url[upper] <= 'Z')) upper++;
+            if (upper < url.size()) {
+                char* lowered = buffer;
+                if (request.url.size() > kBufferSize) {
+                    spill.resize(request.url.size());
+                    lowered = spill.data();
+                }
+                std::memcpy(lowered, request.url.data(), upper);
+                for (size_t i = upper; i < request.url.size(); ++i) lowered[i] = toLower(request.url[i]);
+                url = std::string_view(lowered, request.url.size());
+            }
+            
+            ParsedUrl parsed = UrlParser::parse(url);
+            if (!parsed.valid || parsed.host.empty()) return false;
+            hostBegin = static_cast<size_t>(parsed.host.data() - url.data());
+            hostEnd = hostBegin + parsed.host.size();
+            typeBit = 1u << static_cast<uint32_t>(request.type);
+            
+            hostKeyCount = 0;
+            hostKeysComplete = true;
+            forEachSuffix(host(), [this](uint64_t key, size_t) {
+                if (hostKeyCount < kMaxLabels) {
+                    hostKeys[hostKeyCount++] = key;
+                } else {
+                    hostKeysComplete = false;
+                }
+            });
+            tokenKeyCount = 0;
+            tokensEnd = 0;
+            while (tokensEnd < url.size() && tokenKeyCount < kMaxTokens) {
+                if (!isTokenChar(url[tokensEnd])) {
+                    tokensEnd++;
+                    continue;
+                }
+                size_t end = tokensEnd;
+                while (end < url.size() && isTokenChar(url[end])) end++;
+                tokenKeys[tokenKeyCount++] = hashToken(url, tokensEnd, end - tokensEnd);
+                tokensEnd = end;
+            }
+            
+            sourceHost = request.sourceHost;
+            sourceLowered = false;
+            sourceKeysReady = false;
+            partyKnown = false;
+            return true;
+        }
+        
+        std::string_view host() const { return url.substr(hostBegin, hostEnd - hostBegin); }
+        
+        bool isThirdParty() const {
+            if (!partyKnown) {
+                std::string_view source = lowerSource();
+                thirdParty = !source.empty() && UrlParser::siteOf(source) != UrlParser::siteOf(host());
+                partyKnown = true;
+            }
+            return thirdParty;
+        }
+        
+        // Hashes of each suffix of the source host
+        const uint64_t* sourceKeys(size_t& count) const {
+            if (!sourceKeysReady) {
+                sourceKeyCount = 0;
+                forEachSuffix(lowerSource(), [this](uint64_t key, size_t) {
+                    if (sourceKeyCount < kMaxLabels) sourceKeyStore[sourceKeyCount++] = key;
+                });
+                sourceKeysReady = true;
+            }
+            count = sourceKeyCount;
+            return sourceKeyStore;
+        }
+        
+    private:
+        mutable char source[256];
+        mutable size_t sourceLength = 0;
+        mutable bool sourceLowered = false;
+        mutable uint64_t sourceKeyStore[kMaxLabels];
+        mutable size_t sourceKeyCount = 0;
+        mutable bool sourceKeysReady = false;
+        mutable bool partyKnown = false;
+        mutable bool thirdParty = false;
+        
+        std::string_view lowerSource() const {
+            if (!sourceLowered) {
+                sourceLength = std::min(sourceHost.size(), sizeof(source));
+                for (size_t i = 0; i < sourceLength; ++i) source[i] = toLower(sourceHost[i]);
+                sourceLowered = true;
+            }
+            return std::string_view(source, sourceLength);
+        }
+    };
+    
+    static constexpr char kMagic[4] = {'N', 'C', 'F', 'L'};
+    static constexpr uint64_t kVersion = 2;  // 2: filters hold short patterns and are stored in table order
+    static constexpr uint32_t kAllTypes = (1u << 12) - 1;
+    static constexpr uint32_t kDefaultTypes = kAllTypes & ~(1u << static_cast<uint32_t>(ResourceType::DOCUMENT));
+    static constexpr uint64_t kExcludedDomain = 1ull << 63;  // flag on optionDomains entries
+    
+    RuleSet block;
+    RuleSet allow;
+    std::string patterns;
+    std::vector<uint64_t> optionDomains;
+    bool hasImportant = false;
+    
+    static char toLower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+    
+    static bool isTokenChar(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%' || (c >= 'A' && c <= 'Z');
+    }
+    
+    // What `^` matches: anything but a letter, digit or one of _-.%
+    static bool isSeparator(char c) {
+        return !isTokenChar(c) && c != '_' && c != '-' && c != '.';
+    }
+    
+    static uint64_t hashToken(std::string_view text, size_t offset, size_t length) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = offset; i < offset + length; ++i) {
+            hash = (hash ^ static_cast<uint8_t>(toLower(text[i]))) * 1099511628211ull;
+        }
+        return hash | 1;  // never 0
+    }
+    
+    // Calls fn(key, offset) for the host and each parent domain, hashing from
+    // the right so every suffix costs one extra step
+    template <typename Fn>
+    static void forEachSuffix(std::string_view host, Fn&& fn) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = host.size(); i > 0; --i) {
+            hash = (hash ^ static_cast<uint8_t>(host[i - 1])) * 1099511628211ull;
+            if (i == 1 || host[i - 2] == '.') fn(hash | 1, i - 1);
+        }
+    }
+    
+    static uint64_t hostKey(std::string_view domain) {
+        uint64_t key = 0;
+        forEachSuffix(domain, [&](uint64_t suffixKey, size_t offset) {
+            if (offset == 0) key = suffixKey;
+        });
+        return key;
+    }
+    
+    Parsed parseLine(std::string_view line, Builder& blocking, Builder& exceptions) {
+        while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back()))) line.remove_suffix(1);
+        while (!line.empty() && std::isspace(static_cast<unsigned char>(line.front()))) line.remove_prefix(1);
+        if (line.empty() || line[0] == '!' || line[0] == '[') return Parsed::NOTHING;
+        // Element hiding and scriptlets are for the page, not the network
+        if (line.find('#') != std::string_view::npos &&
+            (line.find("##") != std::string_view::npos || line.find("#@#") != std::string_view::npos ||
+             line.find("#?#") != std::string_view::npos || line.find("#$#") != std::string_view::npos)) {
+            return Parsed::SKIPPED;
+        }
+        
+        bool exception = line.substr(0, 2) == "@@";
+        if (exception) line.remove_prefix(2);
+        Rule rule;
+        rule.filter = Filter{0, 0, static_cast<uint32_t>(optionDomains.size()), 0, kDefaultTypes, 0, {}};
+        size_t dollar = line.rfind('$');
+        if (dollar != std::string_view::npos && !(line.size() > 1 && line.front() == '/' && line.back() == '/')) {
+            if (!parseOptions(line.substr(dollar + 1), rule.filter)) {
+                optionDomains.resize(rule.filter.domains);
+                return Parsed::SKIPPED;
+            }
+            line = line.substr(0, dollar);
+        }
+        if (line.size() > 1 && line.front() == '/' && line.back() == '/') {
+            optionDomains.resize(rule.filter.domains);
+            return Parsed::SKIPPED;  // regular expressions
+        }
+        
+        if (line.substr(0, 2) == "||") {
+            rule.filter.flags |= HOST;
+            line.remove_prefix(2);
+        } else if (line.substr(0, 1) == "|") {
+            rule.filter.flags |= START;
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && line.back() == '|') {
+            rule.filter.flags |= END;
+            line.remove_suffix(1);
+        }
+        // Leading and trailing wildcards only undo anchoring
+        while (!line.empty() && line.front() == '*') {
+            rule.filter.flags &= ~static_cast<uint32_t>(START | HOST);
+            line.remove_prefix(1);
+        }
+        while (!line.empty() && line.back() == '*') {
+            rule.filter.flags &= ~static_cast<uint32_t>(END);
+            line.remove_suffix(1);
+        }
+        rule.pattern.assign(line);
+        if (!(rule.filter.flags & MATCH_CASE)) {
+            for (auto& c : rule.pattern) c = toLower(c);
+        }
+        
+        if (rule.filter.flags & HOST) {
+            size_t domainEnd = 0;
+            while (domainEnd < rule.pattern.size() &&
+                   (isTokenChar(rule.pattern[domainEnd]) || rule.pattern[domainEnd] == '.' ||
+                    rule.pattern[domainEnd] == '-' || rule.pattern[domainEnd] == '_')) {
+                domainEnd++;
+            }
+            // Only a whole host name can be looked up by its suffixes
+            char next = domainEnd < rule.pattern.size() ? rule.pattern[domainEnd] : '\0';
+            if (domainEnd > 0 && rule.pattern[domainEnd - 1] != '.' && (next == '^' || next == '/' || next == ':' ||
+                                                                         (next == '\0' && (rule.filter.flags & END)))) {
+                std::string domain = rule.pattern.substr(0, domainEnd);
+                for (auto& c : domain) c = toLower(c);
+                rule.hostKey = hostKey(domain);
+                rule.filter.flags |= HOST_KEYED;
+                rule.pattern.erase(0, domainEnd);
+            }
+        }
+        if (!(rule.filter.flags & HOST_KEYED)) collectTokens(rule);
+        if (!exception && (rule.filter.flags & IMPORTANT)) hasImportant = true;
+        (exception ? exceptions : blocking).rules.push_back(std::move(rule));
+        return exception ? Parsed::EXCEPTION : Parsed::BLOCKING;
+    }
+    
+    // Tokens that a matching URL must contain whole: not next to a wildcard,
+    // and not at an unanchored end of the pattern
+    static void collectTokens(Rule& rule) {
+        const std::string& pattern = rule.pattern;
+        for (size_t i = 0; i < pattern.size();) {
+            if (!isTokenChar(pattern[i])) {
+                i++;
+                continue;
+            }
+            size_t end = i;
+            while (end < pattern.size() && isTokenChar(pattern[end])) end++;
+            bool startBounded = i > 0 ? pattern[i - 1] != '*' : (rule.filter.flags & (START | HOST)) != 0;
+            bool endBounded = end < pattern.size() ? pattern[end] != '*' : (rule.filter.flags & END) != 0;
+            if (startBounded && endBounded) rule.tokens.push_back({i, end - i});
+            i = end;
+        }
+    }
+    
+    bool parseOptions(std::string_view options, Filter& filter) {
+        static const std::pair<std::string_view, ResourceType> kTypeNames[] = {
+            {"script", ResourceType::SCRIPT}, {"image", ResourceType::IMAGE}, {"stylesheet", ResourceType::STYLESHEET},
+            {"css", ResourceType::STYLESHEET}, {"object", ResourceType::OBJECT},
+            {"xmlhttprequest", ResourceType::XMLHTTPREQUEST}, {"xhr", ResourceType::XMLHTTPREQUEST},
+            {"subdocument", ResourceType::SUBDOCUMENT}, {"frame", ResourceType::SUBDOCUMENT},
+            {"document", ResourceType::DOCUMENT}, {"doc", ResourceType::DOCUMENT}, {"font", ResourceType::FONT},
+            {"media", ResourceType::MEDIA}, {"websocket", ResourceType::WEBSOCKET}, {"ping", ResourceType::PING},
+            {"other", ResourceType::OTHER}};
+        uint32_t included = 0;
+        uint32_t excluded = 0;
+        while (!options.empty()) {
+            size_t comma = options.find(',');
+            std::string_view option = options.substr(0, comma);
+            options = comma == std::string_view::npos ? std::string_view() : options.substr(comma + 1);
+            bool negated = !option.empty() && option[0] == '~';
+            if (negated) option.remove_prefix(1);
+            
+            if (option == "third-party" || option == "3p") {
+                filter.flags |= negated ? FIRST_PARTY : THIRD_PARTY;
+            } else if (option == "first-party" || option == "1p") {
+                filter.flags |= negated ? THIRD_PARTY : FIRST_PARTY;
+            } else if (option == "important" && !negated) {
+                filter.flags |= IMPORTANT;
+            } else if (option == "match-case" && !negated) {
+                filter.flags |= MATCH_CASE;
+            } else if ((option.substr(0, 7) == "domain=" || option.substr(0, 5) == "from=") && !negated) {
+                std::string_view domains = option.substr(option.find('=') + 1);
+                while (!domains.empty()) {
+                    size_t bar = domains.find('|');
+                    std::string domain(domains.substr(0, bar));
+                    domains = bar == std::string_view::npos ? std::string_view() : domains.substr(bar + 1);
+                    bool exclude = !domain.empty() && domain[0] == '~';
+                    if (exclude) domain.erase(0, 1);
+                    if (domain.empty() || domain.find('*') != std::string::npos) return false;
+                    for (auto& c : domain) c = toLower(c);
+                    optionDomains.push_back((hostKey(domain) & ~kExcludedDomain) | (exclude ? kExcludedDomain : 0));
+                    filter.domainCount++;
+                }
+            } else {
+                auto type = std::find_if(std::begin(kTypeNames), std::end(kTypeNames),
+                                         [option](const auto& name) { return name.first == option; });
+                // Rules for popups, redirects and the like do not block requests
+                if (type == std::end(kTypeNames)) return false;
+                (negated ? excluded : included) |= 1u << static_cast<uint32_t>(type->second);
+            }
+        }
+        if (included) filter.types = included;
+        else if (excluded) filter.types = kDefaultTypes & ~excluded;
+        return filter.types != 0;
+    }
+    
+    // The first filter of `set` matching the request
+    const Filter* findMatch(const RuleSet& set, const Context& context, bool importantOnly) const {
+        const Filter* match = nullptr;
+        auto check = [&](const Table& table, uint64_t key, size_t at) {
+            const Slot* slot = table.find(key);
+            if (!slot) return false;
+            for (uint32_t i = slot->begin; i < slot->begin + slot->count; ++i) {
+                const Filter& filter = set.filters[i];
+                if (importantOnly && !(filter.flags & IMPORTANT)) continue;
+                if (matches(filter, context, at)) {
+                    match = &filter;
+                    return true;
+                }
+            }
+            return false;
+        };
+        if (context.hostKeysComplete) {
+            for (size_t k = 0; k < context.hostKeyCount; ++k) {
+                if (check(set.hosts, context.hostKeys[k], context.hostEnd)) return match;
+            }
+        } else {
+            bool found = false;
+            forEachSuffix(context.host(), [&](uint64_t key, size_t) {
+                if (!found) found = check(set.hosts, key, context.hostEnd);
+            });
+            if (found) return match;
+        }
+        
+        for (size_t k = 0; k < context.tokenKeyCount; ++k) {
+            if (check(set.tokens, context.tokenKeys[k], 0)) return match;
+        }
+        std::string_view url = context.url;
+        for (size_t i = context.tokensEnd; i < url.size();) {
+            if (!isTokenChar(url[i])) {
+                i++;
+                continue;
+            }
+            size_t end = i;
+            while (end < url.size() && isTokenChar(url[end])) end++;
+            if (check(set.tokens, hashToken(url, i, end - i), 0)) return match;
+            i = end;
+        }
+        for (size_t k = 0; k < set.untokened.size(); ++k) {
+            if (!(set.untokenedTypes[k] & context.typeBit)) continue;
+            const Filter& filter = set.filters[set.untokened[k]];
+            if ((!importantOnly || (filter.flags & IMPORTANT)) && matches(filter, context, 0)) return &filter;
+        }
+        return nullptr;
+    }
+    
+    // `at` is where a HOST_KEYED filter's pattern must start
+    bool matches(const Filter& filter, const Context& context, size_t at) const {
+        if (!(filter.types & context.typeBit)) return false;
+        if ((filter.flags & THIRD_PARTY) && !context.isThirdParty()) return false;
+        if ((filter.flags & FIRST_PARTY) && context.isThirdParty()) return false;
+        if (filter.domainCount > 0 && !matchesSourceDomain(filter, context)) return false;
+        
+        std::string_view pattern = patternOf(filter);
+        std::string_view url = (filter.flags & MATCH_CASE) ? context.original : context.url;
+        if (filter.flags & HOST_KEYED) return matchesAt(pattern, url, at, filter.flags & END);
+        if (filter.flags & START) return matchesAt(pattern, url, 0, filter.flags & END);
+        if (filter.flags & HOST) {
+            // At the start of the host or of any of its labels
+            for (size_t at = context.hostBegin; at < context.hostEnd; ++at) {
+                if ((at == context.hostBegin || url[at - 1] == '.') && matchesAt(pattern, url, at, filter.flags & END)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        char first = pattern.empty() ? '^' : pattern[0];
+        for (size_t at = 0; at <= url.size(); ++at) {
+            if ((first == '^' || (at < url.size() && url[at] == first)) && matchesAt(pattern, url, at, filter.flags & END)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    std::string_view patternOf(const Filter& filter) const {
+        if (filter.patternLength <= kInlinePattern) return std::string_view(filter.text, filter.patternLength);
+        return std::string_view(patterns.data() + filter.pattern, filter.patternLength);
+    }
+    
+    bool matchesSourceDomain(const Filter& filter, const Context& context) const {
+        size_t sourceKeyCount = 0;
+        const uint64_t* sourceKeys = context.sourceKeys(sourceKeyCount);
+        bool anyIncluded = false;
+        bool included = false;
+        for (uint32_t i = filter.domains; i < filter.domains + filter.domainCount; ++i) {
+            uint64_t entry = optionDomains[i];
+            uint64_t key = entry & ~kExcludedDomain;
+            bool hit = false;
+            for (size_t k = 0; k < sourceKeyCount && !hit; ++k) hit = (sourceKeys[k] & ~kExcludedDomain) == key;
+            if (entry & kExcludedDomain) {
+                if (hit) return false;
+            } else {
+                anyIncluded = true;
+                included = included || hit;
+            }
+        }
+        return !anyIncluded || included;
+    }
+    
+    // Whether `pattern` (with * and ^) matches url from `at`, through the end
+    // if `anchoredEnd`. Segments between wildcards match leftmost-first.
+    static bool matchesAt(std::string_view pattern, std::string_view url, size_t at, bool anchoredEnd) {
+        size_t star = pattern.find('*');
+        std::string_view first = pattern.substr(0, star);
+        size_t length = 0;
+        if (!segmentAt(first, url, at, length)) return false;
+        at += length;
+        if (star == std::string_view::npos) return !anchoredEnd || at == url.size();
+        
+        pattern.remove_prefix(star + 1);
+        while (true) {
+            star = pattern.find('*');
+            std::string_view segment = pattern.substr(0, star);
+            if (star == std::string_view::npos && anchoredEnd) {
+                // The last segment has to end the URL
+                for (size_t from = at; from <= url.size(); ++from) {
+                    if (segmentAt(segment, url, from, length) && from + length == url.size()) return true;
+                }
+                return false;
+            }
+            bool found = false;
+            for (size_t from = at; from <= url.size(); ++from) {
+                if (segmentAt(segment, url, from, length)) {
+                    at = from + length;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) return false;
+            if (star == std::string_view::npos) return true;
+            pattern.remove_prefix(star + 1);
+        }
+    }
+    
+    // A wildcard-free run of the pattern at exactly `at`; `^` may match the
+    // end of the URL, consuming nothing
+    static bool segmentAt(std::string_view segment, std::string_view url, size_t at, size_t& length) {
+        size_t position = at;
+        for (size_t i = 0; i < segment.size(); ++i) {
+            char c = segment[i];
+            if (position == url.size()) {
+                if (c != '^') return false;
+                continue;
+            }
+            if (c == '^' ? !isSeparator(url[position]) : c != url[position]) return false;
+            position++;
+        }
+        length = position - at;
+        return true;
+    }
+    
+    template <typename T>
+    static void writeArray(ByteWriter& writer, const std::vector<T>& values) {
+        writer.writeString(std::string_view(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T)));
+    }
+    
+    template <typename T>
+    static bool readArray(ByteReader& reader, std::vector<T>& values) {
+        std::string_view bytes = reader.readStringView();
+        if (!reader.ok() || bytes.size() % sizeof(T) != 0) return false;
+        values.resize(bytes.size() / sizeof(T));
+        if (!bytes.empty()) std::memcpy(values.data(), bytes.data(), bytes.size());
+        return true;
+    }
+    
+    static void writeRules(ByteWriter& writer, const RuleSet& set) {
+        writeArray(writer, set.filters);
+        writeArray(writer, set.hosts.slots);
+        writeArray(writer, set.tokens.slots);
+        writeArray(writer, set.untokened);
+    }
+    
+    static bool readRules(ByteReader& reader, RuleSet& set) {
+        bool read = readArray(reader, set.filters) && readArray(reader, set.hosts.slots) &&
+                    readArray(reader, set.tokens.slots) && readArray(reader, set.untokened);
+        set.hosts.index();
+        set.tokens.index();
+        set.indexUntokened();
+        return read;
+    }
+    
+    // Every offset in a loaded blob points inside its arrays
+    bool isConsistent(const RuleSet& set) const {
+        for (const auto& filter : set.filters) {
+            if ((filter.patternLength > kInlinePattern &&
+                 static_cast<uint64_t>(filter.pattern) + filter.patternLength > patterns.size()) ||
+                static_cast<uint64_t>(filter.domains) + filter.domainCount > optionDomains.size()) {
+                return false;
+            }
+        }
+        for (const Table* table : {&set.hosts, &set.tokens}) {
+            if (!table->slots.empty() && (table->slots.size() & (table->slots.size() - 1)) != 0) return false;
+            bool hasEmpty = table->slots.empty();
+            for (const auto& slot : table->slots) {
+                hasEmpty = hasEmpty || slot.count == 0;
+                if (static_cast<uint64_t>(slot.begin) + slot.count > set.filters.size()) return false;
+            }
+            if (!hasEmpty) return false;
+        }
+        for (uint32_t id : set.untokened) {
+            if (id >= set.filters.size()) return false;
+        }
+        return true;
+    }
+};
+
+// Cookies for every window. Each cookie is stored under the top-level site
+// it was set from (its partition), so a tracker embedded on two sites sees
+// two unrelated jars, and grouped with the other cookies of its own site in
+// one bucket: a lookup hashes the partition and the request's site once and
+// filters that bucket by precomputed domain keys. Buckets are spread over
+// shards with a lock each, so concurrent page loads rarely meet. Changes to
+// persistent cookies are queued per shard and appended to a journal in
+// batches by a timer; the journal is rewritten from the live cookies once it
+// is mostly superseded records. Until open() is called nothing is written.
+class CookieJar {
+public:
+    using Clock = std::chrono::system_clock;
+    
+    enum class SameSite : uint8_t { UNSPECIFIED, NONE, LAX, STRICT };
+    
+    struct Cookie {
+        std::string name;
+        std::string value;
+        std::string domain;
+        std::string path;
+        int64_t expires = 0;  // unix seconds, 0 for session cookies
+        int64_t created = 0;
+        int64_t lastAccess = 0;
+        bool hostOnly = true;
+        bool secure = false;
+        bool httpOnly = false;
+        SameSite sameSite = SameSite::UNSPECIFIED;
+    };
+    
+    // Where a request is made or a response received
+    struct Context {
+        std::string_view url;
+        std::string_view topLevelSite;  // host of the tab's page, empty for none
+        bool partitioned = true;        // false keeps every site's cookies in one jar
+    };
+    
+    struct Limits {
+        size_t perSite;  // within one partition
+        size_t total;    // exceeding it evicts the least recently used down to 90%
+    };
+    
+    struct Stats {
+        size_t cookies = 0;
+        uint64_t evicted = 0;
+        uint64_t journalBytes = 0;
+    };
+    
+    static CookieJar& instance() {
+        static CookieJar jar;
+        return jar;
+    }
+    
+    CookieJar(const CookieJar&) = delete;
+    CookieJar& operator=(const CookieJar&) = delete;
+    
+    ~CookieJar() {
+        if (TimerId timer = flushTimer.exchange(0)) TimerWheel::instance().cancel(timer);
+        flush();
+    }
+    
+    static int64_t nowSeconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(Clock::now().time_since_epoch()).count();
+    }
+    
+    // Loads the cookies saved at `file` and keeps it up to date from now on;
+    // an empty file name goes back to memory only. Cookies set before are
+    // kept, so this belongs at startup.
+    bool open(const std::string& file) {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        path.clear();
+        persistent.store(false, std::memory_order_relaxed);
+        if (file.empty()) return true;
+        std::error_code error;
+        bool loaded = !fs::exists(file, error) || load(file);
+        if (!loaded) NOVA_LOG_WARN(PRIVACY, "Cookie file " << file << " is damaged, keeping what could be read");
+        path = file;
+        persistent.store(true, std::memory_order_relaxed);
+        // Starts the journal over with just the live cookies
+        if (!compact()) {
+            NOVA_LOG_ERROR(PRIVACY, "Could not write cookies to " << file << ", keeping them in memory");
+            path.clear();
+            persistent.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        NOVA_LOG_INFO(PRIVACY, "Opened cookie jar at " << file << ": " << size() << " cookies");
+        return loaded;
+    }
+    
+    void setLimits(Limits newLimits) {
+        perSiteLimit.store(std::max<size_t>(newLimits.perSite, 1), std::memory_order_relaxed);
+        totalLimit.store(std::max<size_t>(newLimits.total, 1), std::memory_order_relaxed);
+    }
+    
+    Limits getLimits() const {
+        return {perSiteLimit.load(std::memory_order_relaxed), totalLimit.load(std::memory_order_relaxed)};
+    }
+    
+    // Stores the cookie from a Set-Cookie header value, following RFC 6265
+    // with the SameSite and Secure rules browsers apply on top of it
+    bool setCookie(const Context& context, std::string_view header, int64_t now = nowSeconds()) {
+        Target target;
+        Cookie cookie;
+        if (!target.prepare(context) || !parseSetCookie(header, target, now, cookie)) return false;
+        
+        uint64_t key = bucketKey(target.partition, target.site);
+        Shard& shard = shardFor(key);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Bucket* bucket = bucketFor(shard, key, target.partition, target.site);
+            if (!bucket) return false;
+            auto existing = find(*bucket, cookie);
+            if (existing != bucket->entries.end()) {
+                // A page without TLS may not replace what one with TLS set
+                if (existing->cookie.secure && !target.secure) return false;
+                cookie.created = existing->cookie.created;
+                remove(shard, *bucket, existing);
+            }
+            // An expiry in the past only deletes
+            if (cookie.expires != 0 && cookie.expires <= now) {
+                if (bucket->entries.empty()) shard.buckets.erase(key);
+                scheduleFlush();
+                return true;
+            }
+            uint64_t domain = hashOf(cookie.domain);
+            insert(shard, *bucket, Entry{std::move(cookie), domain});
+            size_t perSite = perSiteLimit.load(std::memory_order_relaxed);
+            while (bucket->entries.size() > perSite) {
+                remove(shard, *bucket, leastRecentlyUsed(*bucket, now));
+                evictedCount.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (cookieCount.load(std::memory_order_relaxed) > totalLimit.load(std::memory_order_relaxed)) purge(now);
+        scheduleFlush();
+        return true;
+    }
+    
+    // The Cookie header value for a request: longest paths first, then oldest
+    std::string cookieHeader(const Context& context, int64_t now = nowSeconds()) {
+        Target target;
+        std::string header;
+        if (!target.prepare(context)) return header;
+        uint64_t key = bucketKey(target.partition, target.site);
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.buckets.find(key);
+        if (it == shard.buckets.end() || it->second.partition != target.partition || it->second.site != target.site) {
+            return header;
+        }
+        // Matches are gathered first so the header grows once per batch
+        const Cookie* matched[kHeaderBatch];
+        size_t count = 0;
+        for (Entry& entry : it->second.entries) {
+            Cookie& cookie = entry.cookie;
+            bool domainMatches = cookie.hostOnly ? entry.domainKey == target.hostKey
+                                                 : std::find(target.suffixKeys, target.suffixKeys + target.suffixCount,
+                                                             entry.domainKey) != target.suffixKeys + target.suffixCount;
+            if (!domainMatches || (cookie.expires != 0 && cookie.expires <= now) || (cookie.secure && !target.secure) ||
+                (target.crossSite && cookie.sameSite != SameSite::NONE) || !pathMatches(target.path, cookie.path)) {
+                continue;
+            }
+            cookie.lastAccess = now;
+            matched[count++] = &cookie;
+            if (count == kHeaderBatch) {
+                appendPairs(header, matched, count);
+                count = 0;
+            }
+        }
+        appendPairs(header, matched, count);
+        return header;
+    }
+    
+    void clear() {
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            cookieCount.fetch_sub(shard.cookies, std::memory_order_relaxed);
+            shard.cookies = 0;
+            shard.buckets.clear();
+            shard.pending = ByteWriter();
+            pendingRecords.fetch_sub(std::exchange(shard.pendingRecords, 0), std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(fileMutex);
+        compact();
+    }
+    
+    // Writes queued changes now rather than when the flush timer fires
+    bool flush() {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        flushScheduled.store(false, std::memory_order_relaxed);
+        if (path.empty()) return true;
+        uint64_t queued = pendingRecords.load(std::memory_order_relaxed);
+        if (queued == 0) return true;
+        if (journalRecords + queued > 2 * cookieCount.load(std::memory_order_relaxed) + kCompactionSlack) {
+            return compact();
+        }
+        
+        ByteWriter batch;
+        uint64_t records = 0;
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> shardLock(shard.mutex);
+            if (shard.pendingRecords == 0) continue;
+            const auto& bytes = shard.pending.data();
+            batch.writeBytes(bytes.data(), bytes.size());
+            records += shard.pendingRecords;
+            pendingRecords.fetch_sub(std::exchange(shard.pendingRecords, 0), std::memory_order_relaxed);
+            shard.pending = ByteWriter();
+        }
+        std::FILE* file = std::fopen(path.c_str(), "ab");
+        bool written = file && writeFrame(file, batch.data());
+        if (file) written = std::fclose(file) == 0 && written;
+        if (!written) {
+            NOVA_LOG_ERROR(PRIVACY, "Could not append to cookie journal " << path);
+            return false;
+        }
+        journalRecords += records;
+        journalBytes += batch.size();
+        return true;
+    }
+    
+    size_t size() const { return cookieCount.load(std::memory_order_relaxed); }
+    
+    Stats stats() const {
+        Stats result;
+        result.cookies = size();
+        result.evicted = evictedCount.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(fileMutex);
+        result.journalBytes = journalBytes;
+        return result;
+    }
+    
+private:
+    struct Entry {
+        Cookie cookie;
+        uint64_t domainKey;
+    };
+    
+    // The cookies of one site within one partition, longest path first, then oldest
+    struct Bucket {
+        std::string partition;
+        std::string site;
+        std::vector<Entry> entries;
+    };
+    
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Bucket> buckets;
+        ByteWriter pending;  // journal records not yet written
+        uint64_t pendingRecords = 0;
+        size_t cookies = 0;
+    };
+    
+    // A request's URL and partition, lowercased and hashed once
+    struct Target {
+        static constexpr size_t kMaxLabels = 32;
+        
+        char hostBuffer[256];
+        char partitionBuffer[256];
+        std::string_view host;
+        std::string_view site;
+        std::string_view partition;
+        std::string_view path;
+        uint64_t hostKey = 0;
+        uint64_t suffixKeys[kMaxLabels];  // the host and its parents down to the site
+        size_t suffixCount = 0;
+        bool secure = false;
+        bool crossSite = false;
+        bool isIp = false;
+        
+        bool prepare(const Context& context) {
+            ParsedUrl parsed = UrlParser::parse(context.url);
+            if (!parsed.valid || !parsed.isHttp() || parsed.host.empty() || parsed.host.size() > sizeof(hostBuffer) ||
+                context.topLevelSite.size() > sizeof(partitionBuffer)) {
+                return false;
+            }
+            host = lowercase(parsed.host, hostBuffer);
+            site = UrlParser::siteOf(host);
+            path = parsed.path.empty() ? std::string_view("/") : parsed.path;
+            secure = ParsedUrl::equalsIgnoreCase(parsed.scheme, "https");
+            isIp = parsed.isIpv6 || (!host.empty() && host.back() >= '0' && host.back() <= '9');
+            std::string_view topLevelSite = UrlParser::siteOf(lowercase(context.topLevelSite, partitionBuffer));
+            crossSite = !topLevelSite.empty() && topLevelSite != site;
+            partition = context.partitioned ? topLevelSite : std::string_view();
+            
+            uint64_t hash = kHashSeed;
+            for (size_t i = host.size(); i > 0; --i) {
+                hash = (hash ^ static_cast<uint8_t>(host[i - 1])) * kHashPrime;
+                if ((i == 1 || host[i - 2] == '.') && host.size() - (i - 1) >= site.size() &&
+                    suffixCount < kMaxLabels) {
+                    suffixKeys[suffixCount++] = hash;
+                }
+            }
+            hostKey = hash;
+            return true;
+        }
+        
+        static std::string_view lowercase(std::string_view text, char* buffer) {
+            for (size_t i = 0; i < text.size(); ++i) {
+                char c = text[i];
+                buffer[i] = c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+            }
+            return std::string_view(buffer, text.size());
+        }
+    };
+    
+    enum Record : uint8_t { SET = 1, REMOVE = 2 };
+    
+    static constexpr size_t kShards = 64;
+    static constexpr uint64_t kHashSeed = 14695981039346656037ull;
+    static constexpr uint64_t kHashPrime = 1099511628211ull;
+    static constexpr char kMagic[4] = {'N', 'C', 'K', 'J'};
+    static constexpr uint64_t kVersion = 1;
+    static constexpr uint64_t kCompactionSlack = 1024;
+    static constexpr size_t kMaxCookieBytes = 4096;
+    static constexpr size_t kHeaderBatch = 64;
+    static constexpr int64_t kMaxLifetime = 400 * 86400;  // seconds, as browsers cap it
+    static constexpr std::chrono::seconds kFlushDelay{2};
+    
+    Shard shards[kShards];
+    std::atomic<size_t> cookieCount{0};
+    std::atomic<uint64_t> pendingRecords{0};
+    std::atomic<uint64_t> evictedCount{0};
+    std::atomic<size_t> perSiteLimit{180};
+    std::atomic<size_t> totalLimit{3300};
+    std::atomic<bool> persistent{false};
+    std::atomic<bool> flushScheduled{false};
+    std::atomic<TimerId> flushTimer{0};
+    std::mutex purgeMutex;
+    
+    mutable std::mutex fileMutex;  // guards the journal and the fields below
+    std::string path;
+    uint64_t journalRecords = 0;
+    uint64_t journalBytes = 0;
+    
+    // Flushes run on the timer thread, which must outlive the jar
+    CookieJar() { TimerWheel::instance(); }
+    
+    // FNV-1a from the right, so the keys of a host's suffixes come for free
+    static uint64_t hashOf(std::string_view text) {
+        uint64_t hash = kHashSeed;
+        for (size_t i = text.size(); i > 0; --i) hash = (hash ^ static_cast<uint8_t>(text[i - 1])) * kHashPrime;
+        return hash;
+    }
+    
+    static uint64_t bucketKey(std::string_view partition, std::string_view site) {
+        return hashOf(partition) * 0x9E3779B97F4A7C15ull ^ hashOf(site);
+    }
+    
+    Shard& shardFor(uint64_t key) { return shards[(key >> 40) % kShards]; }
+    
+    // Null in the unlikely case that another partition and site share the key
+    static Bucket* bucketFor(Shard& shard, uint64_t key, std::string_view partition, std::string_view site) {
+        auto [it, added] = shard.buckets.try_emplace(key);
+        if (added) {
+            it->second.partition.assign(partition);
+            it->second.site.assign(site);
+        } else if (it->second.partition != partition || it->second.site != site) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+    
+    static std::vector<Entry>::iterator find(Bucket& bucket, const Cookie& cookie) {
+        return std::find_if(bucket.entries.begin(), bucket.entries.end(), [&](const Entry& entry) {
+            return entry.cookie.name == cookie.name && entry.cookie.domain == cookie.domain &&
+                   entry.cookie.path == cookie.path;
+        });
+    }
+    
+    // Expired cookies go first
+    static std::vector<Entry>::iterator leastRecentlyUsed(Bucket& bucket, int64_t now) {
+        return std::min_element(bucket.entries.begin(), bucket.entries.end(), [now](const Entry& a, const Entry& b) {
+            return evictionRank(a.cookie, now) < evictionRank(b.cookie, now);
+        });
+    }
+    
+    static int64_t evictionRank(const Cookie& cookie, int64_t now) {
+        return cookie.expires != 0 && cookie.expires <= now ? INT64_MIN : cookie.lastAccess;
+    }
+    
+    void insert(Shard& shard, Bucket& bucket, Entry entry) {
+        size_t pathLength = entry.cookie.path.size();
+        int64_t created = entry.cookie.created;
+        auto position = std::find_if(bucket.entries.begin(), bucket.entries.end(), [&](const Entry& other) {
+            return other.cookie.path.size() < pathLength ||
+                   (other.cookie.path.size() == pathLength && other.cookie.created > created);
+        });
+        if (entry.cookie.expires != 0) queueRecord(shard, SET, bucket.partition, entry.cookie);
+        bucket.entries.insert(position, std::move(entry));
+        shard.cookies++;
+        cookieCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    void remove(Shard& shard, Bucket& bucket, std::vector<Entry>::iterator entry) {
+        if (entry->cookie.expires != 0) queueRecord(shard, REMOVE, bucket.partition, entry->cookie);
+        bucket.entries.erase(entry);
+        shard.cookies--;
+        cookieCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+    
+    void queueRecord(Shard& shard, Record record, std::string_view partition, const Cookie& cookie) {
+        if (!persistent.load(std::memory_order_relaxed)) return;
+        writeRecord(shard.pending, record, partition, cookie);
+        shard.pendingRecords++;
+        pendingRecords.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    static void writeRecord(ByteWriter& writer, Record record, std::string_view partition, const Cookie& cookie) {
+        writer.writeU8(record);
+        writer.writeString(partition);
+        writer.writeString(cookie.domain);
+        writer.writeString(cookie.name);
+        writer.writeString(cookie.path);
+        if (record != SET) return;
+        writer.writeString(cookie.value);
+        writer.writeVarint(static_cast<uint64_t>(cookie.expires));
+        writer.writeVarint(static_cast<uint64_t>(cookie.created));
+        writer.writeVarint(static_cast<uint64_t>(cookie.lastAccess));
+        writer.writeU8(static_cast<uint8_t>(cookie.hostOnly | cookie.secure << 1 | cookie.httpOnly << 2 |
+                                            static_cast<uint8_t>(cookie.sameSite) << 3));
+    }
+    
+    void scheduleFlush() {
+        if (!persistent.load(std::memory_order_relaxed) || flushScheduled.exchange(true)) return;
+        flushTimer = TimerWheel::instance().schedule(kFlushDelay, [this] { flush(); },
+                                                     TimerWheel::Clock::duration::zero(), std::chrono::seconds(1));
+    }
+    
+    // Evicts the least recently used cookies of all partitions down to 90% of
+    // the total, so the scan is paid once per tenth of the limit
+    void purge(int64_t now) {
+        std::lock_guard<std::mutex> purgeLock(purgeMutex);
+        size_t limit = totalLimit.load(std::memory_order_relaxed);
+        if (cookieCount.load(std::memory_order_relaxed) <= limit) return;
+        std::vector<int64_t> ranks;
+        ranks.reserve(cookieCount.load(std::memory_order_relaxed));
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto& [key, bucket] : shard.buckets) {
+                for (const Entry& entry : bucket.entries) ranks.push_back(evictionRank(entry.cookie, now));
+            }
+        }
+        size_t keep = limit - limit / 10;
+        if (ranks.size() <= keep) return;
+        size_t excess = ranks.size() - keep;
+        std::nth_element(ranks.begin(), ranks.begin() + static_cast<std::ptrdiff_t>(excess - 1), ranks.end());
+        int64_t cutoff = ranks[excess - 1];
+        // Cookies at the cutoff are evicted only until the excess is gone
+        size_t belowCutoff = static_cast<size_t>(
+            std::count_if(ranks.begin(), ranks.begin() + static_cast<std::ptrdiff_t>(excess),
+                          [cutoff](int64_t rank) { return rank < cutoff; }));
+        size_t atCutoff = excess - belowCutoff;
+        
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+                Bucket& bucket = it->second;
+                for (auto entry = bucket.entries.begin(); entry != bucket.entries.end();) {
+                    int64_t rank = evictionRank(entry->cookie, now);
+                    if (rank < cutoff || (rank == cutoff && atCutoff > 0)) {
+                        if (rank == cutoff) atCutoff--;
+                        if (entry->cookie.expires != 0) queueRecord(shard, REMOVE, bucket.partition, entry->cookie);
+                        entry = bucket.entries.erase(entry);
+                        shard.cookies--;
+                        cookieCount.fetch_sub(1, std::memory_order_relaxed);
+                        evictedCount.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        ++entry;
+                    }
+                }
+                it = bucket.entries.empty() ? shard.buckets.erase(it) : std::next(it);
+            }
+        }
+    }
+    
+    // Replays the journal at `file` into the shards. A torn last batch is
+    // dropped quietly; other damaged batches are skipped and reported.
+    bool load(const std::string& file) {
+        std::error_code error;
+        auto size = fs::file_size(file, error);
+        std::FILE* input = error ? nullptr : std::fopen(file.c_str(), "rb");
+        if (!input) return false;
+        std::vector<uint8_t> bytes(static_cast<size_t>(size));
+        bool complete = std::fread(bytes.data(), 1, bytes.size(), input) == bytes.size();
+        std::fclose(input);
+        if (!complete) return false;
+        
+        ByteReader reader(bytes);
+        if (reader.readStringView() != std::string_view(kMagic, sizeof(kMagic)) || reader.readVarint() != kVersion) {
+            return false;
+        }
+        int64_t now = nowSeconds();
+        bool intact = true;
+        while (reader.ok() && !reader.atEnd()) {
+            std::string_view frame = reader.readStringView();
+            uint64_t checksum = reader.readVarint();
+            if (!reader.ok()) break;
+            if (checksum != hashOf(frame)) {
+                intact = false;
+                continue;
+            }
+            ByteReader records(reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+            while (records.ok() && !records.atEnd() && replay(records, now)) {}
+            intact = intact && records.ok() && records.atEnd();
+        }
+        return intact;
+    }
+    
+    bool replay(ByteReader& reader, int64_t now) {
+        auto record = static_cast<Record>(reader.readU8());
+        std::string_view partition = reader.readStringView();
+        Cookie cookie;
+        cookie.domain = reader.readString();
+        cookie.name = reader.readString();
+        cookie.path = reader.readString();
+        if (record == SET) {
+            cookie.value = reader.readString();
+            cookie.expires = static_cast<int64_t>(reader.readVarint());
+            cookie.created = static_cast<int64_t>(reader.readVarint());
+            cookie.lastAccess = static_cast<int64_t>(reader.readVarint());
+            uint8_t flags = reader.readU8();
+            cookie.hostOnly = flags & 1;
+            cookie.secure = flags & 2;
+            cookie.httpOnly = flags & 4;
+            cookie.sameSite = static_cast<SameSite>((flags >> 3) & 3);
+        }
+        if (!reader.ok() || (record != SET && record != REMOVE)) return false;
+        
+        std::string_view site = UrlParser::siteOf(cookie.domain);
+        uint64_t key = bucketKey(partition, site);
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Bucket* bucket = bucketFor(shard, key, partition, site);
+        if (!bucket) return true;
+        auto existing = find(*bucket, cookie);
+        if (existing != bucket->entries.end()) remove(shard, *bucket, existing);
+        if (record == SET && cookie.expires > now) {
+            uint64_t domain = hashOf(cookie.domain);
+            insert(shard, *bucket, Entry{std::move(cookie), domain});
+        }
+        if (bucket->entries.empty()) shard.buckets.erase(key);
+        return true;
+    }
+    
+    static bool writeFrame(std::FILE* file, const std::vector<uint8_t>& frame) {
+        ByteWriter header;
+        header.writeVarint(frame.size());
+        ByteWriter trailer;
+        trailer.writeVarint(hashOf(std::string_view(reinterpret_cast<const char*>(frame.data()), frame.size())));
+        return std::fwrite(header.data().data(), 1, header.size(), file) == header.size() &&
+               std::fwrite(frame.data(), 1, frame.size(), file) == frame.size() &&
+               std::fwrite(trailer.data().data(), 1, trailer.size(), file) == trailer.size();
+    }
+    
+    // Rewrites the journal as one batch per shard of live persistent cookies;
+    // queued changes are part of the snapshot. Call with fileMutex held.
+    bool compact() {
+        if (path.empty()) return true;
+        std::string temporary = path + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file) return false;
+        ByteWriter header;
+        header.writeString(std::string_view(kMagic, sizeof(kMagic)));
+        header.writeVarint(kVersion);
+        bool written = std::fwrite(header.data().data(), 1, header.size(), file) == header.size();
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        for (Shard& shard : shards) {
+            ByteWriter batch;
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                for (const auto& [key, bucket] : shard.buckets) {
+                    for (const Entry& entry : bucket.entries) {
+                        if (entry.cookie.expires == 0) continue;
+                        writeRecord(batch, SET, bucket.partition, entry.cookie);
+                        records++;
+                    }
+                }
+                pendingRecords.fetch_sub(std::exchange(shard.pendingRecords, 0), std::memory_order_relaxed);
+                shard.pending = ByteWriter();
+            }
+            if (batch.size() == 0) continue;
+            written = written && writeFrame(file, batch.data());
+            bytes += batch.size();
+        }
+        written = std::fclose(file) == 0 && written;
+        std::error_code error;
+        if (written) fs::rename(temporary, path, error);
+        if (!written || error) {
+            NOVA_LOG_ERROR(PRIVACY, "Could not rewrite cookie journal " << path);
+            return false;
+        }
+        journalRecords = records;
+        journalBytes = bytes;
+        return true;
+    }
+    
+    // Adds "name=value" for each cookie, separated by "; "
+    static void appendPairs(std::string& header, const Cookie* const* cookies, size_t count) {
+        size_t length = header.size();
+        for (size_t i = 0; i < count; ++i) length += cookies[i]->name.size() + cookies[i]->value.size() + 3;
+        if (count == 0) return;
+        size_t at = header.size();
+        header.resize(length - (at == 0 ? 2 : 0));
+        char* out = header.data() + at;
+        for (size_t i = 0; i < count; ++i) {
+            if (out != header.data()) {
+                *out++ = ';';
+                *out++ = ' ';
+            }
+            std::memcpy(out, cookies[i]->name.data(), cookies[i]->name.size());
+            out += cookies[i]->name.size();
+            *out++ = '=';
+            std::memcpy(out, cookies[i]->value.data(), cookies[i]->value.size());
+            out += cookies[i]->value.size();
+        }
+    }
+    
+    static std::string_view trim(std::string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+        return text;
+    }
+    
+    // RFC 6265 5.2, with the Secure and SameSite requirements of its successor
+    static bool parseSetCookie(std::string_view header, Target& target, int64_t now, Cookie& cookie) {
+        size_t semicolon = header.find(';');
+        std::string_view pair = header.substr(0, semicolon);
+        size_t equals = pair.find('=');
+        if (equals == std::string_view::npos) return false;
+        std::string_view name = trim(pair.substr(0, equals));
+        std::string_view value = trim(pair.substr(equals + 1));
+        if (name.empty() || name.size() + value.size() > kMaxCookieBytes) return false;
+        cookie.name.assign(name);
+        cookie.value.assign(value);
+        
+        std::string_view attributes = semicolon == std::string_view::npos ? std::string_view() : header.substr(semicolon + 1);
+        std::string_view domain;
+        bool hasMaxAge = false;
+        bool hasExpires = false;
+        int64_t maxAge = 0;
+        int64_t expires = 0;
+        while (!attributes.empty()) {
+            semicolon = attributes.find(';');
+            std::string_view attribute = attributes.substr(0, semicolon);
+            attributes = semicolon == std::string_view::npos ? std::string_view() : attributes.substr(semicolon + 1);
+            equals = attribute.find('=');
+            std::string_view key = trim(attribute.substr(0, equals));
+            std::string_view argument = equals == std::string_view::npos ? std::string_view() : trim(attribute.substr(equals + 1));
+            
+            if (ParsedUrl::equalsIgnoreCase(key, "expires")) {
+                hasExpires = parseCookieDate(argument, expires) || hasExpires;
+            } else if (ParsedUrl::equalsIgnoreCase(key, "max-age")) {
+                int64_t seconds = 0;
+                auto [end, error] = std::from_chars(argument.data(), argument.data() + argument.size(), seconds);
+                if (!argument.empty() && end == argument.data() + argument.size()) {
+                    hasMaxAge = true;
+                    maxAge = error == std::errc() ? seconds : argument[0] == '-' ? 0 : kMaxLifetime;
+                }
+            } else if (ParsedUrl::equalsIgnoreCase(key, "domain")) {
+                if (!argument.empty() && argument[0] == '.') argument.remove_prefix(1);
+                if (!argument.empty()) domain = argument;
+            } else if (ParsedUrl::equalsIgnoreCase(key, "path")) {
+                if (!argument.empty() && argument[0] == '/') cookie.path.assign(argument);
+            } else if (ParsedUrl::equalsIgnoreCase(key, "secure")) {
+                cookie.secure = true;
+            } else if (ParsedUrl::equalsIgnoreCase(key, "httponly")) {
+                cookie.httpOnly = true;
+            } else if (ParsedUrl::equalsIgnoreCase(key, "samesite")) {
+                cookie.sameSite = ParsedUrl::equalsIgnoreCase(argument, "none")     ? SameSite::NONE
+                                  : ParsedUrl::equalsIgnoreCase(argument, "lax")    ? SameSite::LAX
+                                  : ParsedUrl::equalsIgnoreCase(argument, "strict") ? SameSite::STRICT
+                                                                                    : SameSite::UNSPECIFIED;
+            }
+        }
+        // Max-Age wins over Expires; either in the past makes a deletion
+        if (hasMaxAge) {
+            cookie.expires = maxAge <= 0 ? 1 : now + std::min(maxAge, kMaxLifetime);
+        } else if (hasExpires) {
+            cookie.expires = std::clamp<int64_t>(expires, 1, now + kMaxLifetime);
+        }
+        
+        if (!domain.empty()) {
+            if (domain.size() > sizeof(target.partitionBuffer)) return false;
+            char lowered[sizeof(target.partitionBuffer)];
+            std::string_view lower = Target::lowercase(domain, lowered);
+            // Only the host itself or a parent within its site
+            bool matches = lower == target.host || (!target.isIp && target.host.size() > lower.size() &&
+                                                    target.host.compare(target.host.size() - lower.size(),
+                                                                        lower.size(), lower) == 0 &&
+                                                    target.host[target.host.size() - lower.size() - 1] == '.');
+            if (!matches || lower.size() < target.site.size()) return false;
+            cookie.domain.assign(lower);
+            cookie.hostOnly = false;
+        } else {
+            cookie.domain.assign(target.host);
+            cookie.hostOnly = true;
+        }
+        if (cookie.path.empty()) cookie.path.assign(defaultPath(target.path));
+        
+        if (cookie.secure && !target.secure) return false;
+        if (cookie.sameSite == SameSite::NONE && !cookie.secure) return false;
+        // A cross-site response may only set cookies meant for cross-site use
+        if (target.crossSite && cookie.sameSite != SameSite::NONE) return false;
+        cookie.created = now;
+        cookie.lastAccess = now;
+        return true;
+    }
+    
+    // The request path up to its last '/', or "/"
+    static std::string_view defaultPath(std::string_view requestPath) {
+        size_t slash = requestPath.rfind('/');
+        if (requestPath.empty() || requestPath[0] != '/' || slash == 0) return "/";
+        return requestPath.substr(0, slash);
+    }
+    
+    static bool pathMatches(std::string_view requestPath, std::string_view cookiePath) {
+        if (requestPath.compare(0, cookiePath.size(), cookiePath) != 0) return false;
+        return requestPath.size() == cookiePath.size() || cookiePath.back() == '/' ||
+               requestPath[cookiePath.size()] == '/';
+    }
+    
+    // RFC 6265 5.1.1: the first time, day, month and year found among the
+    // date's tokens, in whatever order they come
+    static bool parseCookieDate(std::string_view text, int64_t& seconds) {
+        static const char* const kMonths[] = {"jan", "feb", "mar", "apr", "may", "jun",
+                                              "jul", "aug", "sep", "oct", "nov", "dec"};
+        int hour = -1, minute = 0, second = 0, day = -1, month = -1, year = -1;
+        auto isDelimiter = [](char c) {
+            auto byte = static_cast<unsigned char>(c);
+            return byte == 0x09 || (byte >= 0x20 && byte <= 0x2F) || (byte >= 0x3B && byte <= 0x40) ||
+                   (byte >= 0x5B && byte <= 0x60) || (byte >= 0x7B && byte <= 0x7E);
+        };
+        // Leading digits of `token` if there are min..max of them
+        auto number = [](std::string_view token, size_t min, size_t max, int& value) {
+            size_t digits = 0;
+            while (digits < token.size() && token[digits] >= '0' && token[digits] <= '9') digits++;
+            if (digits < min || digits > max) return std::string_view::npos;
+            value = 0;
+            for (size_t i = 0; i < digits; ++i) value = value * 10 + (token[i] - '0');
+            return digits;
+        };
+        
+        for (size_t i = 0; i < text.size();) {
+            if (isDelimiter(text[i])) {
+                i++;
+                continue;
+            }
+            size_t end = i;
+            while (end < text.size() && !isDelimiter(text[end])) end++;
+            std::string_view token = text.substr(i, end - i);
+            i = end;
+            
+            // hh:mm:ss, each one or two digits
+            int value = 0;
+            size_t digits = number(token, 1, 2, value);
+            if (hour < 0 && digits != std::string_view::npos && digits < token.size() && token[digits] == ':') {
+                int h = value, m = 0, s = 0;
+                std::string_view rest = token.substr(digits + 1);
+                size_t minuteDigits = number(rest, 1, 2, m);
+                if (minuteDigits != std::string_view::npos && minuteDigits < rest.size() && rest[minuteDigits] == ':' &&
+                    number(rest.substr(minuteDigits + 1), 1, 2, s) != std::string_view::npos) {
+                    hour = h;
+                    minute = m;
+                    second = s;
+                    continue;
+                }
+            }
+            if (day < 0 && digits != std::string_view::npos) {
+                day = value;
+                continue;
+            }
+            if (month < 0 && token.size() >= 3) {
+                for (int k = 0; k < 12; ++k) {
+                    if (ParsedUrl::equalsIgnoreCase(token.substr(0, 3), kMonths[k])) month = k + 1;
+                }
+                if (month > 0) continue;
+            }
+            if (year < 0 && number(token, 2, 4, value) != std::string_view::npos) year = value;
+        }
+        if (year >= 70 && year <= 99) year += 1900;
+        if (year >= 0 && year <= 69) year += 2000;
+        if (hour < 0 || day < 1 || day > 31 || month < 1 || year < 1601 || hour > 23 || minute > 59 || second > 59) {
+            return false;
+        }
+        seconds = daysFromCivil(year, static_cast<unsigned>(month), static_cast<unsigned>(day)) * 86400 +
+                  hour * 3600 + minute * 60 + second;
+        return true;
+    }
+    
+    // Days since 1970-01-01 of a proleptic Gregorian date
+    static int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        auto yearOfEra = static_cast<unsigned>(year - era * 400);
+        unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+    }
+};
+
+// Sequential reads of a file through a fixed buffer, so a parser sees a
+// window of it at a time however large the file is
+class ChunkedReader {
+public:
+    explicit ChunkedReader(const std::string& path) : file(std::fopen(path.c_str(), "rb")) {
+        std::error_code error;
+        uintmax_t size = file ? fs::file_size(path, error) : 0;
+        total = error ? 0 : static_cast<uint64_t>(size);
+    }
+    ~ChunkedReader() {
+        if (file) std::fclose(file);
+    }
+    
+    ChunkedReader(const ChunkedReader&) = delete;
+    ChunkedReader& operator=(const ChunkedReader&) = delete;
+    
+    bool ok() const { return file != nullptr; }
+    
+    // The next byte, or -1 at the end
+    int get() {
+        if (at == end && !fill()) return -1;
+        return static_cast<unsigned char>(buffer[at++]);
+    }
+    
+    int peek() {
+        if (at == end && !fill()) return -1;
+        return static_cast<unsigned char>(buffer[at]);
+    }
+    
+    // Appends up to `count` bytes to `out`; false if the file ends first
+    bool read(std::string& out, size_t count) {
+        while (count > 0) {
+            if (at == end && !fill()) return false;
+            size_t take = std::min(count, end - at);
+            out.append(buffer.data() + at, take);
+            at += take;
+            count -= take;
+        }
+        return true;
+    }
+    
+    uint64_t position() const { return consumed - (end - at); }
+    uint64_t size() const { return total; }
+    
+private:
+    static constexpr size_t kBufferSize = 64 * 1024;
+    
+    std::FILE* file;
+    std::vector<char> buffer = std::vector<char>(kBufferSize);
+    size_t at = 0;
+    size_t end = 0;
+    uint64_t consumed = 0;
+    uint64_t total = 0;
+    
+    bool fill() {
+        if (!file) return false;
+        end = std::fread(buffer.data(), 1, buffer.size(), file);
+        at = 0;
+        consumed += end;
+        return end > 0;
+    }
+};
+
+// Buffered sequential writes; close() reports whether everything reached the file
+class ChunkedWriter {
+public:
+    explicit ChunkedWriter(const std::string& path) : file(std::fopen(path.c_str(), "wb")), failed(!file) {
+        buffer.reserve(kBufferSize);
+    }
+    ~ChunkedWriter() { close(); }
+    
+    ChunkedWriter(const ChunkedWriter&) = delete;
+    ChunkedWriter& operator=(const ChunkedWriter&) = delete;
+    
+    bool ok() const { return !failed; }
+    
+    void write(std::string_view text) {
+        buffer.append(text);
+        if (buffer.size() >= kBufferSize) flush();
+    }
+    
+    void put(char c) {
+        buffer.push_back(c);
+        if (buffer.size() >= kBufferSize) flush();
+    }
+    
+    uint64_t written() const { return flushed + buffer.size(); }
+    
+    bool close() {
+        if (!file) return !failed;
+        flush();
+        failed = std::fclose(file) != 0 || failed;
+        file = nullptr;
+        return !failed;
+    }
+    
+private:
+    static constexpr size_t kBufferSize = 64 * 1024;
+    
+    std::FILE* file;
+    bool failed;
+    std::string buffer;
+    uint64_t flushed = 0;
+    
+    void flush() {
+        if (file && !failed && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) failed = true;
+        flushed += buffer.size();
+        buffer.clear();
+    }
+};
+
+// Pull parser for JSON read through a ChunkedReader. Only the current
+// string is held, so memory does not grow with the document; a string
+// longer than kMaxString is an error.
+class JsonReader {
+public:
+    enum class Token { BEGIN_OBJECT, END_OBJECT, BEGIN_ARRAY, END_ARRAY, KEY, STRING, NUMBER, LITERAL, END, ERROR };
+    
+    explicit JsonReader(ChunkedReader& input) : input(input) {}
+    
+    // After KEY, STRING, NUMBER or LITERAL (true, false, null), text() holds it
+    Token next() {
+        if (failed) return Token::ERROR;
+        int c = skipSeparators();
+        if (c < 0) return containers.empty() && started ? Token::END : fail();
+        started = true;
+        bool key = !containers.empty() && containers.back() == '{' && expectKey;
+        if (key && c != '"' && c != '}') return fail();
+        switch (c) {
+            case '{':
+            case '[':
+                containers.push_back(static_cast<char>(c));
+                expectKey = c == '{';
+                return c == '{' ? Token::BEGIN_OBJECT : Token::BEGIN_ARRAY;
+            case '}':
+            case ']':
+                if (containers.empty() || containers.back() != (c == '}' ? '{' : '[')) return fail();
+                containers.pop_back();
+                expectKey = !containers.empty() && containers.back() == '{';
+                return c == '}' ? Token::END_OBJECT : Token::END_ARRAY;
+            case '"':
+                if (!readString()) return fail();
+                if (key) {
+                    if (skipWhitespace() != ':') return fail();
+                    expectKey = false;
+                    return Token::KEY;
+                }
+                expectKey = true;
+                return Token::STRING;
+            default:
+                if (c != '-' && !std::isalnum(c)) return fail();
+                current.assign(1, static_cast<char>(c));
+                while (std::isalnum(input.peek()) || input.peek() == '.' || input.peek() == '-' || input.peek() == '+') {
+                    current.push_back(static_cast<char>(input.get()));
+                }
+                expectKey = true;
+                return c == '-' || std::isdigit(c) ? Token::NUMBER : Token::LITERAL;
+        }
+    }
+    
+    const std::string& text() const { return current; }
+    size_t depth() const { return containers.size(); }
+    
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            out.push_back(static_cast<char>(0xc0 | (code >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        } else if (code < 0x10000) {
+            out.push_back(static_cast<char>(0xe0 | (code >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        } else {
+            out.push_back(static_cast<char>(0xf0 | (code >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+    }
+    
+    // Skips the value whose first token was just read
+    bool skipValue(Token first) {
+        if (first != Token::BEGIN_OBJECT && first != Token::BEGIN_ARRAY) return first != Token::ERROR;
+        size_t target = containers.size() - 1;
+        while (containers.size() > target) {
+            if (next() == Token::ERROR) return false;
+        }
+        return true;
+    }
+    
+private:
+    static constexpr size_t kMaxString = 16 * 1024 * 1024;
+    
+    ChunkedReader& input;
+    std::string current;
+    std::vector<char> containers;  // '{' or '[' for each open one
+    bool expectKey = false;
+    bool started = false;
+    bool failed = false;
+    
+    Token fail() {
+        failed = true;
+        return Token::ERROR;
+    }
+    
+    int skipWhitespace() {
+        int c = input.get();
+        while (c == ' ' || c == '\n' || c == '\r' || c == '\t') c = input.get();
+        return c;
+    }
+    
+    int skipSeparators() {
+        int c = skipWhitespace();
+        while (c == ',') c = skipWhitespace();
+        return c;
+    }
+    
+    bool readString() {
+        current.clear();
+        for (;;) {
+            int c = input.get();
+            if (c < 0 || current.size() > kMaxString) return false;
+            if (c == '"') return true;
+            if (c != '\\') {
+                current.push_back(static_cast<char>(c));
+                continue;
+            }
+            switch (c = input.get()) {
+                case 'b': current.push_back('\b'); break;
+                case 'f': current.push_back('\f'); break;
+                case 'n': current.push_back('\n'); break;
+                case 'r': current.push_back('\r'); break;
+                case 't': current.push_back('\t'); break;
+                case 'u': {
+                    uint32_t code = 0;
+                    if (!readHex(code)) return false;
+                    // A surrogate pair spells one code point in two escapes
+                    if (code >= 0xd800 && code < 0xdc00 && input.peek() == '\\') {
+                        input.get();
+                        uint32_t low = 0;
+                        if (input.get() != 'u' || !readHex(low)) return false;
+                        if (low >= 0xdc00 && low < 0xe000) {
+                            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                        } else {
+                            appendUtf8(current, code);
+                            code = low;
+                        }
+                    }
+                    appendUtf8(current, code);
+                    break;
+                }
+                default:
+                    if (c < 0) return false;
+                    current.push_back(static_cast<char>(c));
+            }
+        }
+    }
+    
+    bool readHex(uint32_t& code) {
+        for (int i = 0; i < 4; ++i) {
+            int c = input.get();
+            if (!std::isxdigit(c)) return false;
+            code = code * 16 + static_cast<uint32_t>(std::isdigit(c) ? c - '0' : std::tolower(c) - 'a' + 10);
+        }
+        return true;
+    }
+};
+
+// The engine's session on disk: a journal of checkpoints, each one frame
+// holding the records that changed since the one before. A record is a
+// byte string under a 64-bit key. Putting a record with the fingerprint it
+// was last written with writes nothing, and keys that are not put again
+// during a checkpoint are removed. Loading maps the file and replays the
+// frames with later records replacing earlier ones, and drops a torn last
+// frame. A frame keeps its records' keys and lengths in a checksummed index
+// ahead of their bytes, and each record carries its own checksum, checked
+// when the record is first read; so opening reads the indexes, not every
+// record. Once the journal is more than twice the size of its live
+// records, the next checkpoint rewrites it.
+class SessionJournal {
+public:
+    using Key = uint64_t;
+    
+    struct Stats {
+        size_t records = 0;
+        uint64_t liveBytes = 0;     // of the current records
+        uint64_t journalBytes = 0;  // of the file
+        size_t lastWritten = 0;     // records the last checkpoint wrote or removed
+        uint64_t lastBytes = 0;     // and the bytes it took
+    };
+    
+    SessionJournal() = default;
+    SessionJournal(const SessionJournal&) = delete;
+    SessionJournal& operator=(const SessionJournal&) = delete;
+    
+    // Maps the journal at `file` and checkpoints there from then on; a file
+    // that does not exist yet is an empty session. False if the file is not
+    // a session journal or cannot be read.
+    bool open(const std::string& file) {
+        path.clear();
+        entries.clear();
+        loaded.clear();
+        mapping.close();
+        journalBytes = 0;
+        liveBytes = 0;
+        highestKey = 0;
+        rewriteNext = false;
+        
+        std::error_code error;
+        if (!fs::exists(file, error)) {
+            path = file;
+            return true;
+        }
+        if (!mapping.open(file)) return false;
+        ByteReader reader(mapping.data(), mapping.size());
+        if (reader.readStringView() != std::string_view(kMagic, sizeof(kMagic)) || reader.readVarint() != kVersion) {
+            mapping.close();
+            return false;
+        }
+        
+        bool intact = true;
+        while (reader.ok() && !reader.atEnd()) {
+            std::string_view frame = reader.readStringView();
+            uint64_t checksum = reader.readVarint();
+            if (!reader.ok()) break;
+            ByteReader parts(reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+            std::string_view index = parts.readStringView();
+            if (!parts.ok() || checksum != fingerprintOf(index)) {
+                intact = false;
+                continue;
+            }
+            std::string_view bodies = frame.substr(static_cast<size_t>(index.data() + index.size() - frame.data()));
+            intact = readIndex(index, bodies) && intact;
+        }
+        // Appending after damage would hide the new frames behind it
+        intact = intact && reader.ok();
+        rewriteNext = !intact;
+        if (!intact) NOVA_LOG_WARN(ENGINE, "Session " << file << " has damaged checkpoints; restoring what is left");
+        journalBytes = mapping.size();
+        path = file;
+        return true;
+    }
+    
+    bool isOpen() const { return !path.empty(); }
+    const std::string& getPath() const { return path; }
+    
+    // A record read by open(), until the first checkpoint begins; nothing
+    // if it is not there or fails its checksum
+    std::optional<std::string_view> loadedRecord(Key key) const {
+        auto it = loaded.find(key);
+        if (it == loaded.end()) return std::nullopt;
+        if (fingerprintOf(it->second.bytes) != it->second.checksum) {
+            NOVA_LOG_WARN(ENGINE, "Session " << path << " has a damaged record " << key);
+            return std::nullopt;
+        }
+        return it->second.bytes;
+    }
+    
+    // The highest key open() read, for picking new ones
+    Key highestLoadedKey() const { return highestKey; }
+    
+    // Marks a loaded record as what its owner would write now
+    void restored(Key key, uint64_t fingerprint) {
+        auto it = loaded.find(key);
+        if (it == loaded.end()) return;
+        it->second.entry.fingerprint = fingerprint;
+        it->second.entry.written = true;
+    }
+    
+    void begin() {
+        // Loaded records become entries only now, so that opening does
+        // not index them twice
+        entries.reserve(entries.size() + loaded.size());
+        for (const auto& [key, record] : loaded) entries[key] = record.entry;
+        loaded.clear();
+        mapping.close();
+        generation++;
+        pendingIndex = ByteWriter();
+        pendingBodies = ByteWriter();
+        pendingRecords = 0;
+        rewriting = rewriteNext || journalBytes > 2 * liveBytes + kMinRewriteBytes;
+    }
+    
+    // Adds the record under `key` to the checkpoint; write(ByteWriter&) is
+    // called only if `fingerprint` differs from the one last written
+    template <typename Write>
+    void put(Key key, uint64_t fingerprint, Write&& write) {
+        Entry& entry = entries[key];
+        entry.generation = generation;
+        if (!rewriting && entry.written && entry.fingerprint == fingerprint) return;
+        size_t start = pendingBodies.size();
+        write(pendingBodies);
+        size_t size = pendingBodies.size() - start;
+        std::string_view bytes(reinterpret_cast<const char*>(pendingBodies.data().data()) + start, size);
+        pendingIndex.writeU8(PUT);
+        pendingIndex.writeVarint(key);
+        pendingIndex.writeVarint(size);
+        pendingIndex.writeVarint(fingerprintOf(bytes));
+        pendingRecords++;
+        liveBytes = liveBytes - entry.bytes + size;
+        entry.bytes = size;
+        entry.fingerprint = fingerprint;
+        entry.written = true;
+    }
+    
+    // Removes the records that were not put and writes the checkpoint out
+    bool commit() {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->second.generation == generation) {
+                ++it;
+                continue;
+            }
+            if (!rewriting) {
+                pendingIndex.writeU8(REMOVE);
+                pendingIndex.writeVarint(it->first);
+                pendingRecords++;
+            }
+            liveBytes -= it->second.bytes;
+            it = entries.erase(it);
+        }
+        lastWritten = pendingRecords;
+        lastBytes = pendingIndex.size() + pendingBodies.size();
+        bool written = rewriting ? rewrite() : append();
+        pendingIndex = ByteWriter();
+        pendingBodies = ByteWriter();
+        // What was not written has to be written next time
+        rewriteNext = !written;
+        if (!written) NOVA_LOG_ERROR(ENGINE, "Could not write session checkpoint to " << path);
+        return written;
+    }
+    
+    Stats stats() const {
+        Stats result;
+        result.records = entries.size() + loaded.size();
+        result.liveBytes = liveBytes;
+        result.journalBytes = journalBytes;
+        result.lastWritten = lastWritten;
+        result.lastBytes = lastBytes;
+        return result;
+    }
+    
+    // FNV-1a folded a word at a time, since whole checkpoints run through it;
+    // also how owners fingerprint records they have no revision for
+    static uint64_t fingerprintOf(std::string_view bytes) {
+        uint64_t hash = 14695981039346656037ull ^ bytes.size();
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes.data() + i, sizeof(word));
+            hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+            hash ^= hash >> 32;
+        }
+        for (; i < bytes.size(); ++i) hash = (hash ^ static_cast<uint8_t>(bytes[i])) * 1099511628211ull;
+        return hash;
+    }
+    
+private:
+    enum RecordKind : uint8_t { PUT = 1, REMOVE = 2 };
+    
+    struct Entry {
+        uint64_t fingerprint = 0;
+        uint64_t bytes = 0;
+        uint64_t generation = 0;
+        bool written = false;
+    };
+    
+    struct LoadedRecord {
+        std::string_view bytes;  // into the mapping
+        uint64_t checksum = 0;
+        Entry entry;
+    };
+    
+    static constexpr char kMagic[4] = {'N', 'S', 'E', 'S'};
+    static constexpr uint64_t kVersion = 4;  // 4: frames index their records, which carry their own checksums
+    static constexpr uint64_t kMinRewriteBytes = 64 * 1024;
+    
+    std::string path;
+    std::unordered_map<Key, Entry> entries;
+    std::unordered_map<Key, LoadedRecord> loaded;  // until begin()
+    MappedFile mapping;
+    Key highestKey = 0;
+    uint64_t journalBytes = 0;
+    uint64_t liveBytes = 0;
+    uint64_t generation = 0;
+    ByteWriter pendingIndex;
+    ByteWriter pendingBodies;
+    size_t pendingRecords = 0;
+    bool rewriting = false;
+    bool rewriteNext = false;
+    size_t lastWritten = 0;
+    uint64_t lastBytes = 0;
+    
+    static ByteWriter header() {
+        ByteWriter writer;
+        writer.writeString(std::string_view(kMagic, sizeof(kMagic)));
+        writer.writeVarint(kVersion);
+        return writer;
+    }
+    
+    // Replays one frame's index over the loaded records; false if it does
+    // not account for the frame's bytes
+    bool readIndex(std::string_view index, std::string_view bodies) {
+        // An index entry takes at least four bytes
+        loaded.reserve(loaded.size() + index.size() / 4);
+        ByteReader reader(reinterpret_cast<const uint8_t*>(index.data()), index.size());
+        size_t offset = 0;
+        while (reader.ok() && !reader.atEnd()) {
+            auto kind = static_cast<RecordKind>(reader.readU8());
+            Key key = reader.readVarint();
+            highestKey = std::max(highestKey, key);
+            if (kind == REMOVE) {
+                auto it = loaded.find(key);
+                if (it != loaded.end()) {
+                    liveBytes -= it->second.entry.bytes;
+                    loaded.erase(it);
+                }
+                continue;
+            }
+            uint64_t size = reader.readVarint();
+            uint64_t checksum = reader.readVarint();
+            if (kind != PUT || size > bodies.size() - offset) return false;
+            LoadedRecord& record = loaded[key];
+            liveBytes = liveBytes - record.entry.bytes + size;
+            record.bytes = bodies.substr(offset, static_cast<size_t>(size));
+            record.checksum = checksum;
+            record.entry.bytes = size;
+            offset += static_cast<size_t>(size);
+        }
+        return reader.ok() && offset == bodies.size();
+    }
+    
+    // A frame is its index, then the records' bytes; the checksum after it
+    // covers the index
+    bool writeFrame(std::FILE* file, uint64_t& written) {
+        const auto& index = pendingIndex.data();
+        const auto& bodies = pendingBodies.data();
+        ByteWriter lengths;
+        ByteWriter indexLength;
+        indexLength.writeVarint(index.size());
+        lengths.writeVarint(indexLength.size() + index.size() + bodies.size());
+        lengths.writeBytes(indexLength.data().data(), indexLength.size());
+        ByteWriter checksum;
+        checksum.writeVarint(fingerprintOf(std::string_view(reinterpret_cast<const char*>(index.data()), index.size())));
+        bool complete = true;
+        for (const auto* part : {&lengths.data(), &index, &bodies, &checksum.data()}) {
+            complete = std::fwrite(part->data(), 1, part->size(), file) == part->size() && complete;
+            written += part->size();
+        }
+        return complete;
+    }
+    
+    bool append() {
+        if (pendingIndex.size() == 0) return true;
+        std::FILE* file = std::fopen(path.c_str(), "ab");
+        if (!file) return false;
+        uint64_t written = 0;
+        bool complete = true;
+        if (journalBytes == 0) {
+            ByteWriter start = header();
+            complete = std::fwrite(start.data().data(), 1, start.size(), file) == start.size();
+            written += start.size();
+        }
+        complete = writeFrame(file, written) && complete;
+        complete = std::fclose(file) == 0 && complete;
+        journalBytes += written;
+        return complete;
+    }
+    
+    // The whole session as one frame, swapped in for the old journal
+    bool rewrite() {
+        std::string temporary = path + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file) return false;
+        ByteWriter start = header();
+        uint64_t written = start.size();
+        bool complete = std::fwrite(start.data().data(), 1, start.size(), file) == start.size();
+        complete = writeFrame(file, written) && complete;
+        complete = std::fclose(file) == 0 && complete;
+        std::error_code error;
+        if (complete) fs::rename(temporary, path, error);
+        if (!complete || error) {
+            fs::remove(temporary, error);
+            return false;
+        }
+        journalBytes = written;
+        return true;
+    }
+};
+
+// How a session layout refers to what it holds: tabs by their journal key
+// and windows by their position among the engine's windows. Saving uses
+// the first two, loading the other two; a tab is restored into the arena
+// of the first window or group that asks for it.
+struct SessionRefs {
+    std::function<SessionJournal::Key(const Tab&)> tabKey;
+    std::function<uint64_t(const BrowserWindow&)> windowIndex;
+    std::function<std::shared_ptr<Tab>(SessionJournal::Key, const std::shared_ptr<Arena>&)> tab;
+    std::function<std::shared_ptr<BrowserWindow>(uint64_t)> window;
+};
+
+// ASCII case folding and substring search over folded text, sixteen bytes
+// at a time where SSE2 is available. The search compares the needle's first
+// and last bytes against a whole block at once and checks the middle only
+// where both match.
+class FoldedText {
+public:
+    static constexpr size_t npos = std::string_view::npos;
+    
+    static char fold(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+    
+    // `output` may be `input`
+    static void fold(const char* input, size_t size, char* output) {
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128i beforeA = _mm_set1_epi8('A' - 1);
+        const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+        const __m128i caseBit = _mm_set1_epi8(0x20);
+        for (; i + 16 <= size; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            // Bytes past 0x7F compare as negative, so they are never upper case
+            __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, beforeA), _mm_cmplt_epi8(bytes, afterZ));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_or_si128(bytes, _mm_and_si128(upper, caseBit)));
+        }
+#endif
+        for (; i < size; ++i) output[i] = fold(input[i]);
+    }
+    
+    static std::string fold(std::string_view text) {
+        std::string folded(text.size(), '\0');
+        fold(text.data(), text.size(), folded.data());
+        return folded;
+    }
+    
+    // First position at or after `from` where the (folded) needle occurs
+    static size_t find(std::string_view haystack, std::string_view needle, size_t from = 0) {
+        if (from > haystack.size() || needle.size() > haystack.size() - from) return npos;
+        if (needle.empty()) return from;
+        const char* data = haystack.data();
+        const size_t last = needle.size() - 1;
+        const size_t middle = needle.size() > 2 ? needle.size() - 2 : 0;
+        const size_t end = haystack.size() - last;  // candidates start before this
+        size_t i = from;
+#if defined(__SSE2__)
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i final = _mm_set1_epi8(needle[last]);
+        for (; i + 16 <= end; i += 16) {
+            __m128i starts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i ends = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + last));
+            unsigned mask = static_cast<unsigned>(
+                _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(starts, first), _mm_cmpeq_epi8(ends, final))));
+            while (mask != 0) {
+                size_t candidate = i + static_cast<size_t>(__builtin_ctz(mask));
+                if (std::memcmp(data + candidate + 1, needle.data() + 1, middle) == 0) return candidate;
+                mask &= mask - 1;
+            }
+        }
+#endif
+        for (; i < end; ++i) {
+            if (data[i] == needle[0] && data[i + last] == needle[last] &&
+                std::memcmp(data + i + 1, needle.data() + 1, middle) == 0) {
+                return i;
+            }
+        }
+        return npos;
+    }
+};
+
+// A tab search compiled once: whitespace-separated terms that must each
+// match the title or the URL, ignoring ASCII case. A term with * or ? is a
+// glob matching anywhere within one field; any other term is a literal, so
+// there is no such thing as an invalid query.
+class TabQuery {
+public:
+    explicit TabQuery(std::string_view query) {
+        size_t i = 0;
+        while (i < query.size()) {
+            while (i < query.size() && std::isspace(static_cast<unsigned char>(query[i]))) i++;
+            size_t start = i;
+            while (i < query.size() && !std::isspace(static_cast<unsigned char>(query[i]))) i++;
+            if (i > start) addTerm(FoldedText::fold(query.substr(start, i - start)));
+        }
+        for (const auto& term : terms) {
+            if (term.anchor.size() > longestAnchor.size()) longestAnchor = term.anchor;
+        }
+    }
+    
+    bool empty() const { return terms.empty(); }
+    
+    // The longest literal run every match contains; empty if there is none
+    std::string_view anchor() const { return longestAnchor; }
+    
+    // Over fields already folded with FoldedText::fold
+    bool matchesFolded(std::string_view title, std::string_view url) const {
+        if (terms.empty()) return false;
+        for (const auto& term : terms) {
+            if (!term.matches(title) && !term.matches(url)) return false;
+        }
+        return true;
+    }
+    
+    bool matches(std::string_view title, std::string_view url) const {
+        return matchesFolded(FoldedText::fold(title), FoldedText::fold(url));
+    }
+    
+private:
+    struct Term {
+        std::vector<std::string> segments;  // between the *s; a glob has several or a ?
+        std::string anchor;
+        bool glob = false;
+        
+        bool matches(std::string_view field) const {
+            if (!glob) return FoldedText::find(field, segments.front()) != FoldedText::npos;
+            // Leftmost matches in order are enough: a later * can skip anything
+            size_t position = 0;
+            for (const auto& segment : segments) {
+                size_t found = findSegment(field, segment, position);
+                if (found == FoldedText::npos) return false;
+                position = found + segment.size();
+            }
+            return true;
+        }
+    };
+    
+    std::vector<Term> terms;
+    std::string longestAnchor;
+    
+    void addTerm(const std::string& text) {
+        Term term;
+        term.glob = text.find_first_of("*?") != std::string::npos;
+        size_t start = 0;
+        for (size_t star; (star = text.find('*', start)) != std::string::npos; start = star + 1) {
+            if (star > start) term.segments.push_back(text.substr(start, star - start));
+        }
+        if (start < text.size()) term.segments.push_back(text.substr(start));
+        if (term.segments.empty()) return;  // only *s: matches everything
+        for (const auto& segment : term.segments) {
+            size_t piece = 0;
+            for (size_t mark; piece <= segment.size(); piece = mark + 1) {
+                mark = std::min(segment.find('?', piece), segment.size());
+                if (mark - piece > term.anchor.size()) term.anchor = segment.substr(piece, mark - piece);
+            }
+        }
+        terms.push_back(std::move(term));
+    }
+    
+    // Like FoldedText::find, with ? matching any one byte
+    static size_t findSegment(std::string_view field, const std::string& segment, size_t from) {
+        if (segment.find('?') == std::string::npos) return FoldedText::find(field, segment, from);
+        for (size_t i = from; i + segment.size() <= field.size(); ++i) {
+            size_t j = 0;
+            while (j < segment.size() && (segment[j] == '?' || segment[j] == field[i + j])) j++;
+            if (j == segment.size()) return i;
+        }
+        return FoldedText::npos;
+    }
+};
+
+// Handle to a live tab: its slot in TabRegistry and the slot's generation
+// when the tab took it. A handle that outlives its tab resolves to null
+// rather than to whichever tab reuses the slot.
+struct TabId {
+    uint32_t slot = 0;
+    uint32_t generation = 0;  // never 0 for a live tab
+    
+    bool valid() const { return generation != 0; }
+    bool operator==(const TabId& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const TabId& other) const { return !(*this == other); }
+};
+
+// Slot map of every live tab. Besides the tab itself, each slot keeps a copy
+// of the fields that scans over many tabs filter and sort on, one column per
+// field, so a pass over 100k tabs reads a few contiguous bytes per tab
+// instead of a Tab each. Tabs take a slot when constructed and free it when
+// destroyed; freed slots are reused with the next generation.
+class TabRegistry {
+public:
+    enum Flag : uint8_t {
+        ACTIVE = 1,
+        PINNED = 2,
+        HIBERNATED = 4,
+        LOADING = 8,
+        PLAYING = 16,
+        TRACKED = 32  // budgeted by HibernationManager; not part of the tab's state
+    };
+    
+    // Never destroyed: tabs held by other singletons free their slots at exit
+    static TabRegistry& instance() {
+        static TabRegistry* registry = new TabRegistry();
+        return *registry;
+    }
+    
+    TabId add(Tab* tab) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(tabs.size());
+            tabs.push_back(nullptr);
+            generations.push_back(0);
+            flags.push_back(0);
+            importance.push_back(0);
+            lastVisited.push_back(0);
+        }
+        // Generation 0 is never handed out
+        if (++generations[slot] == 0) generations[slot] = 1;
+        tabs[slot] = tab;
+        flags[slot] = 0;
+        importance[slot] = 0;
+        lastVisited[slot] = 0;
+        live++;
+        return {slot, generations[slot]};
+    }
+    
+    void remove(TabId id) {
+        if (!contains(id)) return;
+        tabs[id.slot] = nullptr;
+        flags[id.slot] = 0;
+        generations[id.slot]++;
+        freeSlots.push_back(id.slot);
+        live--;
+    }
+    
+    bool contains(TabId id) const {
+        return id.valid() && id.slot < tabs.size() && generations[id.slot] == id.generation && tabs[id.slot];
+    }
+    
+    Tab* get(TabId id) const { return contains(id) ? tabs[id.slot] : nullptr; }
+    
+    // Written by the tab on every change to these fields
+    void setState(TabId id, uint8_t state) {
+        if (!contains(id)) return;
+        flags[id.slot] = static_cast<uint8_t>((flags[id.slot] & TRACKED) | (state & ~TRACKED));
+    }
+    
+    void setImportance(TabId id, uint8_t level) {
+        if (contains(id)) importance[id.slot] = level;
+    }
+    
+    void setLastVisited(TabId id, int64_t visited) {
+        if (contains(id)) lastVisited[id.slot] = visited;
+    }
+    
+    void setTracked(TabId id, bool tracked) {
+        if (!contains(id)) return;
+        flags[id.slot] = static_cast<uint8_t>(tracked ? flags[id.slot] | TRACKED : flags[id.slot] & ~TRACKED);
+    }
+    
+    uint8_t flagsOf(TabId id) const { return contains(id) ? flags[id.slot] : 0; }
+    uint8_t importanceOf(TabId id) const { return contains(id) ? importance[id.slot] : 0; }
+    int64_t lastVisitedOf(TabId id) const { return contains(id) ? lastVisited[id.slot] : 0; }
+    
+    // Slot-indexed access for scans; free slots have a null tab and no flags
+    size_t slotCount() const { return tabs.size(); }
+    Tab* tabAt(size_t slot) const { return tabs[slot]; }
+    TabId idAt(size_t slot) const { return {static_cast<uint32_t>(slot), generations[slot]}; }
+    uint8_t flagsAt(size_t slot) const { return flags[slot]; }
+    uint8_t importanceAt(size_t slot) const { return importance[slot]; }
+    int64_t lastVisitedAt(size_t slot) const { return lastVisited[slot]; }
+    
+    size_t size() const { return live; }
+    
+private:
+    TabRegistry() = default;
+    
+    std::vector<Tab*> tabs;
+    std::vector<uint32_t> generations;
+    std::vector<uint8_t> flags;
+    std::vector<uint8_t> importance;   // Tab::ImportanceLevel
+    std::vector<int64_t> lastVisited;  // system_clock ticks
+    std::vector<uint32_t> freeSlots;
+    size_t live = 0;
+};
+
+// Typed tab notifications. `value` carries the new state where one applies:
+// the enum value for load/media state, 0/1 for pinned/hibernated and the
+// DomainAtom of the new URL for NAVIGATED.
+enum class TabEventType : uint8_t {
+    NAVIGATED,
+    TITLE_CHANGED,
+    FAVICON_CHANGED,
+    LOAD_STATE_CHANGED,
+    MEDIA_STATE_CHANGED,
+    PINNED_CHANGED,
+    HIBERNATION_CHANGED
+};
+
+struct TabEvent {
+    TabEventType type;
+    const Tab* tab;
+    int32_t value;
+};
+
+// Receives metric deltas from the tabs it owns so group metrics can be kept
+// up to date without rescanning every tab (see TabGroup)
+class TabStateObserver {
+public:
+    struct Delta {
+        int active = 0;
+        int hibernated = 0;
+        int loading = 0;
+    };
+    
+    virtual ~TabStateObserver() = default;
+    virtual void onTabStateChanged(const Delta& delta) = 0;
+};
+
+// Enhanced Tab class with modern browser capabilities
+class Tab {
+public:
+    enum class MediaState { PLAYING, PAUSED, MUTED, NONE };
+    enum class LoadState { LOADING, LOADED, ERROR, UNLOADED };
+    enum class ImportanceLevel { CRITICAL, HIGH, NORMAL, LOW, BACKGROUND };
+    
+    struct TabMetadata {
+        std::string favicon;
+        std::string ogImage;
+        std::string description;
+        std::vector<std::string> keywords;
+        std::chrono::system_clock::time_point lastVisited;
+        std::chrono::system_clock::time_point created;
+        int visitCount = 0;
+        std::map<std::string, std::string> customMetadata;
+    };
+    
+    // True if the request should not be made
+    using RequestFilter = std::function<bool(const ContentFilter::Request&)>;
+    
+    Tab(const std::string& url = "about:blank") 
+        : url(url), title("New Tab"), isActive(false), isPinned(false), 
+          isHibernated(false), mediaState(MediaState::NONE), loadState(LoadState::UNLOADED),
+          importance(ImportanceLevel::NORMAL) {
+        
+        metadata.created = std::chrono::system_clock::now();
+        metadata.lastVisited = metadata.created;
+        refreshParsedUrl();
+        handle = TabRegistry::instance().add(this);
+        storeHotState();
+    }
+    
+    // parsedUrl holds views into url, so tabs are never copied
+    Tab(const Tab&) = delete;
+    Tab& operator=(const Tab&) = delete;
+    
+    ~Tab() {
+        TabRegistry::instance().remove(handle);
+        if (reloadTimer) TimerWheel::instance().cancel(reloadTimer);
+        MainThreadQueue::instance().cancel(this);
+        if (packedState && !packedState->spillPath.empty()) {
+            HibernationStore::instance().discard(packedState->spillPath);
+        }
+    }
+    
+    // Requests the tab makes from now on are checked with `filter`;
+    // the window holding the tab sets it, and clears it when letting go
+    void setRequestFilter(RequestFilter filter) { requestFilter = std::move(filter); }
+    
+    void navigate(const std::string& newUrl) {
+        if (isBlocked({newUrl, {}, ContentFilter::ResourceType::DOCUMENT})) {
+            NOVA_LOG_INFO(TAB, "Blocked navigation to: " << newUrl);
+            return;
+        }
+        // Navigation needs the live history back
+        ensurePageState();
+        
+        // Record history before navigating
+        if (url != "about:blank" && !url.empty()) {
+            browserHistory.push(takeCurrentEntry());
+        }
+        
+        url = newUrl;
+        refreshParsedUrl();
+        // The page has no title yet; setTitle fills it in
+        recordVisit(HistoryDatabase::Transition::NAVIGATE, "");
+        setLoadState(LoadState::LOADING);
+        NOVA_LOG_DEBUG(TAB, "Navigating to: " << url);
+        
+        // Simulated page loading
+        NOVA_LOG_DEBUG(TAB, "Loading content...");
+        
+        // In a real implementation, this would start the actual page loading process
+        // For now, we'll simulate it completing immediately
+        setLoadState(LoadState::LOADED);
+        
+        // Update metadata
+        markVisited();
+        metadata.visitCount++;
+        
+        // In a real browser, we would extract these from the page
+        if (!parsedUrl.host.empty()) {
+            std::string favicon = "https://" + std::string(parsedUrl.host) + "/favicon.ico";
+            bool blocked = isBlocked({favicon, parsedUrl.host, ContentFilter::ResourceType::IMAGE});
+            metadata.favicon = blocked ? std::string() : std::move(favicon);
+            publishEvent(TabEventType::FAVICON_CHANGED);
+        }
+        publishEvent(TabEventType::NAVIGATED, static_cast<int32_t>(domainAtom));
+    }
+    
+    std::string extractDomain(const std::string& url) const {
+        return std::string(UrlParser::parse(url).host);
+    }
+    
+    // Host of the current URL, parsed once per navigation
+    std::string_view getDomain() const { return parsedUrl.host; }
+    DomainAtom getDomainAtom() const { return domainAtom; }
+    const ParsedUrl& getParsedUrl() const { return parsedUrl; }
+    
+    void setTitle(const std::string& newTitle) {
+        title = newTitle;
+        if (visitRow != HistoryDatabase::kNoRow) HistoryDatabase::instance().setVisitTitle(visitRow, url, title);
+        publishEvent(TabEventType::TITLE_CHANGED);
+    }
+    
+    // Page-provided metadata; in a real browser this comes from the document
+    void setPageMetadata(const std::string& description, const std::vector<std::string>& keywords,
+                         const std::string& ogImage = "") {
+        ensurePageState();
+        metadata.description = description;
+        metadata.keywords = keywords;
+        metadata.ogImage = ogImage;
+        revision++;
+    }
+    
+    void setActive(bool active) {
+        if (active && !isActive) {
+            // Tab is being activated
+            markVisited();
+        }
+        
+        auto before = stateContribution();
+        isActive = active;
+        publishStateChange(before);
+        
+        if (isActive) {
+            // Automatically wake up hibernated and restored tabs when activated
+            ensurePageState();
+        }
+    }
+    
+    void setPinned(bool pinned) {
+        isPinned = pinned;
+        NOVA_LOG_INFO(TAB, (pinned ? "Tab pinned" : "Tab unpinned"));
+        publishEvent(TabEventType::PINNED_CHANGED, pinned ? 1 : 0);
+        
+        // Pinned tabs should not be hibernated
+        if (isPinned && isHibernated) {
+            hibernateTab(false);
+        }
+    }
+    
+    // Unique for the process; history visits refer to tabs by it
+    uint32_t getId() const { return id; }
+    // This tab's slot in TabRegistry, for as long as the tab lives
+    TabId getHandle() const { return handle; }
+    std::string getUrl() const { return url; }
+    std::string getTitle() const { return title; }
+    bool getIsActive() const { return isActive; }
+    bool getIsPinned() const { return isPinned; }
+    bool getIsHibernated() const { return isHibernated; }
+    LoadState getLoadState() const { return loadState; }
+    MediaState getMediaState() const { return mediaState; }
+    ImportanceLevel getImportance() const { return importance; }
+    
+    // While hibernated, or restored and not used yet, the page metadata is
+    // packed; this unpacks a copy without waking the tab
+    TabMetadata getMetadata() const {
+        TabMetadata copy = metadata;
+        if (packedState) {
+            ByteReader reader(packedState->metadata);
+            readPageMetadata(reader, copy);
+        }
+        return copy;
+    }
+    
+    std::chrono::system_clock::time_point getLastVisited() const { return metadata.lastVisited; }
+    
+    // Advanced tab features
+    void captureScreenshot() {
+        NOVA_LOG_INFO(TAB, "Captured screenshot of tab: " << title);
+        
+        // In a real implementation, would call into the rendering engine
+        // to capture the current visual state of the page
+        std::string screenshotPath = "/tmp/screenshot_" + 
+            std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".png";
+        
+        NOVA_LOG_INFO(TAB, "Screenshot saved to: " << screenshotPath);
+    }
+    
+    void pinToSidebar() {
+        NOVA_LOG_INFO(TAB, "Pinned tab to sidebar: " << title);
+        // Would add a shortcut to this tab in the sidebar
+        isPinnedToSidebar = true;
+        revision++;
+    }
+    
+    void unpinFromSidebar() {
+        NOVA_LOG_INFO(TAB, "Unpinned tab from sidebar: " << title);
+        isPinnedToSidebar = false;
+        revision++;
+    }
+    
+    void hibernateTab(bool hibernate = true) {
+        // Don't hibernate pinned tabs
+        if (hibernate && isPinned) {
+            NOVA_LOG_DEBUG(TAB, "Cannot hibernate pinned tab: " << title);
+            return;
+        }
+        
+        auto before = stateContribution();
+        bool changed = isHibernated != hibernate;
+        if (changed) {
+            // A restored tab that was never used is already packed
+            if (!hibernate) {
+                unpackState();
+            } else if (!packedState) {
+                packState();
+            }
+        }
+        isHibernated = hibernate;
+        publishStateChange(before);
+        if (changed) {
+            publishEvent(TabEventType::HIBERNATION_CHANGED, hibernate ? 1 : 0);
+        }
+        NOVA_LOG_DEBUG(TAB, (hibernate ? "Tab hibernated to save resources: " : "Tab restored from hibernation: ")
+                  << title);
+        
+        // In a real implementation, this would also suspend/resume the tab's processes
+    }
+    
+    // Approximate heap footprint of this tab, used by the hibernation budget
+    size_t estimateMemoryUsage() const {
+        size_t bytes = sizeof(Tab) + heapBytes(url) + heapBytes(title);
+        bytes += browserHistory.memoryBytes() + forwardHistory.memoryBytes();
+        bytes += currentEntry.url.sharedBytes() + currentEntry.title.sharedBytes();
+        bytes += heapBytes(metadata.favicon) + heapBytes(metadata.ogImage) + heapBytes(metadata.description);
+        bytes += metadata.keywords.capacity() * sizeof(std::string);
+        for (const auto& keyword : metadata.keywords) bytes += heapBytes(keyword);
+        for (const auto& [key, value] : metadata.customMetadata) {
+            // Red-black tree node overhead plus the pair itself
+            bytes += 32 + sizeof(std::pair<const std::string, std::string>) + heapBytes(key) + heapBytes(value);
+        }
+        bytes += stateObservers.capacity() * sizeof(TabStateObserver*);
+        if (packedState) {
+            bytes += sizeof(PackedState) + packedState->blob.capacity() + packedState->metadata.capacity() +
+                     heapBytes(packedState->spillPath);
+        }
+        return bytes;
+    }
+    
+    bool isSpilledToDisk() const { return packedState && !packedState->spillPath.empty(); }
+    
+    void recordInteractions() {
+        NOVA_LOG_INFO(TAB, "Recording interactions for later analysis: " << title);
+        isRecordingInteractions = true;
+        // Would begin tracking user interactions with the page
+    }
+    
+    void stopRecordingInteractions() {
+        if (isRecordingInteractions) {
+            NOVA_LOG_INFO(TAB, "Stopped recording interactions for: " << title);
+            isRecordingInteractions = false;
+            // Would generate a report of interactions
+        }
+    }
+    
+    void setMediaState(MediaState state) {
+        mediaState = state;
+        std::string stateStr;
+        
+        switch (state) {
+            case MediaState::PLAYING: stateStr = "playing"; break;
+            case MediaState::PAUSED: stateStr = "paused"; break;
+            case MediaState::MUTED: stateStr = "muted"; break;
+            case MediaState::NONE: stateStr = "none"; break;
+        }
+        
+        NOVA_LOG_DEBUG(TAB, "Setting media state for tab to " << stateStr << ": " << title);
+        publishEvent(TabEventType::MEDIA_STATE_CHANGED, static_cast<int32_t>(state));
+    }
+    
+    void boost() {
+        NOVA_LOG_INFO(TAB, "Boosting tab performance: " << title);
+        setImportance(ImportanceLevel::HIGH);
+        // Would allocate more resources to this tab
+    }
+    
+    void deprioritize() {
+        NOVA_LOG_INFO(TAB, "Deprioritizing tab: " << title);
+        setImportance(ImportanceLevel::LOW);
+        // Would reduce resource allocation
+    }
+    
+    void minify() {
+        NOVA_LOG_INFO(TAB, "Minifying tab view: " << title);
+        isMinified = true;
+        revision++;
+        // Would reduce the tab's UI to minimal elements
+    }
+    
+    void restore() {
+        if (isMinified) {
+            NOVA_LOG_INFO(TAB, "Restoring tab from minified view: " << title);
+            isMinified = false;
+            revision++;
+        }
+    }
+    
+    bool canGoBack() const {
+        return packedState ? packedState->backEntries > 0 : !browserHistory.empty();
+    }
+    
+    void goBack() {
+        if (canGoBack()) {
+            ensurePageState();
+            forwardHistory.push(takeCurrentEntry());
+            
+            // Navigate without adding to history
+            enterEntry(browserHistory.pop());
+            recordVisit(HistoryDatabase::Transition::BACK, title);
+            NOVA_LOG_DEBUG(TAB, "Navigating back to: " << url);
+            publishEvent(TabEventType::NAVIGATED, static_cast<int32_t>(domainAtom));
+            
+            // Update metadata
+            markVisited();
+            metadata.visitCount++;
+        }
+    }
+    
+    bool canGoForward() const {
+        return packedState ? packedState->forwardEntries > 0 : !forwardHistory.empty();
+    }
+    
+    void goForward() {
+        if (canGoForward()) {
+            ensurePageState();
+            browserHistory.push(takeCurrentEntry());
+            
+            // Navigate without adding to history
+            enterEntry(forwardHistory.pop());
+            recordVisit(HistoryDatabase::Transition::FORWARD, title);
+            NOVA_LOG_DEBUG(TAB, "Navigating forward to: " << url);
+            publishEvent(TabEventType::NAVIGATED, static_cast<int32_t>(domainAtom));
+            
+            // Update metadata
+            markVisited();
+            metadata.visitCount++;
+        }
+    }
+    
+    void reload(bool bypassCache = false) {
+        NOVA_LOG_DEBUG(TAB, "Reloading page" << (bypassCache ? " (bypass cache)" : "") << ": " << url);
+        setLoadState(LoadState::LOADING);
+        // In a real implementation, this would trigger the page reload
+        setLoadState(LoadState::LOADED);
+    }
+    
+    void findInPage(const std::string& searchText) {
+        NOVA_LOG_INFO(TAB, "Searching for \"" << searchText << "\" in page: " << title);
+        // Would highlight matches in the page
+    }
+    
+    void scheduleReload(std::chrono::seconds interval) {
+        NOVA_LOG_INFO(TAB, "Tab will auto-reload every " << interval.count() << " seconds");
+        reloadInterval = interval;
+        revision++;
+        armReloadTimer();
+    }
+    
+    void cancelReload() {
+        reloadInterval = std::chrono::seconds(0);
+        revision++;
+        armReloadTimer();
+    }
+    
+    // Importance decides how hard this tab's timers are throttled
+    void setImportance(ImportanceLevel level) {
+        if (importance == level) return;
+        importance = level;
+        revision++;
+        TabRegistry::instance().setImportance(handle, static_cast<uint8_t>(level));
+        if (reloadTimer) armReloadTimer();
+    }
+    
+    // The returned handle unsubscribes when destroyed
+    [[nodiscard]] Subscription subscribe(EventChannel<TabEvent>::Callback callback) {
+        return events.subscribe(std::move(callback));
+    }
+    
+    // Groups owning this tab register here to receive metric deltas
+    void attachStateObserver(TabStateObserver* observer) {
+        stateObservers.push_back(observer);
+    }
+    
+    void detachStateObserver(TabStateObserver* observer) {
+        auto it = std::find(stateObservers.begin(), stateObservers.end(), observer);
+        if (it != stateObservers.end()) {
+            stateObservers.erase(it);
+        }
+    }
+    
+    // What this tab currently adds to its groups' metrics
+    TabStateObserver::Delta stateContribution() const {
+        TabStateObserver::Delta contribution;
+        contribution.active = isActive ? 1 : 0;
+        contribution.hibernated = isHibernated ? 1 : 0;
+        contribution.loading = loadState == LoadState::LOADING ? 1 : 0;
+        return contribution;
+    }
+    
+    // Bumped by every change that saveState would write
+    uint64_t getRevision() const { return revision; }
+    
+    // The tab as a session record: page, settings, timestamps and history.
+    // A hibernated tab's packed state is written as it is.
+    void saveState(ByteWriter& writer) const {
+        writer.writeString(url);
+        writer.writeString(title);
+        writer.writeU8(static_cast<uint8_t>((isPinned ? 1 : 0) | (isHibernated ? 2 : 0) | (isMinified ? 4 : 0) |
+                                            (isPinnedToSidebar ? 8 : 0)));
+        writer.writeU8(static_cast<uint8_t>(importance));
+        writer.writeVarint(static_cast<uint64_t>(reloadInterval.count()));
+        writer.writeVarint(millisOf(metadata.created));
+        writer.writeVarint(millisOf(metadata.lastVisited));
+        writer.writeVarint(static_cast<uint64_t>(metadata.visitCount));
+        if (!packedState) {
+            writePageMetadata(writer);
+            // Framed like a packed state, so restoring can leave it unread
+            ByteWriter page;
+            page.writeU8(kRestoredStateVersion);
+            writeHistory(page);
+            writer.writeVarint(browserHistory.size());
+            writer.writeVarint(forwardHistory.size());
+            writer.writeString(std::string_view(reinterpret_cast<const char*>(page.data().data()), page.size()));
+            return;
+        }
+        writer.writeBytes(packedState->metadata.data(), packedState->metadata.size());
+        writer.writeVarint(packedState->backEntries);
+        writer.writeVarint(packedState->forwardEntries);
+        std::vector<uint8_t> spilled;
+        const std::vector<uint8_t>* blob = &packedState->blob;
+        if (!packedState->spillPath.empty()) {
+            if (!HibernationStore::instance().read(packedState->spillPath, spilled)) {
+                NOVA_LOG_WARN(TAB, "Saving tab " << title << " without its history: cannot read " << packedState->spillPath);
+            }
+            blob = &spilled;
+        }
+        writer.writeString(std::string_view(reinterpret_cast<const char*>(blob->data()), blob->size()));
+    }
+    
+    // A tab from a saveState record. Nothing is navigated or loaded: the tab
+    // shows its saved page until it is reloaded or navigated, and its history
+    // stays packed until first used, as if it were hibernated. Null if the
+    // record is damaged.
+    static std::shared_ptr<Tab> restoreState(ByteReader& reader, const std::shared_ptr<Arena>& arena = nullptr) {
+        auto tab = Arena::make<Tab>(arena, reader.readString());
+        tab->title = reader.readString();
+        uint8_t flags = reader.readU8();
+        tab->isPinned = flags & 1;
+        tab->isMinified = flags & 4;
+        tab->isPinnedToSidebar = flags & 8;
+        tab->importance = static_cast<ImportanceLevel>(
+            std::min<uint8_t>(reader.readU8(), static_cast<uint8_t>(ImportanceLevel::BACKGROUND)));
+        tab->reloadInterval = std::chrono::seconds(static_cast<int64_t>(reader.readVarint()));
+        tab->metadata.created = timeOf(reader.readVarint());
+        tab->metadata.lastVisited = timeOf(reader.readVarint());
+        tab->metadata.visitCount = static_cast<int>(reader.readVarint());
+        const uint8_t* pageMetadata = reader.position();
+        skipPageMetadata(reader);
+        tab->packedState = std::make_unique<PackedState>();
+        tab->packedState->metadata.assign(pageMetadata, reader.position());
+        tab->packedState->backEntries = static_cast<uint32_t>(reader.readVarint());
+        tab->packedState->forwardEntries = static_cast<uint32_t>(reader.readVarint());
+        std::string_view blob = reader.readStringView();
+        tab->packedState->blob.assign(blob.begin(), blob.end());
+        tab->isHibernated = flags & 2;
+        if (!reader.ok()) return nullptr;
+        tab->storeHotState();
+        if (tab->reloadInterval.count() > 0) tab->armReloadTimer();
+        return tab;
+    }
+    
+private:
+    static inline std::atomic<uint32_t> nextId{1};
+    
+    uint32_t id = nextId++;
+    std::string url;
+    std::string title;
+    ParsedUrl parsedUrl;
+    DomainAtom domainAtom = 0;
+    bool isActive;
+    bool isPinned;
+    bool isHibernated;
+    bool isMinified = false;
+    bool isPinnedToSidebar = false;
+    bool isRecordingInteractions = false;
+    MediaState mediaState;
+    LoadState loadState;
+    ImportanceLevel importance;
+    TabId handle;  // next to the state it mirrors, so storing it stays on one cache line
+    TabMetadata metadata;
+    EventChannel<TabEvent> events;
+    std::vector<TabStateObserver*> stateObservers;
+    uint64_t revision = 0;
+    
+    // Auto-reload; low-importance tabs share coarse slack boundaries and
+    // background tabs reload at most once a minute
+    static constexpr std::chrono::seconds kLowTimerSlack{1};
+    static constexpr std::chrono::seconds kBackgroundTimerSlack{10};
+    static constexpr std::chrono::seconds kBackgroundReloadFloor{60};
+    std::chrono::seconds reloadInterval{0};
+    TimerId reloadTimer = 0;
+    RequestFilter requestFilter;
+    
+    // Navigation history
+    NavigationStack browserHistory;
+    NavigationStack forwardHistory;
+    NavigationStack::Entry currentEntry;  // url and title, pooled once they enter a stack
+    uint64_t visitRow = HistoryDatabase::kNoRow;  // the current page's visit
+    
+    bool isBlocked(const ContentFilter::Request& request) const {
+        return requestFilter && requestFilter(request);
+    }
+    
+    void recordVisit(HistoryDatabase::Transition transition, const std::string& visitTitle) {
+        visitRow = url.empty() || url == "about:blank"
+                       ? HistoryDatabase::kNoRow
+                       : HistoryDatabase::instance().recordVisit(url, visitTitle, transition, id);
+    }
+    
+    // The current page as a stack entry. Pages reached through the stacks
+    // still hold their pooled strings, so moving back and forth never
+    // allocates.
+    NavigationStack::Entry takeCurrentEntry() {
+        if (currentEntry.url.view() != url) currentEntry.url = StringPool::instance().intern(url);
+        if (currentEntry.title.view() != title) currentEntry.title = StringPool::instance().intern(title);
+        return std::move(currentEntry);
+    }
+    
+    void enterEntry(NavigationStack::Entry entry) {
+        currentEntry = std::move(entry);
+        // assign() reuses the strings' capacity
+        url.assign(currentEntry.url.view());
+        title.assign(currentEntry.title.view());
+        refreshParsedUrl();
+    }
+    
+    void armReloadTimer() {
+        auto& wheel = TimerWheel::instance();
+        if (reloadTimer) {
+            wheel.cancel(reloadTimer);
+            MainThreadQueue::instance().cancel(this);
+            reloadTimer = 0;
+        }
+        if (reloadInterval.count() <= 0) return;
+        
+        TimerWheel::Clock::duration period = reloadInterval;
+        TimerWheel::Clock::duration slack = TimerWheel::Clock::duration::zero();
+        if (importance == ImportanceLevel::BACKGROUND) {
+            period = std::max<TimerWheel::Clock::duration>(period, kBackgroundReloadFloor);
+            slack = kBackgroundTimerSlack;
+        } else if (importance == ImportanceLevel::LOW) {
+            slack = kLowTimerSlack;
+        }
+        
+        // Hibernated tabs stay asleep; they reload when woken
+        reloadTimer = wheel.schedule(period, [this] {
+            MainThreadQueue::instance().post(this, [this] { if (!isHibernated) reload(); });
+        }, period, slack);
+    }
+    
+    // Serialized history and page metadata of a hibernated tab
+    struct PackedState {
+        std::vector<uint8_t> blob; // empty once spilled to disk
+        std::vector<uint8_t> metadata;  // never spilled, so getMetadata() stays cheap
+        std::string spillPath;
+        uint32_t backEntries = 0;
+        uint32_t forwardEntries = 0;
+    };
+    std::unique_ptr<PackedState> packedState;
+    
+    static constexpr uint8_t kPackedStateVersion = 4;
+    static constexpr uint8_t kRestoredStateVersion = 5;  // uncompressed, from a session record
+    
+    static size_t heapBytes(const std::string& text) {
+        // Strings that fit the small-string buffer own no heap memory
+        return text.capacity() > 15 ? text.capacity() + 1 : 0;
+    }
+    
+    // Moves the back/forward history into a compact blob and frees the live
+    // stacks. The blob is a version byte followed by the CompactCodec-compressed
+    // record. The page metadata strings are packed apart from it, uncompressed,
+    // so getMetadata() can read them back without waking the tab.
+    void packState() {
+        ByteWriter writer;
+        writeHistory(writer);
+        
+        packedState = std::make_unique<PackedState>();
+        ByteWriter page;
+        writePageMetadata(page);
+        packedState->metadata = page.release();
+        packedState->backEntries = static_cast<uint32_t>(browserHistory.size());
+        packedState->forwardEntries = static_cast<uint32_t>(forwardHistory.size());
+        packedState->blob = CompactCodec::compress(writer.data());
+        packedState->blob.insert(packedState->blob.begin(), kPackedStateVersion);
+        packedState->blob.shrink_to_fit();
+        packedState->spillPath = HibernationStore::instance().spill(packedState->blob);
+        if (!packedState->spillPath.empty()) {
+            std::vector<uint8_t>().swap(packedState->blob);
+        }
+        
+        // swap() with empty objects actually returns the capacity
+        browserHistory.clear();
+        forwardHistory.clear();
+        currentEntry = NavigationStack::Entry();
+        std::string().swap(metadata.favicon);
+        std::string().swap(metadata.ogImage);
+        std::string().swap(metadata.description);
+        std::vector<std::string>().swap(metadata.keywords);
+        metadata.customMetadata.clear();
+    }
+    
+    // Hibernated and restored tabs keep their history packed until it is used
+    void ensurePageState() {
+        if (isHibernated) {
+            hibernateTab(false);
+        } else if (packedState) {
+            unpackState();
+        }
+    }
+    
+    void unpackState() {
+        if (!packedState) return;
+        std::unique_ptr<PackedState> state = std::move(packedState);
+        ByteReader page(state->metadata);
+        readPageMetadata(page, metadata);
+        
+        if (!state->spillPath.empty() && !HibernationStore::instance().load(state->spillPath, state->blob)) {
+            NOVA_LOG_ERROR(TAB, "Lost hibernated state of tab " << title << ": cannot read " << state->spillPath);
+            return;
+        }
+        
+        std::vector<uint8_t> record;
+        uint8_t version = state->blob.empty() ? 0 : state->blob[0];
+        if (version != kPackedStateVersion && version != kRestoredStateVersion) {
+            NOVA_LOG_ERROR(TAB, "Unsupported hibernation format for tab: " << title);
+            return;
+        }
+        state->blob.erase(state->blob.begin());
+        if (version == kRestoredStateVersion) {
+            record.swap(state->blob);
+        } else if (!CompactCodec::decompress(state->blob, record)) {
+            NOVA_LOG_ERROR(TAB, "Corrupt hibernated state for tab: " << title);
+            return;
+        }
+        
+        ByteReader reader(record);
+        if (!readHistory(reader)) {
+            NOVA_LOG_ERROR(TAB, "Corrupt hibernated state for tab: " << title);
+        }
+    }
+    
+    // What hibernation packs away
+    void writeHistory(ByteWriter& writer) const {
+        browserHistory.write(writer);
+        forwardHistory.write(writer);
+    }
+    
+    bool readHistory(ByteReader& reader) {
+        browserHistory.read(reader);
+        forwardHistory.read(reader);
+        return reader.ok();
+    }
+    
+    void writePageMetadata(ByteWriter& writer) const {
+        writer.writeString(metadata.favicon);
+        writer.writeString(metadata.ogImage);
+        writer.writeString(metadata.description);
+        writer.writeVarint(metadata.keywords.size());
+        for (const auto& keyword : metadata.keywords) writer.writeString(keyword);
+        writer.writeVarint(metadata.customMetadata.size());
+        for (const auto& [key, value] : metadata.customMetadata) {
+            writer.writeString(key);
+            writer.writeString(value);
+        }
+    }
+    
+    static void readPageMetadata(ByteReader& reader, TabMetadata& into) {
+        into.favicon = reader.readString();
+        into.ogImage = reader.readString();
+        into.description = reader.readString();
+        size_t keywordCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < keywordCount && reader.ok(); ++i) {
+            into.keywords.push_back(reader.readString());
+        }
+        size_t customCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < customCount && reader.ok(); ++i) {
+            std::string key = reader.readString();
+            into.customMetadata[key] = reader.readString();
+        }
+    }
+    
+    static void skipPageMetadata(ByteReader& reader) {
+        for (int i = 0; i < 3; ++i) reader.readStringView();
+        size_t strings = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < strings && reader.ok(); ++i) reader.readStringView();
+        strings = static_cast<size_t>(reader.readVarint()) * 2;
+        for (size_t i = 0; i < strings && reader.ok(); ++i) reader.readStringView();
+    }
+    
+    static uint64_t millisOf(std::chrono::system_clock::time_point time) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+    }
+    
+    static std::chrono::system_clock::time_point timeOf(uint64_t millis) {
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::milliseconds(static_cast<int64_t>(millis))));
+    }
+    
+    void setLoadState(LoadState state) {
+        auto before = stateContribution();
+        loadState = state;
+        publishStateChange(before);
+        publishEvent(TabEventType::LOAD_STATE_CHANGED, static_cast<int32_t>(state));
+    }
+    
+    void publishEvent(TabEventType type, int32_t value = 0) {
+        storeState();
+        revision++;
+        events.publish(TabEvent{type, this, value});
+    }
+    
+    void publishStateChange(const TabStateObserver::Delta& before) {
+        storeState();
+        auto after = stateContribution();
+        TabStateObserver::Delta delta;
+        delta.active = after.active - before.active;
+        delta.hibernated = after.hibernated - before.hibernated;
+        delta.loading = after.loading - before.loading;
+        if (delta.active == 0 && delta.hibernated == 0 && delta.loading == 0) return;
+        revision++;
+        
+        for (auto* observer : stateObservers) {
+            observer->onTabStateChanged(delta);
+        }
+    }
+    
+    // TabRegistry keeps copies of the fields scans read. The flags are stored
+    // on every state change and event, the other fields where they change.
+    void storeState() {
+        uint8_t state = (isActive ? TabRegistry::ACTIVE : 0) | (isPinned ? TabRegistry::PINNED : 0) |
+                        (isHibernated ? TabRegistry::HIBERNATED : 0) |
+                        (loadState == LoadState::LOADING ? TabRegistry::LOADING : 0) |
+                        (mediaState == MediaState::PLAYING ? TabRegistry::PLAYING : 0);
+        TabRegistry::instance().setState(handle, state);
+    }
+    
+    void storeHotState() {
+        storeState();
+        TabRegistry::instance().setImportance(handle, static_cast<uint8_t>(importance));
+        TabRegistry::instance().setLastVisited(handle, metadata.lastVisited.time_since_epoch().count());
+    }
+    
+    void markVisited() {
+        metadata.lastVisited = std::chrono::system_clock::now();
+        TabRegistry::instance().setLastVisited(handle, metadata.lastVisited.time_since_epoch().count());
+    }
+    
+    void refreshParsedUrl() {
+        parsedUrl = UrlParser::parse(url);
+        domainAtom = DomainAtoms::instance().intern(parsedUrl.host);
+    }
+};
+
+// Process-wide memory budget for tabs. When the estimated footprint of the
+// tracked tabs exceeds the budget, the least valuable tabs are hibernated
+// first: lowest importance, then least recently visited. Active, pinned,
+// critical and media-playing tabs are never chosen. Candidates are picked
+// and ranked from TabRegistry's columns; only their footprints need the tabs.
+class HibernationManager {
+public:
+    struct Usage {
+        size_t trackedTabs = 0;
+        size_t hibernatedTabs = 0;
+        size_t residentBytes = 0;
+    };
+    
+    static HibernationManager& instance() {
+        static HibernationManager manager;
+        return manager;
+    }
+    
+    // Tracked until the tab is destroyed. New tabs bring the budget check
+    // forward (see scheduleEnforcement).
+    void track(const std::shared_ptr<Tab>& tab) {
+        if (!tab) return;
+        TabRegistry::instance().setTracked(tab->getHandle(), true);
+        scheduleEnforcement();
+    }
+    
+    // 0 disables the budget
+    void setMemoryBudget(size_t bytes) {
+        memoryBudget = bytes;
+        scheduleEnforcement();
+    }
+    size_t getMemoryBudget() const { return memoryBudget; }
+    
+    Usage measure() {
+        Usage usage;
+        auto& registry = TabRegistry::instance();
+        for (size_t slot = 0; slot < registry.slotCount(); ++slot) {
+            uint8_t flags = registry.flagsAt(slot);
+            if (!(flags & TabRegistry::TRACKED)) continue;
+            usage.trackedTabs++;
+            if (flags & TabRegistry::HIBERNATED) usage.hibernatedTabs++;
+            usage.residentBytes += registry.tabAt(slot)->estimateMemoryUsage();
+        }
+        return usage;
+    }
+    
+    // Hibernates tabs until the budget is met; returns how many were hibernated
+    size_t enforceBudget() {
+        if (memoryBudget == 0) return 0;
+        
+        struct Candidate {
+            int rank;
+            int64_t lastVisited;
+            uint32_t slot;
+            size_t bytes;
+        };
+        std::vector<Candidate> candidates;
+        size_t residentBytes = 0;
+        auto& registry = TabRegistry::instance();
+        for (size_t slot = 0; slot < registry.slotCount(); ++slot) {
+            uint8_t flags = registry.flagsAt(slot);
+            if (!(flags & TabRegistry::TRACKED)) continue;
+            size_t bytes = registry.tabAt(slot)->estimateMemoryUsage();
+            residentBytes += bytes;
+            if (flags & (TabRegistry::ACTIVE | TabRegistry::PINNED | TabRegistry::HIBERNATED | TabRegistry::PLAYING)) continue;
+            auto importance = static_cast<Tab::ImportanceLevel>(registry.importanceAt(slot));
+            if (importance == Tab::ImportanceLevel::CRITICAL) continue;
+            candidates.push_back({evictionRank(importance), registry.lastVisitedAt(slot), static_cast<uint32_t>(slot), bytes});
+        }
+        if (residentBytes <= memoryBudget) return 0;
+        
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            if (a.rank != b.rank) return a.rank < b.rank;
+            return a.lastVisited < b.lastVisited;
+        });
+        
+        size_t before = residentBytes;
+        size_t hibernated = 0;
+        for (auto& candidate : candidates) {
+            if (residentBytes <= memoryBudget) break;
+            Tab* tab = registry.tabAt(candidate.slot);
+            tab->hibernateTab(true);
+            residentBytes = residentBytes - candidate.bytes + tab->estimateMemoryUsage();
+            hibernated++;
+        }
+        
+        NOVA_LOG_INFO(TAB, "Memory budget: hibernated " << hibernated << " tabs ("
+                      << before / 1024 << " KB -> " << residentBytes / 1024 << " KB)");
+        return hibernated;
+    }
+    
+private:
+    HibernationManager() = default;
+    
+    static constexpr std::chrono::seconds kEnforceDelay{2};
+    static constexpr std::chrono::seconds kEnforceSlack{1};
+    
+    size_t memoryBudget = 0;
+    TimerId enforceTimer = 0;  // set while a check is scheduled or waiting to run
+    
+    // Runs enforceBudget on the owner thread shortly after the first tab
+    // opened since the last check, so a burst of new tabs costs one scan
+    void scheduleEnforcement() {
+        if (memoryBudget == 0 || enforceTimer) return;
+        enforceTimer = TimerWheel::instance().schedule(kEnforceDelay, [this] {
+            MainThreadQueue::instance().post(this, [this] {
+                enforceTimer = 0;
+                enforceBudget();
+            });
+        }, TimerWheel::Clock::duration::zero(), kEnforceSlack);
+    }
+    
+    // Lower ranks are hibernated first
+    static int evictionRank(Tab::ImportanceLevel importance) {
+        switch (importance) {
+            case Tab::ImportanceLevel::BACKGROUND: return 0;
+            case Tab::ImportanceLevel::LOW: return 1;
+            case Tab::ImportanceLevel::NORMAL: return 2;
+            case Tab::ImportanceLevel::HIGH: return 3;
+            case Tab::ImportanceLevel::CRITICAL: return 4;
+        }
+        return 2;
+    }
+};
+
+// Process-wide index of open tabs by canonical URL (see CanonicalUrl), so
+// "is this page already open, and where?" is one hash lookup. Windows and
+// groups report the tabs they gain and lose, and each indexed tab's
+// navigations move it to its new page.
+class OpenTabIndex {
+public:
+    // A window or a group holding the tab; exactly one is set
+    struct Location {
+        BrowserWindow* window = nullptr;
+        TabGroup* group = nullptr;
+        
+        bool operator==(const Location& other) const { return window == other.window && group == other.group; }
+    };
+    
+    struct Match {
+        std::shared_ptr<Tab> tab;
+        std::vector<Location> locations;
+    };
+    
+    struct Stats {
+        size_t tabs = 0;
+        size_t pages = 0;
+        size_t duplicateTabs = 0;  // tabs beyond the first on each page
+    };
+    
+    // Never destroyed: windows and groups held by other singletons report
+    // their tabs gone at exit
+    static OpenTabIndex& instance() {
+        static OpenTabIndex* index = new OpenTabIndex();
+        return *index;
+    }
+    
+    void add(const std::shared_ptr<Tab>& tab, Location location) {
+        if (!tab) return;
+        auto [it, added] = records.try_emplace(tab.get());
+        Record& record = it->second;
+        if (added) {
+            record.tab = tab;
+            record.order = nextOrder++;
+            record.subscription = tab->subscribe([this, key = tab.get()](EventSpan<TabEvent> events) {
+                for (const auto& event : events) {
+                    if (event.type == TabEventType::NAVIGATED) {
+                        reindex(key);
+                        break;
+                    }
+                }
+            });
+            record.hash = CanonicalUrl::hash(tab->getUrl());
+            link(record);
+        }
+        if (std::find(record.locations.begin(), record.locations.end(), location) == record.locations.end()) {
+            record.locations.push_back(location);
+        }
+    }
+    
+    // The tab leaves the index with its last location
+    void remove(const Tab* tab, Location location) {
+        auto it = records.find(tab);
+        if (it == records.end()) return;
+        auto& locations = it->second.locations;
+        locations.erase(std::remove(locations.begin(), locations.end(), location), locations.end());
+        if (!locations.empty()) return;
+        unlink(it->second);
+        records.erase(it);
+    }
+    
+    // Open tabs showing the same page as `url`, in the order they were opened
+    std::vector<Match> find(std::string_view url) const {
+        std::vector<Match> matches;
+        uint64_t hash = CanonicalUrl::hash(url);
+        if (hash == 0) return matches;
+        auto page = pages.find(hash);
+        if (page == pages.end()) return matches;
+        for (const Tab* tab : page->second) {
+            const Record& record = records.at(tab);
+            matches.push_back({record.tab, record.locations});
+        }
+        return matches;
+    }
+    
+    bool isOpen(std::string_view url) const {
+        uint64_t hash = CanonicalUrl::hash(url);
+        return hash != 0 && pages.count(hash) > 0;
+    }
+    
+    // Every page open in more than one tab
+    std::vector<std::vector<Match>> duplicates() const {
+        std::vector<std::vector<Match>> sets;
+        if (duplicateTabs == 0) return sets;
+        for (const auto& [hash, tabs] : pages) {
+            if (tabs.size() < 2) continue;
+            auto& matches = sets.emplace_back();
+            for (const Tab* tab : tabs) {
+                const Record& record = records.at(tab);
+                matches.push_back({record.tab, record.locations});
+            }
+        }
+        // Oldest page first, so repeated calls agree
+        std::sort(sets.begin(), sets.end(), [this](const auto& a, const auto& b) {
+            return records.at(a.front().tab.get()).order < records.at(b.front().tab.get()).order;
+        });
+        return sets;
+    }
+    
+    Stats getStats() const { return {records.size(), pages.size(), duplicateTabs}; }
+    
+private:
+    struct Record {
+        std::shared_ptr<Tab> tab;
+        uint64_t hash = 0;  // 0 while the tab shows no page
+        uint64_t order = 0;
+        std::vector<Location> locations;
+        Subscription subscription;
+    };
+    
+    std::unordered_map<const Tab*, Record> records;
+    std::unordered_map<uint64_t, std::vector<const Tab*>> pages;  // tabs in the order they were opened
+    size_t duplicateTabs = 0;
+    uint64_t nextOrder = 0;
+    
+    OpenTabIndex() = default;
+    
+    void link(const Record& record) {
+        if (record.hash == 0) return;
+        auto& tabs = pages[record.hash];
+        auto at = std::upper_bound(tabs.begin(), tabs.end(), record.order, [this](uint64_t order, const Tab* tab) {
+            return order < records.at(tab).order;
+        });
+        tabs.insert(at, record.tab.get());
+        if (tabs.size() > 1) duplicateTabs++;
+    }
+    
+    void unlink(const Record& record) {
+        if (record.hash == 0) return;
+        auto page = pages.find(record.hash);
+        if (page == pages.end()) return;
+        auto& tabs = page->second;
+        auto it = std::find(tabs.begin(), tabs.end(), record.tab.get());
+        if (it == tabs.end()) return;
+        if (tabs.size() > 1) duplicateTabs--;
+        tabs.erase(it);
+        if (tabs.empty()) pages.erase(page);
+    }
+    
+    void reindex(const Tab* tab) {
+        auto it = records.find(tab);
+        if (it == records.end()) return;
+        Record& record = it->second;
+        uint64_t hash = CanonicalUrl::hash(record.tab->getUrl());
+        if (hash == record.hash) return;
+        unlink(record);
+        record.hash = hash;
+        link(record);
+    }
+};
+
+// On-device topic clustering. Each tab is reduced to the words of its
+// title, URL, description and keywords, and those to a MinHash sketch, so
+// the share of equal slots between two sketches estimates how much of
+// their vocabulary two tabs share. Sketches are banded into buckets
+// (locality-sensitive hashing): tabs land in a common bucket only when
+// they are likely similar, and only those pairs have their words
+// compared, since an estimate alone links unrelated tabs often enough to
+// chain whole topics together. Sketches are cached by tab revision; a few
+// changed tabs are placed into the existing topics, many changes cluster
+// everything again.
+class TopicClusterer {
+public:
+    struct Topic {
+        std::string label;  // its most common words
+        std::vector<std::shared_ptr<Tab>> tabs;
+    };
+    
+    struct Stats {
+        size_t tabs = 0;
+        size_t topics = 0;     // with two tabs or more
+        size_t sketched = 0;   // over all updates
+        size_t reclusters = 0;
+        size_t placed = 0;     // tabs placed one at a time
+    };
+    
+    static constexpr size_t kHashes = 32;
+    static constexpr size_t kRows = 2;
+    static constexpr size_t kBands = kHashes / kRows;
+    
+    // `threshold` is the share of words two tabs must have in common to
+    // be put together
+    explicit TopicClusterer(double threshold = 0.3) : threshold(threshold), bands(kBands) {}
+    
+    // Catches up with `tabs`: forgets tabs no longer there and sketches
+    // the new ones and those whose words changed. Tabs are held weakly,
+    // so a closed tab is gone from the topics before the next update.
+    void update(const std::vector<std::shared_ptr<Tab>>& tabs) {
+        std::unordered_set<const Tab*> present;
+        present.reserve(tabs.size());
+        std::vector<std::shared_ptr<Tab>> changed;
+        for (const auto& tab : tabs) {
+            if (!tab || !present.insert(tab.get()).second) continue;
+            auto it = slots.find(tab.get());
+            if (it == slots.end() || entries[it->second].tab.expired() || entries[it->second].text != textOf(*tab)) {
+                changed.push_back(tab);
+            }
+        }
+        std::vector<const Tab*> gone;
+        for (const auto& [tab, slot] : slots) {
+            if (!present.count(tab)) gone.push_back(tab);
+        }
+        for (const Tab* tab : gone) remove(tab);
+        if (changed.empty()) return;
+        
+        // Placing tabs one at a time never splits or merges topics
+        if (changed.size() * 4 > slots.size() + changed.size()) {
+            recluster(changed);
+            return;
+        }
+        std::vector<Entry> sketched = sketchAll(changed);
+        for (size_t i = 0; i < changed.size(); ++i) place(changed[i], std::move(sketched[i]));
+    }
+    
+    void remove(const Tab* tab) {
+        auto it = slots.find(tab);
+        if (it == slots.end()) return;
+        // Its bucket entries go stale and are skipped until the next recluster
+        entries[it->second] = Entry();
+        freeSlots.push_back(it->second);
+        slots.erase(it);
+    }
+    
+    // Topics with at least `minTabs` tabs, largest first
+    std::vector<Topic> topics(size_t minTabs = 2) const {
+        std::unordered_map<uint32_t, std::vector<uint32_t>> members;
+        for (const auto& [tab, slot] : slots) {
+            if (!entries[slot].tab.expired()) members[entries[slot].topic].push_back(slot);
+        }
+        
+        std::vector<std::vector<uint32_t>> ordered;
+        for (auto& [topic, group] : members) {
+            if (group.size() >= std::max<size_t>(minTabs, 1)) {
+                std::sort(group.begin(), group.end());
+                ordered.push_back(std::move(group));
+            }
+        }
+        std::sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) {
+            return a.size() != b.size() ? a.size() > b.size() : a.front() < b.front();
+        });
+        
+        std::vector<Topic> result;
+        result.reserve(ordered.size());
+        for (const auto& group : ordered) {
+            Topic topic;
+            topic.label = labelOf(group);
+            for (uint32_t slot : group) {
+                if (auto tab = entries[slot].tab.lock()) topic.tabs.push_back(std::move(tab));
+            }
+            if (topic.tabs.size() >= std::max<size_t>(minTabs, 1)) result.push_back(std::move(topic));
+        }
+        return result;
+    }
+    
+    // Tabs in the same topic share an id; 0 for tabs not clustered
+    uint32_t topicOf(const Tab* tab) const {
+        auto it = slots.find(tab);
+        return it == slots.end() ? 0 : entries[it->second].topic;
+    }
+    
+    Stats getStats() const {
+        Stats current = stats;
+        current.tabs = slots.size();
+        std::unordered_map<uint32_t, size_t> sizes;
+        for (const auto& [tab, slot] : slots) sizes[entries[slot].topic]++;
+        current.topics = static_cast<size_t>(std::count_if(sizes.begin(), sizes.end(),
+            [](const auto& size) { return size.second >= 2; }));
+        return current;
+    }
+    
+    // Words are runs of letters and digits, lowercased; numbers, short
+    // words and words every page has are left out
+    static std::vector<std::string> wordsOf(const Tab& tab) {
+        const auto& metadata = tab.getMetadata();
+        std::string text = tab.getTitle();
+        text += ' ';
+        text += tab.getUrl();
+        text += ' ';
+        text += metadata.description;
+        for (const auto& keyword : metadata.keywords) {
+            text += ' ';
+            text += keyword;
+        }
+        FoldedText::fold(text.data(), text.size(), text.data());
+        
+        std::vector<std::string> words;
+        words.reserve(16);
+        size_t i = 0;
+        while (i < text.size()) {
+            while (i < text.size() && !isWordByte(text[i])) i++;
+            size_t start = i;
+            bool letters = false;
+            while (i < text.size() && isWordByte(text[i])) {
+                letters |= !std::isdigit(static_cast<unsigned char>(text[i]));
+                i++;
+            }
+            std::string_view word(text.data() + start, i - start);
+            if (word.size() >= 3 && letters && !isCommonWord(word)) words.emplace_back(word);
+        }
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+        return words;
+    }
+    
+private:
+    using Sketch = std::array<uint32_t, kHashes>;
+    
+    struct Entry {
+        std::weak_ptr<Tab> tab;
+        uint64_t text = 0;  // textOf when it was sketched
+        Sketch sketch{};
+        std::vector<std::string> words;
+        std::vector<uint64_t> wordHashes;  // sorted
+        uint32_t topic = 0;
+    };
+    
+    // One band's buckets as (key, slot) pairs. Pairs for removed or
+    // changed tabs stay behind and are recognised by their key no longer
+    // matching the slot's sketch.
+    struct Band {
+        std::vector<std::pair<uint64_t, uint32_t>> sorted;  // by key, as of the last recluster
+        std::vector<std::pair<uint64_t, uint32_t>> recent;  // placed since
+    };
+    
+    double threshold;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeSlots;
+    std::unordered_map<const Tab*, uint32_t> slots;
+    std::vector<Band> bands;
+    uint32_t nextTopic = 1;
+    Stats stats;
+    
+    static constexpr size_t kParallelTabs = 1024;
+    static constexpr size_t kBucketScan = 64;  // members compared when placing a tab
+    
+    // The fields wordsOf reads, hashed; a tab's revision also moves on
+    // activation and loading, which change none of its words
+    static uint64_t textOf(const Tab& tab) {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const std::string& field) {
+            for (char c : field) hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+            hash = (hash ^ 0xFF) * 1099511628211ull;
+        };
+        const auto& metadata = tab.getMetadata();
+        add(tab.getTitle());
+        add(tab.getUrl());
+        add(metadata.description);
+        for (const auto& keyword : metadata.keywords) add(keyword);
+        return hash;
+    }
+    
+    static bool isWordByte(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || static_cast<unsigned char>(c) >= 0x80;
+    }
+    
+    static bool isCommonWord(std::string_view word) {
+        if (word.size() > 7) return false;
+        static const std::unordered_set<std::string_view> common = {
+            "the", "and", "for", "with", "you", "your", "are", "from", "this", "that", "how", "what",
+            "why", "www", "http", "https", "com", "org", "net", "html", "htm", "php", "index", "about",
+            "blank", "new", "tab", "page", "home", "welcome"};
+        return common.count(word) > 0;
+    }
+    
+    static uint64_t mix(uint64_t value) {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdull;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ull;
+        return value ^ (value >> 33);
+    }
+    
+    static std::vector<uint64_t> hashWords(const std::vector<std::string>& words) {
+        std::vector<uint64_t> hashes;
+        hashes.reserve(words.size());
+        for (const auto& word : words) {
+            uint64_t hash = 14695981039346656037ull;
+            for (char c : word) hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+            hashes.push_back(hash);
+        }
+        std::sort(hashes.begin(), hashes.end());
+        return hashes;
+    }
+    
+    // An empty sketch (all ones) stands for a tab with no usable words
+    static Sketch sketchOf(const std::vector<uint64_t>& wordHashes) {
+        Sketch sketch;
+        sketch.fill(std::numeric_limits<uint32_t>::max());
+        for (uint64_t hash : wordHashes) {
+            // Two hashes make all the others (Kirsch-Mitzenmacher)
+            uint64_t first = mix(hash);
+            uint64_t step = mix(hash ^ 0x9E3779B97F4A7C15ull) | 1;
+            for (size_t i = 0; i < kHashes; ++i) {
+                sketch[i] = std::min(sketch[i], static_cast<uint32_t>(mix(first + i * step) >> 32));
+            }
+        }
+        return sketch;
+    }
+    
+    static bool isEmpty(const Sketch& sketch) {
+        return sketch[0] == std::numeric_limits<uint32_t>::max();
+    }
+    
+    // Shared words over all words of the two (Jaccard)
+    static double similarity(const Entry& a, const Entry& b) {
+        size_t shared = 0;
+        auto i = a.wordHashes.begin();
+        auto j = b.wordHashes.begin();
+        while (i != a.wordHashes.end() && j != b.wordHashes.end()) {
+            if (*i < *j) {
+                ++i;
+            } else if (*j < *i) {
+                ++j;
+            } else {
+                shared++;
+                ++i;
+                ++j;
+            }
+        }
+        size_t all = a.wordHashes.size() + b.wordHashes.size() - shared;
+        return all == 0 ? 0.0 : static_cast<double>(shared) / static_cast<double>(all);
+    }
+    
+    static uint64_t bandKey(const Sketch& sketch, size_t band) {
+        uint64_t key = 14695981039346656037ull;
+        for (size_t row = band * kRows; row < (band + 1) * kRows; ++row) {
+            key = (key ^ sketch[row]) * 1099511628211ull;
+        }
+        return key;
+    }
+    
+    bool inBucket(uint32_t slot, size_t band, uint64_t key) const {
+        const Entry& entry = entries[slot];
+        return !entry.tab.expired() && !isEmpty(entry.sketch) && bandKey(entry.sketch, band) == key;
+    }
+    
+    // Words and sketches for `tabs`, spread over the cores for large batches
+    std::vector<Entry> sketchAll(const std::vector<std::shared_ptr<Tab>>& tabs) {
+        std::vector<Entry> sketched(tabs.size());
+        auto work = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                sketched[i].tab = tabs[i];
+                sketched[i].text = textOf(*tabs[i]);
+                sketched[i].words = wordsOf(*tabs[i]);
+                sketched[i].wordHashes = hashWords(sketched[i].words);
+                sketched[i].sketch = sketchOf(sketched[i].wordHashes);
+            }
+        };
+        size_t workers = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), tabs.size() / kParallelTabs + 1);
+        std::vector<std::future<void>> pending;
+        for (size_t w = 1; w < workers; ++w) {
+            pending.push_back(std::async(std::launch::async, work, tabs.size() * w / workers, tabs.size() * (w + 1) / workers));
+        }
+        work(0, tabs.size() / workers);
+        for (auto& done : pending) done.get();
+        stats.sketched += tabs.size();
+        return sketched;
+    }
+    
+    uint32_t claimSlot(const std::shared_ptr<Tab>& tab) {
+        auto it = slots.find(tab.get());
+        if (it != slots.end()) return it->second;
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(entries.size());
+            entries.emplace_back();
+        }
+        slots.emplace(tab.get(), slot);
+        return slot;
+    }
+    
+    // Joins the topic of the closest tab sharing a bucket, if it is close enough
+    void place(const std::shared_ptr<Tab>& tab, Entry sketched) {
+        uint32_t slot = claimSlot(tab);
+        entries[slot] = std::move(sketched);
+        Entry& entry = entries[slot];
+        entry.topic = nextTopic++;
+        stats.placed++;
+        if (isEmpty(entry.sketch)) return;
+        
+        double best = threshold;
+        for (size_t band = 0; band < kBands; ++band) {
+            Band& buckets = bands[band];
+            uint64_t key = bandKey(entry.sketch, band);
+            size_t scanned = 0;
+            auto consider = [&](uint32_t member) {
+                if (member == slot || scanned >= kBucketScan || !inBucket(member, band, key)) return;
+                scanned++;
+                double similar = similarity(entry, entries[member]);
+                if (similar >= best) {
+                    best = similar;
+                    entry.topic = entries[member].topic;
+                }
+            };
+            auto run = std::equal_range(buckets.sorted.begin(), buckets.sorted.end(), std::make_pair(key, 0u),
+                [](const auto& a, const auto& b) { return a.first < b.first; });
+            for (auto it = run.first; it != run.second; ++it) consider(it->second);
+            for (const auto& [recentKey, member] : buckets.recent) {
+                if (recentKey == key) consider(member);
+            }
+            
+            buckets.recent.emplace_back(key, slot);
+            if (buckets.recent.size() > std::max<size_t>(64, buckets.sorted.size() / 16)) {
+                size_t middle = buckets.sorted.size();
+                buckets.sorted.insert(buckets.sorted.end(), buckets.recent.begin(), buckets.recent.end());
+                std::sort(buckets.sorted.begin() + middle, buckets.sorted.end());
+                std::inplace_merge(buckets.sorted.begin(), buckets.sorted.begin() + middle, buckets.sorted.end());
+                buckets.recent.clear();
+            }
+        }
+    }
+    
+    // Sketches the changed tabs and clusters every tab from scratch: each
+    // bucket's members join its first member when they are close to it,
+    // and topics are what that links together
+    void recluster(const std::vector<std::shared_ptr<Tab>>& changed) {
+        stats.reclusters++;
+        std::vector<Entry> sketched = sketchAll(changed);
+        for (size_t i = 0; i < changed.size(); ++i) {
+            uint32_t slot = claimSlot(changed[i]);
+            entries[slot] = std::move(sketched[i]);
+        }
+        
+        // Bands are independent, so each worker sorts a share of them
+        auto sortBands = [&](size_t first, size_t stride) {
+            for (size_t band = first; band < kBands; band += stride) {
+                Band& buckets = bands[band];
+                buckets.recent.clear();
+                buckets.sorted.clear();
+                buckets.sorted.reserve(slots.size());
+                for (uint32_t slot = 0; slot < entries.size(); ++slot) {
+                    const Entry& entry = entries[slot];
+                    if (!entry.tab.expired() && !isEmpty(entry.sketch)) buckets.sorted.emplace_back(bandKey(entry.sketch, band), slot);
+                }
+                std::sort(buckets.sorted.begin(), buckets.sorted.end());
+            }
+        };
+        size_t workers = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u),
+                                          std::min(kBands, slots.size() / kParallelTabs + 1));
+        std::vector<std::future<void>> pending;
+        for (size_t w = 1; w < workers; ++w) pending.push_back(std::async(std::launch::async, sortBands, w, workers));
+        sortBands(0, workers);
+        for (auto& done : pending) done.get();
+        
+        std::vector<uint32_t> parent(entries.size());
+        for (uint32_t i = 0; i < parent.size(); ++i) parent[i] = i;
+        auto root = [&](uint32_t slot) {
+            while (parent[slot] != slot) slot = parent[slot] = parent[parent[slot]];
+            return slot;
+        };
+        // Pairs already joined through an earlier band are not compared again
+        for (const Band& buckets : bands) {
+            const auto& sorted = buckets.sorted;
+            for (size_t start = 0, end; start < sorted.size(); start = end) {
+                uint32_t leader = sorted[start].second;
+                for (end = start + 1; end < sorted.size() && sorted[end].first == sorted[start].first; ++end) {
+                    uint32_t member = sorted[end].second;
+                    uint32_t rootA = root(leader);
+                    uint32_t rootB = root(member);
+                    if (rootA == rootB || similarity(entries[leader], entries[member]) < threshold) continue;
+                    parent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+                }
+            }
+        }
+        std::unordered_map<uint32_t, uint32_t> topicIds;
+        nextTopic = 1;
+        for (const auto& [tab, slot] : slots) {
+            auto [it, added] = topicIds.emplace(root(slot), nextTopic);
+            if (added) nextTopic++;
+            entries[slot].topic = it->second;
+        }
+    }
+    
+    // The two words most of the topic's tabs have
+    std::string labelOf(const std::vector<uint32_t>& group) const {
+        std::unordered_map<std::string_view, size_t> counts;
+        for (uint32_t slot : group) {
+            for (const auto& word : entries[slot].words) counts[word]++;
+        }
+        std::vector<std::pair<std::string_view, size_t>> ranked(counts.begin(), counts.end());
+        size_t top = std::min<size_t>(2, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + top, ranked.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        std::string label;
+        for (size_t i = 0; i < top; ++i) label += (i ? " " : "") + std::string(ranked[i].first);
+        return label.empty() ? "Topic" : label;
+    }
+};
+
+// Enhanced TabGroup with advanced organizational features
+class TabGroup : public TabStateObserver {
+public:
+    enum class AutoGroupingRule { 
+        BY_DOMAIN,
+        BY_TOPIC,
+        BY_TIME,
+        BY_PROJECT,
+        BY_INTERACTION_PATTERN,
+        CUSTOM
+    };
+    
+    enum class ViewMode {
+        GRID,
+        LIST,
+        CAROUSEL,
+        STACKED
+    };
+    
+    struct GroupMetrics {
+        size_t totalTabs = 0;
+        size_t activeTabs = 0;
+        size_t hibernatedTabs = 0;
+        size_t loadingTabs = 0;
+        std::chrono::system_clock::time_point lastAccessed;
+        std::chrono::seconds totalFocusTime{0};
+    };
+    
+    // Tabs the group creates itself, from snapshots, come from `arena`
+    TabGroup(const std::string& name = "New Group", std::shared_ptr<Arena> arena = nullptr) 
+        : name(name), color("#5F9EA0"), isCollapsed(false), isAutoGroup(false),
+          autoGroupRule(AutoGroupingRule::BY_DOMAIN), viewMode(ViewMode::LIST), arena(std::move(arena)) {
+        metrics.lastAccessed = std::chrono::system_clock::now();
+    }
+    
+    // Tabs keep a raw pointer back to the groups observing them
+    TabGroup(const TabGroup&) = delete;
+    TabGroup& operator=(const TabGroup&) = delete;
+    
+    ~TabGroup() override {
+        if (idleTimer) TimerWheel::instance().cancel(idleTimer);
+        MainThreadQueue::instance().cancel(this);
+        for (const auto& tab : tabs) {
+            tab->detachStateObserver(this);
+            OpenTabIndex::instance().remove(tab.get(), {nullptr, this});
+        }
+    }
+    
+    void addTab(std::shared_ptr<Tab> tab) {
+        if (!tab || members.count(tab.get()) > 0) return;
+        
+        tabs.push_back(tab);
+        handles.push_back(tab->getHandle());
+        tab->attachStateObserver(this);
+        OpenTabIndex::instance().add(tab, {nullptr, this});
+        metrics.totalTabs++;
+        applyMetricsDelta(tab->stateContribution(), 1);
+        updateThumbnail(tab);
+        
+        // Set up a listener for this tab; the subscription ends with the membership
+        Membership& membership = members[tab.get()];
+        membership.tab = tab;
+        membership.subscription = tab->subscribe([this](EventSpan<TabEvent> events) {
+            this->handleTabEvents(events);
+        });
+        
+        NOVA_LOG_DEBUG(GROUP, "Added tab to group: " << name);
+        
+        // Add to domain index for quick lookups
+        membership.indexedDomain = tab->getDomainAtom();
+        if (membership.indexedDomain != 0) {
+            domainIndex[membership.indexedDomain].push_back(tab);
+        }
+    }
+    
+    void removeTab(std::shared_ptr<Tab> tab) {
+        if (!tab) return;
+        
+        // Find and remove the tab
+        auto it = std::find_if(tabs.begin(), tabs.end(),
+            [&tab](const std::shared_ptr<Tab>& t) { return t.get() == tab.get(); });
+        
+        if (it != tabs.end()) {
+            // Remove from domain index
+            removeMembership(tab);
+            
+            if (topicClusterer) topicClusterer->remove(tab.get());
+            
+            // Remove from main list
+            handles.erase(handles.begin() + (it - tabs.begin()));
+            tabs.erase(it);
+            tab->detachStateObserver(this);
+            OpenTabIndex::instance().remove(tab.get(), {nullptr, this});
+            metrics.totalTabs--;
+            applyMetricsDelta(tab->stateContribution(), -1);
+            NOVA_LOG_DEBUG(GROUP, "Removed tab from group: " << name);
+        }
+    }
+    
+    void setName(const std::string& newName) {
+        name = newName;
+    }
+    
+    void setColor(const std::string& newColor) {
+        color = newColor;
+    }
+    
+    void setIcon(const std::string& newIcon) {
+        icon = newIcon;
+    }
+    
+    std::string getName() const { return name; }
+    std::string getColor() const { return color; }
+    std::string getIcon() const { return icon; }
+    const std::vector<std::shared_ptr<Tab>>& getTabs() const { return tabs; }
+    const GroupMetrics& getMetrics() const { return metrics; }
+    
+    // Advanced tab group features
+    void toggleCollapse() {
+        isCollapsed = !isCollapsed;
+        NOVA_LOG_INFO(GROUP, "Group '" << name << "' is now "
+                 << (isCollapsed ? "collapsed" : "expanded"));
+    }
+    
+    void setViewMode(ViewMode mode) {
+        viewMode = mode;
+        std::string modeStr;
+        
+        switch (mode) {
+            case ViewMode::GRID: modeStr = "grid"; break;
+            case ViewMode::LIST: modeStr = "list"; break;
+            case ViewMode::CAROUSEL: modeStr = "carousel"; break;
+            case ViewMode::STACKED: modeStr = "stacked"; break;
+        }
+        
+        NOVA_LOG_INFO(GROUP, "Changed view mode to " << modeStr << " for group: " << name);
+    }
+    
+    void setAutoGrouping(bool enabled, AutoGroupingRule rule = AutoGroupingRule::BY_DOMAIN) {
+        isAutoGroup = enabled;
+        autoGroupRule = rule;
+        NOVA_LOG_INFO(GROUP, "Auto-grouping " << (enabled ? "enabled" : "disabled")
+                 << " for group: " << name);
+                 
+        if (enabled) {
+            reorganizeTabs();
+        }
+    }
+    
+    void reorganizeTabs() {
+        if (!isAutoGroup) return;
+        
+        switch (autoGroupRule) {
+            case AutoGroupingRule::BY_DOMAIN:
+                NOVA_LOG_INFO(GROUP, "Reorganizing tabs based on rule: by domain");
+                // This is already handled by our domain index
+                break;
+            case AutoGroupingRule::BY_TOPIC:
+                NOVA_LOG_INFO(GROUP, "Reorganizing tabs based on rule: by topic");
+                arrangeByTopic();
+                break;
+            case AutoGroupingRule::BY_TIME:
+                NOVA_LOG_INFO(GROUP, "Reorganizing tabs based on rule: by access time");
+                // Sort by last access time
+                sortTabsByLastVisited();
+                break;
+            case AutoGroupingRule::BY_PROJECT:
+                NOVA_LOG_INFO(GROUP, "Reorganizing tabs based on rule: by project");
+                // Would require project metadata
+                break;
+            case AutoGroupingRule::BY_INTERACTION_PATTERN:
+                NOVA_LOG_INFO(GROUP, "Reorganizing tabs based on rule: by interaction pattern");
+                // Would analyze user interaction patterns
+                break;
+            case AutoGroupingRule::CUSTOM:
+                NOVA_LOG_INFO(GROUP, "Reorganizing tabs based on rule: using custom rules");
+                // Would apply custom rule functions
+                break;
+        }
+    }
+    
+    void createSnapshot() {
+        std::string snapshotId = "snapshot_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+        std::vector<std::string> urlList;
+        
+        for (const auto& tab : tabs) {
+            urlList.push_back(tab->getUrl());
+        }
+        
+        snapshots[snapshotId] = urlList;
+        
+        NOVA_LOG_INFO(GROUP, "Creating snapshot " << snapshotId << " of group '" << name
+                 << "' with " << tabs.size() << " tabs");
+    }
+    
+    void restoreSnapshot(const std::string& snapshotId) {
+        if (snapshots.find(snapshotId) != snapshots.end()) {
+            NOVA_LOG_INFO(GROUP, "Restoring snapshot " << snapshotId << " to group '" << name << "'");
+            
+            // Clear current tabs
+            clearTabs();
+            
+            // Create new tabs from snapshot URLs
+            for (const auto& url : snapshots[snapshotId]) {
+                auto tab = Arena::make<Tab>(arena, url);
+                HibernationManager::instance().track(tab);
+                addTab(tab);
+            }
+        } else {
+            NOVA_LOG_WARN(GROUP, "Snapshot not found: " << snapshotId);
+        }
+    }
+    
+    std::vector<std::string> listSnapshots() const {
+        std::vector<std::string> result;
+        for (const auto& [id, _] : snapshots) {
+            result.push_back(id);
+        }
+        return result;
+    }
+    
+    // Settings, members and snapshots, as part of a session layout
+    void saveState(ByteWriter& writer, const SessionRefs& refs) const {
+        writer.writeString(name);
+        writer.writeString(color);
+        writer.writeString(icon);
+        writer.writeU8(static_cast<uint8_t>(viewMode));
+        writer.writeU8(static_cast<uint8_t>((isCollapsed ? 1 : 0) | (isAutoGroup ? 2 : 0)));
+        writer.writeU8(static_cast<uint8_t>(autoGroupRule));
+        writer.writeVarint(tabs.size());
+        for (const auto& tab : tabs) writer.writeVarint(refs.tabKey(*tab));
+        writer.writeVarint(snapshots.size());
+        for (const auto& [id, urls] : snapshots) {
+            writer.writeString(id);
+            writer.writeVarint(urls.size());
+            std::string_view previous;
+            for (const auto& url : urls) {
+                writer.writePrefixedString(url, previous);
+                previous = url;
+            }
+        }
+    }
+    
+    // Replaces the group's settings and tabs with saved ones. The tabs
+    // themselves come in through restorePendingTabs.
+    bool loadState(ByteReader& reader, const SessionRefs&) {
+        name = reader.readString();
+        color = reader.readString();
+        icon = reader.readString();
+        viewMode = static_cast<ViewMode>(std::min<uint8_t>(reader.readU8(), static_cast<uint8_t>(ViewMode::STACKED)));
+        uint8_t flags = reader.readU8();
+        isCollapsed = flags & 1;
+        isAutoGroup = flags & 2;
+        autoGroupRule = static_cast<AutoGroupingRule>(
+            std::min<uint8_t>(reader.readU8(), static_cast<uint8_t>(AutoGroupingRule::CUSTOM)));
+        clearTabs();
+        pendingKeys.clear();
+        pendingNext = 0;
+        size_t count = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < count && reader.ok(); ++i) pendingKeys.push_back(reader.readVarint());
+        snapshots.clear();
+        size_t snapshotCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < snapshotCount && reader.ok(); ++i) {
+            auto& urls = snapshots[reader.readString()];
+            size_t urlCount = static_cast<size_t>(reader.readVarint());
+            for (size_t j = 0; j < urlCount && reader.ok(); ++j) {
+                urls.push_back(reader.readPrefixedString(urls.empty() ? std::string_view() : std::string_view(urls.back())));
+            }
+        }
+        return reader.ok();
+    }
+    
+    // Saved tabs loadState has not restored yet
+    size_t pendingTabs() const { return pendingKeys.size() - pendingNext; }
+    
+    // Adds up to `limit` more of the saved tabs, in their saved order;
+    // returns how many it went through
+    size_t restorePendingTabs(const SessionRefs& refs, size_t limit) {
+        size_t looked = 0;
+        for (; pendingNext < pendingKeys.size() && looked < limit; ++pendingNext, ++looked) {
+            if (auto tab = refs.tab(pendingKeys[pendingNext], arena)) addTab(tab);
+        }
+        if (pendingTabs() == 0) {
+            std::vector<SessionJournal::Key>().swap(pendingKeys);
+            pendingNext = 0;
+        }
+        return looked;
+    }
+    
+    void moveAllTabs(std::shared_ptr<TabGroup> targetGroup) {
+        if (!targetGroup) return;
+        
+        for (auto& tab : tabs) {
+            targetGroup->addTab(tab);
+        }
+        clearTabs();
+        NOVA_LOG_INFO(GROUP, "All tabs moved from '" << name
+                 << "' to '" << targetGroup->getName() << "'");
+    }
+    
+    void moveTab(size_t index, std::shared_ptr<TabGroup> targetGroup) {
+        if (!targetGroup || index >= tabs.size()) return;
+        
+        auto tab = tabs[index];
+        targetGroup->addTab(tab);
+        
+        removeMembership(tab);
+        if (topicClusterer) topicClusterer->remove(tab.get());
+        tabs.erase(tabs.begin() + index);
+        handles.erase(handles.begin() + index);
+        tab->detachStateObserver(this);
+        OpenTabIndex::instance().remove(tab.get(), {nullptr, this});
+        metrics.totalTabs--;
+        applyMetricsDelta(tab->stateContribution(), -1);
+        
+        NOVA_LOG_INFO(GROUP, "Tab '" << tab->getTitle() << "' moved from '"
+                 << name << "' to '" << targetGroup->getName() << "'");
+    }
+    
+    void archiveTabs(bool keepGroup = true) {
+        NOVA_LOG_INFO(GROUP, "Archiving " << tabs.size() << " tabs from group '" << name << "'");
+        
+        // In a real implementation, this would save the tabs to an archive
+        createSnapshot(); // Create a snapshot before archiving
+        
+        if (!keepGroup) {
+            clearTabs();
+        }
+    }
+    
+    void updateThumbnail(std::shared_ptr<Tab> tab) {
+        if (!tab) return;
+        
+        NOVA_LOG_DEBUG(GROUP, "Updating thumbnail for tab in group '" << name << "'");
+        // In a real implementation, this would capture a thumbnail of the tab
+        
+        // Update last accessed time when interacting with tabs
+        metrics.lastAccessed = std::chrono::system_clock::now();
+    }
+    
+    // Full recount of the metrics. Tabs push deltas on every state change, so
+    // this is only needed to verify or repair the incremental counts.
+    void updateMetrics() {
+        metrics.totalTabs = tabs.size();
+        metrics.activeTabs = 0;
+        metrics.hibernatedTabs = 0;
+        metrics.loadingTabs = 0;
+        
+        auto& registry = TabRegistry::instance();
+        for (TabId handle : handles) {
+            uint8_t flags = registry.flagsOf(handle);
+            metrics.activeTabs += (flags & TabRegistry::ACTIVE) ? 1 : 0;
+            metrics.hibernatedTabs += (flags & TabRegistry::HIBERNATED) ? 1 : 0;
+            metrics.loadingTabs += (flags & TabRegistry::LOADING) ? 1 : 0;
+        }
+    }
+    
+    void onTabStateChanged(const Delta& delta) override {
+        applyMetricsDelta(delta, 1);
+    }
+    
+    void recordFocusTime(std::chrono::seconds duration) {
+        metrics.totalFocusTime += duration;
+    }
+    
+    std::string generateInsights() const {
+        // In a real implementation, this would analyze the group's tabs and usage
+        return "Group '" + name + "' contains " + std::to_string(tabs.size()) + 
+               " tabs primarily focused on " + suggestGroupFocus() + 
+               "\nActive tabs: " + std::to_string(metrics.activeTabs) +
+               "\nHibernated tabs: " + std::to_string(metrics.hibernatedTabs) +
+               "\nTotal focus time: " + std::to_string(metrics.totalFocusTime.count()) + " seconds";
+    }
+    
+    std::string suggestGroupFocus() const {
+        // Placeholder for ML-based analysis of tab content
+        if (tabs.empty()) return "no specific topic";
+        
+        // The domain index already holds the per-domain tab counts
+        DomainAtom mostFrequentDomain = 0;
+        size_t maxCount = 0;
+        
+        domainIndex.forEach([&](DomainAtom domain, const std::vector<std::shared_ptr<Tab>>& domainTabs) {
+            if (domainTabs.size() > maxCount) {
+                mostFrequentDomain = domain;
+                maxCount = domainTabs.size();
+            }
+        });
+        
+        if (mostFrequentDomain != 0) {
+            return std::string(DomainAtoms::instance().name(mostFrequentDomain)) + " content";
+        }
+        
+        return "productivity tools";
+    }
+    
+    std::vector<std::shared_ptr<Tab>> findTabsByDomain(const std::string& domain) const {
+        if (const auto* domainTabs = domainIndex.find(DomainAtoms::instance().find(domain))) {
+            return *domainTabs;
+        }
+        return {};
+    }
+    
+    // See TabQuery for the syntax; TabSearch looks through every tab at once
+    std::vector<std::shared_ptr<Tab>> searchTabs(const std::string& query) const {
+        std::vector<std::shared_ptr<Tab>> results;
+        TabQuery compiled(query);
+        
+        for (const auto& tab : tabs) {
+            if (compiled.matches(tab->getTitle(), tab->getUrl())) {
+                results.push_back(tab);
+            }
+        }
+        
+        return results;
+    }
+    
+    void sortTabsByTitle() {
+        std::sort(tabs.begin(), tabs.end(), 
+            [](const std::shared_ptr<Tab>& a, const std::shared_ptr<Tab>& b) {
+                return a->getTitle() < b->getTitle();
+            });
+        refreshHandles();
+    }
+    
+    void sortTabsByLastVisited() {
+        std::sort(tabs.begin(), tabs.end(), 
+            [](const std::shared_ptr<Tab>& a, const std::shared_ptr<Tab>& b) {
+                return a->getLastVisited() > b->getLastVisited();
+            });
+        refreshHandles();
+    }
+    
+    // Reads the registry's columns; only the tabs to hibernate are touched
+    void hibernateInactiveTabs(std::chrono::minutes threshold) {
+        auto& registry = TabRegistry::instance();
+        // Idle for more than `threshold` whole minutes
+        auto cutoff = (std::chrono::system_clock::now() - threshold - std::chrono::minutes(1)).time_since_epoch().count();
+        int count = 0;
+        EventBatch batch;
+        
+        for (TabId handle : handles) {
+            uint8_t flags = registry.flagsOf(handle);
+            if (flags & (TabRegistry::ACTIVE | TabRegistry::PINNED | TabRegistry::HIBERNATED)) continue;
+            if (registry.lastVisitedOf(handle) <= cutoff) {
+                registry.get(handle)->hibernateTab(true);
+                count++;
+            }
+        }
+        
+        if (count > 0) {
+            NOVA_LOG_INFO(GROUP, "Hibernated " << count << " inactive tabs in group '" << name << "'");
+        }
+    }
+    
+    // Runs hibernateInactiveTabs on the owner thread at half the threshold
+    // (at least once a minute), as the shared timer posts it; a zero
+    // threshold turns it off
+    void setIdleHibernation(std::chrono::minutes threshold) {
+        auto& wheel = TimerWheel::instance();
+        if (idleTimer) {
+            wheel.cancel(idleTimer);
+            MainThreadQueue::instance().cancel(this);
+            idleTimer = 0;
+        }
+        if (threshold.count() <= 0) return;
+        
+        auto period = std::max(threshold / 2, std::chrono::minutes(1));
+        idleTimer = wheel.schedule(period, [this, threshold] {
+            MainThreadQueue::instance().post(this, [this, threshold] { hibernateInactiveTabs(threshold); });
+        }, period, kIdleCheckSlack);
+        NOVA_LOG_DEBUG(GROUP, "Idle hibernation after " << threshold.count() << " minutes in group '" << name << "'");
+    }
+    
+    // Event handler for tab events
+    void handleTabEvents(EventSpan<TabEvent> events) {
+        for (const auto& event : events) {
+            switch (event.type) {
+                case TabEventType::NAVIGATED:
+                    reindexDomain(event.tab, static_cast<DomainAtom>(event.value));
+                    break;
+                case TabEventType::TITLE_CHANGED:
+                case TabEventType::FAVICON_CHANGED:
+                    // Update group UI accordingly
+                    break;
+                case TabEventType::MEDIA_STATE_CHANGED:
+                    // Potentially highlight tabs with media
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    
+private:
+    std::string name;
+    std::string color;
+    std::string icon;
+    ViewMode viewMode;
+    std::vector<std::shared_ptr<Tab>> tabs;
+    std::vector<TabId> handles;  // the tabs' registry handles, in the same order
+    std::vector<SessionJournal::Key> pendingKeys;  // saved tabs still to restore, from pendingNext
+    size_t pendingNext = 0;
+    bool isCollapsed;
+    bool isAutoGroup;
+    AutoGroupingRule autoGroupRule;
+    GroupMetrics metrics;
+    
+    // Per-tab bookkeeping: the event subscription and the domain the tab is
+    // currently indexed under (which may lag its URL inside an EventBatch)
+    struct Membership {
+        std::shared_ptr<Tab> tab;  // indexed again whenever its domain changes
+        Subscription subscription;
+        DomainAtom indexedDomain = 0;
+    };
+    std::unordered_map<const Tab*, Membership> members;
+    
+    // For quick lookups
+    FlatAtomMap<std::vector<std::shared_ptr<Tab>>> domainIndex;
+    
+    // Kept between reorganizations so only changed tabs are sketched again
+    std::unique_ptr<TopicClusterer> topicClusterer;
+    
+    static constexpr std::chrono::seconds kIdleCheckSlack{30};
+    TimerId idleTimer = 0;
+    
+    // Snapshots for group state restoration
+    std::map<std::string, std::vector<std::string>> snapshots; // id -> list of URLs
+    
+    std::shared_ptr<Arena> arena;
+    
+    void applyMetricsDelta(const Delta& delta, int sign) {
+        metrics.activeTabs += static_cast<size_t>(sign * delta.active);
+        metrics.hibernatedTabs += static_cast<size_t>(sign * delta.hibernated);
+        metrics.loadingTabs += static_cast<size_t>(sign * delta.loading);
+        assert(metricsMatchRecount());
+    }
+    
+    // Builds with -DNOVA_CHECK_METRICS check every incremental update against
+    // a full recount; that costs O(tabs) per state change, so it is opt-in
+    bool metricsMatchRecount() const {
+#ifdef NOVA_CHECK_METRICS
+        size_t active = 0, hibernated = 0, loading = 0;
+        for (const auto& tab : tabs) {
+            auto contribution = tab->stateContribution();
+            active += static_cast<size_t>(contribution.active);
+            hibernated += static_cast<size_t>(contribution.hibernated);
+            loading += static_cast<size_t>(contribution.loading);
+        }
+        return metrics.totalTabs == tabs.size() && metrics.activeTabs == active &&
+               metrics.hibernatedTabs == hibernated && metrics.loadingTabs == loading;
+#else
+        return true;
+#endif
+    }
+    
+    // Largest topics first, each topic's tabs kept in their current order;
+    // tabs that fit no topic go last
+    void arrangeByTopic() {
+        if (!topicClusterer) topicClusterer = std::make_unique<TopicClusterer>();
+        topicClusterer->update(tabs);
+        std::unordered_map<uint32_t, size_t> rank;
+        for (const auto& topic : topicClusterer->topics()) {
+            rank.emplace(topicClusterer->topicOf(topic.tabs.front().get()), rank.size());
+        }
+        auto rankOf = [&](const std::shared_ptr<Tab>& tab) {
+            auto it = rank.find(topicClusterer->topicOf(tab.get()));
+            return it == rank.end() ? rank.size() : it->second;
+        };
+        std::stable_sort(tabs.begin(), tabs.end(), [&](const std::shared_ptr<Tab>& a, const std::shared_ptr<Tab>& b) {
+            return rankOf(a) < rankOf(b);
+        });
+        refreshHandles();
+        NOVA_LOG_DEBUG(GROUP, "Arranged " << tabs.size() << " tabs of group '" << name << "' into "
+                       << rank.size() << " topics");
+    }
+    
+    void clearTabs() {
+        for (const auto& tab : tabs) {
+            tab->detachStateObserver(this);
+            OpenTabIndex::instance().remove(tab.get(), {nullptr, this});
+        }
+        tabs.clear();
+        handles.clear();
+        members.clear();
+        domainIndex.clear();
+        topicClusterer.reset();
+        metrics.totalTabs = 0;
+        metrics.activeTabs = 0;
+        metrics.hibernatedTabs = 0;
+        metrics.loadingTabs = 0;
+    }
+    
+    void refreshHandles() {
+        for (size_t i = 0; i < tabs.size(); ++i) handles[i] = tabs[i]->getHandle();
+    }
+    
+    void removeMembership(const std::shared_ptr<Tab>& tab) {
+        auto it = members.find(tab.get());
+        if (it == members.end()) return;
+        unindexDomain(tab.get(), it->second.indexedDomain);
+        members.erase(it);
+    }
+    
+    void reindexDomain(const Tab* tab, DomainAtom domain) {
+        auto it = members.find(tab);
+        if (it == members.end() || it->second.indexedDomain == domain) return;
+        
+        // A tab that had no domain (about:blank) is in no bucket yet
+        unindexDomain(tab, it->second.indexedDomain);
+        it->second.indexedDomain = domain;
+        if (domain != 0) {
+            domainIndex[domain].push_back(it->second.tab);
+        }
+    }
+    
+    void unindexDomain(const Tab* tab, DomainAtom domain) {
+        auto* domainTabs = domainIndex.find(domain);
+        if (!domainTabs) return;
+        
+        auto pos = std::find_if(domainTabs->begin(), domainTabs->end(),
+            [tab](const std::shared_ptr<Tab>& t) { return t.get() == tab; });
+        if (pos != domainTabs->end()) {
+            // Order within a domain bucket is irrelevant, so swap-and-pop
+            *pos = std::move(domainTabs->back());
+            domainTabs->pop_back();
+        }
+        if (domainTabs->empty()) {
+            domainIndex.erase(domain);
+        }
+    }
+};
+
+// Sidebar for quick access to bookmarks, history, etc.
+class Sidebar {
+public:
+    enum class Panel { BOOKMARKS, HISTORY, EXTENSIONS, NOTES, NONE };
+    
+    Sidebar() : isVisible(false), activePanel(Panel::NONE) {}
+    
+    void toggle() {
+        isVisible = !isVisible;
+        NOVA_LOG_INFO(UI, (isVisible ? "Sidebar shown" : "Sidebar hidden"));
+    }
+    
+    void showPanel(Panel panel) {
+        activePanel = panel;
+        isVisible = true;
+        NOVA_LOG_INFO(UI, "Showing sidebar panel: " << getPanelString());
+        if (panel == Panel::HISTORY) loadHistory();
+    }
+    
+    bool getIsVisible() const { return isVisible; }
+    Panel getActivePanel() const { return activePanel; }
+    
+    // What the history panel lists: the last day's visits and busiest sites
+    const std::vector<HistoryDatabase::Visit>& getRecentVisits() const { return recentVisits; }
+    const std::vector<HistoryDatabase::DomainVisits>& getTopSites() const { return topSites; }
+    
+    std::string getPanelString() const {
+        switch (activePanel) {
+            case Panel::BOOKMARKS: return "Bookmarks";
+            case Panel::HISTORY: return "History";
+            case Panel::EXTENSIONS: return "Extensions";
+            case Panel::NOTES: return "Notes";
+            case Panel::NONE: return "None";
+            default: return "Unknown";
+        }
+    }
+    
+private:
+    static constexpr size_t kHistoryRows = 100;
+    static constexpr size_t kTopSites = 10;
+    
+    bool isVisible;
+    Panel activePanel;
+    std::vector<HistoryDatabase::Visit> recentVisits;
+    std::vector<HistoryDatabase::DomainVisits> topSites;
+    
+    void loadHistory() {
+        auto& history = HistoryDatabase::instance();
+        auto now = std::chrono::system_clock::now();
+        auto dayAgo = now - std::chrono::hours(24);
+        // Inclusive of visits recorded this millisecond
+        auto end = now + std::chrono::milliseconds(1);
+        recentVisits = history.recentVisits(dayAgo, end, kHistoryRows);
+        topSites = history.topDomains(dayAgo, end, kTopSites);
+        NOVA_LOG_DEBUG(UI, "History panel: " << recentVisits.size() << " visits, " << topSites.size() << " sites");
+    }
+};
+
+// Google search integration with customized results
+class SearchEngine {
+public:
+    SearchEngine() : defaultEngine("Google") {}
+    
+    void search(const std::string& query) {
+        NOVA_LOG_INFO(UI, "Searching with " << defaultEngine << ": " << query);
+        // This would actually perform the search and render results
+        NOVA_LOG_INFO(UI, "Displaying results in enhanced reading layout");
+    }
+    
+    void setDefaultEngine(const std::string& engine) {
+        defaultEngine = engine;
+    }
+    
+    std::string getDefaultEngine() const { return defaultEngine; }
+    
+private:
+    std::string defaultEngine;
+};
+
+// Ids are never reused, so one held by the UI or a sync record stays valid
+// or reads as removed
+using BookmarkId = uint32_t;
+
+// Bookmarks in a folder tree. Each node is addressed by a stable id and
+// linked to its siblings, so adds, removals and moves are O(1). A hash of
+// every URL answers "is this bookmarked?" without a scan, and a sorted
+// index of title words and URLs (without the scheme) answers prefix
+// searches. Flat categories map onto folders under the root.
+class BookmarkManager : public SuggestionSource {
+public:
+    static constexpr BookmarkId kNoBookmark = 0;
+    static constexpr BookmarkId kRoot = 1;
+    
+    struct Bookmark {
+        BookmarkId id = kNoBookmark;
+        BookmarkId parent = kNoBookmark;
+        std::string title;
+        std::string url;  // empty for folders
+        bool folder = false;
+    };
+    
+    // Indexes the bookmarks added while it is open for search in one pass
+    // when the outermost batch closes; searches see them only then
+    class Batch {
+    public:
+        explicit Batch(BookmarkManager& manager) : manager(manager) { manager.batchDepth++; }
+        ~Batch() {
+            if (--manager.batchDepth == 0) manager.indexPending();
+        }
+        
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+        
+    private:
+        BookmarkManager& manager;
+    };
+    
+    BookmarkManager() {
+        nodes.resize(2);
+        nodes[kRoot].title = "Bookmarks";
+        nodes[kRoot].folder = true;
+        nodes[kRoot].live = true;
+    }
+    
+    BookmarkId addBookmark(const std::string& url, const std::string& title, const std::string& category = "Uncategorized") {
+        BookmarkId id = addBookmarkTo(folderNamed(kRoot, category), url, title);
+        NOVA_LOG_INFO(BOOKMARKS, "Bookmarked: " << title << " in category: " << category);
+        return id;
+    }
+    
+    BookmarkId addBookmarkTo(BookmarkId folder, std::string_view url, std::string_view title) {
+        if (!isFolder(folder) || url.empty()) return kNoBookmark;
+        BookmarkId id = newNode(folder, title, false);
+        Node& node = nodes[id];
+        node.url.assign(url);
+        node.urlHash = hashOf(url);
+        locateUrlKeys(node);
+        BookmarkId& head = urlIndex[node.urlHash];
+        node.nextSameUrl = head;
+        head = id;
+        indexKeys(id, true);
+        bookmarkCount++;
+        journal.record({node.url, node.title, 1, std::chrono::system_clock::now()});
+        return id;
+    }
+    
+    // The existing child folder with this title (the oldest, if several
+    // share it), or a new one
+    BookmarkId folderNamed(BookmarkId parent, std::string_view title) {
+        if (!isFolder(parent)) return kNoBookmark;
+        auto it = folderNames.find({parent, std::string(title)});
+        if (it != folderNames.end()) return it->second;
+        return addFolder(parent, title);
+    }
+    
+    BookmarkId addFolder(BookmarkId parent, std::string_view title) {
+        if (!isFolder(parent)) return kNoBookmark;
+        BookmarkId id = newNode(parent, title, true);
+        nameFolder(id);
+        return id;
+    }
+    
+    // With no category, removes the most recently added bookmark of the URL
+    void removeBookmark(const std::string& url, const std::string& category = "") {
+        BookmarkId folder = kNoBookmark;
+        if (!category.empty()) {
+            auto it = folderNames.find({kRoot, category});
+            if (it == folderNames.end()) return;
+            folder = it->second;
+        }
+        for (BookmarkId id = firstWithUrl(url); id != kNoBookmark; id = nextWithUrl(id)) {
+            if (folder != kNoBookmark && nodes[id].parent != folder) continue;
+            remove(id);
+            if (category.empty()) {
+                NOVA_LOG_INFO(BOOKMARKS, "Removed bookmark: " << url);
+            } else {
+                NOVA_LOG_INFO(BOOKMARKS, "Removed bookmark: " << url << " from category: " << category);
+            }
+            return;
+        }
+    }
+    
+    // Removes a bookmark, or a folder with everything in it
+    bool remove(BookmarkId id) {
+        if (!isLive(id) || id == kRoot) return false;
+        while (nodes[id].firstChild != kNoBookmark) remove(nodes[id].firstChild);
+        if (nodes[id].folder) unnameFolder(id);
+        unlink(id);
+        Node& node = nodes[id];
+        if (!node.folder) {
+            indexKeys(id, false);
+            unindexUrl(id);
+            bookmarkCount--;
+            // A URL bookmarked elsewhere is still suggested
+            if (firstWithUrl(node.url) == kNoBookmark) {
+                Item removal;
+                removal.text = node.url;
+                removal.removed = true;
+                journal.record(std::move(removal));
+            }
+        }
+        node = Node();
+        return true;
+    }
+    
+    bool rename(BookmarkId id, std::string_view title) {
+        if (!isLive(id) || id == kRoot) return false;
+        Node& node = nodes[id];
+        if (node.folder) {
+            unnameFolder(id);
+            node.title.assign(title);
+            nameFolder(id);
+            return true;
+        }
+        indexKeys(id, false);
+        node.title.assign(title);
+        indexKeys(id, true);
+        journal.record({node.url, node.title, 1, std::chrono::system_clock::now()});
+        return true;
+    }
+    
+    // Moves to the end of `folder`; a folder cannot move into itself
+    bool move(BookmarkId id, BookmarkId folder) {
+        if (!isLive(id) || id == kRoot || !isFolder(folder)) return false;
+        for (BookmarkId ancestor = folder; ancestor != kNoBookmark; ancestor = nodes[ancestor].parent) {
+            if (ancestor == id) return false;
+        }
+        if (nodes[id].folder) unnameFolder(id);
+        unlink(id);
+        link(id, folder);
+        if (nodes[id].folder) nameFolder(id);
+        return true;
+    }
+    
+    bool isBookmarked(std::string_view url) const { return firstWithUrl(url) != kNoBookmark; }
+    
+    std::optional<Bookmark> getBookmark(BookmarkId id) const {
+        if (!isLive(id)) return std::nullopt;
+        const Node& node = nodes[id];
+        return Bookmark{id, node.parent, node.title, node.url, node.folder};
+    }
+    
+    std::vector<BookmarkId> getChildren(BookmarkId folder) const {
+        std::vector<BookmarkId> children;
+        if (!isFolder(folder)) return children;
+        for (BookmarkId child = nodes[folder].firstChild; child != kNoBookmark; child = nodes[child].next) {
+            children.push_back(child);
+        }
+        return children;
+    }
+    
+    // Bookmarks with a title word or URL starting with each of the query's
+    // words, in index order
+    std::vector<Bookmark> search(std::string_view query, size_t limit = 20) const {
+        std::vector<std::string> terms = queryTerms(query);
+        std::vector<Bookmark> results;
+        if (terms.empty() || limit == 0) return results;
+        // The rarest term drives the search; the others are checked per candidate
+        std::vector<std::pair<size_t, std::string>> counted;
+        size_t rarest = SIZE_MAX;
+        for (auto& term : terms) {
+            counted.push_back({keyIndex.count(nodes, term, rarest), std::move(term)});
+            rarest = std::min(rarest, counted.back().first);
+        }
+        std::sort(counted.begin(), counted.end());
+        if (counted.front().first == 0) return results;
+        for (size_t i = 0; i < counted.size(); ++i) terms[i] = std::move(counted[i].second);
+        std::vector<BookmarkId> found;
+        keyIndex.forEachPrefix(nodes, terms[0], [&](BookmarkId id) {
+            if (std::find(found.begin(), found.end(), id) != found.end()) return true;
+            for (size_t i = 1; i < terms.size(); ++i) {
+                if (!matchesPrefix(id, terms[i])) return true;
+            }
+            found.push_back(id);
+            return found.size() < limit;
+        });
+        for (BookmarkId id : found) results.push_back(*getBookmark(id));
+        return results;
+    }
+    
+    size_t size() const { return bookmarkCount; }
+    
+    void suggestBookmarks() const {
+        NOVA_LOG_INFO(BOOKMARKS, "Suggesting bookmarks based on browsing habits and time of day");
+        // In a real implementation, this would use algorithms to suggest relevant bookmarks
+    }
+    
+    SuggestionKind suggestionKind() const override { return SuggestionKind::BOOKMARK; }
+    uint64_t suggestionVersion() override { return journal.version(); }
+    
+    bool suggestionChanges(uint64_t since, std::vector<Item>& items) override {
+        if (journal.changesSince(since, items)) return true;
+        auto now = std::chrono::system_clock::now();
+        for (const auto& node : nodes) {
+            if (node.live && !node.folder) items.push_back({node.url, node.title, 1, now});
+        }
+        return false;
+    }
+    
+private:
+    // A key's place in its bookmark's title, or from `offset` to the end of its URL
+    struct KeyRef {
+        static constexpr uint16_t kToUrlEnd = UINT16_MAX;
+        uint16_t offset;
+        uint16_t length;
+    };
+    
+    struct Node {
+        std::string title;
+        std::string url;
+        size_t urlHash = 0;
+        uint32_t urlKey = 0;   // where the URL keys start in `url`
+        uint32_t siteKey = 0;  // or 0 without a separate site key
+        BookmarkId parent = kNoBookmark;
+        BookmarkId firstChild = kNoBookmark;
+        BookmarkId lastChild = kNoBookmark;
+        BookmarkId previous = kNoBookmark;
+        BookmarkId next = kNoBookmark;
+        BookmarkId nextSameUrl = kNoBookmark;  // other bookmarks whose URL hashes alike
+        bool folder = false;
+        bool live = false;
+    };
+    
+    // Sorted (key, id) postings in blocks of at most kBlockSize, so an insert
+    // or erase shifts one block rather than the whole index. A posting keeps
+    // only the first 8 folded bytes of its key; the rest is read from the
+    // bookmark's title or URL when two keys start alike.
+    class PrefixIndex {
+    public:
+        void insert(const std::vector<Node>& nodes, BookmarkId id, KeyRef ref) {
+            if (blocks.empty()) {
+                blocks.emplace_back();
+                firsts.push_back(0);
+            }
+            Probe probe = probeOf(keyText(nodes[id], ref), id, false);
+            size_t index = blockOf(nodes, probe);
+            auto& block = blocks[index];
+            block.insert(lowerBound(nodes, block, probe), Posting{probe.head, id, ref});
+            postings++;
+            if (block.size() > kBlockSize) {
+                std::vector<Posting> upper(block.begin() + kBlockSize / 2, block.end());
+                block.erase(block.begin() + kBlockSize / 2, block.end());
+                blocks.insert(blocks.begin() + static_cast<std::ptrdiff_t>(index) + 1, std::move(upper));
+                firsts.insert(firsts.begin() + static_cast<std::ptrdiff_t>(index) + 1, blocks[index + 1].front().head);
+            }
+            firsts[index] = blocks[index].front().head;
+        }
+        
+        void erase(const std::vector<Node>& nodes, BookmarkId id, KeyRef ref) {
+            if (blocks.empty()) return;
+            Probe probe = probeOf(keyText(nodes[id], ref), id, false);
+            size_t index = blockOf(nodes, probe);
+            auto& block = blocks[index];
+            auto position = lowerBound(nodes, block, probe);
+            if (position == block.end() || compare(nodes, *position, probe) != 0) return;
+            block.erase(position);
+            postings--;
+            if (block.empty() && blocks.size() > 1) {
+                blocks.erase(blocks.begin() + static_cast<std::ptrdiff_t>(index));
+                firsts.erase(firsts.begin() + static_cast<std::ptrdiff_t>(index));
+            } else if (!block.empty()) {
+                firsts[index] = block.front().head;
+            }
+        }
+        
+        // Merges many keys in with one pass over the index, leaving blocks
+        // three-quarters full so that single inserts rarely split them
+        void insertAll(const std::vector<Node>& nodes, const std::vector<std::pair<BookmarkId, KeyRef>>& keys) {
+            // A few keys are cheaper to insert than a pass over everything
+            if (keys.size() * 64 < postings) {
+                for (const auto& [id, ref] : keys) insert(nodes, id, ref);
+                return;
+            }
+            auto less = [&](const Posting& posting, const Probe& probe) { return compare(nodes, posting, probe) < 0; };
+            auto probeFor = [&](const Posting& posting) { return probeOf(keyText(nodes[posting.id], posting.ref), posting.id, false); };
+            std::vector<Posting> added = sortedPostings(nodes, keys);
+            
+            std::vector<std::vector<Posting>> merged;
+            std::vector<uint64_t> mergedFirsts;
+            std::vector<Posting> filling;
+            auto emit = [&](const Posting& posting) {
+                if (filling.empty()) filling.reserve(kBlockSize + 1);
+                filling.push_back(posting);
+                if (filling.size() == kBlockSize * 3 / 4) {
+                    mergedFirsts.push_back(filling.front().head);
+                    merged.push_back(std::move(filling));
+                    filling = std::vector<Posting>();
+                }
+            };
+            // Old blocks are freed as the merge passes them
+            size_t index = 0;
+            size_t position = 0;
+            for (const Posting& posting : added) {
+                Probe probe = probeFor(posting);
+                while (index < blocks.size()) {
+                    auto& block = blocks[index];
+                    if (block.empty() || less(block.back(), probe)) {
+                        for (size_t i = position; i < block.size(); ++i) emit(block[i]);
+                        std::vector<Posting>().swap(block);
+                        index++;
+                        position = 0;
+                        continue;
+                    }
+                    auto end = std::lower_bound(block.begin() + static_cast<std::ptrdiff_t>(position), block.end(), probe, less);
+                    for (size_t i = position; i < static_cast<size_t>(end - block.begin()); ++i) emit(block[i]);
+                    position = static_cast<size_t>(end - block.begin());
+                    break;
+                }
+                emit(posting);
+            }
+            for (; index < blocks.size(); ++index, position = 0) {
+                for (size_t i = position; i < blocks[index].size(); ++i) emit(blocks[index][i]);
+                std::vector<Posting>().swap(blocks[index]);
+            }
+            if (!filling.empty()) {
+                mergedFirsts.push_back(filling.front().head);
+                merged.push_back(std::move(filling));
+            }
+            blocks.swap(merged);
+            firsts.swap(mergedFirsts);
+            postings += keys.size();
+        }
+        
+        // Calls fn(id) for each key starting with the folded `prefix` until it returns false
+        template <typename Fn>
+        void forEachPrefix(const std::vector<Node>& nodes, std::string_view prefix, Fn&& fn) const {
+            if (blocks.empty() || prefix.empty()) return;
+            Probe start = probeOf(prefix, 0);
+            uint64_t mask = ~uint64_t(0) << (64 - 8 * std::min<size_t>(prefix.size(), 8));
+            for (size_t index = blockOf(nodes, start); index < blocks.size(); ++index) {
+                const auto& block = blocks[index];
+                for (auto position = lowerBound(nodes, block, start); position != block.end(); ++position) {
+                    if ((position->head & mask) != (start.head & mask)) return;
+                    if (!start.headOnly && !startsWithFolded(keyText(nodes[position->id], position->ref), prefix)) return;
+                    if (!fn(position->id)) return;
+                }
+            }
+        }
+        
+        // Keys starting with the folded `prefix`, counting no further than `cap`
+        size_t count(const std::vector<Node>& nodes, std::string_view prefix, size_t cap = SIZE_MAX) const {
+            if (blocks.empty()) return 0;
+            // No UTF-8 byte is 0xff, so this sorts after every key with the prefix
+            std::string end = std::string(prefix) + '\xff';
+            Probe first = probeOf(prefix, 0);
+            Probe last = probeOf(end, 0);
+            size_t firstBlock = blockOf(nodes, first);
+            size_t lastBlock = blockOf(nodes, last);
+            auto from = lowerBound(nodes, blocks[firstBlock], first);
+            auto to = lowerBound(nodes, blocks[lastBlock], last);
+            if (firstBlock == lastBlock) return static_cast<size_t>(to - from);
+            size_t total = static_cast<size_t>(blocks[firstBlock].end() - from) + static_cast<size_t>(to - blocks[lastBlock].begin());
+            for (size_t index = firstBlock + 1; index < lastBlock && total < cap; ++index) total += blocks[index].size();
+            return total;
+        }
+        
+    private:
+        struct Posting {
+            uint64_t head;  // first 8 folded bytes, most significant first
+            BookmarkId id;
+            KeyRef ref;
+        };
+        
+        // A key being looked up, in place of a posting
+        struct Probe {
+            uint64_t head;
+            std::string_view text;
+            BookmarkId id;
+            bool headOnly;  // the head spells out the whole key
+            bool folded;    // `text` is folded already, as queries are
+        };
+        
+        static constexpr size_t kBlockSize = 256;
+        std::vector<std::vector<Posting>> blocks;
+        std::vector<uint64_t> firsts;  // head of each block's first posting
+        size_t postings = 0;
+        
+        static uint64_t headOf(std::string_view text) {
+            uint64_t head = 0;
+            for (size_t i = 0; i < 8; ++i) head = (head << 8) | (i < text.size() ? foldByte(text[i]) : 0);
+            return head;
+        }
+        
+        // Words have no NUL bytes, so up to 8 bytes of one fit in its head
+        static Probe probeOf(std::string_view text, BookmarkId id, bool folded = true) {
+            return {headOf(text), text, id, text.size() <= 8 && text.find('\0') == std::string_view::npos, folded};
+        }
+        
+        static int compare(const std::vector<Node>& nodes, const Posting& posting, const Probe& probe) {
+            if (posting.head != probe.head) return posting.head < probe.head ? -1 : 1;
+            if (!probe.headOnly || posting.ref.length > 8) {
+                std::string_view text = keyText(nodes[posting.id], posting.ref);
+                int order = probe.folded ? compareFolded(text, probe.text) : compareUnfolded(text, probe.text);
+                if (order != 0) return order;
+            }
+            return posting.id < probe.id ? -1 : posting.id > probe.id ? 1 : 0;
+        }
+        
+        // Postings for `keys` in index order. Keys are sorted on 8 folded bytes
+        // at a time and only runs sharing them go on to the next 8, so each
+        // key's text is read once per level rather than once per comparison
+        static std::vector<Posting> sortedPostings(const std::vector<Node>& nodes,
+                                                   const std::vector<std::pair<BookmarkId, KeyRef>>& keys) {
+            struct Sorting {
+                uint64_t word;  // the folded bytes at the run's depth
+                bool ended;     // the key ends within them
+                std::string_view text;
+                Posting posting;
+            };
+            std::vector<Sorting> sorting;
+            sorting.reserve(keys.size());
+            for (const auto& [id, ref] : keys) {
+                std::string_view text = keyText(nodes[id], ref);
+                sorting.push_back({0, false, text, {headOf(text), id, ref}});
+            }
+            struct Run {
+                size_t begin;
+                size_t end;
+                size_t depth;
+            };
+            std::vector<Run> runs = {{0, sorting.size(), 0}};
+            while (!runs.empty()) {
+                Run run = runs.back();
+                runs.pop_back();
+                auto begin = sorting.begin() + static_cast<std::ptrdiff_t>(run.begin);
+                auto end = sorting.begin() + static_cast<std::ptrdiff_t>(run.end);
+                for (auto it = begin; it != end; ++it) {
+                    it->word = headOf(it->text.substr(std::min(it->text.size(), run.depth)));
+                    it->ended = it->text.size() <= run.depth + 8;
+                }
+                // A key ending here is a prefix of the longer ones sharing its word
+                std::sort(begin, end, [](const Sorting& a, const Sorting& b) {
+                    if (a.word != b.word) return a.word < b.word;
+                    if (a.ended != b.ended) return a.ended;
+                    return a.posting.id < b.posting.id;
+                });
+                for (auto it = begin; it != end;) {
+                    auto next = it + 1;
+                    while (next != end && next->word == it->word) ++next;
+                    auto longer = std::find_if(it, next, [](const Sorting& entry) { return !entry.ended; });
+                    if (next - longer > 1) {
+                        runs.push_back({static_cast<size_t>(longer - sorting.begin()), static_cast<size_t>(next - sorting.begin()),
+                                        run.depth + 8});
+                    }
+                    it = next;
+                }
+            }
+            std::vector<Posting> sorted;
+            sorted.reserve(sorting.size());
+            for (const auto& entry : sorting) sorted.push_back(entry.posting);
+            return sorted;
+        }
+        
+        std::vector<Posting>::const_iterator lowerBound(const std::vector<Node>& nodes, const std::vector<Posting>& block,
+                                                        const Probe& probe) const {
+            return std::lower_bound(block.begin(), block.end(), probe, [&](const Posting& posting, const Probe& key) {
+                return compare(nodes, posting, key) < 0;
+            });
+        }
+        
+        // The last block starting at or before `probe`; only the first block can be empty
+        size_t blockOf(const std::vector<Node>& nodes, const Probe& probe) const {
+            // Heads narrow it down; blocks starting with the same head need the full key
+            auto low = std::lower_bound(firsts.begin() + 1, firsts.end(), probe.head);
+            auto high = std::upper_bound(low, firsts.end(), probe.head);
+            auto next = std::upper_bound(low, high, probe, [&](const Probe& key, const uint64_t& first) {
+                return compare(nodes, blocks[static_cast<size_t>(&first - firsts.data())].front(), key) > 0;
+            });
+            return static_cast<size_t>(next - firsts.begin()) - 1;
+        }
+    };
+    
+    static constexpr size_t kMaxTitleWords = 16;
+    
+    std::vector<Node> nodes;  // by id; 0 is unused
+    std::unordered_map<size_t, BookmarkId> urlIndex;  // URL hash -> newest bookmark
+    std::map<std::pair<BookmarkId, std::string>, BookmarkId> folderNames;
+    PrefixIndex keyIndex;
+    std::vector<BookmarkId> pendingKeys;  // added inside a batch, not yet indexed
+    int batchDepth = 0;
+    size_t bookmarkCount = 0;
+    SuggestionJournal journal;
+    
+    static size_t hashOf(std::string_view text) { return std::hash<std::string_view>{}(text); }
+    
+    bool isLive(BookmarkId id) const { return id < nodes.size() && nodes[id].live; }
+    bool isFolder(BookmarkId id) const { return isLive(id) && nodes[id].folder; }
+    
+    BookmarkId newNode(BookmarkId parent, std::string_view title, bool folder) {
+        BookmarkId id = static_cast<BookmarkId>(nodes.size());
+        nodes.emplace_back();
+        Node& node = nodes.back();
+        node.title.assign(title);
+        node.folder = folder;
+        node.live = true;
+        link(id, parent);
+        return id;
+    }
+    
+    // folderNames holds one folder per (parent, title): the oldest
+    void nameFolder(BookmarkId id) {
+        auto [it, added] = folderNames.emplace(std::make_pair(nodes[id].parent, nodes[id].title), id);
+        if (!added && it->second > id) it->second = id;
+    }
+    
+    void unnameFolder(BookmarkId id) {
+        const Node& node = nodes[id];
+        auto it = folderNames.find({node.parent, node.title});
+        if (it == folderNames.end() || it->second != id) return;
+        it->second = kNoBookmark;
+        for (BookmarkId sibling = nodes[node.parent].firstChild; sibling != kNoBookmark; sibling = nodes[sibling].next) {
+            const Node& other = nodes[sibling];
+            if (sibling != id && other.folder && other.title == node.title && (it->second == kNoBookmark || sibling < it->second)) {
+                it->second = sibling;
+            }
+        }
+        if (it->second == kNoBookmark) folderNames.erase(it);
+    }
+    
+    void link(BookmarkId id, BookmarkId parent) {
+        Node& node = nodes[id];
+        Node& folder = nodes[parent];
+        node.parent = parent;
+        node.previous = folder.lastChild;
+        node.next = kNoBookmark;
+        if (folder.lastChild != kNoBookmark) {
+            nodes[folder.lastChild].next = id;
+        } else {
+            folder.firstChild = id;
+        }
+        folder.lastChild = id;
+    }
+    
+    void unlink(BookmarkId id) {
+        Node& node = nodes[id];
+        Node& folder = nodes[node.parent];
+        (node.previous != kNoBookmark ? nodes[node.previous].next : folder.firstChild) = node.next;
+        (node.next != kNoBookmark ? nodes[node.next].previous : folder.lastChild) = node.previous;
+        node.previous = kNoBookmark;
+        node.next = kNoBookmark;
+    }
+    
+    BookmarkId firstWithUrl(std::string_view url) const {
+        auto it = urlIndex.find(hashOf(url));
+        if (it == urlIndex.end()) return kNoBookmark;
+        BookmarkId id = it->second;
+        while (id != kNoBookmark && nodes[id].url != url) id = nodes[id].nextSameUrl;
+        return id;
+    }
+    
+    BookmarkId nextWithUrl(BookmarkId id) const {
+        const std::string& url = nodes[id].url;
+        do {
+            id = nodes[id].nextSameUrl;
+        } while (id != kNoBookmark && nodes[id].url != url);
+        return id;
+    }
+    
+    void unindexUrl(BookmarkId id) {
+        auto it = urlIndex.find(nodes[id].urlHash);
+        BookmarkId* link = &it->second;
+        while (*link != id) link = &nodes[*link].nextSameUrl;
+        *link = nodes[id].nextSameUrl;
+        if (it->second == kNoBookmark) urlIndex.erase(it);
+    }
+    
+    static uint8_t foldByte(char c) {
+        return static_cast<uint8_t>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+    
+    static std::string fold(std::string_view text) {
+        std::string folded(text);
+        for (auto& c : folded) c = static_cast<char>(foldByte(c));
+        return folded;
+    }
+    
+    // Orders `text` against `folded` as if `text` were folded too
+    static int compareFolded(std::string_view text, std::string_view folded) {
+        size_t length = std::min(text.size(), folded.size());
+        for (size_t i = 0; i < length; ++i) {
+            uint8_t a = foldByte(text[i]);
+            uint8_t b = static_cast<uint8_t>(folded[i]);
+            if (a != b) return a < b ? -1 : 1;
+        }
+        return text.size() < folded.size() ? -1 : text.size() > folded.size() ? 1 : 0;
+    }
+    
+    // Orders two keys as if both were folded
+    static int compareUnfolded(std::string_view left, std::string_view right) {
+        size_t length = std::min(left.size(), right.size());
+        for (size_t i = 0; i < length; ++i) {
+            uint8_t a = foldByte(left[i]);
+            uint8_t b = foldByte(right[i]);
+            if (a != b) return a < b ? -1 : 1;
+        }
+        return left.size() < right.size() ? -1 : left.size() > right.size() ? 1 : 0;
+    }
+    
+    static bool startsWithFolded(std::string_view text, std::string_view prefix) {
+        return text.size() >= prefix.size() && compareFolded(text.substr(0, prefix.size()), prefix) == 0;
+    }
+    
+    // Runs of letters and digits; bytes of multi-byte UTF-8 characters count as letters
+    template <typename Fn>
+    static void forEachWord(std::string_view text, Fn&& fn) {
+        auto isWordByte = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || (c & 0x80); };
+        for (size_t i = 0; i < text.size();) {
+            if (!isWordByte(text[i])) {
+                i++;
+                continue;
+            }
+            size_t end = i;
+            while (end < text.size() && isWordByte(text[end])) end++;
+            fn(text.substr(i, end - i));
+            i = end;
+        }
+    }
+    
+    // Words, except that a URL-like piece ("github.com/nova") stays whole to
+    // match the URL keys
+    static std::vector<std::string> queryTerms(std::string_view query) {
+        std::vector<std::string> terms;
+        for (size_t i = 0; i < query.size();) {
+            size_t end = query.find(' ', i);
+            if (end == std::string_view::npos) end = query.size();
+            std::string_view piece = query.substr(i, end - i);
+            i = end + 1;
+            if (piece.find_first_of("./") == std::string_view::npos) {
+                forEachWord(piece, [&](std::string_view word) { terms.push_back(fold(word)); });
+                continue;
+            }
+            size_t scheme = piece.find("://");
+            if (scheme != std::string_view::npos) piece.remove_prefix(scheme + 3);
+            std::string term = fold(piece);
+            if (term.compare(0, 4, "www.") == 0) term.erase(0, 4);
+            if (!term.empty()) terms.push_back(std::move(term));
+        }
+        return terms;
+    }
+    
+    static std::string_view keyText(const Node& node, KeyRef ref) {
+        if (ref.length == KeyRef::kToUrlEnd) return std::string_view(node.url).substr(ref.offset);
+        return std::string_view(node.title).substr(ref.offset, ref.length);
+    }
+    
+    // Title words, the URL without its scheme and "www.", and the URL from
+    // its site on (wikipedia.org/... for en.wikipedia.org/...)
+    template <typename Fn>
+    static void forEachKey(const Node& node, Fn&& fn) {
+        size_t words = 0;
+        forEachWord(node.title, [&](std::string_view word) {
+            size_t offset = static_cast<size_t>(word.data() - node.title.data());
+            if (words++ < kMaxTitleWords && offset <= UINT16_MAX && word.size() < KeyRef::kToUrlEnd) {
+                fn(KeyRef{static_cast<uint16_t>(offset), static_cast<uint16_t>(word.size())});
+            }
+        });
+        if (node.urlKey <= UINT16_MAX) fn(KeyRef{static_cast<uint16_t>(node.urlKey), KeyRef::kToUrlEnd});
+        if (node.siteKey && node.siteKey <= UINT16_MAX) fn(KeyRef{static_cast<uint16_t>(node.siteKey), KeyRef::kToUrlEnd});
+    }
+    
+    static void locateUrlKeys(Node& node) {
+        std::string url = fold(node.url);
+        ParsedUrl parsed = UrlParser::parse(url);
+        size_t rest = 0;
+        if (parsed.hasAuthority && !parsed.host.empty()) rest = static_cast<size_t>(parsed.host.data() - url.data());
+        if (url.compare(rest, 4, "www.") == 0) rest += 4;
+        std::string_view site = UrlParser::siteOf(parsed.host);
+        node.urlKey = static_cast<uint32_t>(rest);
+        node.siteKey = 0;
+        if (!site.empty() && site.size() < parsed.host.size() && site.data() > url.data() + rest) {
+            node.siteKey = static_cast<uint32_t>(site.data() - url.data());
+        }
+    }
+    
+    static constexpr size_t kMaxKeys = kMaxTitleWords + 2;
+    
+    size_t keysOf(BookmarkId id, KeyRef (&keys)[kMaxKeys]) const {
+        const Node& node = nodes[id];
+        size_t count = 0;
+        forEachKey(node, [&](KeyRef ref) {
+            // A title repeating a word, or naming the URL, indexes it once
+            std::string_view text = keyText(node, ref);
+            for (size_t i = 0; i < count; ++i) {
+                std::string_view other = keyText(node, keys[i]);
+                if (other.size() == text.size() &&
+                    std::equal(text.begin(), text.end(), other.begin(), [](char a, char b) { return foldByte(a) == foldByte(b); })) {
+                    return;
+                }
+            }
+            keys[count++] = ref;
+        });
+        return count;
+    }
+    
+    void indexKeys(BookmarkId id, bool add) {
+        if (add && batchDepth > 0) {
+            pendingKeys.push_back(id);
+            return;
+        }
+        // The bookmark may still be waiting for its keys
+        if (!add && !pendingKeys.empty()) indexPending();
+        KeyRef keys[kMaxKeys];
+        size_t count = keysOf(id, keys);
+        for (size_t i = 0; i < count; ++i) {
+            if (add) {
+                keyIndex.insert(nodes, id, keys[i]);
+            } else {
+                keyIndex.erase(nodes, id, keys[i]);
+            }
+        }
+    }
+    
+    void indexPending() {
+        std::vector<std::pair<BookmarkId, KeyRef>> keys;
+        KeyRef refs[kMaxKeys];
+        for (BookmarkId id : pendingKeys) {
+            size_t count = keysOf(id, refs);
+            for (size_t i = 0; i < count; ++i) keys.push_back({id, refs[i]});
+        }
+        std::vector<BookmarkId>().swap(pendingKeys);
+        keyIndex.insertAll(nodes, keys);
+    }
+    
+    // Whether one of the bookmark's keys starts with the folded `prefix`,
+    // without building the keys
+    bool matchesPrefix(BookmarkId id, std::string_view prefix) const {
+        const Node& node = nodes[id];
+        bool matched = false;
+        forEachKey(node, [&](KeyRef ref) { matched = matched || startsWithFolded(keyText(node, ref), prefix); });
+        return matched;
+    }
+};
+
+// Bookmarks and history in the files other browsers exchange: Netscape
+// bookmark HTML, Chromium-style bookmark JSON and Takeout-style history
+// JSON. Files are streamed through a fixed buffer and entries are added in
+// batches of kBatchItems, so neither the file nor a copy of it is ever
+// held whole. Visits must be recorded oldest first, while exports are
+// often newest first, so history is sorted on the way in: sorted runs of a
+// batch each are spilled to temporary files and then merged.
+class ProfileTransfer {
+public:
+    struct Progress {
+        uint64_t bytes = 0;       // read or written so far
+        uint64_t totalBytes = 0;  // of the file being read; 0 when writing
+        uint64_t items = 0;
+    };
+    using ProgressCallback = std::function<void(const Progress&)>;
+    
+    struct Result {
+        bool ok = false;
+        uint64_t items = 0;
+    };
+    
+    // Into `folder`; folders in the file merge with same-named ones there
+    static Result importBookmarksHtml(const std::string& path, BookmarkManager& bookmarks,
+                                      BookmarkId folder = BookmarkManager::kRoot, const ProgressCallback& progress = nullptr) {
+        ChunkedReader input(path);
+        if (!input.ok()) return failOpen(path);
+        auto start = std::chrono::steady_clock::now();
+        BookmarkImport import(bookmarks, input, progress);
+        std::vector<BookmarkId> folders{folder};
+        std::optional<std::string> pendingFolder;  // an <H3> waiting for its <DL>
+        enum class Capture { NONE, FOLDER, LINK } capture = Capture::NONE;
+        std::string text;
+        std::string href;
+        std::string tag;
+        
+        for (int c = input.get(); c >= 0; c = input.get()) {
+            if (c != '<') {
+                if (capture != Capture::NONE && text.size() < kMaxText) text.push_back(static_cast<char>(c));
+                continue;
+            }
+            if (!readTag(input, tag)) continue;
+            bool closing = !tag.empty() && tag[0] == '/';
+            std::string name = tagName(tag);
+            if (name == "h3") {
+                if (!closing) {
+                    capture = Capture::FOLDER;
+                    text.clear();
+                } else if (capture == Capture::FOLDER) {
+                    pendingFolder = decodeEntities(trim(text));
+                    capture = Capture::NONE;
+                }
+            } else if (name == "a") {
+                if (!closing) {
+                    href = decodeEntities(attribute(tag, "href"));
+                    capture = Capture::LINK;
+                    text.clear();
+                } else if (capture == Capture::LINK) {
+                    if (!href.empty()) import.add(folders.back(), href, decodeEntities(trim(text)));
+                    capture = Capture::NONE;
+                }
+            } else if (name == "dl") {
+                if (!closing) {
+                    folders.push_back(pendingFolder ? bookmarks.folderNamed(folders.back(), *pendingFolder) : folders.back());
+                    pendingFolder.reset();
+                } else if (folders.size() > 1) {
+                    folders.pop_back();
+                }
+            }
+        }
+        return import.finish(path, start, true);
+    }
+    
+    static Result exportBookmarksHtml(const std::string& path, const BookmarkManager& bookmarks,
+                                      const ProgressCallback& progress = nullptr) {
+        ChunkedWriter output(path);
+        if (!output.ok()) return failOpen(path);
+        auto start = std::chrono::steady_clock::now();
+        output.write("<!DOCTYPE NETSCAPE-Bookmark-file-1>\n"
+                     "<!-- This is an automatically generated file.\n"
+                     "     It will be read and overwritten.\n"
+                     "     DO NOT EDIT! -->\n"
+                     "<META HTTP-EQUIV=\"Content-Type\" CONTENT=\"text/html; charset=UTF-8\">\n"
+                     "<TITLE>Bookmarks</TITLE>\n"
+                     "<H1>Bookmarks</H1>\n"
+                     "<DL><p>\n");
+        uint64_t items = 0;
+        forEachInTree(bookmarks, [&](const BookmarkManager::Bookmark& bookmark, size_t depth, bool enter) {
+            std::string indent(depth * 4, ' ');
+            if (!enter) {
+                output.write(indent);
+                output.write("</DL><p>\n");
+                return;
+            }
+            output.write(indent);
+            if (bookmark.folder) {
+                output.write("<DT><H3>");
+                writeEscaped(output, bookmark.title, false);
+                output.write("</H3>\n");
+                output.write(indent);
+                output.write("<DL><p>\n");
+                return;
+            }
+            output.write("<DT><A HREF=\"");
+            writeEscaped(output, bookmark.url, true);
+            output.write("\">");
+            writeEscaped(output, bookmark.title, false);
+            output.write("</A>\n");
+            if (++items % kBatchItems == 0 && progress) progress({output.written(), 0, items});
+        });
+        output.write("</DL><p>\n");
+        return finishExport(LogCategory::BOOKMARKS, output, path, items, start, progress, "bookmarks");
+    }
+    
+    // Chromium's layout: {"roots": {"bookmark_bar": {...}, "other": {...}}}.
+    // The bookmark bar's contents go straight into `folder` and every other
+    // root becomes a folder in it; any object with a "url" (or "uri") is a
+    // bookmark and any with "children" a folder, so flat lists import too.
+    static Result importBookmarksJson(const std::string& path, BookmarkManager& bookmarks,
+                                      BookmarkId folder = BookmarkManager::kRoot, const ProgressCallback& progress = nullptr) {
+        ChunkedReader input(path);
+        if (!input.ok()) return failOpen(path);
+        auto start = std::chrono::steady_clock::now();
+        BookmarkImport import(bookmarks, input, progress);
+        JsonReader reader(input);
+        
+        std::vector<JsonScope> scopes;
+        
+        for (JsonReader::Token token = reader.next();; token = reader.next()) {
+            if (token == JsonReader::Token::END) break;
+            if (token == JsonReader::Token::ERROR) return import.finish(path, start, false);
+            JsonScope* scope = scopes.empty() ? nullptr : &scopes.back();
+            switch (token) {
+                case JsonReader::Token::BEGIN_OBJECT: {
+                    JsonScope next;
+                    next.object = true;
+                    next.parent = folder;
+                    if (scope && scope->object) {
+                        next.parent = BookmarkManager::kNoBookmark;
+                        if (scope->key == "roots") {
+                            next.parent = folder;
+                            next.roots = true;
+                        } else if (scope->roots) {
+                            next.parent = folder;
+                            if (scope->key == "bookmark_bar") next.self = folder;
+                        }
+                    } else if (scope) {
+                        next.parent = scope->parent;
+                    } else {
+                        next.self = folder;
+                    }
+                    scopes.push_back(std::move(next));
+                    break;
+                }
+                case JsonReader::Token::BEGIN_ARRAY: {
+                    JsonScope next;
+                    next.parent = scope ? scope->parent : folder;
+                    if (scope && scope->object && scope->key == "children") next.parent = folderOf(bookmarks, *scope);
+                    scopes.push_back(std::move(next));
+                    break;
+                }
+                case JsonReader::Token::END_OBJECT: {
+                    JsonScope done = std::move(scopes.back());
+                    scopes.pop_back();
+                    if (done.parent == BookmarkManager::kNoBookmark || done.roots) break;
+                    if (done.renameOnClose && !done.name.empty()) bookmarks.rename(done.self, done.name);
+                    if (done.self == BookmarkManager::kNoBookmark && !done.url.empty() && done.type != "folder") {
+                        import.add(done.parent, done.url, done.name);
+                    }
+                    break;
+                }
+                case JsonReader::Token::END_ARRAY:
+                    scopes.pop_back();
+                    break;
+                case JsonReader::Token::KEY:
+                    scope->key = reader.text();
+                    break;
+                default:
+                    if (!scope || !scope->object) break;
+                    if (scope->key == "name" || scope->key == "title") {
+                        scope->name = reader.text();
+                    } else if (scope->key == "url" || scope->key == "uri") {
+                        scope->url = reader.text();
+                    } else if (scope->key == "type") {
+                        scope->type = reader.text();
+                    }
+            }
+        }
+        return import.finish(path, start, true);
+    }
+    
+    static Result exportBookmarksJson(const std::string& path, const BookmarkManager& bookmarks,
+                                      const ProgressCallback& progress = nullptr) {
+        ChunkedWriter output(path);
+        if (!output.ok()) return failOpen(path);
+        auto start = std::chrono::steady_clock::now();
+        output.write("{\"roots\": {\"bookmark_bar\": {\"name\": \"Bookmarks\", \"type\": \"folder\", \"children\": [");
+        uint64_t items = 0;
+        std::vector<bool> started{false};  // per open folder, whether a child was written
+        forEachInTree(bookmarks, [&](const BookmarkManager::Bookmark& bookmark, size_t depth, bool enter) {
+            if (!enter) {
+                started.pop_back();
+                output.write("]}");
+                return;
+            }
+            output.write(started[depth - 1] ? ",\n" : "\n");
+            started[depth - 1] = true;
+            output.write("{\"name\": ");
+            writeJsonString(output, bookmark.title);
+            if (bookmark.folder) {
+                output.write(", \"type\": \"folder\", \"children\": [");
+                started.push_back(false);
+                return;
+            }
+            output.write(", \"type\": \"url\", \"url\": ");
+            writeJsonString(output, bookmark.url);
+            output.put('}');
+            if (++items % kBatchItems == 0 && progress) progress({output.written(), 0, items});
+        });
+        output.write("\n]}}, \"version\": 1}\n");
+        return finishExport(LogCategory::BOOKMARKS, output, path, items, start, progress, "bookmarks");
+    }
+    
+    // Takeout's {"Browser History": [{"url", "title", "time_usec",
+    // "page_transition"}, ...]}; "visitTime" in milliseconds is read too.
+    // Objects without a URL and a time are skipped. Visits are merged with
+    // the ones already in `history` by time.
+    static Result importHistoryJson(const std::string& path, HistoryDatabase& history,
+                                    const ProgressCallback& progress = nullptr) {
+        ChunkedReader input(path);
+        if (!input.ok()) return failOpen(path);
+        auto start = std::chrono::steady_clock::now();
+        JsonReader reader(input);
+        
+        std::vector<HistoryScope> scopes;
+        std::vector<HistoryDatabase::Visit> batch;
+        std::vector<std::string> runs;
+        uint64_t parsed = 0;
+        bool complete = true;
+        static std::atomic<uint32_t> imports{0};
+        std::string runPrefix = "nova-history-" + std::to_string(::getpid()) + "-" + std::to_string(imports++) + "-";
+        auto spill = [&] {
+            std::stable_sort(batch.begin(), batch.end(), [](const auto& a, const auto& b) { return a.time < b.time; });
+            std::string run = (fs::temp_directory_path() / (runPrefix + std::to_string(runs.size()) + ".run")).string();
+            runs.push_back(run);
+            bool written = writeRun(run, batch);
+            batch.clear();
+            return written;
+        };
+        
+        for (JsonReader::Token token = reader.next(); token != JsonReader::Token::END; token = reader.next()) {
+            if (token == JsonReader::Token::ERROR) {
+                complete = false;
+                break;
+            }
+            if (token == JsonReader::Token::BEGIN_OBJECT || token == JsonReader::Token::BEGIN_ARRAY) {
+                scopes.emplace_back();
+                scopes.back().object = token == JsonReader::Token::BEGIN_OBJECT;
+            } else if (token == JsonReader::Token::END_ARRAY) {
+                scopes.pop_back();
+            } else if (token == JsonReader::Token::END_OBJECT) {
+                HistoryScope done = std::move(scopes.back());
+                scopes.pop_back();
+                if (done.visit.url.empty() || !done.timed) continue;
+                batch.push_back(std::move(done.visit));
+                if (++parsed % kBatchItems == 0 && progress) progress({input.position(), input.size(), parsed});
+                if (batch.size() == kBatchItems && !spill()) {
+                    complete = false;
+                    break;
+                }
+            } else if (token == JsonReader::Token::KEY) {
+                scopes.back().key = reader.text();
+            } else if (!scopes.empty() && scopes.back().object) {
+                readVisitField(scopes.back(), reader.text());
+            }
+        }
+        
+        // One run never left memory; several are merged from their files
+        uint64_t stored = 0;
+        if (complete && runs.empty()) {
+            std::stable_sort(batch.begin(), batch.end(), [](const auto& a, const auto& b) { return a.time < b.time; });
+            stored = history.recordVisits(batch);
+            complete = stored == batch.size();
+        } else if (complete && (batch.empty() || spill())) {
+            complete = mergeRuns(runs, history, stored, [&](uint64_t items) {
+                if (progress) progress({input.size(), input.size(), items});
+            });
+        }
+        for (const auto& run : runs) {
+            std::error_code error;
+            fs::remove(run, error);
+        }
+        if (progress) progress({input.position(), input.size(), stored});
+        logImport(LogCategory::HISTORY, path, "visits", stored, start, complete);
+        return {complete, stored};
+    }
+    
+    static Result exportHistoryJson(const std::string& path, const HistoryDatabase& history,
+                                    const ProgressCallback& progress = nullptr) {
+        ChunkedWriter output(path);
+        if (!output.ok()) return failOpen(path);
+        auto start = std::chrono::steady_clock::now();
+        output.write("{\"Browser History\": [");
+        uint64_t items = 0;
+        char number[24];
+        history.forEachVisit([&](const HistoryDatabase::Visit& visit) {
+            output.write(items > 0 ? ",\n{\"page_transition\": " : "\n{\"page_transition\": ");
+            output.write(visit.transition == HistoryDatabase::Transition::NAVIGATE ? "\"LINK\"" : "\"FORWARD_BACK\"");
+            output.write(", \"title\": ");
+            writeJsonString(output, visit.title);
+            output.write(", \"url\": ");
+            writeJsonString(output, visit.url);
+            output.write(", \"time_usec\": ");
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(visit.time.time_since_epoch()).count();
+            output.write(std::string_view(number, static_cast<size_t>(std::to_chars(number, number + sizeof(number), micros).ptr - number)));
+            output.put('}');
+            if (++items % kBatchItems == 0 && progress) progress({output.written(), 0, items});
+        });
+        output.write("\n]}\n");
+        return finishExport(LogCategory::HISTORY, output, path, items, start, progress, "visits");
+    }
+    
+    // Depth-first over the tree: fn(bookmark, depth, true) for each entry,
+    // with depth 1 at the root, and fn(folder, depth, false) after a
+    // folder's contents
+    template <typename Fn>
+    static void forEachInTree(const BookmarkManager& bookmarks, Fn&& fn) {
+        struct Level {
+            BookmarkManager::Bookmark folder;
+            std::vector<BookmarkId> children;
+            size_t next = 0;
+        };
+        std::vector<Level> levels;
+        levels.push_back({*bookmarks.getBookmark(BookmarkManager::kRoot), bookmarks.getChildren(BookmarkManager::kRoot)});
+        while (!levels.empty()) {
+            Level& level = levels.back();
+            if (level.next == level.children.size()) {
+                BookmarkManager::Bookmark folder = std::move(level.folder);
+                levels.pop_back();
+                if (!levels.empty()) fn(folder, levels.size(), false);
+                continue;
+            }
+            auto bookmark = bookmarks.getBookmark(level.children[level.next++]);
+            if (!bookmark) continue;
+            fn(*bookmark, levels.size(), true);
+            if (bookmark->folder) {
+                std::vector<BookmarkId> children = bookmarks.getChildren(bookmark->id);
+                levels.push_back({std::move(*bookmark), std::move(children)});
+            }
+        }
+    }
+    
+private:
+    static constexpr size_t kBatchItems = 64 * 1024;
+    static constexpr size_t kIndexItems = 4 * kBatchItems;  // each merge passes over the whole index
+    static constexpr size_t kMaxText = 64 * 1024;  // of a title in HTML
+    static constexpr size_t kMaxTag = 64 * 1024;   // longer tags (inline icons) are cut off
+    
+    // Adds bookmarks inside a BookmarkManager::Batch, reopened every
+    // kIndexItems so each batch is indexed in one pass
+    class BookmarkImport {
+    public:
+        BookmarkImport(BookmarkManager& bookmarks, ChunkedReader& input, const ProgressCallback& progress)
+            : bookmarks(bookmarks), input(input), progress(progress) {
+            batch.emplace(bookmarks);
+        }
+        
+        void add(BookmarkId folder, const std::string& url, const std::string& title) {
+            if (bookmarks.addBookmarkTo(folder, url, title) == BookmarkManager::kNoBookmark) return;
+            if (++items % kBatchItems != 0) return;
+            if (items % kIndexItems == 0) {
+                batch.reset();
+                batch.emplace(bookmarks);
+            }
+            if (progress) progress({input.position(), input.size(), items});
+        }
+        
+        Result finish(const std::string& path, std::chrono::steady_clock::time_point start, bool complete) {
+            batch.reset();
+            if (progress) progress({input.position(), input.size(), items});
+            logImport(LogCategory::BOOKMARKS, path, "bookmarks", items, start, complete);
+            return {complete, items};
+        }
+        
+    private:
+        BookmarkManager& bookmarks;
+        ChunkedReader& input;
+        const ProgressCallback& progress;
+        std::optional<BookmarkManager::Batch> batch;
+        uint64_t items = 0;
+    };
+    
+    static Result failOpen(const std::string& path) {
+        NOVA_LOG_ERROR(ENGINE, "Could not open " << path);
+        return {};
+    }
+    
+    static void logImport(LogCategory category, const std::string& path, const char* what, uint64_t items,
+                          std::chrono::steady_clock::time_point start, bool complete) {
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (complete) {
+            NOVA_LOG(LogLevel::INFO, category, "Imported " << items << " " << what << " from " << path << " in " << millis << " ms");
+        } else {
+            NOVA_LOG(LogLevel::WARN, category, "Import from " << path << " stopped early, kept " << items << " " << what
+                     << ": the file is malformed or could not be stored");
+        }
+    }
+    
+    static Result finishExport(LogCategory category, ChunkedWriter& output, const std::string& path, uint64_t items,
+                               std::chrono::steady_clock::time_point start, const ProgressCallback& progress, const char* what) {
+        uint64_t bytes = output.written();
+        if (!output.close()) {
+            NOVA_LOG(LogLevel::ERROR, category, "Could not write " << path);
+            return {false, items};
+        }
+        if (progress) progress({bytes, 0, items});
+        NOVA_LOG(LogLevel::INFO, category, "Exported " << items << " " << what << " to " << path << " in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms");
+        return {true, items};
+    }
+    
+    // Reads up to the next '>' outside quotes into `tag`; comments are
+    // skipped, returning false
+    static bool readTag(ChunkedReader& input, std::string& tag) {
+        tag.clear();
+        if (input.peek() == '!') {
+            std::string opening;
+            input.read(opening, 1);
+            if (input.peek() == '-') {
+                // <!-- ... -->
+                int dashes = 0;
+                for (int c = input.get(); c >= 0; c = input.get()) {
+                    if (c == '>' && dashes >= 2) break;
+                    dashes = c == '-' ? dashes + 1 : 0;
+                }
+                return false;
+            }
+            tag = opening;
+        }
+        char quote = 0;
+        for (int c = input.get(); c >= 0; c = input.get()) {
+            if (quote) {
+                if (c == quote) quote = 0;
+            } else if (c == '"' || c == '\'') {
+                quote = static_cast<char>(c);
+            } else if (c == '>') {
+                break;
+            }
+            if (tag.size() < kMaxTag) tag.push_back(static_cast<char>(c));
+        }
+        return true;
+    }
+    
+    static std::string tagName(std::string_view tag) {
+        if (!tag.empty() && tag[0] == '/') tag.remove_prefix(1);
+        std::string name;
+        for (char c : tag) {
+            if (!std::isalnum(static_cast<unsigned char>(c))) break;
+            name.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        }
+        return name;
+    }
+    
+    // The value of a tag's attribute, quoted or not; names are case-insensitive
+    static std::string attribute(std::string_view tag, std::string_view name) {
+        size_t i = 0;
+        while (i < tag.size() && !std::isspace(static_cast<unsigned char>(tag[i]))) i++;
+        while (i < tag.size()) {
+            while (i < tag.size() && std::isspace(static_cast<unsigned char>(tag[i]))) i++;
+            size_t nameStart = i;
+            while (i < tag.size() && tag[i] != '=' && !std::isspace(static_cast<unsigned char>(tag[i]))) i++;
+            std::string_view found = tag.substr(nameStart, i - nameStart);
+            while (i < tag.size() && std::isspace(static_cast<unsigned char>(tag[i]))) i++;
+            std::string_view value;
+            if (i < tag.size() && tag[i] == '=') {
+                i++;
+                while (i < tag.size() && std::isspace(static_cast<unsigned char>(tag[i]))) i++;
+                if (i < tag.size() && (tag[i] == '"' || tag[i] == '\'')) {
+                    size_t end = tag.find(tag[i], i + 1);
+                    if (end == std::string_view::npos) end = tag.size();
+                    value = tag.substr(i + 1, end - i - 1);
+                    i = end + 1;
+                } else {
+                    size_t valueStart = i;
+                    while (i < tag.size() && !std::isspace(static_cast<unsigned char>(tag[i]))) i++;
+                    value = tag.substr(valueStart, i - valueStart);
+                }
+            }
+            bool matches = found.size() == name.size() &&
+                           std::equal(found.begin(), found.end(), name.begin(), [](char a, char b) {
+                               return std::tolower(static_cast<unsigned char>(a)) == b;
+                           });
+            if (matches) return std::string(value);
+            if (found.empty()) i++;
+        }
+        return std::string();
+    }
+    
+    static std::string_view trim(std::string_view text) {
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+        return text;
+    }
+    
+    // &amp; &lt; &gt; &quot; &apos; and numeric references; others stay as written
+    static std::string decodeEntities(std::string_view text) {
+        std::string decoded;
+        decoded.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            size_t end = text[i] == '&' ? text.find(';', i) : std::string_view::npos;
+            if (end == std::string_view::npos || end - i > 10) {
+                decoded.push_back(text[i]);
+                continue;
+            }
+            std::string_view entity = text.substr(i + 1, end - i - 1);
+            uint32_t code = 0;
+            if (entity == "amp") {
+                decoded.push_back('&');
+            } else if (entity == "lt") {
+                decoded.push_back('<');
+            } else if (entity == "gt") {
+                decoded.push_back('>');
+            } else if (entity == "quot") {
+                decoded.push_back('"');
+            } else if (entity == "apos") {
+                decoded.push_back('\'');
+            } else if (entity.size() > 1 && entity[0] == '#') {
+                bool hex = entity[1] == 'x' || entity[1] == 'X';
+                std::string_view digits = entity.substr(hex ? 2 : 1);
+                auto [ptr, error] = std::from_chars(digits.data(), digits.data() + digits.size(), code, hex ? 16 : 10);
+                if (error != std::errc() || ptr != digits.data() + digits.size() || digits.empty() || code > 0x10ffff) {
+                    decoded.push_back(text[i]);
+                    continue;
+                }
+                JsonReader::appendUtf8(decoded, code);
+            } else {
+                decoded.push_back(text[i]);
+                continue;
+            }
+            i = end;
+        }
+        return decoded;
+    }
+    
+    static void writeEscaped(ChunkedWriter& output, std::string_view text, bool attribute) {
+        size_t from = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            const char* entity = nullptr;
+            switch (text[i]) {
+                case '&': entity = "&amp;"; break;
+                case '<': entity = "&lt;"; break;
+                case '>': entity = "&gt;"; break;
+                case '"': entity = attribute ? "&quot;" : nullptr; break;
+                default: break;
+            }
+            if (!entity) continue;
+            output.write(text.substr(from, i - from));
+            output.write(entity);
+            from = i + 1;
+        }
+        output.write(text.substr(from));
+    }
+    
+    static void writeJsonString(ChunkedWriter& output, std::string_view text) {
+        output.put('"');
+        size_t from = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            output.write(text.substr(from, i - from));
+            from = i + 1;
+            if (c == '"' || c == '\\') {
+                output.put('\\');
+                output.put(static_cast<char>(c));
+            } else if (c == '\n') {
+                output.write("\\n");
+            } else if (c == '\t') {
+                output.write("\\t");
+            } else {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                output.write(escape);
+            }
+        }
+        output.write(text.substr(from));
+        output.put('"');
+    }
+    
+    struct HistoryScope {
+        bool object = false;
+        std::string key;
+        HistoryDatabase::Visit visit{"", "", {}, HistoryDatabase::Transition::NAVIGATE, 0};
+        bool timed = false;
+    };
+    
+    // One per open JSON object or array while importing bookmarks. `parent`
+    // is where the entries inside go, kNoBookmark for parts to ignore.
+    struct JsonScope {
+        bool object = false;
+        BookmarkId parent = BookmarkManager::kNoBookmark;
+        BookmarkId self = BookmarkManager::kNoBookmark;  // its folder, once it has children
+        bool roots = false;                              // the "roots" object
+        bool renameOnClose = false;                      // its folder was made before its name was read
+        std::string key;
+        std::string name;
+        std::string url;
+        std::string type;
+    };
+    
+    // The folder for an object's children, made when they start. Chromium
+    // writes "children" before "name", so such a folder is named when the
+    // object closes and does not merge with a namesake.
+    static BookmarkId folderOf(BookmarkManager& bookmarks, JsonScope& scope) {
+        if (scope.self != BookmarkManager::kNoBookmark || scope.parent == BookmarkManager::kNoBookmark) return scope.self;
+        if (!scope.name.empty()) {
+            scope.self = bookmarks.folderNamed(scope.parent, scope.name);
+        } else {
+            scope.self = bookmarks.addFolder(scope.parent, "");
+            scope.renameOnClose = true;
+        }
+        return scope.self;
+    }
+    
+    static void readVisitField(HistoryScope& scope, const std::string& value) {
+        auto& visit = scope.visit;
+        if (scope.key == "url") {
+            visit.url = value;
+        } else if (scope.key == "title") {
+            visit.title = value;
+        } else if (scope.key == "time_usec") {
+            int64_t micros = 0;
+            auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), micros);
+            (void)end;
+            if (error != std::errc()) return;
+            visit.time = HistoryDatabase::Clock::time_point(std::chrono::microseconds(micros));
+            scope.timed = true;
+        } else if (scope.key == "visitTime" || scope.key == "lastVisitTime") {
+            char* end = nullptr;
+            double millis = std::strtod(value.c_str(), &end);
+            if (end == value.c_str()) return;
+            visit.time = HistoryDatabase::Clock::time_point(std::chrono::microseconds(static_cast<int64_t>(millis * 1000)));
+            scope.timed = true;
+        } else if (scope.key == "page_transition") {
+            bool backForward = value.find("FORWARD_BACK") != std::string::npos || value.find("BACK_FORWARD") != std::string::npos;
+            visit.transition = backForward ? HistoryDatabase::Transition::BACK : HistoryDatabase::Transition::NAVIGATE;
+        }
+    }
+    
+    // A run is its visits back to back: zigzag varint milliseconds,
+    // transition, varint tab id, then URL and title as varint-length strings
+    static bool writeRun(const std::string& path, const std::vector<HistoryDatabase::Visit>& visits) {
+        ChunkedWriter output(path);
+        ByteWriter record;
+        for (const auto& visit : visits) {
+            int64_t millis = std::chrono::duration_cast<std::chrono::milliseconds>(visit.time.time_since_epoch()).count();
+            record = ByteWriter();
+            record.writeVarint((static_cast<uint64_t>(millis) << 1) ^ static_cast<uint64_t>(millis >> 63));
+            record.writeU8(static_cast<uint8_t>(visit.transition));
+            record.writeVarint(visit.tabId);
+            record.writeString(visit.url);
+            record.writeString(visit.title);
+            output.write(std::string_view(reinterpret_cast<const char*>(record.data().data()), record.size()));
+        }
+        return output.close();
+    }
+    
+    static bool readVarint(ChunkedReader& input, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = input.get();
+            if (c < 0) return false;
+            value |= static_cast<uint64_t>(c & 0x7f) << shift;
+            if (!(c & 0x80)) return true;
+        }
+        return false;
+    }
+    
+    static bool readRunVisit(ChunkedReader& input, HistoryDatabase::Visit& visit) {
+        uint64_t zigzag = 0;
+        uint64_t tabId = 0;
+        uint64_t urlSize = 0;
+        uint64_t titleSize = 0;
+        if (!readVarint(input, zigzag)) return false;
+        int transition = input.get();
+        visit.url.clear();
+        visit.title.clear();
+        if (transition < 0 || !readVarint(input, tabId) || !readVarint(input, urlSize) || !input.read(visit.url, urlSize) ||
+            !readVarint(input, titleSize) || !input.read(visit.title, titleSize)) {
+            return false;
+        }
+        int64_t millis = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+        visit.time = HistoryDatabase::Clock::time_point(std::chrono::milliseconds(millis));
+        visit.transition = static_cast<HistoryDatabase::Transition>(transition);
+        visit.tabId = static_cast<uint32_t>(tabId);
+        return true;
+    }
+    
+    // Records the runs' visits oldest first, a batch at a time; equal times
+    // keep the order they had in the file
+    template <typename Fn>
+    static bool mergeRuns(const std::vector<std::string>& paths, HistoryDatabase& history, uint64_t& stored, Fn&& onBatch) {
+        std::vector<std::unique_ptr<ChunkedReader>> inputs;
+        std::vector<HistoryDatabase::Visit> heads(paths.size());
+        auto later = [&](size_t a, size_t b) { return heads[a].time != heads[b].time ? heads[a].time > heads[b].time : a > b; };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)> queue(later);
+        for (size_t run = 0; run < paths.size(); ++run) {
+            inputs.push_back(std::make_unique<ChunkedReader>(paths[run]));
+            if (!inputs.back()->ok()) return false;
+            if (readRunVisit(*inputs.back(), heads[run])) queue.push(run);
+        }
+        std::vector<HistoryDatabase::Visit> batch;
+        auto record = [&] {
+            size_t recorded = history.recordVisits(batch);
+            stored += recorded;
+            bool complete = recorded == batch.size();
+            batch.clear();
+            onBatch(stored);
+            return complete;
+        };
+        while (!queue.empty()) {
+            size_t run = queue.top();
+            queue.pop();
+            batch.push_back(std::move(heads[run]));
+            heads[run] = HistoryDatabase::Visit();
+            if (readRunVisit(*inputs[run], heads[run])) queue.push(run);
+            if (batch.size() == kBatchItems && !record()) return false;
+        }
+        return batch.empty() || record();
+    }
+};
+
+// Privacy-focused tools and settings
+class PrivacyManager {
+public:
+    PrivacyManager() 
+        : trackingProtection(true), cookieControl(true), fingerprintingProtection(true) {}
+    
+    void toggleTrackingProtection(bool enabled) {
+        trackingProtection = enabled;
+        NOVA_LOG_INFO(PRIVACY, "Tracking protection: " << (enabled ? "enabled" : "disabled"));
+    }
+    
+    void toggleCookieControl(bool enabled) {
+        cookieControl = enabled;
+        NOVA_LOG_INFO(PRIVACY, "Cookie control: " << (enabled ? "enabled" : "disabled"));
+    }
+    
+    void toggleFingerprintingProtection(bool enabled) {
+        fingerprintingProtection = enabled;
+        NOVA_LOG_INFO(PRIVACY, "Fingerprinting protection: " << (enabled ? "enabled" : "disabled"));
+    }
+    
+    void enterPrivateMode() {
+        NOVA_LOG_INFO(PRIVACY, "Entering private browsing mode");
+        // Would create a new private window in actual implementation
+    }
+    
+    // Replaces the tracking protection filters with these EasyList-style lists
+    ContentFilter::Stats loadFilterLists(const std::vector<std::string_view>& lists) {
+        ContentFilter::Stats stats = contentFilter.compile(lists);
+        NOVA_LOG_INFO(PRIVACY, "Compiled " << stats.filters << " blocking and " << stats.exceptions
+                      << " exception filters, skipped " << stats.skipped);
+        return stats;
+    }
+    
+    // Filters compiled earlier, saved with saveCompiledFilters
+    bool loadCompiledFilters(const std::string& path) {
+        if (!contentFilter.load(path)) {
+            NOVA_LOG_WARN(PRIVACY, "Could not load compiled filters from " << path);
+            return false;
+        }
+        NOVA_LOG_INFO(PRIVACY, "Loaded " << contentFilter.size() << " compiled filters");
+        return true;
+    }
+    
+    bool saveCompiledFilters(const std::string& path) const {
+        if (contentFilter.save(path)) return true;
+        NOVA_LOG_ERROR(PRIVACY, "Could not save compiled filters to " << path);
+        return false;
+    }
+    
+    bool shouldBlockRequest(const ContentFilter::Request& request) const {
+        return trackingProtection && contentFilter.shouldBlock(request);
+    }
+    
+    // Cookies live in the engine-wide jar; with cookie control on, each
+    // top-level site gets its own partition of it
+    bool setCookie(std::string_view url, std::string_view setCookieHeader, std::string_view topLevelSite) {
+        return CookieJar::instance().setCookie({url, topLevelSite, cookieControl}, setCookieHeader);
+    }
+    
+    std::string getCookieHeader(std::string_view url, std::string_view topLevelSite) const {
+        return CookieJar::instance().cookieHeader({url, topLevelSite, cookieControl});
+    }
+    
+    void clearCookies() {
+        CookieJar::instance().clear();
+        NOVA_LOG_INFO(PRIVACY, "Cleared all cookies");
+    }
+    
+    bool isTrackingProtectionEnabled() const { return trackingProtection; }
+    bool isCookieControlEnabled() const { return cookieControl; }
+    bool isFingerprintingProtectionEnabled() const { return fingerprintingProtection; }
+    
+private:
+    bool trackingProtection;
+    bool cookieControl;
+    bool fingerprintingProtection;
+    ContentFilter contentFilter;
+};
+
+// Reading mode for distraction-free content consumption
+class ReadingMode {
+public:
+    enum class FontFamily { SERIF, SANS_SERIF, MONOSPACE };
+    enum class TextSize { SMALL, MEDIUM, LARGE, XLARGE };
+    enum class ColorTheme { LIGHT, DARK, SEPIA, CUSTOM };
+    
+    ReadingMode() : enabled(false), fontFamily(FontFamily::SANS_SERIF), 
+                  textSize(TextSize::MEDIUM), theme(ColorTheme::LIGHT) {}
+    
+    void toggle() {
+        enabled = !enabled;
+        NOVA_LOG_INFO(UI, (enabled ? "Enabled" : "Disabled") << " reading mode");
+    }
+    
+    void setFontFamily(FontFamily font) {
+        fontFamily = font;
+        NOVA_LOG_INFO(UI, "Changed reading mode font family");
+    }
+    
+    void setTextSize(TextSize size) {
+        textSize = size;
+        NOVA_LOG_INFO(UI, "Changed reading mode text size");
+    }
+    
+    void setColorTheme(ColorTheme newTheme) {
+        theme = newTheme;
+        NOVA_LOG_INFO(UI, "Changed reading mode color theme");
+    }
+    
+    void saveContent() {
+        NOVA_LOG_INFO(UI, "Saved article for offline reading");
+        // Would save the current article to local storage
+    }
+    
+    void textToSpeech() {
+        NOVA_LOG_INFO(UI, "Started text-to-speech for current article");
+        // Would read the article content aloud
+    }
+    
+private:
+    bool enabled;
+    FontFamily fontFamily;
+    TextSize textSize;
+    ColorTheme theme;
+};
+
+// AI Assistant for enhanced browsing experience
+class AiAssistant {
+public:
+    enum class SuggestionType { TAB_GROUP, SEARCH_REFINEMENT, CONTENT_SUMMARY, TIME_MANAGEMENT };
+    
+    AiAssistant() : isEnabled(true) {}
+    
+    void toggleAssistant(bool enabled) {
+        isEnabled = enabled;
+        NOVA_LOG_INFO(AI, "AI Assistant " << (enabled ? "enabled" : "disabled"));
+    }
+    
+    void summarizeTab(std::shared_ptr<Tab> tab) {
+        if (!isEnabled || !tab) return;
+        NOVA_LOG_INFO(AI, "AI Summary of " << tab->getTitle() << ": "
+                 << "This page discusses key concepts related to its main topic...");
+        // Would use AI to generate a summary of the page content
+    }
+    
+    std::vector<std::string> suggestRelatedSearches(const std::string& query) {
+        if (!isEnabled) return {};
+        NOVA_LOG_INFO(AI, "AI suggesting related searches for: " << query);
+        // Would generate related search suggestions
+        return {"refined query 1", "alternative search 2", "more specific query 3"};
+    }
+    
+    // Proposes a group for each topic the tabs fall into, largest first;
+    // tabs with nothing close to them are left where they are. Proposals
+    // are plain lists, so nothing is grouped until the caller makes the
+    // groups. Topics carry over between calls, so tabs opened or navigated
+    // since the last call are placed into them without clustering
+    // everything again.
+    std::vector<TopicClusterer::Topic> organizeTabsAutomatically(const std::vector<std::shared_ptr<Tab>>& tabs) {
+        if (!isEnabled) return {};
+        NOVA_LOG_INFO(AI, "AI organizing " << tabs.size() << " tabs into logical groups");
+        topicClusterer.update(tabs);
+        
+        auto proposals = topicClusterer.topics();
+        NOVA_LOG_DEBUG(AI, "Proposed " << proposals.size() << " groups for " << tabs.size() << " tabs");
+        return proposals;
+    }
+    
+    std::string generateTabName(std::shared_ptr<Tab> tab) {
+        if (!isEnabled || !tab) return "New Tab";
+        // Would generate a descriptive name based on content
+        return "AI-Generated Name: " + tab->getTitle();
+    }
+    
+    void suggestFocus() {
+        if (!isEnabled) return;
+        NOVA_LOG_INFO(AI, "AI suggests focusing on work-related tabs for the next 30 minutes");
+        // Would analyze current tabs and suggest focus areas
+    }
+    
+private:
+    bool isEnabled;
+    TopicClusterer topicClusterer;
+};
+
+// Space for context-specific workspaces (similar to Arc's Spaces)
+class Space {
+public:
+    Space(const std::string& name = "Default Space") 
+        : name(name), icon("🏠"), isActive(false), arena(std::make_shared<Arena>()) {}
+    
+    void setName(const std::string& newName) {
+        name = newName;
+    }
+    
+    void setIcon(const std::string& newIcon) {
+        icon = newIcon;
+    }
+    
+    void activate() {
+        isActive = true;
+        NOVA_LOG_INFO(ENGINE, "Activated space: " << name << " " << icon);
+    }
+    
+    void deactivate() {
+        isActive = false;
+        NOVA_LOG_INFO(ENGINE, "Deactivated space: " << name << " " << icon);
+    }
+    
+    void addWindow(std::shared_ptr<class BrowserWindow> window) {
+        windows.push_back(window);
+    }
+    
+    void removeWindow(const BrowserWindow* window) {
+        windows.erase(std::remove_if(windows.begin(), windows.end(),
+            [window](const std::shared_ptr<BrowserWindow>& w) { return w.get() == window; }), windows.end());
+    }
+    
+    void addTabGroup(std::shared_ptr<TabGroup> group) {
+        if (group) tabGroups.push_back(std::move(group));
+    }
+    
+    // A group allocated from this space's arena, as are the tabs it creates
+    std::shared_ptr<TabGroup> createTabGroup(const std::string& groupName) {
+        auto group = Arena::make<TabGroup>(arena, groupName, arena);
+        tabGroups.push_back(group);
+        return group;
+    }
+    
+    const std::shared_ptr<Arena>& getArena() const { return arena; }
+    
+    std::string getName() const { return name; }
+    std::string getIcon() const { return icon; }
+    bool getIsActive() const { return isActive; }
+    const std::vector<std::shared_ptr<BrowserWindow>>& getWindows() const { return windows; }
+    const std::vector<std::shared_ptr<TabGroup>>& getTabGroups() const { return tabGroups; }
+    
+    // The space's settings, windows and groups, as part of a session layout
+    void saveState(ByteWriter& writer, const SessionRefs& refs) const {
+        NOVA_LOG_DEBUG(ENGINE, "Saving state for space: " << name);
+        writer.writeString(name);
+        writer.writeString(icon);
+        writer.writeU8(isActive ? 1 : 0);
+        writer.writeVarint(spaceSettings.size());
+        for (const auto& [key, value] : spaceSettings) {
+            writer.writeString(key);
+            writer.writeString(value);
+        }
+        writer.writeVarint(windows.size());
+        for (const auto& window : windows) writer.writeVarint(refs.windowIndex(*window));
+        writer.writeVarint(tabGroups.size());
+        for (const auto& group : tabGroups) group->saveState(writer, refs);
+    }
+    
+    bool loadState(ByteReader& reader, const SessionRefs& refs) {
+        name = reader.readString();
+        icon = reader.readString();
+        isActive = reader.readU8() & 1;
+        NOVA_LOG_DEBUG(ENGINE, "Loading state for space: " << name);
+        spaceSettings.clear();
+        size_t settingCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < settingCount && reader.ok(); ++i) {
+            std::string key = reader.readString();
+            spaceSettings[key] = reader.readString();
+        }
+        windows.clear();
+        size_t windowCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < windowCount && reader.ok(); ++i) {
+            if (auto window = refs.window(reader.readVarint())) windows.push_back(window);
+        }
+        tabGroups.clear();
+        size_t groupCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < groupCount && reader.ok(); ++i) {
+            auto group = Arena::make<TabGroup>(arena, "New Group", arena);
+            if (group->loadState(reader, refs)) tabGroups.push_back(group);
+        }
+        return reader.ok();
+    }
+    
+private:
+    std::string name;
+    std::string icon;
+    bool isActive;
+    std::vector<std::shared_ptr<class BrowserWindow>> windows;
+    std::vector<std::shared_ptr<TabGroup>> tabGroups;
+    std::map<std::string, std::string> spaceSettings;
+    std::shared_ptr<Arena> arena;  // groups, and tabs created by them
+};
+
+// Open tabs as command bar suggestions. Tabs do not report changes, so the
+// version is a fingerprint of what the lister currently returns.
+class OpenTabSource : public SuggestionSource {
+public:
+    using TabVisitor = std::function<void(const Tab&)>;
+    using TabLister = std::function<void(const TabVisitor&)>;
+    
+    explicit OpenTabSource(TabLister lister) : lister(std::move(lister)) {}
+    
+    void setLister(TabLister newLister) { lister = std::move(newLister); }
+    
+    SuggestionKind suggestionKind() const override { return SuggestionKind::OPEN_TAB; }
+    
+    uint64_t suggestionVersion() override {
+        uint64_t fingerprint = 14695981039346656037ull;
+        lister([&](const Tab& tab) {
+            fingerprint = (fingerprint ^ std::hash<std::string>{}(tab.getUrl())) * 1099511628211ull;
+            fingerprint = (fingerprint ^ std::hash<std::string>{}(tab.getTitle())) * 1099511628211ull;
+        });
+        return fingerprint;
+    }
+    
+    bool suggestionChanges(uint64_t, std::vector<Item>& items) override {
+        lister([&](const Tab& tab) {
+            items.push_back({tab.getUrl(), tab.getTitle(), 1, tab.getLastVisited()});
+        });
+        return false;
+    }
+    
+private:
+    TabLister lister;
+};
+
+// Command bar for quick navigation and actions
+class CommandBar {
+public:
+    static constexpr size_t kMaxSuggestions = 8;
+    
+    CommandBar() : isVisible(false) {}
+    
+    void toggle() {
+        isVisible = !isVisible;
+        NOVA_LOG_INFO(UI, (isVisible ? "Showing" : "Hiding") << " command bar");
+        // Catch up before the first keystroke
+        if (isVisible) syncSuggestions();
+    }
+    
+    // Sources must outlive the command bar or be removed first
+    void addSuggestionSource(SuggestionSource* source) {
+        if (source) sources.push_back({source, 0, false});
+    }
+    
+    void removeSuggestionSource(SuggestionSource* source) {
+        auto it = std::find_if(sources.begin(), sources.end(),
+                               [source](const SourceState& state) { return state.source == source; });
+        if (it == sources.end()) return;
+        suggestions.replace(source->suggestionKind(), {});
+        sources.erase(it);
+    }
+    
+    void executeCommand(const std::string& command) {
+        NOVA_LOG_INFO(UI, "Executing command: " << command);
+        recordCommand(command);
+        
+        if (command.substr(0, 4) == "goto") {
+            std::string url = command.substr(5);
+            NOVA_LOG_INFO(UI, "Navigating to: " << url);
+        } else if (command == "newtab") {
+            NOVA_LOG_INFO(UI, "Opening new tab");
+        } else if (command.substr(0, 6) == "search") {
+            std::string query = command.substr(7);
+            NOVA_LOG_INFO(UI, "Searching for: " << query);
+        } else if (command == "history") {
+            NOVA_LOG_INFO(UI, "Opening history");
+        } else {
+            NOVA_LOG_INFO(UI, "Unknown command: " << command);
+        }
+    }
+    
+    // Called on every keystroke with the text typed so far
+    std::vector<std::string> getSuggestions(const std::string& partialCommand) {
+        syncSuggestions();
+        std::vector<std::string> texts;
+        for (const auto& suggestion : suggestions.query(partialCommand, kMaxSuggestions)) {
+            texts.push_back(suggestion.text);
+        }
+        return texts;
+    }
+    
+private:
+    struct SourceState {
+        SuggestionSource* source;
+        uint64_t version;
+        bool synced;
+    };
+    
+    bool isVisible;
+    std::vector<std::string> commandHistory;
+    std::unordered_map<std::string, uint32_t> commandUses;
+    SuggestionIndex suggestions;
+    std::vector<SourceState> sources;
+    std::vector<SuggestionSource::Item> changes;
+    
+    void recordCommand(const std::string& command) {
+        commandHistory.push_back(command);
+        suggestions.update(SuggestionKind::COMMAND,
+                           {command, "", ++commandUses[command], std::chrono::system_clock::now()});
+    }
+    
+    // Applies what each source changed since the last sync
+    void syncSuggestions() {
+        for (auto& state : sources) {
+            uint64_t version = state.source->suggestionVersion();
+            if (state.synced && version == state.version) continue;
+            
+            changes.clear();
+            SuggestionKind kind = state.source->suggestionKind();
+            if (state.source->suggestionChanges(state.synced ? state.version : 0, changes)) {
+                for (const auto& item : changes) suggestions.update(kind, item);
+            } else {
+                suggestions.replace(kind, changes);
+            }
+            state.version = version;
+            state.synced = true;
+        }
+    }
+};
+
+// Extension system
+class Extension {
+public:
+    Extension(const std::string& id, const std::string& name, const std::string& version)
+        : id(id), name(name), version(version), isEnabled(false) {}
+        
+    void enable() {
+        isEnabled = true;
+        NOVA_LOG_INFO(EXTENSIONS, "Extension enabled: " << name);
+    }
+    
+    void disable() {
+        isEnabled = false;
+        NOVA_LOG_INFO(EXTENSIONS, "Extension disabled: " << name);
+    }
+    
+    std::string getId() const { return id; }
+    std::string getName() const { return name; }
+    std::string getVersion() const { return version; }
+    bool getIsEnabled() const { return isEnabled; }
+    
+private:
+    std::string id;
+    std::string name;
+    std::string version;
+    bool isEnabled;
+};
+
+class ExtensionManager {
+public:
+    void installExtension(const std::string& id, const std::string& name, const std::string& version) {
+        auto extension = std::make_shared<Extension>(id, name, version);
+        extensions[id] = extension;
+        NOVA_LOG_INFO(EXTENSIONS, "Installed extension: " << name << " v" << version);
+    }
+    
+    void uninstallExtension(const std::string& id) {
+        if (extensions.count(id) > 0) {
+            NOVA_LOG_INFO(EXTENSIONS, "Uninstalled extension: " << extensions[id]->getName());
+            extensions.erase(id);
+        }
+    }
+    
+    void toggleExtension(const std::string& id, bool enable) {
+        if (extensions.count(id) > 0) {
+            if (enable) {
+                extensions[id]->enable();
+            } else {
+                extensions[id]->disable();
+            }
+        }
+    }
+    
+    std::shared_ptr<Extension> getExtension(const std::string& id) {
+        if (extensions.count(id) > 0) {
+            return extensions[id];
+        }
+        return nullptr;
+    }
+    
+    std::vector<std::shared_ptr<Extension>> getAllExtensions() {
+        std::vector<std::shared_ptr<Extension>> result;
+        for (const auto& pair : extensions) {
+            result.push_back(pair.second);
+        }
+        return result;
+    }
+    
+private:
+    std::unordered_map<std::string, std::shared_ptr<Extension>> extensions;
+};
+
+// Website customization
+class WebsiteCustomizer {
+public:
+    void addCustomCSS(const std::string& domain, const std::string& css) {
+        customCSS[domain] = css;
+        NOVA_LOG_INFO(UI, "Added custom CSS for: " << domain);
+    }
+    
+    void addCustomScript(const std::string& domain, const std::string& script) {
+        customScripts[domain] = script;
+        NOVA_LOG_INFO(UI, "Added custom script for: " << domain);
+    }
+    
+    void setZoomLevel(const std::string& domain, float level) {
+        zoomLevels[domain] = level;
+        NOVA_LOG_INFO(UI, "Set zoom level for " << domain << " to " << level);
+    }
+    
+    std::optional<std::string> getCustomCSS(const std::string& domain) const {
+        if (customCSS.count(domain) > 0) {
+            return customCSS.at(domain);
+        }
+        return std::nullopt;
+    }
+    
+    std::optional<std::string> getCustomScript(const std::string& domain) const {
+        if (customScripts.count(domain) > 0) {
+            return customScripts.at(domain);
+        }
+        return std::nullopt;
+    }
+    
+    float getZoomLevel(const std::string& domain) const {
+        if (zoomLevels.count(domain) > 0) {
+            return zoomLevels.at(domain);
+        }
+        return 1.0f; // Default zoom
+    }
+    
+private:
+    std::unordered_map<std::string, std::string> customCSS;
+    std::unordered_map<std::string, std::string> customScripts;
+    std::unordered_map<std::string, float> zoomLevels;
+};
+
+// Tab archive for managing old tabs. Records live in an ArchiveStore; the
+// search index over them is built on the first search and kept up to date
+// from then on.
+class TabArchive : public SuggestionSource {
+public:
+    struct ArchivedTab {
+        ArchiveId id = 0;
+        std::string url;
+        std::string title;
+        std::chrono::system_clock::time_point timestamp;
+    };
+    
+    struct SearchPage {
+        std::vector<ArchivedTab> results;
+        size_t totalMatches = 0;
+    };
+    
+    static constexpr size_t kSearchPageSize = 50;
+    
+    TabArchive() = default;
+    
+    // Keeps archives in `directory`, picking up any already there
+    explicit TabArchive(const std::string& directory) : store(directory) {}
+    
+    void archiveTab(std::shared_ptr<Tab> tab) {
+        if (!tab) return;
+        
+        auto now = std::chrono::system_clock::now();
+        ArchiveId id = store.append(tab->getUrl(), tab->getTitle(), now);
+        if (id == 0) return;
+        if (indexed) {
+            index.addDocument(tab->getTitle(), tab->getUrl());
+            documentIds.push_back(id);
+        }
+        journal.record({tab->getUrl(), tab->getTitle(), 1, now});
+        NOVA_LOG_INFO(ARCHIVE, "Archived tab: " << tab->getTitle());
+    }
+    
+    // Case-insensitive; every whitespace-separated term must occur in the title
+    // or URL. Results are ranked by match quality, then most recent first.
+    SearchPage searchArchive(const std::string& query, size_t offset = 0, size_t limit = kSearchPageSize) {
+        ensureIndexed();
+        auto found = index.search(query, offset, limit);
+        
+        SearchPage page;
+        page.totalMatches = found.totalMatches;
+        for (const auto& hit : found.hits) {
+            if (auto record = store.find(documentIds[hit.document])) {
+                page.results.push_back({record->id, std::string(record->url), std::string(record->title),
+                                        record->timestamp});
+            }
+        }
+        
+        NOVA_LOG_INFO(ARCHIVE, "Found " << page.totalMatches << " archived tabs matching: " << query);
+        return page;
+    }
+    
+    // `index` counts archived tabs in the order they were archived
+    std::shared_ptr<Tab> restoreTab(size_t index) {
+        if (index >= store.size()) return nullptr;
+        return restoreArchivedTab(store.selectLive(index));
+    }
+    
+    std::shared_ptr<Tab> restoreArchivedTab(ArchiveId id) {
+        auto record = store.find(id);
+        if (!record) return nullptr;
+        
+        NOVA_LOG_INFO(ARCHIVE, "Restoring archived tab: " << record->title);
+        auto tab = std::make_shared<Tab>(std::string(record->url));
+        tab->setTitle(std::string(record->title));
+        HibernationManager::instance().track(tab);
+        
+        store.remove(id);
+        forgetDocument(id);
+        recordRemoval(tab->getUrl());
+        return tab;
+    }
+    
+    // Whole days of archives are dropped as files; the rest of the space is
+    // reclaimed by a background compaction
+    void clearOldArchives(int daysOld) {
+        auto cutoff = std::chrono::system_clock::now() - std::chrono::hours(24 * daysOld);
+        size_t cleared = store.expireBefore(cutoff, [this](const ArchiveStore::Record& record) {
+            forgetDocument(record.id);
+            recordRemoval(std::string(record.url));
+        });
+        store.compactInBackground();
+        
+        NOVA_LOG_INFO(ARCHIVE, "Cleared " << cleared << " archives older than " << daysOld << " days");
+    }
+    
+    size_t size() const { return store.size(); }
+    
+    SuggestionKind suggestionKind() const override { return SuggestionKind::ARCHIVED_TAB; }
+    uint64_t suggestionVersion() override { return journal.version(); }
+    
+    bool suggestionChanges(uint64_t since, std::vector<Item>& items) override {
+        if (journal.changesSince(since, items)) return true;
+        store.forEachLive([&](const ArchiveStore::Record& record) {
+            items.push_back({std::string(record.url), std::string(record.title), 1, record.timestamp});
+        });
+        return false;
+    }
+    
+private:
+    ArchiveStore store;
+    FullTextIndex index;
+    std::vector<ArchiveId> documentIds;  // index document -> record, ascending
+    size_t forgottenDocuments = 0;
+    bool indexed = false;
+    
+    SuggestionJournal journal;
+    
+    static constexpr size_t kMinReindex = 1024;
+    
+    void recordRemoval(std::string url) {
+        Item removal;
+        removal.text = std::move(url);
+        removal.removed = true;
+        journal.record(std::move(removal));
+    }
+    
+    void ensureIndexed() {
+        if (indexed) return;
+        index.clear();
+        documentIds.clear();
+        forgottenDocuments = 0;
+        store.forEachLive([this](const ArchiveStore::Record& record) {
+            index.addDocument(record.title, record.url);
+            documentIds.push_back(record.id);
+        });
+        indexed = true;
+    }
+    
+    // Drops a record from the index; once most of it is dead, the index is
+    // rebuilt by the next search
+    void forgetDocument(ArchiveId id) {
+        if (!indexed) return;
+        auto it = std::lower_bound(documentIds.begin(), documentIds.end(), id);
+        if (it == documentIds.end() || *it != id) return;
+        index.removeDocument(static_cast<uint32_t>(it - documentIds.begin()));
+        forgottenDocuments++;
+        
+        if (forgottenDocuments >= kMinReindex && forgottenDocuments * 2 >= documentIds.size()) {
+            indexed = false;
+            index.clear();
+            std::vector<ArchiveId>().swap(documentIds);
+        }
+    }
+};
+
+// Notification center
+class NotificationCenter {
+public:
+    enum class NotificationType { INFO, WARNING, ERROR, SUCCESS };
+    
+    void showNotification(const std::string& message, NotificationType type = NotificationType::INFO) {
+        NOVA_LOG_INFO(NOTIFICATIONS, "Notification [" << getTypeString(type) << "]: " << message);
+        // Would display a toast notification in the UI
+    }
+    
+    void clearNotifications() {
+        NOVA_LOG_INFO(NOTIFICATIONS, "All notifications cleared");
+    }
+    
+private:
+    std::string getTypeString(NotificationType type) const {
+        switch (type) {
+            case NotificationType::INFO: return "INFO";
+            case NotificationType::WARNING: return "WARNING";
+            case NotificationType::ERROR: return "ERROR";
+            case NotificationType::SUCCESS: return "SUCCESS";
+            default: return "UNKNOWN";
+        }
+    }
+};
+
+// What devices sync. Each record is a last-writer-wins register: a
+// (clock, device) version orders concurrent writes the same way everywhere,
+// with the clock a Lamport clock carried along by every merge.
+enum class SyncKind : uint8_t { BOOKMARK, HISTORY, OPEN_TABS, SETTING };
+
+struct SyncRecord {
+    SyncKind kind = SyncKind::SETTING;
+    std::string key;
+    std::string value;
+    bool deleted = false;
+    uint64_t clock = 0;
+    std::string device;
+    
+    bool newerThan(const SyncRecord& other) const {
+        return clock != other.clock ? clock > other.clock : device > other.device;
+    }
+    
+    // Kind and key in one string, as stores index records
+    static std::string idOf(SyncKind kind, std::string_view key) {
+        std::string id(1, static_cast<char>(kind));
+        id.append(key);
+        return id;
+    }
+    
+    void write(ByteWriter& writer) const {
+        writer.writeU8(static_cast<uint8_t>(kind) | (deleted ? 0x80 : 0));
+        writer.writeString(key);
+        writer.writeVarint(clock);
+        writer.writeString(device);
+        if (!deleted) writer.writeString(value);
+    }
+    
+    bool read(ByteReader& reader) {
+        uint8_t flags = reader.readU8();
+        kind = static_cast<SyncKind>(std::min<uint8_t>(flags & 0x7F, static_cast<uint8_t>(SyncKind::SETTING)));
+        deleted = flags & 0x80;
+        key = reader.readString();
+        clock = reader.readVarint();
+        device = reader.readString();
+        value = deleted ? std::string() : reader.readString();
+        return reader.ok();
+    }
+};
+
+// Requests and responses are single messages passed to a transport. Each
+// is a compressed frame of: the device and its sync token, then a batch of
+// records. The response carries the next token, whether more changes are
+// waiting, and the changes since the token that the device does not have.
+using SyncTransport = std::function<std::vector<uint8_t>(const std::vector<uint8_t>&)>;
+
+// A stand-in for the sync service: keeps the winning version of every
+// record, numbered in the order they were accepted, so a device's token is
+// the last number it has seen. Runs in process, or as a `--sync-server`
+// process that answers over a socket pair.
+class SyncServer {
+public:
+    static constexpr size_t kBatchRecords = 2048;
+    
+    std::vector<uint8_t> handle(const std::vector<uint8_t>& request) {
+        std::vector<uint8_t> bytes;
+        if (!CompactCodec::decompress(request, bytes)) return {};
+        ByteReader reader(bytes);
+        std::string device = reader.readString();
+        uint64_t token = reader.readVarint();
+        size_t count = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < count && reader.ok(); ++i) {
+            SyncRecord record;
+            if (record.read(reader)) accept(std::move(record));
+        }
+        if (!reader.ok()) return {};
+        
+        // Changes after the token, skipping what the device wrote itself
+        ByteWriter records;
+        size_t sent = 0;
+        auto it = log.upper_bound(token);
+        for (; it != log.end() && sent < kBatchRecords; ++it) {
+            token = it->first;
+            const SyncRecord& record = entries[it->second].record;
+            if (record.device == device) continue;
+            record.write(records);
+            sent++;
+        }
+        
+        ByteWriter response;
+        response.writeVarint(it == log.end() ? std::max(token, sequence) : token);
+        response.writeU8(it == log.end() ? 0 : 1);
+        response.writeVarint(sent);
+        const auto& body = records.data();
+        std::vector<uint8_t> message = response.data();
+        message.insert(message.end(), body.begin(), body.end());
+        return CompactCodec::compress(message);
+    }
+    
+    size_t size() const { return entries.size(); }
+    
+    // Starts this binary as a `--sync-server` process for the returned
+    // transport; the process exits once the last copy of the transport is
+    // gone. Null if it cannot start.
+    static SyncTransport spawnProcess() {
+        // Close-on-exec, so no other server process holds this one's ends
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) return nullptr;
+        // Carries errno back if the exec fails, and closes on one that works
+        int status[2];
+        if (pipe2(status, O_CLOEXEC) != 0) {
+            close(sockets[0]);
+            close(sockets[1]);
+            return nullptr;
+        }
+        std::string descriptor = std::to_string(sockets[1]);
+        pid_t pid = fork();
+        if (pid == 0) {
+            // The parent's other threads may hold locks: nothing but
+            // async-signal-safe calls until the exec
+            fcntl(sockets[1], F_SETFD, 0);
+            execl(kSelfPath, kSelfPath, "--sync-server", descriptor.c_str(), static_cast<char*>(nullptr));
+            int error = errno;
+            ssize_t written = write(status[1], &error, sizeof(error));
+            (void)written;
+            _exit(127);
+        }
+        int error = pid < 0 ? errno : 0;
+        close(sockets[1]);
+        close(status[1]);
+        // Nothing to read means the exec went through
+        ssize_t failed = 0;
+        if (pid > 0) {
+            do {
+                failed = read(status[0], &error, sizeof(error));
+            } while (failed < 0 && errno == EINTR);
+        }
+        close(status[0]);
+        if (pid < 0 || failed > 0) {
+            close(sockets[0]);
+            if (pid > 0) waitpid(pid, nullptr, 0);
+            NOVA_LOG_ERROR(SYNC, "Could not start the sync server: " << std::strerror(error));
+            return nullptr;
+        }
+        
+        struct Channel {
+            int socket;
+            pid_t pid;
+            
+            Channel(int socket, pid_t pid) : socket(socket), pid(pid) {}
+            Channel(const Channel&) = delete;
+            Channel& operator=(const Channel&) = delete;
+            ~Channel() {
+                // Ends the server's read even if a copy of this end leaked
+                shutdown(socket, SHUT_RDWR);
+                close(socket);
+                waitpid(pid, nullptr, 0);
+            }
+        };
+        auto channel = std::make_shared<Channel>(sockets[0], pid);
+        return [channel](const std::vector<uint8_t>& request) {
+            std::vector<uint8_t> response;
+            if (!sendMessage(channel->socket, request) || !receiveMessage(channel->socket, response)) return std::vector<uint8_t>();
+            return response;
+        };
+    }
+    
+    // The body of a `--sync-server` process: answers on `socket` until the
+    // other end closes. It only serves, so it neither logs nor keeps any
+    // descriptor it was started with.
+    static int serve(int socket) {
+        std::vector<int> inherited;
+        std::error_code error;
+        for (const auto& entry : fs::directory_iterator("/proc/self/fd", error)) {
+            int descriptor = -1;
+            std::string name = entry.path().filename().string();
+            std::from_chars(name.data(), name.data() + name.size(), descriptor);
+            if (descriptor > STDERR_FILENO && descriptor != socket) inherited.push_back(descriptor);
+        }
+        for (int descriptor : inherited) close(descriptor);
+        
+        SyncServer server;
+        std::vector<uint8_t> request;
+        while (receiveMessage(socket, request) && sendMessage(socket, server.handle(request))) {}
+        close(socket);
+        return 0;
+    }
+    
+private:
+    static constexpr const char* kSelfPath = "/proc/self/exe";
+    
+    struct Entry {
+        SyncRecord record;
+        uint64_t sequence = 0;
+    };
+    
+    std::unordered_map<std::string, Entry> entries;  // by SyncRecord::idOf
+    std::map<uint64_t, std::string> log;              // sequence -> id of the record it holds
+    uint64_t sequence = 0;
+    
+    void accept(SyncRecord record) {
+        Entry& entry = entries[SyncRecord::idOf(record.kind, record.key)];
+        if (entry.sequence != 0 && !record.newerThan(entry.record)) return;
+        if (entry.sequence != 0) log.erase(entry.sequence);
+        entry.sequence = ++sequence;
+        log.emplace(entry.sequence, SyncRecord::idOf(record.kind, record.key));
+        entry.record = std::move(record);
+    }
+    
+    // Messages are a 4-byte length and the bytes
+    static bool sendMessage(int socket, const std::vector<uint8_t>& message) {
+        if (message.empty() || message.size() > std::numeric_limits<uint32_t>::max()) return false;
+        uint8_t header[4];
+        for (int i = 0; i < 4; ++i) header[i] = static_cast<uint8_t>(message.size() >> (8 * i));
+        return sendAll(socket, header, sizeof(header)) && sendAll(socket, message.data(), message.size());
+    }
+    
+    static bool receiveMessage(int socket, std::vector<uint8_t>& message) {
+        uint8_t header[4];
+        if (!receiveAll(socket, header, sizeof(header))) return false;
+        size_t size = 0;
+        for (int i = 0; i < 4; ++i) size |= static_cast<size_t>(header[i]) << (8 * i);
+        message.resize(size);
+        return receiveAll(socket, message.data(), size);
+    }
+    
+    static bool sendAll(int socket, const uint8_t* data, size_t size) {
+        while (size > 0) {
+            ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+            if (sent <= 0) return false;
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+    
+    static bool receiveAll(int socket, uint8_t* data, size_t size) {
+        while (size > 0) {
+            ssize_t received = recv(socket, data, size, 0);
+            if (received <= 0) return false;
+            data += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+};
+
+// Cross-device synchronization. Local edits are staged as records; a sync
+// pushes only the records changed since the last one and pulls the changes
+// other devices made since this device's token, in batches. Records that
+// did not change are never looked at, so syncing an unchanged profile is a
+// single empty round trip.
+class Synchronizer {
+public:
+    struct Stats {
+        size_t records = 0;
+        size_t pushed = 0;       // by the last sync
+        size_t pulled = 0;
+        size_t roundTrips = 0;
+        uint64_t bytesSent = 0;
+        uint64_t bytesReceived = 0;
+    };
+    
+    using ChangeHandler = std::function<void(const SyncRecord&)>;
+    
+    Synchronizer() : isSyncEnabled(false), lastSyncTime(std::chrono::system_clock::now()) {
+        std::random_device random;
+        char id[17];
+        std::snprintf(id, sizeof(id), "%08x%08x", random(), random());
+        deviceId = id;
+    }
+    
+    void enableSync(bool enabled) {
+        isSyncEnabled = enabled;
+        NOVA_LOG_INFO(SYNC, "Synchronization " << (enabled ? "enabled" : "disabled"));
+    }
+    
+    // Without a transport, syncing only records the time
+    void connect(SyncTransport newTransport) {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        transport = std::move(newTransport);
+    }
+    
+    // Called for each change pulled from another device once the sync that
+    // merged it has let go of the lock, so the handler may use get and put
+    void setChangeHandler(ChangeHandler handler) {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        changeHandler = std::move(handler);
+    }
+    
+    void setDeviceId(const std::string& id) {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        deviceId = id;
+    }
+    std::string getDeviceId() const {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        return deviceId;
+    }
+    
+    // Pushes local changes and pulls remote ones until both are drained
+    bool syncNow() {
+        if (!isSyncEnabled) return false;
+        
+        NOVA_LOG_INFO(SYNC, "Syncing browser data across devices");
+        std::vector<SyncRecord> merged;
+        ChangeHandler handler;
+        bool synced;
+        {
+            std::lock_guard<std::mutex> lock(syncMutex);
+            handler = changeHandler;
+            synced = pushAndPull(handler ? &merged : nullptr);
+        }
+        // Changes pulled before a failure are merged all the same
+        for (const auto& record : merged) handler(record);
+        return synced;
+    }
+    
+    // Stages a local edit; writing the value a record already has is free
+    void put(SyncKind kind, std::string_view key, std::string_view value) {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        stage(kind, key, value, false);
+    }
+    
+    void remove(SyncKind kind, std::string_view key) {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        stage(kind, key, {}, true);
+    }
+    
+    std::optional<std::string> get(SyncKind kind, std::string_view key) const {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        auto it = records.find(SyncRecord::idOf(kind, key));
+        if (it == records.end() || it->second.deleted) return std::nullopt;
+        return it->second.value;
+    }
+    
+    // Bookmarks by folder path and URL; ones no longer there are removed
+    void stageBookmarks(const BookmarkManager& bookmarks) {
+        std::unordered_map<std::string, std::string> snapshot;
+        std::vector<size_t> folders;  // where each open folder's name starts in path
+        std::string path;
+        ProfileTransfer::forEachInTree(bookmarks, [&](const BookmarkManager::Bookmark& bookmark, size_t, bool enter) {
+            if (!enter) {
+                path.resize(folders.back());
+                folders.pop_back();
+            } else if (bookmark.folder) {
+                folders.push_back(path.size());
+                path += bookmark.title + "/";
+            } else {
+                snapshot[path + "\n" + bookmark.url] = bookmark.title;
+            }
+        });
+        std::lock_guard<std::mutex> lock(syncMutex);
+        replaceKind(SyncKind::BOOKMARK, snapshot);
+    }
+    
+    // The latest title of every URL visited since `since`
+    void stageHistory(const HistoryDatabase& history, HistoryDatabase::Clock::time_point since) {
+        auto visits = history.recentVisits(since, HistoryDatabase::Clock::now() + std::chrono::seconds(1),
+                                           std::numeric_limits<size_t>::max());
+        std::lock_guard<std::mutex> lock(syncMutex);
+        // Newest first, so the first visit of each URL wins
+        std::unordered_set<std::string_view> seen;
+        for (const auto& visit : visits) {
+            if (seen.insert(visit.url).second) stage(SyncKind::HISTORY, visit.url, visit.title, false);
+        }
+    }
+    
+    // This device's open tabs, as one record other devices can list
+    void stageOpenTabs(const OpenTabSource::TabLister& lister) {
+        ByteWriter writer;
+        lister([&](const Tab& tab) {
+            writer.writeString(tab.getUrl());
+            writer.writeString(tab.getTitle());
+        });
+        std::lock_guard<std::mutex> lock(syncMutex);
+        stage(SyncKind::OPEN_TABS, deviceId,
+              std::string_view(reinterpret_cast<const char*>(writer.data().data()), writer.size()), false);
+    }
+    
+    void stageSettings(const std::map<std::string, std::string>& settings) {
+        std::unordered_map<std::string, std::string> snapshot(settings.begin(), settings.end());
+        std::lock_guard<std::mutex> lock(syncMutex);
+        replaceKind(SyncKind::SETTING, snapshot);
+    }
+    
+    void addDevice(const std::string& deviceName) {
+        connectedDevices.push_back(deviceName);
+        NOVA_LOG_INFO(SYNC, "Added device to sync: " << deviceName);
+    }
+    
+    void removeDevice(const std::string& deviceName) {
+        connectedDevices.erase(
+            std::remove(connectedDevices.begin(), connectedDevices.end(), deviceName),
+            connectedDevices.end()
+        );
+        NOVA_LOG_INFO(SYNC, "Removed device from sync: " << deviceName);
+    }
+    
+    bool getSyncStatus() const { return isSyncEnabled; }
+    std::vector<std::string> getConnectedDevices() const { return connectedDevices; }
+    
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        Stats stats = lastStats;
+        stats.records = records.size();
+        return stats;
+    }
+    
+private:
+    struct Record : SyncRecord {
+        bool dirty = false;  // changed here since the last push
+    };
+    
+    bool isSyncEnabled;
+    std::chrono::system_clock::time_point lastSyncTime;
+    std::vector<std::string> connectedDevices;
+    mutable std::mutex syncMutex;
+    
+    std::string deviceId;
+    SyncTransport transport;
+    ChangeHandler changeHandler;
+    std::unordered_map<std::string, Record> records;  // by SyncRecord::idOf
+    std::vector<std::string> dirty;
+    uint64_t clock = 0;
+    uint64_t token = 0;
+    Stats lastStats;
+    
+    void stage(SyncKind kind, std::string_view key, std::string_view value, bool deleted) {
+        auto [it, added] = records.try_emplace(SyncRecord::idOf(kind, key));
+        Record& record = it->second;
+        if (!added && record.deleted == deleted && record.value == value) return;
+        if (added && deleted) {
+            records.erase(it);
+            return;
+        }
+        record.kind = kind;
+        record.key = key;
+        record.value = value;
+        record.deleted = deleted;
+        record.clock = ++clock;
+        record.device = deviceId;
+        if (!record.dirty) {
+            record.dirty = true;
+            dirty.push_back(it->first);
+        }
+    }
+    
+    // Stages every record of a kind from a full snapshot of it
+    void replaceKind(SyncKind kind, const std::unordered_map<std::string, std::string>& snapshot) {
+        std::vector<std::string> gone;
+        for (const auto& [id, record] : records) {
+            if (record.kind == kind && !record.deleted && snapshot.count(record.key) == 0) gone.push_back(record.key);
+        }
+        for (const auto& key : gone) stage(kind, key, {}, true);
+        for (const auto& [key, value] : snapshot) stage(kind, key, value, false);
+    }
+    
+    // Runs the round trips of syncNow under the lock, collecting the
+    // merged records into `merged` when there is one
+    bool pushAndPull(std::vector<SyncRecord>* merged) {
+        lastSyncTime = std::chrono::system_clock::now();
+        if (!transport) return true;
+        
+        lastStats = Stats();
+        bool more = true;
+        while (more || !dirty.empty()) {
+            size_t batch = std::min(dirty.size(), SyncServer::kBatchRecords);
+            ByteWriter request;
+            request.writeString(deviceId);
+            request.writeVarint(token);
+            request.writeVarint(batch);
+            for (size_t i = dirty.size() - batch; i < dirty.size(); ++i) records[dirty[i]].write(request);
+            std::vector<uint8_t> message = CompactCodec::compress(request.data());
+            std::vector<uint8_t> reply = transport(message);
+            
+            std::vector<uint8_t> bytes;
+            if (reply.empty() || !CompactCodec::decompress(reply, bytes) || !mergeResponse(bytes, more, merged)) {
+                NOVA_LOG_ERROR(SYNC, "Sync failed after " << lastStats.roundTrips << " round trips; "
+                               << dirty.size() << " changes left to push");
+                return false;
+            }
+            for (size_t i = dirty.size() - batch; i < dirty.size(); ++i) records[dirty[i]].dirty = false;
+            dirty.resize(dirty.size() - batch);
+            lastStats.pushed += batch;
+            lastStats.roundTrips++;
+            lastStats.bytesSent += message.size();
+            lastStats.bytesReceived += reply.size();
+        }
+        NOVA_LOG_DEBUG(SYNC, "Synced: pushed " << lastStats.pushed << ", pulled " << lastStats.pulled << " in "
+                       << lastStats.roundTrips << " round trips (" << lastStats.bytesSent + lastStats.bytesReceived << " bytes)");
+        return true;
+    }
+    
+    bool mergeResponse(const std::vector<uint8_t>& bytes, bool& more, std::vector<SyncRecord>* merged) {
+        ByteReader reader(bytes);
+        uint64_t nextToken = reader.readVarint();
+        more = reader.readU8() != 0;
+        size_t count = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < count && reader.ok(); ++i) {
+            SyncRecord incoming;
+            if (!incoming.read(reader)) break;
+            clock = std::max(clock, incoming.clock);
+            auto [it, added] = records.try_emplace(SyncRecord::idOf(incoming.kind, incoming.key));
+            Record& record = it->second;
+            // A newer local edit stays dirty and wins when pushed
+            if (!added && !incoming.newerThan(record)) continue;
+            static_cast<SyncRecord&>(record) = std::move(incoming);
+            lastStats.pulled++;
+            if (merged) merged->push_back(record);
+        }
+        if (!reader.ok()) return false;
+        token = nextToken;
+        return true;
+    }
+};
+
+// Main browser window class
+class BrowserWindow {
+public:
+    // The window's tabs are allocated from `arena`, so closing a window
+    // returns their memory at once; without one they use the global heap
+    explicit BrowserWindow(std::shared_ptr<Arena> arena = std::make_shared<Arena>())
+        : arena(std::move(arena)), isFullScreen(false),
+          openTabs([this](const OpenTabSource::TabVisitor& visit) { forEachTab(visit); }) {
+        // Initialize with a default tab
+        openNewTab("about:welcome");
+    }
+    
+    ~BrowserWindow() {
+        for (const auto& tab : tabs) {
+            tab->setRequestFilter(nullptr);
+            OpenTabIndex::instance().remove(tab.get(), {this, nullptr});
+        }
+    }
+    
+    void forEachTab(const OpenTabSource::TabVisitor& visit) const {
+        for (const auto& tab : tabs) visit(*tab);
+    }
+    
+    // Widens the command bar's tab suggestions, e.g. to every window
+    void setTabLister(OpenTabSource::TabLister lister) { openTabs.setLister(std::move(lister)); }
+    
+    void openNewTab(const std::string& url = "about:blank") {
+        auto tab = Arena::make<Tab>(arena, url);
+        tab->setRequestFilter(requestFilter());
+        HibernationManager::instance().track(tab);
+        OpenTabIndex::instance().add(tab, {this, nullptr});
+        tabs.push_back(tab);
+        handles.push_back(tab->getHandle());
+        setActiveTab(tabs.size() - 1);
+        NOVA_LOG_DEBUG(UI, "New tab opened with URL: " << url);
+    }
+    
+    // The active tab is held by handle, so closing a tab before it keeps it active
+    void closeTab(size_t index) {
+        if (index < tabs.size()) {
+            bool wasActive = handles[index] == activeTab;
+            if (wasActive) {
+                tabs[index]->setActive(false);
+                activeTab = TabId();
+            }
+            tabs[index]->setRequestFilter(nullptr);
+            OpenTabIndex::instance().remove(tabs[index].get(), {this, nullptr});
+            tabs.erase(tabs.begin() + index);
+            handles.erase(handles.begin() + index);
+            NOVA_LOG_INFO(UI, "Tab closed at index: " << index);
+            
+            // If we closed the active tab, activate the one that took its place
+            if (wasActive && !tabs.empty()) {
+                setActiveTab(std::min(index, tabs.size() - 1));
+            }
+        }
+    }
+    
+    void setActiveTab(size_t index) {
+        if (index < tabs.size()) {
+            // Deactivate current active tab
+            if (Tab* current = TabRegistry::instance().get(activeTab)) {
+                current->setActive(false);
+            }
+            
+            // Activate new tab
+            tabs[index]->setActive(true);
+            activeTab = handles[index];
+            NOVA_LOG_DEBUG(UI, "Active tab changed to: " << tabs[index]->getTitle());
+        }
+    }
+    
+    void splitView(size_t tabIndex1, size_t tabIndex2) {
+        if (tabIndex1 < tabs.size() && tabIndex2 < tabs.size()) {
+            NOVA_LOG_INFO(UI, "Split view enabled between tabs: "
+                      << tabs[tabIndex1]->getTitle() << " and "
+                      << tabs[tabIndex2]->getTitle());
+            // In a real implementation, this would rearrange the UI
+        }
+    }
+    
+    void toggleFullScreen() {
+        isFullScreen = !isFullScreen;
+        NOVA_LOG_INFO(UI, (isFullScreen ? "Entered" : "Exited") << " full screen mode");
+    }
+    
+    std::shared_ptr<Tab> getActiveTab() const {
+        size_t index = activeTabIndex();
+        return index < tabs.size() ? tabs[index] : nullptr;
+    }
+    
+    const std::vector<std::shared_ptr<Tab>>& getTabs() const { return tabs; }
+    const std::shared_ptr<Arena>& getArena() const { return arena; }
+    
+    // The window's tabs and which one is active, as part of a session layout
+    void saveState(ByteWriter& writer, const SessionRefs& refs) const {
+        writer.writeU8(isFullScreen ? 1 : 0);
+        writer.writeVarint(activeTabIndex());
+        writer.writeVarint(tabs.size());
+        for (const auto& tab : tabs) writer.writeVarint(refs.tabKey(*tab));
+    }
+    
+    // Replaces the window's tabs with saved ones. Only the active tab is
+    // restored here; the others come in through restorePendingTabs.
+    bool loadState(ByteReader& reader, const SessionRefs& refs) {
+        isFullScreen = reader.readU8() & 1;
+        size_t active = static_cast<size_t>(reader.readVarint());
+        size_t count = static_cast<size_t>(reader.readVarint());
+        std::vector<SessionJournal::Key> keys;
+        for (size_t i = 0; i < count && reader.ok(); ++i) keys.push_back(reader.readVarint());
+        for (const auto& tab : tabs) {
+            tab->setRequestFilter(nullptr);
+            OpenTabIndex::instance().remove(tab.get(), {this, nullptr});
+        }
+        tabs.clear();
+        handles.clear();
+        // No tab is active until the saved one is activated
+        activeTab = TabId();
+        pending = PendingTabs();
+        if (keys.empty()) return reader.ok();
+        
+        pending.active = std::min(active, keys.size() - 1);
+        if (auto tab = refs.tab(keys[pending.active], arena)) {
+            insertRestored(0, {std::move(tab)});
+            pending.anchor = 1;
+            setActiveTab(0);
+        }
+        pending.keys = std::move(keys);
+        return reader.ok();
+    }
+    
+    // Saved tabs loadState has not restored yet
+    size_t pendingTabs() const {
+        if (pending.next >= pending.keys.size()) return 0;
+        return pending.keys.size() - pending.next - (pending.next <= pending.active ? 1 : 0);
+    }
+    
+    // Restores up to `limit` more of the saved tabs, in their saved order
+    // around the active one; returns how many it went through
+    size_t restorePendingTabs(const SessionRefs& refs, size_t limit) {
+        size_t looked = 0;
+        while (pending.next < pending.keys.size() && looked < limit) {
+            if (pending.next == pending.active) {
+                pending.next++;
+                continue;
+            }
+            bool before = pending.next < pending.active;
+            size_t end = before ? pending.active : pending.keys.size();
+            std::vector<std::shared_ptr<Tab>> batch;
+            for (; pending.next < end && looked < limit; ++pending.next, ++looked) {
+                if (auto tab = refs.tab(pending.keys[pending.next], arena)) batch.push_back(std::move(tab));
+            }
+            size_t& placed = before ? pending.placedBefore : pending.placedAfter;
+            size_t at = before ? pending.placedBefore : pending.placedBefore + pending.anchor + pending.placedAfter;
+            placed += batch.size();
+            insertRestored(std::min(at, tabs.size()), std::move(batch));
+        }
+        if (pending.next >= pending.keys.size()) pending = PendingTabs();
+        return looked;
+    }
+    
+    Sidebar& getSidebar() { return sidebar; }
+    Theme& getTheme() { return theme; }
+    SearchEngine& getSearchEngine() { return searchEngine; }
+    BookmarkManager& getBookmarks() { return bookmarks; }
+    PrivacyManager& getPrivacy() { return privacy; }
+    
+    // Advanced features
+    void addReadingMode() {
+        readingMode = std::make_unique<ReadingMode>();
+        NOVA_LOG_INFO(UI, "Reading mode added to browser window");
+    }
+    
+    void addAiAssistant() {
+        aiAssistant = std::make_unique<AiAssistant>();
+        NOVA_LOG_INFO(UI, "AI assistant added to browser window");
+    }
+    
+    void addCommandBar() {
+        commandBar = std::make_unique<CommandBar>();
+        commandBar->addSuggestionSource(&openTabs);
+        commandBar->addSuggestionSource(&bookmarks);
+        commandBar->addSuggestionSource(tabArchive.get());
+        commandBar->addSuggestionSource(&HistoryDatabase::instance());
+        NOVA_LOG_INFO(UI, "Command bar added to browser window");
+    }
+    
+    void addTabArchive() {
+        if (commandBar && tabArchive) commandBar->removeSuggestionSource(tabArchive.get());
+        tabArchive = std::make_unique<TabArchive>();
+        if (commandBar) commandBar->addSuggestionSource(tabArchive.get());
+        NOVA_LOG_INFO(UI, "Tab archive added to browser window");
+    }
+    
+    void addWebsiteCustomizer() {
+        websiteCustomizer = std::make_unique<WebsiteCustomizer>();
+        NOVA_LOG_INFO(UI, "Website customizer added to browser window");
+    }
+    
+    ReadingMode* getReadingMode() { return readingMode.get(); }
+    AiAssistant* getAiAssistant() { return aiAssistant.get(); }
+    CommandBar* getCommandBar() { return commandBar.get(); }
+    TabArchive* getTabArchive() { return tabArchive.get(); }
+    WebsiteCustomizer* getWebsiteCustomizer() { return websiteCustomizer.get(); }
+    
+private:
+    // Saved tabs still to restore after loadState: keys from `next` on,
+    // except the active one, which loadState restored as the anchor
+    struct PendingTabs {
+        std::vector<SessionJournal::Key> keys;
+        size_t next = 0;
+        size_t active = 0;
+        size_t anchor = 0;  // 1 if the active tab was restored
+        size_t placedBefore = 0;
+        size_t placedAfter = 0;
+    };
+    
+    std::shared_ptr<Arena> arena;
+    std::vector<std::shared_ptr<Tab>> tabs;
+    std::vector<TabId> handles;  // the tabs' registry handles, in the same order
+    PendingTabs pending;
+    TabId activeTab;
+    bool isFullScreen;
+    OpenTabSource openTabs;
+    
+    Sidebar sidebar;
+    Theme theme;
+    SearchEngine searchEngine;
+    BookmarkManager bookmarks;
+    PrivacyManager privacy;
+    
+    // Advanced components
+    std::unique_ptr<ReadingMode> readingMode;
+    std::unique_ptr<AiAssistant> aiAssistant;
+    std::unique_ptr<CommandBar> commandBar;
+    std::unique_ptr<TabArchive> tabArchive;
+    std::unique_ptr<WebsiteCustomizer> websiteCustomizer;
+    
+    // Position of the active tab, or tabs.size() if none is
+    size_t activeTabIndex() const {
+        if (!activeTab.valid()) return tabs.size();
+        // Usually the newest tab
+        for (size_t i = handles.size(); i-- > 0;) {
+            if (handles[i] == activeTab) return i;
+        }
+        return tabs.size();
+    }
+    
+    // The window's tracking protection, for each tab it holds
+    Tab::RequestFilter requestFilter() const {
+        return [this](const ContentFilter::Request& request) { return privacy.shouldBlockRequest(request); };
+    }
+    
+    // Places restored tabs at `index`, as openNewTab would each one
+    void insertRestored(size_t index, std::vector<std::shared_ptr<Tab>> restored) {
+        std::vector<TabId> restoredHandles;
+        for (const auto& tab : restored) {
+            tab->setRequestFilter(requestFilter());
+            OpenTabIndex::instance().add(tab, {this, nullptr});
+            restoredHandles.push_back(tab->getHandle());
+        }
+        tabs.insert(tabs.begin() + index, std::make_move_iterator(restored.begin()),
+                    std::make_move_iterator(restored.end()));
+        handles.insert(handles.begin() + index, restoredHandles.begin(), restoredHandles.end());
+    }
+};
+
+// Search over every open tab at once: each window's, each group's and each
+// space's. Titles and URLs are kept folded in one contiguous buffer, so a
+// query is one scan for its longest literal piece plus a check of the tabs
+// it lands in. The index catches up with the tabs before each search,
+// folding again only tabs whose revision moved.
+class TabSearch {
+public:
+    // Where a tab was listed; a tab listed twice, e.g. in a window and in a
+    // group, has both filled in
+    struct Place {
+        const Space* space = nullptr;
+        const BrowserWindow* window = nullptr;
+        const TabGroup* group = nullptr;
+        
+        bool operator==(const Place& other) const {
+            return space == other.space && window == other.window && group == other.group;
+        }
+    };
+    
+    struct Hit {
+        std::shared_ptr<Tab> tab;
+        Place place;
+    };
+    
+    struct Stats {
+        size_t tabs = 0;
+        size_t indexBytes = 0;
+        size_t rebuilds = 0;
+        size_t foldedTabs = 0;  // over all rebuilds
+    };
+    
+    using Visitor = std::function<void(const std::shared_ptr<Tab>&, const Place&)>;
+    using Lister = std::function<void(const Visitor&)>;
+    // Takes hits a batch at a time, in listing order; false stops the search.
+    // It must not search again from inside.
+    using HitHandler = std::function<bool(const std::vector<Hit>&)>;
+    
+    static constexpr size_t kBatchHits = 256;
+    
+    explicit TabSearch(Lister lister) : lister(std::move(lister)) {}
+    
+    // Returns how many hits were handed over
+    size_t search(const std::string& query, const HitHandler& onHits) {
+        TabQuery compiled(query);
+        if (compiled.empty()) return 0;
+        refresh();
+        
+        std::vector<Hit> batch;
+        batch.reserve(kBatchHits);
+        size_t delivered = 0;
+        bool stopped = false;
+        auto consider = [&](const Entry& entry) {
+            std::string_view title(text.data() + entry.offset, entry.titleLength);
+            std::string_view url(text.data() + entry.offset + entry.titleLength + 1, entry.urlLength);
+            if (!compiled.matchesFolded(title, url)) return;
+            // Closed since the last refresh
+            auto tab = entry.tab.lock();
+            if (!tab) return;
+            batch.push_back({std::move(tab), entry.place});
+            if (batch.size() < kBatchHits) return;
+            delivered += batch.size();
+            stopped = !onHits(batch);
+            batch.clear();
+        };
+        
+        std::string_view anchor = compiled.anchor();
+        if (anchor.empty()) {
+            for (size_t i = 0; i < entries.size() && !stopped; ++i) consider(entries[i]);
+        } else {
+            // Entries are laid out in order, so the scan only moves forward
+            size_t next = 0;
+            size_t position = 0;
+            while (!stopped) {
+                position = FoldedText::find(text, anchor, position);
+                if (position == FoldedText::npos) break;
+                while (entryEnd(entries[next]) <= position) next++;
+                consider(entries[next]);
+                position = entryEnd(entries[next++]);
+            }
+        }
+        if (!stopped && !batch.empty()) {
+            delivered += batch.size();
+            onHits(batch);
+        }
+        NOVA_LOG_TRACE(TAB, "Tab search '" << query << "' found " << delivered << " of " << entries.size());
+        return delivered;
+    }
+    
+    std::vector<Hit> search(const std::string& query, size_t limit = std::numeric_limits<size_t>::max()) {
+        std::vector<Hit> hits;
+        if (limit == 0) return hits;
+        search(query, [&](const std::vector<Hit>& batch) {
+            size_t take = std::min(batch.size(), limit - hits.size());
+            hits.insert(hits.end(), batch.begin(), batch.begin() + take);
+            return hits.size() < limit;
+        });
+        return hits;
+    }
+    
+    // Brings the index up to date with what the lister returns
+    void refresh() {
+        visits.clear();
+        lister([this](const std::shared_ptr<Tab>& tab, const Place& place) {
+            if (tab) visits.push_back({tab->getHandle(), tab->getRevision(), place});
+        });
+        if (visits == indexedVisits) return;
+        bool sameLayout = visits.size() == indexedVisits.size() &&
+            std::equal(visits.begin(), visits.end(), indexedVisits.begin(), [](const Visit& a, const Visit& b) {
+                return a.tab == b.tab && a.place == b.place;
+            });
+        if (sameLayout) {
+            refold();
+        } else {
+            rebuild();
+        }
+        indexedVisits.swap(visits);
+    }
+    
+    Stats getStats() const {
+        Stats current = stats;
+        current.tabs = entries.size();
+        current.indexBytes = text.capacity() + entries.capacity() * sizeof(Entry);
+        return current;
+    }
+    
+private:
+    struct Visit {
+        TabId tab;
+        uint64_t revision;
+        Place place;
+        size_t entry = 0;  // set once indexed
+        
+        bool operator==(const Visit& other) const {
+            return tab == other.tab && revision == other.revision && place == other.place;
+        }
+    };
+    
+    // At `offset` in the text: the folded title, '\n', the folded URL, '\n'.
+    // Query terms hold no whitespace, so no match spans the separators.
+    // Entries hold tabs weakly: a closed tab is skipped, not kept alive.
+    struct Entry {
+        TabId id;
+        std::weak_ptr<Tab> tab;
+        uint64_t revision = 0;
+        Place place;
+        size_t offset = 0;
+        uint32_t titleLength = 0;
+        uint32_t urlLength = 0;
+    };
+    
+    Lister lister;
+    std::string text;
+    std::vector<Entry> entries;
+    std::vector<Visit> visits;
+    std::vector<Visit> indexedVisits;  // what `entries` was built from
+    Stats stats;
+    
+    static size_t entryEnd(const Entry& entry) {
+        return entry.offset + entry.titleLength + entry.urlLength + 2;
+    }
+    
+    static uint64_t keyOf(TabId id) { return static_cast<uint64_t>(id.slot) << 32 | id.generation; }
+    
+    // The same tabs in the same places, some of them changed: only their
+    // text is folded again, the rest is copied across
+    void refold() {
+        std::vector<bool> changed(entries.size());
+        for (size_t i = 0; i < visits.size(); ++i) {
+            visits[i].entry = indexedVisits[i].entry;
+            if (visits[i].revision != indexedVisits[i].revision) changed[visits[i].entry] = true;
+        }
+        std::string refolded;
+        refolded.reserve(text.size() + text.size() / 8);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            Entry& entry = entries[i];
+            size_t offset = refolded.size();
+            if (changed[i]) {
+                // Listed just now, so still open
+                auto tab = entry.tab.lock();
+                entry.revision = tab->getRevision();
+                appendFolded(refolded, tab->getTitle(), entry.titleLength);
+                appendFolded(refolded, tab->getUrl(), entry.urlLength);
+                stats.foldedTabs++;
+            } else {
+                refolded.append(text, entry.offset, entryEnd(entry) - entry.offset);
+            }
+            entry.offset = offset;
+        }
+        text.swap(refolded);
+    }
+    
+    // Tabs came, went or moved. Old entries are matched in order where the
+    // listing still lines up, and by tab otherwise.
+    void rebuild() {
+        stats.rebuilds++;
+        std::unordered_map<uint64_t, size_t> previous;
+        auto findPrevious = [&](TabId id, size_t hint) -> const Entry* {
+            if (hint < entries.size() && entries[hint].id == id) return &entries[hint];
+            if (previous.empty()) {
+                previous.reserve(entries.size());
+                for (size_t i = 0; i < entries.size(); ++i) previous.emplace(keyOf(entries[i].id), i);
+            }
+            auto it = previous.find(keyOf(id));
+            return it == previous.end() ? nullptr : &entries[it->second];
+        };
+        
+        std::vector<Entry> rebuilt;
+        rebuilt.reserve(visits.size());
+        std::string rebuiltText;
+        rebuiltText.reserve(text.size() + text.size() / 8);
+        std::unordered_map<const Tab*, size_t> placed;
+        placed.reserve(visits.size());
+        size_t visit = 0;
+        size_t hint = 0;
+        
+        lister([&](const std::shared_ptr<Tab>& tab, const Place& place) {
+            if (!tab) return;
+            auto [it, added] = placed.emplace(tab.get(), rebuilt.size());
+            if (visit < visits.size()) visits[visit++].entry = it->second;
+            if (!added) {
+                Place& merged = rebuilt[it->second].place;
+                if (!merged.space) merged.space = place.space;
+                if (!merged.window) merged.window = place.window;
+                if (!merged.group) merged.group = place.group;
+                return;
+            }
+            Entry entry;
+            entry.id = tab->getHandle();
+            entry.tab = tab;
+            entry.revision = tab->getRevision();
+            entry.place = place;
+            entry.offset = rebuiltText.size();
+            const Entry* old = findPrevious(entry.id, hint);
+            if (old && old->revision == entry.revision) {
+                entry.titleLength = old->titleLength;
+                entry.urlLength = old->urlLength;
+                rebuiltText.append(text, old->offset, entryEnd(*old) - old->offset);
+            } else {
+                appendFolded(rebuiltText, tab->getTitle(), entry.titleLength);
+                appendFolded(rebuiltText, tab->getUrl(), entry.urlLength);
+                stats.foldedTabs++;
+            }
+            if (old) hint = static_cast<size_t>(old - entries.data()) + 1;
+            rebuilt.push_back(std::move(entry));
+        });
+        entries.swap(rebuilt);
+        text.swap(rebuiltText);
+    }
+    
+    static void appendFolded(std::string& out, const std::string& field, uint32_t& length) {
+        size_t start = out.size();
+        out.resize(start + field.size() + 1);
+        FoldedText::fold(field.data(), field.size(), out.data() + start);
+        // A newline inside a field would read as a separator
+        std::replace(out.begin() + start, out.end() - 1, '\n', ' ');
+        out.back() = '\n';
+        length = static_cast<uint32_t>(field.size());
+    }
+};
+
+// NovaEngine implementation with Space support and additional features
+class NovaEngine {
+public:
+    // How long one step of bringing the engine up took
+    struct StartupPhase {
+        std::string name;
+        double millis = 0;
+    };
+    
+    NovaEngine() : NovaEngine(std::string()) {}
+    
+    // Starts from the session saved in `sessionFile` when there is one, in
+    // place of the welcome window. Only what the first frame shows is ready
+    // when this returns: the active tab of each window. The other tabs are
+    // restored a chunk per runPendingTasks and stay packed until used, and
+    // subsystems start on first use.
+    explicit NovaEngine(const std::string& sessionFile) {
+        NOVA_LOG_INFO(ENGINE, "NOVA Browser has started");
+        NOVA_LOG_INFO(ENGINE, "Navigate. Organize. Visualize. Achieve.");
+        
+        // Create default space
+        startupPhase("default space", [this] {
+            auto defaultSpace = std::make_shared<Space>("Home");
+            spaces.push_back(defaultSpace);
+            activeSpaceIndex = 0;
+            defaultSpace->activate();
+        });
+        
+        if (!sessionFile.empty()) startupPhase("session", [&] { openSession(sessionFile); });
+        
+        // Create first window in default space
+        if (windows.empty()) startupPhase("first window", [this] { createNewWindow(); });
+        
+        // Setup keyboard shortcuts
+        startupPhase("shortcuts", [this] { setupKeyboardShortcuts(); });
+    }
+    
+    ~NovaEngine() {
+        if (checkpointTimer) TimerWheel::instance().cancel(checkpointTimer);
+        MainThreadQueue::instance().cancel(this);
+        MainThreadQueue::instance().cancel(&restoredTabs);
+    }
+    
+    void createSpace(const std::string& name, const std::string& icon = "🏠") {
+        auto space = std::make_shared<Space>(name);
+        space->setIcon(icon);
+        spaces.push_back(space);
+        NOVA_LOG_INFO(ENGINE, "Created new space: " << name << " " << icon);
+    }
+    
+    void switchToSpace(size_t index) {
+        if (index >= spaces.size()) return;
+        
+        if (activeSpaceIndex < spaces.size()) {
+            spaces[activeSpaceIndex]->deactivate();
+        }
+        
+        spaces[index]->activate();
+        activeSpaceIndex = index;
+    }
+    
+    // Closes the space with its groups and the windows no other space
+    // holds. Their tabs are freed with the space's and windows' arenas. The
+    // last space stays open.
+    void closeSpace(size_t index) {
+        if (index >= spaces.size()) return;
+        if (spaces.size() == 1) {
+            NOVA_LOG_WARN(ENGINE, "Cannot close the last space: " << spaces[index]->getName());
+            return;
+        }
+        
+        auto space = spaces[index];
+        auto activeWindow = getActiveWindow();
+        spaces.erase(spaces.begin() + index);
+        for (const auto& window : space->getWindows()) {
+            bool shared = std::any_of(spaces.begin(), spaces.end(), [&](const std::shared_ptr<Space>& other) {
+                const auto& otherWindows = other->getWindows();
+                return std::find(otherWindows.begin(), otherWindows.end(), window) != otherWindows.end();
+            });
+            if (!shared) windows.erase(std::remove(windows.begin(), windows.end(), window), windows.end());
+        }
+        
+        auto activeAt = std::find(windows.begin(), windows.end(), activeWindow);
+        activeWindowIndex = activeAt != windows.end() ? static_cast<size_t>(activeAt - windows.begin())
+                                                      : (windows.empty() ? 0 : windows.size() - 1);
+        if (activeSpaceIndex == index) {
+            // Nothing left to deactivate
+            activeSpaceIndex = spaces.size();
+            switchToSpace(std::min(index, spaces.size() - 1));
+        } else if (activeSpaceIndex > index) {
+            activeSpaceIndex--;
+        }
+        NOVA_LOG_INFO(ENGINE, "Closed space: " << space->getName() << " " << space->getIcon());
+    }
+    
+    // The window belongs to the active space
+    void createNewWindow() {
+        auto window = std::make_shared<BrowserWindow>();
+        attachWindow(*window);
+        windows.push_back(window);
+        if (activeSpaceIndex < spaces.size()) spaces[activeSpaceIndex]->addWindow(window);
+        setActiveWindow(windows.size() - 1);
+        NOVA_LOG_INFO(ENGINE, "New browser window created");
+    }
+    
+    void closeWindow(size_t index) {
+        if (index < windows.size()) {
+            for (const auto& space : spaces) space->removeWindow(windows[index].get());
+            windows.erase(windows.begin() + index);
+            NOVA_LOG_INFO(ENGINE, "Window closed at index: " << index);
+            
+            // If we closed the active window, activate another one
+            if (activeWindowIndex >= windows.size()) {
+                if (!windows.empty()) {
+                    setActiveWindow(windows.size() - 1);
+                } else {
+                    activeWindowIndex = 0;
+                }
+            }
+        }
+    }
+    
+    void setActiveWindow(size_t index) {
+        if (index < windows.size()) {
+            activeWindowIndex = index;
+            NOVA_LOG_INFO(ENGINE, "Active window changed to index: " << index);
+        }
+    }
+    
+    std::shared_ptr<BrowserWindow> getActiveWindow() const {
+        if (!windows.empty() && activeWindowIndex < windows.size()) {
+            return windows[activeWindowIndex];
+        }
+        return nullptr;
+    }
+    
+    void setupKeyboardShortcuts() {
+        globalShortcuts["Ctrl+T"] = [this]() { 
+            auto window = getActiveWindow();
+            if (window) window->openNewTab();
+        };
+        
+        globalShortcuts["Ctrl+W"] = [this]() {
+            auto window = getActiveWindow();
+            if (window && window->getActiveTab()) {
+                // Find the index of the active tab
+                // window->closeTab(index);
+            }
+        };
+        
+        globalShortcuts["Ctrl+Shift+T"] = [this]() {
+            auto window = getActiveWindow();
+            if (window && window->getTabArchive()) {
+                // Restore the most recent tab
+                auto restoredTab = window->getTabArchive()->restoreTab(0);
+                if (restoredTab) {
+                    // Add the restored tab to the window
+                }
+            }
+        };
+        
+        NOVA_LOG_INFO(ENGINE, "Keyboard shortcuts initialized");
+    }
+    
+    // Subsystems start on first use rather than with the engine
+    ExtensionManager* getExtensionManager() {
+        if (!extensionManager) extensionManager = std::make_unique<ExtensionManager>();
+        return extensionManager.get();
+    }
+    
+    Synchronizer* getSynchronizer() {
+        if (!synchronizer) synchronizer = std::make_unique<Synchronizer>();
+        return synchronizer.get();
+    }
+    
+    NotificationCenter* getNotificationCenter() {
+        if (!notificationCenter) notificationCenter = std::make_unique<NotificationCenter>();
+        return notificationCenter.get();
+    }
+    
+    const std::vector<StartupPhase>& getStartupPhases() const { return startupPhases; }
+    
+    std::vector<std::shared_ptr<Space>> getAllSpaces() const { return spaces; }
+    std::vector<std::shared_ptr<BrowserWindow>> getAllWindows() const { return windows; }
+    
+    // Allocation counters of each space's and each window's arena
+    struct ArenaUsage {
+        std::string owner;
+        Arena::Stats stats;
+    };
+    
+    std::vector<ArenaUsage> getArenaUsage() const {
+        std::vector<ArenaUsage> usage;
+        for (const auto& space : spaces) usage.push_back({"space " + space->getName(), space->getArena()->getStats()});
+        for (size_t i = 0; i < windows.size(); ++i) {
+            if (const auto& arena = windows[i]->getArena()) usage.push_back({"window " + std::to_string(i), arena->getStats()});
+        }
+        return usage;
+    }
+    
+    // Every tab of every space, group and window whose title or URL matches;
+    // see TabQuery for the syntax and TabSearch for how hits arrive
+    size_t searchTabs(const std::string& query, const TabSearch::HitHandler& onHits) {
+        return tabSearch.search(query, onHits);
+    }
+    
+    std::vector<TabSearch::Hit> searchTabs(const std::string& query, size_t limit) {
+        return tabSearch.search(query, limit);
+    }
+    
+    TabSearch::Stats getTabSearchStats() const { return tabSearch.getStats(); }
+    
+    // Tabs already showing the page at `url`, and the windows and groups they are in
+    std::vector<OpenTabIndex::Match> findOpenTabs(const std::string& url) const {
+        return OpenTabIndex::instance().find(url);
+    }
+    
+    struct DedupeResult {
+        size_t closedTabs = 0;
+        size_t reclaimedBytes = 0;  // estimated, of the tabs closed
+    };
+    
+    // Closes every tab showing a page another tab shows, in all windows and
+    // groups. The tab kept is the active one, else a pinned one, else the
+    // most recently visited; it joins the groups of the tabs it replaces.
+    // Active and pinned duplicates stay open.
+    DedupeResult dedupeTabs() {
+        DedupeResult result;
+        auto keepRank = [](const Tab& tab) {
+            return std::make_tuple(tab.getIsActive(), tab.getIsPinned(), tab.getLastVisited());
+        };
+        for (const auto& matches : OpenTabIndex::instance().duplicates()) {
+            auto keeper = std::max_element(matches.begin(), matches.end(), [&](const auto& a, const auto& b) {
+                return keepRank(*a.tab) < keepRank(*b.tab);
+            });
+            for (const auto& match : matches) {
+                if (&match == &*keeper || match.tab->getIsActive() || match.tab->getIsPinned()) continue;
+                result.closedTabs++;
+                result.reclaimedBytes += match.tab->estimateMemoryUsage();
+                for (const auto& location : match.locations) {
+                    if (location.group) {
+                        location.group->addTab(keeper->tab);
+                        location.group->removeTab(match.tab);
+                    } else if (location.window) {
+                        const auto& windowTabs = location.window->getTabs();
+                        auto it = std::find(windowTabs.begin(), windowTabs.end(), match.tab);
+                        if (it != windowTabs.end()) location.window->closeTab(static_cast<size_t>(it - windowTabs.begin()));
+                    }
+                }
+            }
+        }
+        NOVA_LOG_INFO(ENGINE, "Closed " << result.closedTabs << " duplicate tabs ("
+                      << result.reclaimedBytes / 1024 << " KB)");
+        return result;
+    }
+    
+    // Restores the session saved in `file`, if there is one, and makes it
+    // where checkpoints go. Saved tabs come back as they were, history
+    // included, without navigating; while the file holds no layout yet,
+    // the current spaces and windows are kept.
+    bool openSession(const std::string& file) {
+        auto start = std::chrono::steady_clock::now();
+        // Tabs still waiting belong to the session being replaced
+        restoreSessionTabs(SIZE_MAX);
+        if (!session.open(file)) {
+            NOVA_LOG_ERROR(ENGINE, "Could not read session " << file);
+            return false;
+        }
+        sessionKeys.clear();
+        restoredTabs.clear();
+        nextSessionKey = std::max(kLayoutKey, session.highestLoadedKey()) + 1;
+        
+        std::optional<std::string_view> layout = session.loadedRecord(kLayoutKey);
+        if (!layout) return true;
+        
+        // Only each window's active tab is restored here; the rest follow
+        // in chunks (see restoreSessionTabs). Records nothing holds any
+        // more are dropped by the next checkpoint.
+        std::vector<std::shared_ptr<BrowserWindow>> loadedWindows;
+        std::vector<std::shared_ptr<Space>> loadedSpaces;
+        SessionRefs refs;
+        refs.tab = [this](SessionJournal::Key key, const std::shared_ptr<Arena>& arena) {
+            return restoreSessionTab(key, arena);
+        };
+        refs.window = [&](uint64_t index) {
+            return index < loadedWindows.size() ? loadedWindows[static_cast<size_t>(index)] : nullptr;
+        };
+        ByteReader reader(reinterpret_cast<const uint8_t*>(layout->data()), layout->size());
+        size_t windowCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < windowCount && reader.ok(); ++i) {
+            auto window = std::make_shared<BrowserWindow>();
+            attachWindow(*window);
+            window->loadState(reader, refs);
+            loadedWindows.push_back(std::move(window));
+        }
+        size_t spaceCount = static_cast<size_t>(reader.readVarint());
+        for (size_t i = 0; i < spaceCount && reader.ok(); ++i) {
+            auto space = std::make_shared<Space>();
+            space->loadState(reader, refs);
+            loadedSpaces.push_back(std::move(space));
+        }
+        size_t activeSpace = static_cast<size_t>(reader.readVarint());
+        size_t activeWindow = static_cast<size_t>(reader.readVarint());
+        if (!reader.ok() || !reader.atEnd() || loadedSpaces.empty()) {
+            NOVA_LOG_ERROR(ENGINE, "Session " << file << " has a damaged layout; keeping the current windows");
+            sessionKeys.clear();
+            restoredTabs.clear();
+            return false;
+        }
+        
+        // Activation moves a tab's revision; what was restored is still
+        // what the file holds
+        for (const auto& [key, restored] : restoredTabs) {
+            if (auto tab = restored.lock()) session.restored(key, tab->getRevision());
+        }
+        session.restored(kLayoutKey, SessionJournal::fingerprintOf(*layout));
+        windows.swap(loadedWindows);
+        spaces.swap(loadedSpaces);
+        activeSpaceIndex = std::min(activeSpace, spaces.size() - 1);
+        activeWindowIndex = windows.empty() ? 0 : std::min(activeWindow, windows.size() - 1);
+        size_t pending = pendingSessionTabs();
+        NOVA_LOG_INFO(ENGINE, "Restored session " << file << ": " << spaces.size() << " spaces, " << windows.size()
+                      << " windows, " << restoredTabs.size() << " tabs in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                      << " ms; " << pending << " more to follow");
+        if (pending > 0) scheduleSessionRestore();
+        return true;
+    }
+    
+    // Saved tabs openSession has not restored yet
+    size_t pendingSessionTabs() const {
+        size_t pending = 0;
+        for (const auto& window : windows) pending += window->pendingTabs();
+        for (const auto& space : spaces) {
+            for (const auto& group : space->getTabGroups()) pending += group->pendingTabs();
+        }
+        return pending;
+    }
+    
+    // Writes what changed since the last checkpoint to the open session:
+    // tabs whose revision moved, tabs that are gone, and the layout of
+    // spaces, windows and groups if it differs
+    bool checkpointSession() {
+        if (!session.isOpen()) return false;
+        auto start = std::chrono::steady_clock::now();
+        // Tabs still waiting are only in the records begin() lets go of
+        restoreSessionTabs(SIZE_MAX);
+        session.begin();
+        
+        std::unordered_map<uint32_t, SessionJournal::Key> keys;
+        std::unordered_map<const BrowserWindow*, uint64_t> windowIndices;
+        for (size_t i = 0; i < windows.size(); ++i) windowIndices[windows[i].get()] = i;
+        SessionRefs refs;
+        // A tab's record is put the first time the layout refers to it
+        refs.tabKey = [&](const Tab& tab) {
+            auto [it, added] = keys.try_emplace(tab.getId(), kLayoutKey);
+            if (!added) return it->second;
+            auto known = sessionKeys.find(tab.getId());
+            it->second = known != sessionKeys.end() ? known->second : nextSessionKey++;
+            session.put(it->second, tab.getRevision(), [&tab](ByteWriter& writer) { tab.saveState(writer); });
+            return it->second;
+        };
+        refs.windowIndex = [&](const BrowserWindow& window) {
+            auto it = windowIndices.find(&window);
+            return it != windowIndices.end() ? it->second : static_cast<uint64_t>(windows.size());
+        };
+        
+        // Windows come first, so that spaces can refer to them by position
+        ByteWriter layout;
+        layout.writeVarint(windows.size());
+        for (const auto& window : windows) window->saveState(layout, refs);
+        layout.writeVarint(spaces.size());
+        for (const auto& space : spaces) space->saveState(layout, refs);
+        layout.writeVarint(activeSpaceIndex);
+        layout.writeVarint(activeWindowIndex);
+        std::string_view bytes(reinterpret_cast<const char*>(layout.data().data()), layout.size());
+        session.put(kLayoutKey, SessionJournal::fingerprintOf(bytes), [&bytes](ByteWriter& writer) {
+            writer.writeBytes(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+        });
+        
+        sessionKeys.swap(keys);
+        bool written = session.commit();
+        auto stats = session.stats();
+        NOVA_LOG_DEBUG(ENGINE, "Session checkpoint: " << stats.lastWritten << " records, " << stats.lastBytes << " bytes in "
+                       << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms");
+        return written;
+    }
+    
+    // Checkpoints the open session every `interval`; zero turns it off. The
+    // shared timer only posts the checkpoint, which runs on the owner thread
+    // between changes to the session (see runPendingTasks)
+    void setSessionCheckpointInterval(std::chrono::seconds interval) {
+        auto& wheel = TimerWheel::instance();
+        if (checkpointTimer) {
+            wheel.cancel(checkpointTimer);
+            MainThreadQueue::instance().cancel(this);
+            checkpointTimer = 0;
+        }
+        if (interval.count() <= 0) return;
+        checkpointTimer = wheel.schedule(interval, [this] {
+            MainThreadQueue::instance().post(this, [this] { checkpointSession(); });
+        }, interval, kCheckpointSlack);
+    }
+    
+    // Runs work timers posted for the engine's objects; the embedder's
+    // loop calls this on the thread that drives the engine
+    size_t runPendingTasks() { return MainThreadQueue::instance().runPending(); }
+    
+    SessionJournal::Stats getSessionStats() const { return session.stats(); }
+    
+private:
+    std::vector<std::shared_ptr<Space>> spaces;
+    size_t activeSpaceIndex;
+    std::vector<std::shared_ptr<BrowserWindow>> windows;
+    size_t activeWindowIndex = 0;
+    std::unique_ptr<ExtensionManager> extensionManager;
+    std::unique_ptr<Synchronizer> synchronizer;
+    std::unique_ptr<NotificationCenter> notificationCenter;
+    
+    // Tabs are saved under journal keys, which outlive their process-local ids
+    static constexpr SessionJournal::Key kLayoutKey = 0;
+    static constexpr std::chrono::seconds kCheckpointSlack{5};
+    SessionJournal session;
+    std::unordered_map<uint32_t, SessionJournal::Key> sessionKeys;
+    SessionJournal::Key nextSessionKey = kLayoutKey + 1;
+    TimerId checkpointTimer = 0;
+    // Tabs restored from the open session, so that a tab the layout names
+    // twice is restored once; also the owner of the restore tasks
+    std::unordered_map<SessionJournal::Key, std::weak_ptr<Tab>> restoredTabs;
+    static constexpr size_t kRestoreChunk = 64;
+    
+    std::vector<StartupPhase> startupPhases;
+    
+    TabSearch tabSearch{[this](const TabSearch::Visitor& visit) { listTabs(visit); }};
+    
+    // Spaces first, so tabs carry their space; then windows in no space
+    void listTabs(const TabSearch::Visitor& visit) const {
+        for (const auto& space : spaces) {
+            for (const auto& window : space->getWindows()) {
+                for (const auto& tab : window->getTabs()) visit(tab, {space.get(), window.get(), nullptr});
+            }
+            for (const auto& group : space->getTabGroups()) {
+                for (const auto& tab : group->getTabs()) visit(tab, {space.get(), nullptr, group.get()});
+            }
+        }
+        for (const auto& window : windows) {
+            bool inSpace = std::any_of(spaces.begin(), spaces.end(), [&](const std::shared_ptr<Space>& space) {
+                const auto& spaceWindows = space->getWindows();
+                return std::find(spaceWindows.begin(), spaceWindows.end(), window) != spaceWindows.end();
+            });
+            if (inSpace) continue;
+            for (const auto& tab : window->getTabs()) visit(tab, {nullptr, window.get(), nullptr});
+        }
+    }
+    
+    template <typename Fn>
+    void startupPhase(const char* name, Fn&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        startupPhases.push_back({name, millis});
+        NOVA_LOG_TRACE(ENGINE, "Startup phase " << name << ": " << millis << " ms");
+    }
+    
+    // Restores the saved tab under `key` into `arena`, once
+    std::shared_ptr<Tab> restoreSessionTab(SessionJournal::Key key, const std::shared_ptr<Arena>& arena) {
+        auto known = restoredTabs.find(key);
+        if (known != restoredTabs.end()) return known->second.lock();
+        auto record = session.loadedRecord(key);
+        if (!record) return nullptr;
+        ByteReader reader(reinterpret_cast<const uint8_t*>(record->data()), record->size());
+        auto tab = Tab::restoreState(reader, arena);
+        restoredTabs.emplace(key, tab);
+        if (!tab) {
+            NOVA_LOG_WARN(ENGINE, "Skipping damaged tab record " << key << " in session " << session.getPath());
+            return nullptr;
+        }
+        HibernationManager::instance().track(tab);
+        sessionKeys[tab->getId()] = key;
+        session.restored(key, tab->getRevision());
+        return tab;
+    }
+    
+    // Restores up to `limit` of the saved tabs still waiting, windows
+    // first; returns whether any are left
+    bool restoreSessionTabs(size_t limit) {
+        SessionRefs refs;
+        refs.tab = [this](SessionJournal::Key key, const std::shared_ptr<Arena>& arena) {
+            return restoreSessionTab(key, arena);
+        };
+        for (const auto& window : windows) {
+            if (limit == 0) return true;
+            limit -= window->restorePendingTabs(refs, limit);
+        }
+        for (const auto& space : spaces) {
+            for (const auto& group : space->getTabGroups()) {
+                if (limit == 0) return true;
+                limit -= group->restorePendingTabs(refs, limit);
+            }
+        }
+        if (pendingSessionTabs() > 0) return true;
+        restoredTabs.clear();
+        return false;
+    }
+    
+    // One chunk per turn of the embedder's loop, so no turn depends on
+    // how many tabs the session holds
+    void scheduleSessionRestore() {
+        MainThreadQueue::instance().post(&restoredTabs, [this] {
+            if (restoreSessionTabs(kRestoreChunk)) scheduleSessionRestore();
+        });
+    }
+    
+    void attachWindow(BrowserWindow& window) {
+        window.setTabLister([this](const OpenTabSource::TabVisitor& visit) {
+            for (const auto& open : windows) open->forEachTab(visit);
+        });
+    }
+};
+
+// Definition of demonstrateBrowserFeatures function
+void demonstrateBrowserFeatures(NovaEngine& browser) {
+    auto window = browser.getActiveWindow();
+    if (!window) return;
+    
+    // Initialize advanced components for the window
+    window->addReadingMode();
+    window->addAiAssistant();
+    window->addCommandBar();
+    window->addTabArchive();
+    window->addWebsiteCustomizer();
+    
+    NOVA_LOG_INFO(DEMO, "\n--- NOVA Browser Advanced Feature Demonstration ---\n");
+    
+    // Demo Spaces
+    NOVA_LOG_INFO(DEMO, "1. Contextual Spaces:");
+    browser.createSpace("Work", "💼");
+    browser.createSpace("Personal", "🏠");
+    browser.createSpace("Research", "🔍");
+    browser.switchToSpace(1); // Switch to Work space
+    NOVA_LOG_INFO(DEMO, "   - Spaces organize browser windows into separate contextual environments");
+    NOVA_LOG_INFO(DEMO, "   - Each space maintains its own tabs, groups, and sidebar state");
+    NOVA_LOG_INFO(DEMO, "   - Quickly toggle between different contexts with keyboard shortcuts");
+    
+    // Demo AI Assistant
+    NOVA_LOG_INFO(DEMO, "\n2. AI-Powered Browsing Assistant:");
+    window->getAiAssistant()->summarizeTab(window->getActiveTab());
+    window->getAiAssistant()->suggestFocus();
+    NOVA_LOG_INFO(DEMO, "   - Content summarization with key points extraction");
+    NOVA_LOG_INFO(DEMO, "   - Intelligent tab organization suggestions");
+    NOVA_LOG_INFO(DEMO, "   - Search query refinement assistance");
+    NOVA_LOG_INFO(DEMO, "   - Smart bookmark categorization");
+    
+    // Demo Command Bar
+    NOVA_LOG_INFO(DEMO, "\n3. Command Bar for Quick Actions:");
+    window->getCommandBar()->toggle();
+    window->getCommandBar()->executeCommand("goto example.com");
+    window->getCommandBar()->executeCommand("search nova browser features");
+    NOVA_LOG_INFO(DEMO, "   - Quick navigation with history-aware autocompletion");
+    NOVA_LOG_INFO(DEMO, "   - Execute browser actions with text commands");
+    NOVA_LOG_INFO(DEMO, "   - Customizable shortcuts and aliases");
+    
+    // Demo Tab Archive
+    NOVA_LOG_INFO(DEMO, "\n4. Intelligent Tab Archive:");
+    window->getTabArchive()->archiveTab(window->getActiveTab());
+    window->getTabArchive()->searchArchive("example");
+    NOVA_LOG_INFO(DEMO, "   - Automatically archive inactive tabs to reduce clutter");
+    NOVA_LOG_INFO(DEMO, "   - Full-text search through archived content");
+    NOVA_LOG_INFO(DEMO, "   - One-click restoration of archived tabs");
+    
+    // Demo Website Customization
+    NOVA_LOG_INFO(DEMO, "\n5. Website Customization:");
+    window->getWebsiteCustomizer()->addCustomCSS("example.com", "body { font-size: 18px; }");
+    window->getWebsiteCustomizer()->setZoomLevel("example.com", 1.2f);
+    NOVA_LOG_INFO(DEMO, "   - Per-website custom CSS and JavaScript");
+    NOVA_LOG_INFO(DEMO, "   - Site-specific zoom levels and settings");
+    NOVA_LOG_INFO(DEMO, "   - Content blocking rules customization");
+    
+    // Demo Reading Mode
+    NOVA_LOG_INFO(DEMO, "\n6. Enhanced Reading Experience:");
+    window->getReadingMode()->toggle();
+    window->getReadingMode()->setColorTheme(ReadingMode::ColorTheme::SEPIA);
+    window->getReadingMode()->textToSpeech();
+    NOVA_LOG_INFO(DEMO, "   - Distraction-free reading mode with customizable appearance");
+    NOVA_LOG_INFO(DEMO, "   - Text-to-speech for articles");
+    NOVA_LOG_INFO(DEMO, "   - Offline article saving for later reading");
+    
+    // Demo Extensions
+    NOVA_LOG_INFO(DEMO, "\n7. Extension System:");
+    browser.getExtensionManager()->installExtension("dark-theme", "Dark Theme Pro", "1.2.0");
+    browser.getExtensionManager()->installExtension("privacy-shield", "Privacy Shield", "2.0.1");
+    browser.getExtensionManager()->toggleExtension("privacy-shield", true);
+    NOVA_LOG_INFO(DEMO, "   - Support for Chrome and Firefox extensions");
+    NOVA_LOG_INFO(DEMO, "   - Per-site extension enabling/disabling");
+    NOVA_LOG_INFO(DEMO, "   - Sandboxed extension environment for security");
+    
+    // Demo Sync
+    NOVA_LOG_INFO(DEMO, "\n8. Cross-Device Synchronization:");
+    browser.getSynchronizer()->enableSync(true);
+    browser.getSynchronizer()->addDevice("NOVA Mobile");
+    browser.getSynchronizer()->addDevice("NOVA Tablet");
+    browser.getSynchronizer()->syncNow();
+    NOVA_LOG_INFO(DEMO, "   - Seamless sync between devices");
+    NOVA_LOG_INFO(DEMO, "   - Customizable sync categories");
+    NOVA_LOG_INFO(DEMO, "   - End-to-end encryption for synced data");
+    
+    // Demo Notifications
+    NOVA_LOG_INFO(DEMO, "\n9. Intelligent Notifications:");
+    browser.getNotificationCenter()->showNotification("Download complete", NotificationCenter::NotificationType::SUCCESS);
+    browser.getNotificationCenter()->showNotification("Permission requested: Camera access", NotificationCenter::NotificationType::WARNING);
+    NOVA_LOG_INFO(DEMO, "   - Non-intrusive notification system");
+    NOVA_LOG_INFO(DEMO, "   - Focus mode with notification batching");
+    NOVA_LOG_INFO(DEMO, "   - Priority-based notification management");
+    
+    NOVA_LOG_INFO(DEMO, "\n10. Workflow Optimization:");
+    NOVA_LOG_INFO(DEMO, "   - Smart tab suggestions based on current activity");
+    NOVA_LOG_INFO(DEMO, "   - Automatic workspace organization");
+    NOVA_LOG_INFO(DEMO, "   - Time tracking and productivity insights");
+    NOVA_LOG_INFO(DEMO, "   - Focus timers with website blocking");
+    
+    NOVA_LOG_INFO(DEMO, "\nNOVA Browser surpasses Arc, Chrome, Edge, and Safari by combining:");
+    NOVA_LOG_INFO(DEMO, "- More intelligent workspace organization with AI-powered suggestions");
+    NOVA_LOG_INFO(DEMO, "- Greater customization capabilities for both UI and websites");
+    NOVA_LOG_INFO(DEMO, "- Enhanced privacy controls with granular settings");
+    NOVA_LOG_INFO(DEMO, "- Superior tab management with archiving and intelligent grouping");
+    NOVA_LOG_INFO(DEMO, "- Cross-platform synchronization with end-to-end encryption");
+    NOVA_LOG_INFO(DEMO, "- A more intuitive command interface for power users");
+}
+
+// Microbenchmarks, run with `./nova --bench [name]`
+namespace bench {
+
+// Keeps benchmark results observable so the optimizer cannot drop the work
+volatile size_t sink = 0;
+
+template <typename Fn>
+double measureNanosPerOp(size_t iterations, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        fn(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+void report(const std::string& name, double nanosPerOp) {
+    NOVA_LOG_INFO(BENCH, "  " << name << ": " << nanosPerOp << " ns/op");
+}
+
+double millisSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// xorshift64, for benches drawing millions of numbers where std::mt19937
+// would show up in the timings; the sequence is the same on every run
+class Xorshift {
+public:
+    uint64_t operator()() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    
+private:
+    uint64_t state = 88172645463325252ull;
+};
+
+struct Percentiles {
+    double p50 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// Of latency samples, in their unit; sorts them
+Percentiles percentiles(std::vector<double>& samples) {
+    if (samples.empty()) return {};
+    std::sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2], samples[samples.size() * 99 / 100], samples.back()};
+}
+
+// Drops logging to warnings while a benchmark runs code that logs each
+// operation, and puts the level back for its reports and when it returns
+class QuietLogs {
+public:
+    QuietLogs() : level(Logger::instance().getLevel()) {}
+    ~QuietLogs() { restore(); }
+    
+    QuietLogs(const QuietLogs&) = delete;
+    QuietLogs& operator=(const QuietLogs&) = delete;
+    
+    void quiet() { Logger::instance().setLevel(LogLevel::WARN); }
+    void restore() { Logger::instance().setLevel(level); }
+    
+private:
+    LogLevel level;
+};
+
+// Resident set size of this process, or 0 where it cannot be read
+size_t residentBytes() {
+#ifdef __linux__
+    std::FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (!statm) return 0;
+    unsigned long long pages = 0;
+    unsigned long long resident = 0;
+    int fields = std::fscanf(statm, "%llu %llu", &pages, &resident);
+    std::fclose(statm);
+    return fields == 2 ? static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+std::vector<std::string> sampleUrls(size_t count) {
+    static const char* hosts[] = {
+        "example.com", "news.ycombinator.com", "github.com", "en.wikipedia.org",
+        "docs.google.com", "stackoverflow.com", "user:pw@intranet.local:8080", "[2001:db8::1]:443"
+    };
+    std::vector<std::string> urls;
+    urls.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        urls.push_back("https://" + std::string(hosts[i % 8]) + "/path/" + std::to_string(i) +
+                       "?q=" + std::to_string(i * 7) + "#section");
+    }
+    return urls;
+}
+
+void urlParsing() {
+    NOVA_LOG_INFO(BENCH, "URL parsing (domain extraction)");
+    auto urls = sampleUrls(4096);
+    
+    // The pre-UrlParser implementation of Tab::extractDomain
+    double regexNanos = measureNanosPerOp(20000, [&](size_t i) {
+        std::regex domainPattern(R"(https?://([^/]+))");
+        std::smatch matches;
+        if (std::regex_search(urls[i % urls.size()], matches, domainPattern)) {
+            sink = sink + matches[1].length();
+        }
+    });
+    report("std::regex per call", regexNanos);
+    
+    double parserNanos = measureNanosPerOp(2000000, [&](size_t i) {
+        sink = sink + UrlParser::parse(urls[i % urls.size()]).host.size();
+    });
+    report("UrlParser::parse", parserNanos);
+    NOVA_LOG_INFO(BENCH, "  speedup: " << regexNanos / parserNanos << "x");
+}
+
+void domainIndex() {
+    NOVA_LOG_INFO(BENCH, "Domain index (10k tabs over 500 domains)");
+    std::vector<std::string> domains;
+    for (int i = 0; i < 500; ++i) {
+        domains.push_back("site" + std::to_string(i) + ".example.com");
+    }
+    
+    TabGroup group("bench");
+    std::vector<std::shared_ptr<Tab>> tabs;
+    for (size_t i = 0; i < 10000; ++i) {
+        auto tab = std::make_shared<Tab>("https://" + domains[i % domains.size()] + "/page");
+        tabs.push_back(tab);
+        group.addTab(tab);
+    }
+    
+    report("findTabsByDomain", measureNanosPerOp(200000, [&](size_t i) {
+        sink = sink + group.findTabsByDomain(domains[i % domains.size()]).size();
+    }));
+    report("suggestGroupFocus", measureNanosPerOp(20000, [&](size_t) {
+        sink = sink + group.suggestGroupFocus().size();
+    }));
+    NOVA_LOG_INFO(BENCH, "  interned domains: " << DomainAtoms::instance().size());
+}
+
+void groupMetrics() {
+    NOVA_LOG_INFO(BENCH, "Group metrics (state changes in a 100k-tab group)");
+    TabGroup group("bench");
+    std::vector<std::shared_ptr<Tab>> tabs;
+    
+    for (size_t i = 0; i < 100000; ++i) {
+        auto tab = std::make_shared<Tab>("https://example.com/" + std::to_string(i));
+        tabs.push_back(tab);
+        group.addTab(tab);
+    }
+    
+    double toggleNanos = measureNanosPerOp(200000, [&](size_t i) {
+        tabs[i % tabs.size()]->setActive(i % 2 == 0);
+    });
+    TabGroup::GroupMetrics incremental = group.getMetrics();
+    double recountNanos = measureNanosPerOp(200, [&](size_t) {
+        group.updateMetrics();
+    });
+    const auto& recounted = group.getMetrics();
+    bool match = incremental.totalTabs == recounted.totalTabs && incremental.activeTabs == recounted.activeTabs &&
+                 incremental.hibernatedTabs == recounted.hibernatedTabs &&
+                 incremental.loadingTabs == recounted.loadingTabs;
+    
+    report("incremental update per setActive", toggleNanos);
+    report("full recount", recountNanos);
+    NOVA_LOG_INFO(BENCH, "  incremental counts match the recount: " << (match ? "yes" : "no"));
+    sink = sink + group.getMetrics().activeTabs;
+}
+
+void tabEvents() {
+    const size_t eventCount = 1000000;
+    NOVA_LOG_INFO(BENCH, "Tab events (1M title updates, 4 subscribers)");
+    // Both paths store the same preformatted titles, so only dispatch differs
+    std::vector<std::string> titles;
+    for (size_t i = 0; i < 1024; ++i) titles.push_back("Title number " + std::to_string(i));
+    
+    // The pre-EventChannel listener path: string-keyed std::function callbacks
+    std::vector<std::function<void(const std::string&, const std::string&)>> stringListeners;
+    for (int i = 0; i < 4; ++i) {
+        stringListeners.push_back([](const std::string& event, const std::string& data) {
+            if (event == "title_changed") sink = sink + data.size();
+        });
+    }
+    std::string title;
+    report("string listeners", measureNanosPerOp(eventCount, [&](size_t i) {
+        title = titles[i % titles.size()];
+        for (const auto& listener : stringListeners) listener("title_changed", title);
+    }));
+    
+    Tab tab("https://example.com/");
+    size_t deliveries = 0;
+    std::vector<Subscription> subscriptions;
+    for (int i = 0; i < 4; ++i) {
+        subscriptions.push_back(tab.subscribe([&deliveries](EventSpan<TabEvent> events) {
+            deliveries++;
+            sink = sink + events.size();
+        }));
+    }
+    
+    report("typed, immediate", measureNanosPerOp(eventCount, [&](size_t i) {
+        tab.setTitle(titles[i % titles.size()]);
+    }));
+    
+    // One batch per 500 updates, i.e. 500 title changes in a single frame
+    deliveries = 0;
+    double batchedNanos = measureNanosPerOp(eventCount / 500, [&](size_t frameIndex) {
+        EventBatch frame;
+        for (size_t i = 0; i < 500; ++i) tab.setTitle(titles[(frameIndex * 500 + i) % titles.size()]);
+    }) / 500.0;
+    report("typed, batched per frame", batchedNanos);
+    NOVA_LOG_INFO(BENCH, "  deliveries per frame per subscriber: "
+              << static_cast<double>(deliveries) / static_cast<double>(eventCount / 500) / 4.0);
+}
+
+void hibernation() {
+    const size_t tabCount = 10000;
+    NOVA_LOG_INFO(BENCH, "Tab hibernation (10k tabs, 40 history entries each)");
+    std::vector<std::shared_ptr<Tab>> tabs;
+    tabs.reserve(tabCount);
+    
+    for (size_t i = 0; i < tabCount; ++i) {
+        auto tab = std::make_shared<Tab>();
+        std::string site = "https://site" + std::to_string(i % 700) + ".example.com/articles/";
+        for (int page = 0; page < 40; ++page) {
+            tab->navigate(site + "2024/chapter-" + std::to_string(page) + "/section?ref=nav&session=" + std::to_string(i));
+            tab->setTitle("Chapter " + std::to_string(page) + " - A long running reading session on site " + std::to_string(i % 700));
+        }
+        tab->setPageMetadata("An article about topic " + std::to_string(i % 97) + " with a reasonably long summary text.",
+                             {"news", "technology", "topic" + std::to_string(i % 97), "reading", "long-form"});
+        tabs.push_back(tab);
+        HibernationManager::instance().track(tab);
+    }
+    
+    auto& manager = HibernationManager::instance();
+    size_t liveBytes = manager.measure().residentBytes;
+    NOVA_LOG_INFO(BENCH, "  live: " << liveBytes / tabCount << " bytes/tab, of which " << sizeof(Tab)
+                  << " are the Tab object, resident either way");
+    
+    auto measureMode = [&](const std::string& mode) {
+        manager.setMemoryBudget(1);
+        auto start = std::chrono::steady_clock::now();
+        manager.enforceBudget();
+        double packMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        manager.setMemoryBudget(0);
+        
+        size_t hibernatedBytes = manager.measure().residentBytes;
+        NOVA_LOG_INFO(BENCH, "  hibernated (" << mode << "): " << hibernatedBytes / tabCount << " bytes/tab, "
+                      << static_cast<double>(liveBytes) / static_cast<double>(hibernatedBytes) << "x smaller, "
+                      << packMicros / tabCount << " us/tab to pack");
+        
+        report("wake on setActive (" + mode + ")", measureNanosPerOp(tabCount, [&](size_t i) {
+            tabs[i]->setActive(true);
+            tabs[i]->setActive(false);
+        }));
+    };
+    
+    measureMode("in memory");
+    
+    fs::path spillDirectory = fs::temp_directory_path() / "nova-bench-hibernation";
+    HibernationStore::instance().setSpillDirectory(spillDirectory.string());
+    measureMode("spilled");
+    HibernationStore::instance().setSpillDirectory("");
+    std::error_code error;
+    fs::remove_all(spillDirectory, error);
+}
+
+void timers() {
+    const size_t timerCount = 10000;
+    NOVA_LOG_INFO(BENCH, "Timer wheel (10k timers)");
+    auto& wheel = TimerWheel::instance();
+    std::vector<TimerId> ids(timerCount);
+    
+    report("schedule", measureNanosPerOp(timerCount, [&](size_t i) {
+        ids[i] = wheel.schedule(std::chrono::seconds(1 + (i * 7919) % 86400), [] {});
+    }));
+    report("cancel", measureNanosPerOp(timerCount, [&](size_t i) {
+        sink = sink + wheel.cancel(ids[i]);
+    }));
+    
+    // Thousands of auto-reloading tabs should leave the timer thread asleep
+    std::vector<std::shared_ptr<Tab>> tabs;
+    for (size_t i = 0; i < timerCount; ++i) {
+        tabs.push_back(std::make_shared<Tab>());
+        tabs.back()->scheduleReload(std::chrono::seconds(60 + i % 240));
+    }
+    uint64_t wakeupsBefore = wheel.stats().wakeups;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    NOVA_LOG_INFO(BENCH, "  idle wake-ups with " << timerCount << " reload timers over 500 ms: "
+                  << wheel.stats().wakeups - wakeupsBefore);
+    tabs.clear();
+    
+    // Timers spread over one second fire in a handful of wake-ups when given slack
+    auto fireSpread = [&](TimerWheel::Clock::duration slack) {
+        std::atomic<size_t> fired{0};
+        uint64_t before = wheel.stats().wakeups;
+        for (size_t i = 0; i < timerCount; ++i) {
+            wheel.schedule(std::chrono::microseconds((i * 7919) % 1000000), [&fired] { fired++; },
+                           TimerWheel::Clock::duration::zero(), slack);
+        }
+        while (fired.load() < timerCount) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return wheel.stats().wakeups - before;
+    };
+    NOVA_LOG_INFO(BENCH, "  wake-ups to fire 10k timers over 1 s: " << fireSpread(TimerWheel::Clock::duration::zero())
+                  << " without slack, " << fireSpread(std::chrono::milliseconds(250)) << " with 250 ms slack");
+}
+
+void archiveSearch() {
+    const size_t archiveCount = 1000000;
+    NOVA_LOG_INFO(BENCH, "Archive search (1M archived tabs)");
+    
+    // Pseudo-words built from syllables give a realistic, skewed vocabulary
+    static const char* syllables[] = {
+        "ka", "lo", "mi", "ne", "ru", "sa", "to", "vi", "ber", "con", "dex", "gra", "lin", "mor", "pra", "stel",
+        "tri", "zon", "al", "bo", "cu", "da", "el", "fi", "go", "ha", "im", "ju", "ke", "lu", "ma", "no",
+        "op", "pe", "qui", "ra", "se", "tu", "ul", "ve", "wa", "xe", "yo", "ze", "bra", "cro", "fla", "glo"};
+    const size_t syllableCount = sizeof(syllables) / sizeof(syllables[0]);
+    std::vector<std::string> vocabulary;
+    for (size_t i = 0; i < 20000; ++i) {
+        std::string word;
+        for (size_t n = i, k = 0; k < 2 + i % 3; ++k, n /= syllableCount) {
+            word += syllables[(n + k * 7) % syllableCount];
+        }
+        vocabulary.push_back(word);
+    }
+    Xorshift next;
+    // Squaring skews picks toward the front of the vocabulary
+    auto pickWord = [&]() -> const std::string& {
+        double r = static_cast<double>(next() % 1000000) / 1000000.0;
+        return vocabulary[static_cast<size_t>(r * r * vocabulary.size())];
+    };
+    
+    TabArchive archive;
+    std::vector<std::pair<std::string, std::string>> scanSample;
+    auto buildStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < archiveCount; ++i) {
+        std::string url = "https://" + vocabulary[next() % 5000] + ".com/" + pickWord() + "/" + pickWord() + "-" +
+                          pickWord() + "-" + std::to_string(i);
+        auto tab = std::make_shared<Tab>(url);
+        tab->setTitle(pickWord() + " " + pickWord() + " " + pickWord() + " " + pickWord() + " - " + pickWord());
+        archive.archiveTab(tab);
+        if (scanSample.size() < 20000) scanSample.push_back({tab->getTitle(), url});
+    }
+    // The index is built by the first search
+    archive.searchArchive("", 0, 0);
+    NOVA_LOG_INFO(BENCH, "  build: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count()
+                  << " s");
+    
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < 1000; ++i) {
+        const std::string& word = pickWord();
+        switch (i % 5) {
+            case 0: queries.push_back(word); break;
+            case 1: queries.push_back(word.substr(1, 4)); break;
+            case 2: queries.push_back(word + " " + pickWord()); break;
+            case 3: queries.push_back(word.substr(0, 2)); break;
+            default: queries.push_back(vocabulary[next() % 5000] + ".com"); break;
+        }
+    }
+    
+    std::vector<double> latencies;
+    size_t matches = 0;
+    for (const auto& query : queries) {
+        auto start = std::chrono::steady_clock::now();
+        auto page = archive.searchArchive(query, 0, TabArchive::kSearchPageSize);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        matches += page.totalMatches;
+    }
+    Percentiles latency = percentiles(latencies);
+    NOVA_LOG_INFO(BENCH, "  indexed query: p50 " << latency.p50 / 1000.0 << " ms, p99 " << latency.p99 / 1000.0
+                  << " ms, avg " << matches / queries.size() << " matches");
+    
+    // The pre-index implementation compiled the query and scanned every archive;
+    // timed on a 20k sample and scaled up
+    const size_t scanQueries = 5;
+    double scanMillis = 0;
+    for (size_t q = 0; q < scanQueries; ++q) {
+        auto start = std::chrono::steady_clock::now();
+        std::regex pattern(queries[q], std::regex::icase);
+        for (const auto& [title, url] : scanSample) {
+            if (std::regex_search(title, pattern) || std::regex_search(url, pattern)) sink = sink + 1;
+        }
+        scanMillis += millisSince(start);
+    }
+    NOVA_LOG_INFO(BENCH, "  std::regex linear scan: ~" << scanMillis / scanQueries * (archiveCount / scanSample.size())
+                  << " ms per query");
+}
+
+void archiveStore() {
+    const size_t archiveCount = 1000000;
+    const auto span = std::chrono::hours(24 * 30);
+    NOVA_LOG_INFO(BENCH, "Archive store (1M archived tabs over 30 days)");
+    fs::path directory = fs::temp_directory_path() / "nova-bench-archive";
+    std::error_code error;
+    fs::remove_all(directory, error);
+    
+    auto now = std::chrono::system_clock::now();
+    {
+        ArchiveStore store(directory.string());
+        report("append", measureNanosPerOp(archiveCount, [&](size_t i) {
+            auto timestamp = now - span + span * static_cast<int64_t>(i) / static_cast<int64_t>(archiveCount);
+            std::string url = "https://site" + std::to_string(i % 5000) + ".example.com/articles/" + std::to_string(i);
+            sink = sink + store.append(url, "Archived article number " + std::to_string(i), timestamp);
+        }));
+    }
+    
+    size_t residentBefore = residentBytes();
+    auto openStart = std::chrono::steady_clock::now();
+    TabArchive archive(directory.string());
+    double openMillis = millisSince(openStart);
+    NOVA_LOG_INFO(BENCH, "  open: " << openMillis << " ms, +" << (residentBytes() - residentBefore) / 1024
+                  << " KiB resident for " << archive.size() << " archived tabs");
+    
+    // The in-memory archive had to read every record back at startup
+    {
+        ArchiveStore store(directory.string());
+        residentBefore = residentBytes();
+        auto loadStart = std::chrono::steady_clock::now();
+        std::vector<TabArchive::ArchivedTab> loaded;
+        store.forEachLive([&](const ArchiveStore::Record& record) {
+            loaded.push_back({record.id, std::string(record.url), std::string(record.title), record.timestamp});
+        });
+        NOVA_LOG_INFO(BENCH, "  loading every record instead: " << millisSince(loadStart) << " ms, +"
+                      << (residentBytes() - residentBefore) / 1024 << " KiB resident");
+    }
+    
+    report("restoreTab (random position)", measureNanosPerOp(10000, [&](size_t i) {
+        sink = sink + (archive.restoreTab((i * 7919) % archive.size()) != nullptr);
+    }));
+    
+    auto countFiles = [&] {
+        return std::distance(fs::directory_iterator(directory, error), fs::directory_iterator());
+    };
+    auto filesBefore = countFiles();
+    auto clearStart = std::chrono::steady_clock::now();
+    archive.clearOldArchives(7);
+    NOVA_LOG_INFO(BENCH, "  clearOldArchives(7): " << millisSince(clearStart) << " ms, segment files "
+                  << filesBefore << " -> " << countFiles() << ", " << archive.size() << " archived tabs left");
+    
+    fs::remove_all(directory, error);
+}
+
+// A fixed list of items for one kind, handed over in full on every sync
+class StaticSuggestions : public SuggestionSource {
+public:
+    StaticSuggestions(SuggestionKind kind, std::vector<Item> items) : kind(kind), items(std::move(items)) {}
+    
+    SuggestionKind suggestionKind() const override { return kind; }
+    uint64_t suggestionVersion() override { return 1; }
+    bool suggestionChanges(uint64_t, std::vector<Item>& changes) override {
+        changes.insert(changes.end(), items.begin(), items.end());
+        return false;
+    }
+    
+    const std::vector<Item>& getItems() const { return items; }
+    
+private:
+    SuggestionKind kind;
+    std::vector<Item> items;
+};
+
+void suggestions() {
+    const size_t entryCount = 1000000;
+    NOVA_LOG_INFO(BENCH, "Command bar suggestions (1M history, bookmark and archive entries)");
+    static const char* words[] = {
+        "news", "github", "docs", "mail", "maps", "video", "music", "shop", "travel", "recipe", "weather", "sports",
+        "finance", "cloud", "search", "photos", "forum", "wiki", "blog", "learn", "code", "design", "games", "health"};
+    const size_t wordCount = sizeof(words) / sizeof(words[0]);
+    Xorshift next;
+    
+    auto now = std::chrono::system_clock::now();
+    std::vector<SuggestionSource::Item> history;
+    std::vector<SuggestionSource::Item> bookmarks;
+    std::vector<SuggestionSource::Item> archived;
+    for (size_t i = 0; i < entryCount; ++i) {
+        SuggestionSource::Item item;
+        item.text = "https://" + std::string(words[next() % wordCount]) + std::to_string(next() % 20000) + ".com/" +
+                    words[next() % wordCount] + "/" + std::to_string(i);
+        item.title = std::string(words[next() % wordCount]) + " " + words[next() % wordCount] + " page " +
+                     std::to_string(i % 1000);
+        item.useCount = 1 + static_cast<uint32_t>(next() % 50 == 0 ? next() % 200 : next() % 4);
+        item.lastUsed = now - std::chrono::hours(static_cast<int64_t>(next() % (24 * 180)));
+        (i % 20 == 0 ? bookmarks : i % 4 == 0 ? archived : history).push_back(std::move(item));
+    }
+    StaticSuggestions historySource(SuggestionKind::HISTORY, std::move(history));
+    StaticSuggestions bookmarkSource(SuggestionKind::BOOKMARK, std::move(bookmarks));
+    StaticSuggestions archiveSource(SuggestionKind::ARCHIVED_TAB, std::move(archived));
+    
+    CommandBar commandBar;
+    auto buildStart = std::chrono::steady_clock::now();
+    commandBar.addSuggestionSource(&historySource);
+    commandBar.addSuggestionSource(&bookmarkSource);
+    commandBar.addSuggestionSource(&archiveSource);
+    commandBar.getSuggestions("");
+    NOVA_LOG_INFO(BENCH, "  first sync: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count()
+                  << " s");
+    
+    // Typed one character at a time, as the command bar sees them
+    std::vector<std::string> typed;
+    for (size_t i = 0; i < 200; ++i) {
+        std::string word = words[next() % wordCount];
+        switch (i % 4) {
+            case 0: typed.push_back(word); break;
+            case 1: typed.push_back(word + std::to_string(next() % 20000)); break;
+            case 2: typed.push_back(word + " " + words[next() % wordCount]); break;
+            default: typed.push_back(word.substr(0, 1) + word.substr(2)); break;  // a typo
+        }
+    }
+    std::vector<double> latencies;
+    for (const auto& text : typed) {
+        for (size_t length = 1; length <= text.size(); ++length) {
+            auto start = std::chrono::steady_clock::now();
+            sink = sink + commandBar.getSuggestions(text.substr(0, length)).size();
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    Percentiles keystroke = percentiles(latencies);
+    NOVA_LOG_INFO(BENCH, "  keystroke: p50 " << keystroke.p50 << " us, p99 " << keystroke.p99 << " us, max "
+                  << keystroke.max << " us over " << latencies.size() << " keystrokes");
+    
+    // Without an index every keystroke checks each entry for a subsequence match
+    const auto& scanned = historySource.getItems();
+    const size_t scanKeystrokes = 20;
+    auto scanStart = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < scanKeystrokes; ++q) {
+        const std::string& query = typed[q];
+        std::vector<std::pair<uint32_t, size_t>> matches;
+        for (size_t i = 0; i < scanned.size(); ++i) {
+            size_t position = 0;
+            for (char c : scanned[i].text) {
+                if (position < query.size() && c == query[position]) position++;
+            }
+            if (position == query.size()) matches.push_back({scanned[i].useCount, i});
+        }
+        size_t keep = std::min<size_t>(CommandBar::kMaxSuggestions, matches.size());
+        std::partial_sort(matches.begin(), matches.begin() + keep, matches.end(), std::greater<>());
+        sink = sink + keep;
+    }
+    NOVA_LOG_INFO(BENCH, "  linear subsequence scan: ~" << std::chrono::duration<double, std::micro>(
+                      std::chrono::steady_clock::now() - scanStart).count() / scanKeystrokes * entryCount / scanned.size()
+                  << " us per keystroke");
+}
+
+void history() {
+    const size_t visitCount = 10000000;
+    const size_t urlCount = 2000000;
+    NOVA_LOG_INFO(BENCH, "Browsing history (10M visits to 2M URLs over 90 days)");
+    Xorshift next;
+    // Skewed towards low indices, as visits are towards a few sites
+    auto skewed = [&next](size_t range) {
+        double r = static_cast<double>(next() % 1000000) / 1000000.0;
+        return static_cast<size_t>(r * r * r * static_cast<double>(range));
+    };
+    
+    std::vector<std::string> urls(urlCount);
+    std::vector<std::string> titles(urlCount);
+    for (size_t i = 0; i < urlCount; ++i) {
+        urls[i] = "https://site" + std::to_string(i / 100) + ".example.com/articles/" + std::to_string(i);
+        titles[i] = "Article " + std::to_string(i) + " on site " + std::to_string(i / 100);
+    }
+    
+    fs::path directory = fs::temp_directory_path() / "nova-bench-history";
+    std::error_code error;
+    fs::remove_all(directory, error);
+    auto& history = HistoryDatabase::instance();
+    history.open(directory.string());
+    
+    using Clock = HistoryDatabase::Clock;
+    const auto span = std::chrono::hours(24 * 90);
+    const Clock::time_point start = Clock::now() - span;
+    const auto step = std::chrono::duration_cast<Clock::duration>(span) / visitCount;
+    report("record visit", measureNanosPerOp(visitCount, [&](size_t i) {
+        size_t url = skewed(urlCount);
+        sink = sink + history.recordVisit(urls[url], titles[url], HistoryDatabase::Transition::NAVIGATE,
+                                          static_cast<uint32_t>(i % 500), start + step * static_cast<int64_t>(i));
+    }));
+    
+    auto reopenStart = std::chrono::steady_clock::now();
+    history.open(directory.string());
+    NOVA_LOG_INFO(BENCH, "  reopen: " << millisSince(reopenStart)
+                  << " ms for " << history.size() << " visits");
+    
+    const Clock::time_point end = start + span;
+    auto randomRange = [&](std::chrono::hours length) {
+        auto offset = std::chrono::hours(static_cast<int64_t>(next() % static_cast<uint64_t>((span - length).count())));
+        return std::make_pair(start + offset, start + offset + length);
+    };
+    auto latency = [&](const std::string& name, size_t queries, auto&& query) {
+        std::vector<double> latencies;
+        for (size_t i = 0; i < queries; ++i) {
+            auto queryStart = std::chrono::steady_clock::now();
+            query();
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - queryStart).count());
+        }
+        Percentiles measured = percentiles(latencies);
+        NOVA_LOG_INFO(BENCH, "  " << name << ": p50 " << measured.p50 << " us, max " << measured.max << " us");
+    };
+    
+    latency("last day's 100 visits", 100, [&] {
+        sink = sink + history.recentVisits(end - std::chrono::hours(24), end, 100).size();
+    });
+    latency("count visits in a week", 1000, [&] {
+        auto [from, to] = randomRange(std::chrono::hours(24 * 7));
+        sink = sink + history.countVisits(from, to);
+    });
+    // Block summaries are stored with the columns, so the first pass after
+    // reopening only has to fault them in
+    latency("top 10 domains, 90 days (first after reopen)", 1, [&] { sink = sink + history.topDomains(start, end, 10).size(); });
+    latency("top 10 domains, 90 days", 20, [&] { sink = sink + history.topDomains(start, end, 10).size(); });
+    latency("top 10 domains in a week", 100, [&] {
+        auto [from, to] = randomRange(std::chrono::hours(24 * 7));
+        sink = sink + history.topDomains(from, to, 10).size();
+    });
+    latency("one domain's visits in a month", 1000, [&] {
+        auto [from, to] = randomRange(std::chrono::hours(24 * 30));
+        sink = sink + history.domainVisits("site" + std::to_string(skewed(urlCount / 100)) + ".example.com", from, to);
+    });
+    
+    // A row store has to read and parse every visit in range: time it on a
+    // million rows and scale up to the whole history
+    const size_t scanned = 1000000;
+    auto rowsRead = history.recentVisits(start, end, scanned);
+    auto scanStart = std::chrono::steady_clock::now();
+    std::unordered_map<std::string, uint64_t> counts;
+    for (const auto& visit : rowsRead) counts[std::string(UrlParser::parse(visit.url).host)]++;
+    sink = sink + counts.size();
+    NOVA_LOG_INFO(BENCH, "  row scan for top domains, 90 days: ~" << std::chrono::duration<double, std::micro>(
+                      std::chrono::steady_clock::now() - scanStart).count() * visitCount / scanned << " us");
+    
+    history.open("");
+    fs::remove_all(directory, error);
+}
+
+void navigation() {
+    NOVA_LOG_INFO(BENCH, "Back/forward stacks (2k tabs, 200 entries each on 50 sites)");
+    const size_t tabCount = 2000;
+    const size_t entriesPerTab = 200;
+    std::vector<std::unique_ptr<Tab>> tabs;
+    size_t stringBytes = 0;  // what one std::string pair per entry would hold
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < tabCount; ++i) {
+        auto tab = std::make_unique<Tab>();
+        std::string site = "https://app" + std::to_string(i % 50) + ".example.com/";
+        for (size_t page = 0; page < entriesPerTab; ++page) {
+            std::string pageUrl = site + "inbox/thread/" + std::to_string(page % 60) + "?view=conversation";
+            std::string pageTitle = "Inbox (" + std::to_string(page % 60) + ") - Mail on app" + std::to_string(i % 50);
+            tab->navigate(pageUrl);
+            tab->setTitle(pageTitle);
+            stringBytes += 2 * sizeof(std::string) + pageUrl.capacity() + 1 + pageTitle.capacity() + 1;
+        }
+        tabs.push_back(std::move(tab));
+    }
+    NOVA_LOG_INFO(BENCH, "  navigate + setTitle: " << std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - start).count() / static_cast<double>(tabCount * entriesPerTab)
+                  << " ns/op");
+    
+    size_t pooledBytes = 0;
+    for (const auto& tab : tabs) pooledBytes += tab->estimateMemoryUsage();
+    NOVA_LOG_INFO(BENCH, "  per tab: " << pooledBytes / tabCount << " bytes pooled vs ~"
+                  << stringBytes / tabCount << " bytes as string pairs (" << StringPool::instance().size()
+                  << " distinct strings)");
+    
+    // Moves within the live ring only swap pooled handles
+    Tab& tab = *tabs.front();
+    report("goBack + goForward", measureNanosPerOp(1000000, [&](size_t i) {
+        if (i % 16 < 8) {
+            tab.goBack();
+        } else {
+            tab.goForward();
+        }
+    }));
+    
+    // A single-page app that navigates all day keeps a bounded history
+    Tab longLived;
+    for (size_t i = 0; i < 200000; ++i) {
+        longLived.navigate("https://feed.example.com/item/" + std::to_string(i) + "?from=scroll");
+        longLived.setTitle("Feed item " + std::to_string(i));
+    }
+    NOVA_LOG_INFO(BENCH, "  200k navigations in one tab: " << longLived.estimateMemoryUsage() << " bytes");
+    
+    // Hibernation serializes both stacks, spilled chunks as they are
+    report("hibernate + wake", measureNanosPerOp(tabCount, [&](size_t i) {
+        tabs[i]->hibernateTab(true);
+        tabs[i]->hibernateTab(false);
+    }));
+}
+
+// A synthetic list shaped like EasyList plus EasyPrivacy: mostly tracker
+// hosts, then generic path rules, exceptions and cosmetic rules
+const char* const filterWords[] = {"ads", "banner", "pixel", "track", "beacon", "promo", "sponsor", "metrics",
+                                   "collect", "analytics", "adserver", "popunder", "affiliate", "tag", "sync"};
+
+std::string sampleFilterList(size_t rules) {
+    static const char* types[] = {"", "$third-party", "$script,third-party", "$image", "$xmlhttprequest,third-party"};
+    std::string list = "[Adblock Plus 2.0]\n! Title: bench list\n";
+    for (size_t i = 0; i < rules; ++i) {
+        std::string word = filterWords[i % 15];
+        std::string n = std::to_string(i);
+        switch (i % 20) {
+            case 0: case 1: case 2: case 3: case 4: case 5:
+            case 6: case 7: case 8: case 9: case 10: case 11:
+                list += "||" + word + n + ".tracker" + std::to_string(i % 97) + ".net^" + types[i % 5];
+                break;
+            case 12: case 13: case 14:
+                list += "/" + word + "/" + n + "/*." + (i % 2 ? "js" : "gif") + "^" + types[i % 5];
+                break;
+            case 15: case 16:
+                list += "&" + word + n + "_id=" + (i % 3 ? "" : "$domain=site" + std::to_string(i % 50) + ".com");
+                break;
+            case 17: case 18:
+                list += "@@||cdn" + n + ".example.com/" + word + "/" + types[i % 5];
+                break;
+            default:
+                list += "site" + n + ".com##." + word + "-box";
+                break;
+        }
+        list += '\n';
+    }
+    list += "||ads.example.com^$important\n@@||ads.example.com/allowed/\n";
+    return list;
+}
+
+void filters() {
+    NOVA_LOG_INFO(BENCH, "Content filtering (100k rules, 100k requests)");
+    const size_t ruleCount = 100000;
+    std::string list = sampleFilterList(ruleCount);
+    
+    // Requests hit tracker hosts, ad paths and clean pages, from a few sites
+    std::vector<std::string> urls;
+    std::vector<std::string> sources;
+    std::vector<ContentFilter::ResourceType> types;
+    std::mt19937 random(13);
+    for (size_t i = 0; i < 100000; ++i) {
+        size_t n = random() % ruleCount;
+        std::string word = filterWords[n % 15];
+        std::string source = "www.site" + std::to_string(random() % 60) + ".com";
+        std::string url;
+        switch (random() % 8) {
+            case 0: url = "https://" + word + std::to_string(n) + ".tracker" + std::to_string(n % 97) + ".net/p?id=" + std::to_string(i); break;
+            case 1: url = "https://cdn.site" + std::to_string(n % 60) + ".com/" + word + "/" + std::to_string(n) + "/x.gif?v=2"; break;
+            case 2: url = "https://" + source + "/page?ref=home&" + word + std::to_string(n) + "_id=7"; break;
+            case 3: url = "https://cdn" + std::to_string(n) + ".example.com/" + word + "/lib.js"; break;
+            default: url = "https://" + source + "/static/app." + std::to_string(n % 1000) + ".js?build=" + std::to_string(i % 50); break;
+        }
+        urls.push_back(std::move(url));
+        sources.push_back(std::move(source));
+        static const ContentFilter::ResourceType kTypes[] = {
+            ContentFilter::ResourceType::SCRIPT, ContentFilter::ResourceType::IMAGE,
+            ContentFilter::ResourceType::XMLHTTPREQUEST, ContentFilter::ResourceType::STYLESHEET};
+        types.push_back(kTypes[random() % 4]);
+    }
+    
+    ContentFilter filter;
+    auto start = std::chrono::steady_clock::now();
+    ContentFilter::Stats stats = filter.compile({list});
+    double compileMillis = millisSince(start);
+    NOVA_LOG_INFO(BENCH, "  compile: " << compileMillis << " ms (" << stats.filters << " filters, " << stats.exceptions
+                  << " exceptions, " << stats.skipped << " skipped)");
+    
+    fs::path path = fs::temp_directory_path() / "nova-bench-filters.bin";
+    filter.save(path.string());
+    ContentFilter loaded;
+    start = std::chrono::steady_clock::now();
+    bool loadedOk = loaded.load(path.string());
+    double loadMillis = millisSince(start);
+    NOVA_LOG_INFO(BENCH, "  load compiled: " << loadMillis << " ms (" << fs::file_size(path) / 1024 << " KB)"
+                  << (loadedOk ? "" : " FAILED"));
+    
+    auto request = [&](size_t i) {
+        return ContentFilter::Request{urls[i], sources[i], types[i]};
+    };
+    size_t blocked = 0;
+    size_t disagreements = 0;
+    for (size_t i = 0; i < urls.size(); ++i) {
+        bool decision = filter.shouldBlock(request(i));
+        blocked += decision;
+        disagreements += decision != loaded.shouldBlock(request(i));
+    }
+    NOVA_LOG_INFO(BENCH, "  blocked " << blocked * 100 / urls.size() << "% of requests, " << disagreements
+                  << " differ after reload");
+    
+    std::vector<double> nanos(urls.size());
+    for (size_t i = 0; i < urls.size(); ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        sink = sink + loaded.shouldBlock(request(i));
+        nanos[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    }
+    Percentiles measured = percentiles(nanos);
+    NOVA_LOG_INFO(BENCH, "  shouldBlock p50: " << measured.p50 << " ns, p99: " << measured.p99 << " ns, max: "
+                  << measured.max << " ns");
+    
+    // Lookups go by host suffix and URL token, so they barely grow with the list
+    for (size_t rules : {size_t(10000), ruleCount}) {
+        ContentFilter sized;
+        sized.compile({sampleFilterList(rules)});
+        report("shouldBlock with " + std::to_string(rules) + " rules", measureNanosPerOp(urls.size(), [&](size_t i) {
+            sink = sink + sized.shouldBlock(request(i));
+        }));
+    }
+    fs::remove(path);
+    
+    // Each navigation checks the page and its favicon with the window's filters
+    QuietLogs logs;
+    logs.quiet();
+    BrowserWindow window;
+    auto tab = window.getActiveTab();
+    const size_t navigations = 20000;
+    double unfiltered = measureNanosPerOp(navigations, [&](size_t i) { tab->navigate(urls[i]); });
+    window.getPrivacy().loadFilterLists({list});
+    size_t refused = 0;
+    size_t noFavicon = 0;
+    double filtered = measureNanosPerOp(navigations, [&](size_t i) {
+        tab->navigate(urls[i]);
+        if (tab->getUrl() != urls[i]) {
+            refused++;
+        } else {
+            noFavicon += tab->getMetadata().favicon.empty();
+        }
+    });
+    logs.restore();
+    report("navigate in a window, no filters", unfiltered);
+    report("navigate in a window, " + std::to_string(ruleCount) + " rules", filtered);
+    NOVA_LOG_INFO(BENCH, "  blocked " << refused << " navigations (documents need $document rules) and "
+                  << noFavicon << " favicons");
+}
+
+void cookies() {
+    NOVA_LOG_INFO(BENCH, "Cookie jar (200 top-level sites, 2k cookie sites, 8 threads)");
+    CookieJar& jar = CookieJar::instance();
+    jar.clear();
+    CookieJar::Limits defaults = jar.getLimits();
+    jar.setLimits({180, 1000000});
+    
+    // Every top-level site has its own cookies plus those of 20 embedded
+    // third parties, partitioned under it
+    const size_t topSites = 200;
+    const size_t thirdParties = 1800;
+    std::vector<std::string> hosts;
+    std::vector<std::string> pages;
+    std::vector<std::string> embeds;
+    for (size_t i = 0; i < topSites; ++i) {
+        hosts.push_back("www.site" + std::to_string(i) + ".com");
+        pages.push_back("https://" + hosts.back() + "/articles/" + std::to_string(i));
+    }
+    for (size_t i = 0; i < thirdParties; ++i) embeds.push_back("https://cdn.vendor" + std::to_string(i) + ".net/v1/pixel.gif");
+    auto start = std::chrono::steady_clock::now();
+    size_t set = 0;
+    for (size_t i = 0; i < topSites; ++i) {
+        const std::string& site = hosts[i];
+        for (size_t k = 0; k < 15; ++k) {
+            set += jar.setCookie({pages[i], site}, "c" + std::to_string(k) + "=" + std::to_string(i * k) +
+                                 (k % 3 ? "; Path=/; Max-Age=86400" : "; Path=/articles"));
+        }
+        for (size_t e = 0; e < 20; ++e) {
+            const std::string& embed = embeds[(i * 7 + e * 13) % thirdParties];
+            for (size_t k = 0; k < 3; ++k) {
+                set += jar.setCookie({embed, site}, "t" + std::to_string(k) + "=" + std::to_string(e) +
+                                     "; Path=/; Max-Age=86400; SameSite=None; Secure");
+            }
+        }
+    }
+    double setNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    NOVA_LOG_INFO(BENCH, "  setCookie: " << setNanos / static_cast<double>(set) << " ns/op (" << jar.size() << " cookies)");
+    
+    // A page load: the document, then its embeds, all under the page's site
+    auto lookup = [&](std::mt19937& random) {
+        size_t i = random() % topSites;
+        if (random() % 4 == 0) return jar.cookieHeader({pages[i], hosts[i]}).size();
+        return jar.cookieHeader({embeds[(i * 7 + random() % 20 * 13) % thirdParties], hosts[i]}).size();
+    };
+    std::mt19937 random(14);
+    report("cookieHeader, one thread", measureNanosPerOp(1000000, [&](size_t) { sink = sink + lookup(random); }));
+    
+    auto runThreads = [&](size_t threads, size_t perThread, size_t writeEvery) {
+        std::vector<std::thread> workers;
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937 local(static_cast<uint32_t>(t));
+                size_t bytes = 0;
+                for (size_t n = 0; n < perThread; ++n) {
+                    if (writeEvery && n % writeEvery == 0) {
+                        size_t i = local() % topSites;
+                        jar.setCookie({pages[i], hosts[i]}, "c1=" + std::to_string(n) + "; Path=/; Max-Age=86400");
+                    } else {
+                        bytes += lookup(local);
+                    }
+                }
+                sink = sink + bytes;
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return static_cast<double>(threads * perThread) / seconds;
+    };
+    NOVA_LOG_INFO(BENCH, "  8 threads, lookups only: " << runThreads(8, 250000, 0) / 1e6 << " M ops/s");
+    NOVA_LOG_INFO(BENCH, "  8 threads, 1 write in 20: " << runThreads(8, 250000, 20) / 1e6 << " M ops/s ("
+                  << std::thread::hardware_concurrency() << " hardware threads)");
+    
+    // Write-behind: changes reach the journal in batches
+    fs::path path = fs::temp_directory_path() / "nova-bench-cookies.bin";
+    fs::remove(path);
+    start = std::chrono::steady_clock::now();
+    jar.open(path.string());
+    NOVA_LOG_INFO(BENCH, "  open + snapshot: " << millisSince(start) << " ms (" << fs::file_size(path) / 1024 << " KB)");
+    for (size_t i = 0; i < 20000; ++i) {
+        jar.setCookie({pages[i % topSites], hosts[i % topSites]}, "c2=" + std::to_string(i) + "; Path=/; Max-Age=86400");
+    }
+    start = std::chrono::steady_clock::now();
+    jar.flush();
+    NOVA_LOG_INFO(BENCH, "  flush of 20k changes: " << millisSince(start) << " ms");
+    
+    // Past the total limit, a purge evicts the least recently used tenth
+    jar.setLimits({180, 20000});
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < 100000; ++i) {
+        std::string url = "https://shop" + std::to_string(i) + ".example/";
+        jar.setCookie({url, ""}, "cart=1; Max-Age=3600");
+    }
+    report("setCookie over the total limit", std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start).count() / 100000.0);
+    NOVA_LOG_INFO(BENCH, "  " << jar.size() << " cookies kept, " << jar.stats().evicted << " evicted");
+    
+    jar.clear();
+    jar.setLimits(defaults);
+    jar.open("");
+    fs::remove(path);
+}
+
+void bookmarks() {
+    NOVA_LOG_INFO(BENCH, "Bookmarks (500k bookmarks in 2.5k folders)");
+    const size_t bookmarkCount = 500000;
+    const char* words[] = {"news", "recipes", "travel", "rust", "kernel", "budget", "guide", "review",
+                           "tutorial", "python", "garden", "music", "paper", "release", "notes", "design"};
+    auto urlOf = [&](size_t i) {
+        return "https://" + std::string(i % 3 ? "www." : "docs.") + words[i % 16] + std::to_string(i % 5000) +
+               ".com/" + words[(i / 16) % 16] + "/" + std::to_string(i);
+    };
+    auto titleOf = [&](size_t i) {
+        return std::string(words[(i / 7) % 16]) + " " + words[(i / 3) % 16] + " " + std::to_string(i % 1000) +
+               " - " + words[i % 16] + std::to_string(i % 5000);
+    };
+    
+    // 50 top-level folders of 50 subfolders each; adds and removes log
+    // each bookmark, so only warnings are kept meanwhile
+    QuietLogs logs;
+    logs.quiet();
+    size_t residentBefore = residentBytes();
+    BookmarkManager manager;
+    std::vector<BookmarkId> folders;
+    for (size_t top = 0; top < 50; ++top) {
+        BookmarkId parent = manager.addFolder(BookmarkManager::kRoot, "Folder " + std::to_string(top));
+        for (size_t sub = 0; sub < 50; ++sub) folders.push_back(manager.addFolder(parent, words[sub % 16] + std::to_string(sub)));
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < bookmarkCount; ++i) manager.addBookmarkTo(folders[i % folders.size()], urlOf(i), titleOf(i));
+    double addNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    logs.restore();
+    NOVA_LOG_INFO(BENCH, "  addBookmarkTo: " << addNanos / bookmarkCount << " ns/op, +"
+                  << (residentBytes() - residentBefore) / (1024 * 1024) << " MB resident");
+    
+    std::vector<std::string> hits;
+    std::vector<std::string> misses;
+    for (size_t i = 0; i < 1000; ++i) {
+        hits.push_back(urlOf(i * 499));
+        misses.push_back(urlOf(i * 499) + "#top");
+    }
+    report("isBookmarked, hit", measureNanosPerOp(1000000, [&](size_t i) { sink = sink + manager.isBookmarked(hits[i % 1000]); }));
+    report("isBookmarked, miss", measureNanosPerOp(1000000, [&](size_t i) { sink = sink + manager.isBookmarked(misses[i % 1000]); }));
+    
+    // A few results per query, as the address bar asks for them
+    const std::vector<std::string> queries = {"rec", "kernel", "tutorial py", "github", "travel18", "notes 42 desi",
+                                              "docs.rust12", "www.music", "garden10.com/p", "zzz"};
+    for (const auto& query : queries) {
+        size_t found = manager.search(query).size();
+        report("search \"" + query + "\" (" + std::to_string(found) + ")", measureNanosPerOp(2000, [&](size_t) {
+            sink = sink + manager.search(query).size();
+        }));
+    }
+    
+    // The previous layout: a vector per category, scanned for every lookup
+    std::map<std::string, std::vector<std::pair<std::string, std::string>>> flat;
+    for (size_t i = 0; i < bookmarkCount; ++i) flat["Folder " + std::to_string(i % 50)].push_back({urlOf(i), titleOf(i)});
+    auto flatContains = [&](const std::string& url) {
+        for (const auto& [category, entries] : flat) {
+            for (const auto& entry : entries) {
+                if (entry.first == url) return true;
+            }
+        }
+        return false;
+    };
+    report("isBookmarked, nested map + vector scan (miss)", measureNanosPerOp(20, [&](size_t i) {
+        sink = sink + flatContains(misses[i % 1000]);
+    }));
+    
+    logs.quiet();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < 10000; ++i) manager.removeBookmark(hits[i % 1000] + (i < 1000 ? "" : "?missing"));
+    logs.restore();
+    report("removeBookmark", std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 10000.0);
+    NOVA_LOG_INFO(BENCH, "  " << manager.size() << " bookmarks left");
+}
+
+void transfer() {
+    NOVA_LOG_INFO(BENCH, "Bookmark and history import/export (1M bookmarks, 500k visits)");
+    const size_t bookmarkCount = 1000000;
+    const size_t visitCount = 500000;
+    fs::path directory = fs::temp_directory_path() / "nova-bench-transfer";
+    std::error_code error;
+    fs::remove_all(directory, error);
+    fs::create_directories(directory, error);
+    std::string html = (directory / "bookmarks.html").string();
+    std::string json = (directory / "bookmarks.json").string();
+    std::string visits = (directory / "history.json").string();
+    // A browser's export: 100 folders of 100 subfolders, a hundred bookmarks each
+    {
+        ChunkedWriter output(html);
+        output.write("<!DOCTYPE NETSCAPE-Bookmark-file-1>\n<TITLE>Bookmarks</TITLE>\n<H1>Bookmarks</H1>\n<DL><p>\n");
+        for (size_t i = 0; i < bookmarkCount; ++i) {
+            if (i % 10000 == 0) output.write(std::string(i ? "    </DL><p>\n" : "") + "    <DT><H3>Folder " + std::to_string(i / 10000) + "</H3>\n    <DL><p>\n");
+            if (i % 100 == 0) output.write(std::string(i % 10000 ? "        </DL><p>\n" : "") + "        <DT><H3>Topic " + std::to_string(i / 100 % 100) + "</H3>\n        <DL><p>\n");
+            output.write("            <DT><A HREF=\"https://site" + std::to_string(i % 20000) + ".example.com/articles/" + std::to_string(i) +
+                         "?ref=feed&amp;page=2\" ADD_DATE=\"1700000000\">Article " + std::to_string(i) + " &amp; notes</A>\n");
+        }
+        output.write("        </DL><p>\n    </DL><p>\n</DL><p>\n");
+        output.close();
+    }
+    
+    QuietLogs logs;
+    size_t residentBefore = residentBytes();
+    BookmarkManager manager;
+    auto start = std::chrono::steady_clock::now();
+    auto imported = ProfileTransfer::importBookmarksHtml(html, manager);
+    NOVA_LOG_INFO(BENCH, "  import HTML: " << millisSince(start) << " ms for " << imported.items << " bookmarks ("
+                  << fs::file_size(html, error) / (1024 * 1024) << " MB file), +"
+                  << (residentBytes() - residentBefore) / (1024 * 1024) << " MB resident");
+    start = std::chrono::steady_clock::now();
+    ProfileTransfer::exportBookmarksHtml(html, manager);
+    NOVA_LOG_INFO(BENCH, "  export HTML: " << millisSince(start) << " ms");
+    start = std::chrono::steady_clock::now();
+    ProfileTransfer::exportBookmarksJson(json, manager);
+    NOVA_LOG_INFO(BENCH, "  export JSON: " << millisSince(start) << " ms (" << fs::file_size(json, error) / (1024 * 1024) << " MB file)");
+    {
+        BookmarkManager fromJson;
+        start = std::chrono::steady_clock::now();
+        imported = ProfileTransfer::importBookmarksJson(json, fromJson);
+        NOVA_LOG_INFO(BENCH, "  import JSON: " << millisSince(start) << " ms for " << imported.items << " bookmarks");
+    }
+    
+    // Adding one at a time indexes every bookmark on its own
+    {
+        BookmarkManager oneByOne;
+        BookmarkId folder = oneByOne.addFolder(BookmarkManager::kRoot, "Imported");
+        logs.quiet();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < bookmarkCount; ++i) {
+            oneByOne.addBookmarkTo(folder, "https://site" + std::to_string(i % 20000) + ".example.com/articles/" + std::to_string(i) +
+                                   "?ref=feed&page=2", "Article " + std::to_string(i) + " & notes");
+        }
+        double millis = millisSince(start);
+        logs.restore();
+        NOVA_LOG_INFO(BENCH, "  addBookmarkTo one at a time: " << millis << " ms for " << bookmarkCount << " bookmarks");
+    }
+    
+    // Takeout lists visits newest first; the import sorts them through runs on disk
+    {
+        ChunkedWriter output(visits);
+        output.write("{\"Browser History\": [\n");
+        int64_t newest = 1700000000000000;
+        for (size_t i = 0; i < visitCount; ++i) {
+            output.write(std::string(i ? ",\n" : "") + "{\"favicon_url\": \"https://site" + std::to_string(i % 5000) +
+                         ".example.com/favicon.ico\", \"page_transition\": \"LINK\", \"title\": \"Article " + std::to_string(i) +
+                         "\", \"url\": \"https://site" + std::to_string(i % 5000) + ".example.com/articles/" + std::to_string(i) +
+                         "\", \"client_id\": \"abc\", \"time_usec\": " + std::to_string(newest - static_cast<int64_t>(i) * 5000000) + "}");
+        }
+        output.write("\n]}\n");
+        output.close();
+    }
+    auto& history = HistoryDatabase::instance();
+    history.open((directory / "history").string());
+    start = std::chrono::steady_clock::now();
+    imported = ProfileTransfer::importHistoryJson(visits, history);
+    NOVA_LOG_INFO(BENCH, "  import history JSON: " << millisSince(start) << " ms for " << imported.items << " visits ("
+                  << fs::file_size(visits, error) / (1024 * 1024) << " MB file)");
+    start = std::chrono::steady_clock::now();
+    ProfileTransfer::exportHistoryJson(visits, history);
+    NOVA_LOG_INFO(BENCH, "  export history JSON: " << millisSince(start) << " ms");
+    
+    // Older visits are merged in: once after a single visit, as on first run,
+    // and once more on top of the same 500k, which rewrites them per batch
+    fs::remove_all(directory / "history", error);
+    history.open((directory / "history").string());
+    history.recordVisit("about:welcome", "Welcome", HistoryDatabase::Transition::NAVIGATE, 0);
+    start = std::chrono::steady_clock::now();
+    imported = ProfileTransfer::importHistoryJson(visits, history);
+    NOVA_LOG_INFO(BENCH, "  import history JSON after one visit: " << millisSince(start) << " ms, " << history.size()
+                  << " visits kept");
+    start = std::chrono::steady_clock::now();
+    imported = ProfileTransfer::importHistoryJson(visits, history);
+    NOVA_LOG_INFO(BENCH, "  import history JSON again, merged in: " << millisSince(start) << " ms, " << history.size()
+                  << " visits kept");
+    
+    history.open("");
+    fs::remove_all(directory, error);
+}
+
+// A 5k-tab session: the full first checkpoint, an incremental one, and
+// restoring it next to rebuilding the same tabs by navigating
+void session() {
+    const size_t tabCount = 5000;
+    const size_t windowCount = 4;
+    const int pages = 20;
+    NOVA_LOG_INFO(BENCH, "Session checkpoints and restore (5k tabs, 20 history entries each)");
+    fs::path directory = fs::temp_directory_path() / "nova-bench-session";
+    std::error_code error;
+    fs::remove_all(directory, error);
+    fs::create_directories(directory, error);
+    std::string file = (directory / "session.nses").string();
+    auto pageOf = [](size_t tab, int page) {
+        return "https://site" + std::to_string(tab % 700) + ".example.com/articles/2024/chapter-" + std::to_string(page) +
+               "/section?ref=nav&session=" + std::to_string(tab);
+    };
+    
+    QuietLogs logs;
+    logs.quiet();
+    double rebuildMillis = 0;
+    {
+        NovaEngine engine;
+        engine.createSpace("Research", "R");
+        auto start = std::chrono::steady_clock::now();
+        for (size_t w = 0; w < windowCount; ++w) {
+            if (w == windowCount / 2) engine.switchToSpace(1);
+            if (w > 0) engine.createNewWindow();
+        }
+        auto windows = engine.getAllWindows();
+        auto group = std::make_shared<TabGroup>("Reading");
+        std::vector<std::shared_ptr<Tab>> tabs;
+        for (size_t i = 0; i < tabCount; ++i) {
+            auto& window = windows[i % windowCount];
+            window->openNewTab(pageOf(i, 0));
+            auto tab = window->getActiveTab();
+            for (int page = 1; page < pages; ++page) tab->navigate(pageOf(i, page));
+            if (i % 50 == 0) group->addTab(tab);
+            tabs.push_back(tab);
+        }
+        rebuildMillis = millisSince(start);
+        engine.getAllSpaces().back()->addTabGroup(group);
+        // A third of the tabs sleep, as the hibernation budget would leave them
+        for (size_t i = 0; i < tabCount; i += 3) {
+            if (!tabs[i]->getIsActive()) tabs[i]->hibernateTab(true);
+        }
+        logs.restore();
+        
+        engine.openSession(file);
+        start = std::chrono::steady_clock::now();
+        engine.checkpointSession();
+        auto stats = engine.getSessionStats();
+        NOVA_LOG_INFO(BENCH, "  full checkpoint: " << millisSince(start) << " ms, " << stats.lastWritten << " records, "
+                      << stats.lastBytes / 1024 << " KB");
+        
+        for (size_t i = 0; i < 50; ++i) {
+            windows[i % windowCount]->getActiveTab()->navigate(pageOf(i, pages + static_cast<int>(i)));
+            windows[i % windowCount]->setActiveTab(1 + i * 97 % (tabCount / windowCount));
+        }
+        start = std::chrono::steady_clock::now();
+        engine.checkpointSession();
+        stats = engine.getSessionStats();
+        NOVA_LOG_INFO(BENCH, "  checkpoint after 50 changes: " << millisSince(start) << " ms, " << stats.lastWritten
+                      << " records, " << stats.lastBytes / 1024 << " KB (journal " << stats.journalBytes / 1024 << " KB)");
+        start = std::chrono::steady_clock::now();
+        engine.checkpointSession();
+        NOVA_LOG_INFO(BENCH, "  checkpoint with nothing changed: " << millisSince(start) << " ms");
+    }
+    
+    {
+        logs.quiet();
+        NovaEngine engine;
+        size_t visits = HistoryDatabase::instance().size();
+        auto start = std::chrono::steady_clock::now();
+        engine.openSession(file);
+        double restoreMillis = millisSince(start);
+        size_t pending = engine.pendingSessionTabs();
+        start = std::chrono::steady_clock::now();
+        while (engine.pendingSessionTabs() > 0) engine.runPendingTasks();
+        double restOfMillis = millisSince(start);
+        logs.restore();
+        size_t restoredTabs = 0;
+        for (const auto& window : engine.getAllWindows()) window->forEachTab([&](const Tab&) { restoredTabs++; });
+        NOVA_LOG_INFO(BENCH, "  restore: " << restoreMillis << " ms to the active tabs, " << restOfMillis << " ms for the other "
+                      << pending << " in chunks; " << restoredTabs << " window tabs, "
+                      << HistoryDatabase::instance().size() - visits << " visits recorded");
+        NOVA_LOG_INFO(BENCH, "  rebuild by navigating: " << rebuildMillis << " ms");
+    }
+    fs::remove_all(directory, error);
+}
+
+// Time to first interaction as the saved session grows: constructing the
+// engine from it, then the chunks restoring the other tabs, each turn of
+// the loop timed, and decoding every tab as an eager restore would
+void startup() {
+    NOVA_LOG_INFO(BENCH, "Startup from a saved session (20 history entries per tab)");
+    fs::path directory = fs::temp_directory_path() / "nova-bench-startup";
+    std::error_code error;
+    fs::remove_all(directory, error);
+    fs::create_directories(directory, error);
+    QuietLogs logs;
+    for (size_t tabCount : {1000, 5000, 25000}) {
+        std::string file = (directory / ("session-" + std::to_string(tabCount) + ".nses")).string();
+        logs.quiet();
+        {
+            NovaEngine engine(file);
+            engine.createNewWindow();
+            auto windows = engine.getAllWindows();
+            for (size_t i = 0; i < tabCount; ++i) {
+                auto& window = windows[i % windows.size()];
+                window->openNewTab("https://site" + std::to_string(i % 700) + ".example.com/");
+                auto tab = window->getActiveTab();
+                for (int page = 1; page < 20; ++page) {
+                    tab->navigate("https://site" + std::to_string(i % 700) + ".example.com/articles/" + std::to_string(page) +
+                                  "?session=" + std::to_string(i));
+                }
+            }
+            engine.checkpointSession();
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        NovaEngine engine(file);
+        double firstInteraction = millisSince(start);
+        logs.restore();
+        std::string phases;
+        for (const auto& phase : engine.getStartupPhases()) {
+            phases += (phases.empty() ? "" : ", ") + phase.name + " " + std::to_string(phase.millis).substr(0, 5) + " ms";
+        }
+        NOVA_LOG_INFO(BENCH, "  " << tabCount << " tabs (" << fs::file_size(file, error) / 1024 << " KB): ready in "
+                      << firstInteraction << " ms (" << phases << ")");
+        
+        size_t turns = 0;
+        double slowestTurn = 0;
+        start = std::chrono::steady_clock::now();
+        while (engine.pendingSessionTabs() > 0) {
+            auto turn = std::chrono::steady_clock::now();
+            engine.runPendingTasks();
+            slowestTurn = std::max(slowestTurn, millisSince(turn));
+            turns++;
+        }
+        NOVA_LOG_INFO(BENCH, "    the other tabs: " << millisSince(start) << " ms over " << turns << " turns, slowest turn "
+                      << slowestTurn << " ms");
+        
+        std::vector<std::shared_ptr<Tab>> tabs;
+        for (const auto& window : engine.getAllWindows()) {
+            auto windowTabs = window->getTabs();
+            tabs.insert(tabs.end(), windowTabs.begin(), windowTabs.end());
+        }
+        start = std::chrono::steady_clock::now();
+        for (const auto& tab : tabs) {
+            tab->setActive(true);
+            tab->setActive(false);
+        }
+        NOVA_LOG_INFO(BENCH, "    decoding every tab, as an eager restore did: " << millisSince(start) << " ms");
+    }
+    fs::remove_all(directory, error);
+}
+
+// 100k records through a sync server in a child process: the first push,
+// a second device pulling them, a small delta, and re-syncing unchanged
+void sync() {
+    const size_t recordCount = 100000;
+    NOVA_LOG_INFO(BENCH, "Sync (100k records, server in a child process)");
+    auto transport = SyncServer::spawnProcess();
+    if (!transport) {
+        NOVA_LOG_ERROR(BENCH, "  could not start the sync server");
+        return;
+    }
+    auto describe = [](const Synchronizer::Stats& stats) {
+        return std::to_string(stats.pushed) + " pushed, " + std::to_string(stats.pulled) + " pulled, " +
+               std::to_string(stats.roundTrips) + " round trips, " +
+               std::to_string((stats.bytesSent + stats.bytesReceived) / 1024) + " KB";
+    };
+    
+    QuietLogs logs;
+    logs.quiet();
+    Synchronizer laptop;
+    Synchronizer phone;
+    for (Synchronizer* device : {&laptop, &phone}) {
+        device->enableSync(true);
+        device->connect(transport);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < recordCount; ++i) {
+        laptop.put(SyncKind::HISTORY, "https://site" + std::to_string(i % 5000) + ".example.com/articles/" + std::to_string(i),
+                   "Article " + std::to_string(i));
+    }
+    double stageMillis = millisSince(start);
+    start = std::chrono::steady_clock::now();
+    laptop.syncNow();
+    double pushMillis = millisSince(start);
+    start = std::chrono::steady_clock::now();
+    phone.syncNow();
+    double pullMillis = millisSince(start);
+    logs.restore();
+    NOVA_LOG_INFO(BENCH, "  stage: " << stageMillis << " ms");
+    NOVA_LOG_INFO(BENCH, "  first push: " << pushMillis << " ms (" << describe(laptop.getStats()) << ")");
+    NOVA_LOG_INFO(BENCH, "  pull on a second device: " << pullMillis << " ms (" << describe(phone.getStats()) << ")");
+    
+    logs.quiet();
+    for (size_t i = 0; i < 100; ++i) phone.put(SyncKind::SETTING, "setting." + std::to_string(i), "changed");
+    start = std::chrono::steady_clock::now();
+    phone.syncNow();
+    double deltaPush = millisSince(start);
+    start = std::chrono::steady_clock::now();
+    laptop.syncNow();
+    double deltaPull = millisSince(start);
+    logs.restore();
+    NOVA_LOG_INFO(BENCH, "  100 changes: push " << deltaPush << " ms, pull " << deltaPull << " ms (" << describe(laptop.getStats()) << ")");
+    
+    logs.quiet();
+    for (size_t i = 0; i < recordCount; i += 10) {
+        laptop.put(SyncKind::HISTORY, "https://site" + std::to_string(i % 5000) + ".example.com/articles/" + std::to_string(i),
+                   "Article " + std::to_string(i));
+    }
+    const size_t resyncs = 1000;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < resyncs; ++i) laptop.syncNow();
+    double resyncMicros = millisSince(start) * 1000.0 / resyncs;
+    logs.restore();
+    NOVA_LOG_INFO(BENCH, "  re-sync, nothing changed: " << resyncMicros << " us (" << describe(laptop.getStats()) << ")");
+    
+    // The laptop's stores staged whole; the phone's handler reads each
+    // change back through get, as a UI refreshing from sync would
+    logs.quiet();
+    BookmarkManager bookmarks;
+    for (size_t folder = 0; folder < 20; ++folder) {
+        BookmarkId id = bookmarks.addFolder(BookmarkManager::kRoot, "Folder " + std::to_string(folder));
+        for (size_t i = 0; i < 100; ++i) {
+            bookmarks.addBookmarkTo(id, "https://site" + std::to_string(i) + ".example.com/saved/" + std::to_string(folder),
+                                    "Saved " + std::to_string(folder * 100 + i));
+        }
+    }
+    auto& history = HistoryDatabase::instance();
+    auto since = HistoryDatabase::Clock::now() - std::chrono::seconds(1);
+    for (size_t i = 0; i < 5000; ++i) {
+        history.recordVisit("https://site" + std::to_string(i % 500) + ".example.com/notes/" + std::to_string(i),
+                            "Note " + std::to_string(i), HistoryDatabase::Transition::NAVIGATE, 0);
+    }
+    std::vector<std::shared_ptr<Tab>> tabs;
+    for (size_t i = 0; i < 200; ++i) tabs.push_back(std::make_shared<Tab>("https://site" + std::to_string(i) + ".example.com/"));
+    std::map<std::string, std::string> settings;
+    for (size_t i = 0; i < 100; ++i) settings["setting." + std::to_string(i)] = "laptop";
+    size_t handled = 0;
+    phone.setChangeHandler([&](const SyncRecord& record) { handled += phone.get(record.kind, record.key).has_value(); });
+    start = std::chrono::steady_clock::now();
+    laptop.stageBookmarks(bookmarks);
+    laptop.stageHistory(history, since);
+    laptop.stageOpenTabs([&](const OpenTabSource::TabVisitor& visit) {
+        for (const auto& tab : tabs) visit(*tab);
+    });
+    laptop.stageSettings(settings);
+    double storesMillis = millisSince(start);
+    start = std::chrono::steady_clock::now();
+    laptop.syncNow();
+    deltaPush = millisSince(start);
+    start = std::chrono::steady_clock::now();
+    phone.syncNow();
+    deltaPull = millisSince(start);
+    logs.restore();
+    NOVA_LOG_INFO(BENCH, "  stage 2000 bookmarks, 5000 visits, 200 tabs, 100 settings: " << storesMillis << " ms; push "
+                  << deltaPush << " ms, pull " << deltaPull << " ms (" << handled << " changes handled)");
+}
+
+// 50k tabs over windows, groups and spaces, searched the way a search box
+// does: the first query builds the index, then one query per keystroke
+void tabSearch() {
+    const size_t tabCount = 50000;
+    NOVA_LOG_INFO(BENCH, "Tab search (" << tabCount << " tabs in 3 spaces, 6 windows, 30 groups)");
+    const char* topics[] = {"Rust async runtimes", "Kitchen renovation", "Flight deals", "C++ templates",
+                            "Quarterly report", "Running shoes", "Jazz piano", "Kubernetes operators"};
+    
+    QuietLogs logs;
+    logs.quiet();
+    NovaEngine engine;
+    engine.createSpace("Work", "💼");
+    engine.createSpace("Research", "🔍");
+    for (size_t space = 0; space < 3; ++space) {
+        engine.switchToSpace(space);
+        if (space > 0) engine.createNewWindow();
+        engine.createNewWindow();
+    }
+    auto windows = engine.getAllWindows();
+    auto spaces = engine.getAllSpaces();
+    std::vector<std::shared_ptr<TabGroup>> groups;
+    for (size_t i = 0; i < 30; ++i) {
+        groups.push_back(std::make_shared<TabGroup>("Group " + std::to_string(i)));
+        spaces[i % spaces.size()]->addTabGroup(groups.back());
+    }
+    for (size_t i = 0; i < tabCount; ++i) {
+        auto& window = windows[i % windows.size()];
+        std::string site = i % 50 == 0 ? "github.com" : "site" + std::to_string(i % 700) + ".example.com";
+        window->openNewTab("https://" + site + "/articles/" + std::to_string(i));
+        auto tab = window->getActiveTab();
+        tab->setTitle(std::string(topics[i % 8]) + " - part " + std::to_string(i));
+        if (i % 5 == 0) groups[i % groups.size()]->addTab(tab);
+    }
+    logs.restore();
+    
+    auto start = std::chrono::steady_clock::now();
+    size_t hits = engine.searchTabs("github", std::numeric_limits<size_t>::max()).size();
+    auto stats = engine.getTabSearchStats();
+    NOVA_LOG_INFO(BENCH, "  first query, building the index: " << millisSince(start) << " ms (" << stats.tabs
+                  << " tabs, " << stats.indexBytes / 1024 << " KB, " << hits << " hits)");
+    
+    const int rounds = 20;
+    std::string typed;
+    for (char key : std::string("github")) {
+        typed += key;
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            hits = engine.searchTabs(typed, std::numeric_limits<size_t>::max()).size();
+        }
+        NOVA_LOG_INFO(BENCH, "  keystroke '" << typed << "': " << millisSince(start) / rounds << " ms (" << hits << " hits)");
+    }
+    for (const char* query : {"RUST async", "site1*.com/*/4?2", "c++(", "kubernetes part 4999"}) {
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            hits = engine.searchTabs(query, std::numeric_limits<size_t>::max()).size();
+        }
+        NOVA_LOG_INFO(BENCH, "  query '" << query << "': " << millisSince(start) / rounds << " ms (" << hits << " hits)");
+    }
+    
+    start = std::chrono::steady_clock::now();
+    double firstBatch = 0;
+    engine.searchTabs("part", [&](const std::vector<TabSearch::Hit>&) {
+        firstBatch = millisSince(start);
+        return false;
+    });
+    NOVA_LOG_INFO(BENCH, "  first " << TabSearch::kBatchHits << " hits of a broad query: " << firstBatch << " ms");
+    
+    for (size_t i = 0; i < 10; ++i) windows[i % windows.size()]->getTabs()[i * 97]->setTitle("Renamed tab " + std::to_string(i));
+    start = std::chrono::steady_clock::now();
+    hits = engine.searchTabs("renamed", std::numeric_limits<size_t>::max()).size();
+    NOVA_LOG_INFO(BENCH, "  after renaming 10 tabs: " << millisSince(start) << " ms (" << hits << " hits, "
+                  << engine.getTabSearchStats().foldedTabs << " tabs folded in all)");
+    
+    // What the per-group search used to cost, over the same tabs
+    start = std::chrono::steady_clock::now();
+    hits = 0;
+    for (const auto& window : windows) {
+        std::regex pattern("github", std::regex::icase);
+        for (const auto& tab : window->getTabs()) {
+            if (std::regex_search(tab->getTitle(), pattern) || std::regex_search(tab->getUrl(), pattern)) hits++;
+        }
+    }
+    NOVA_LOG_INFO(BENCH, "  regex scan of every window, for comparison: " << millisSince(start) << " ms (" << hits << " hits)");
+}
+
+// 20k tabs on 150 made-up topics, each tab using a few of its topic's
+// words and a few shared ones: proposing groups, then again after some
+// tabs navigate and more open
+void topics() {
+    const size_t tabCount = 20000;
+    const size_t topicCount = 150;
+    NOVA_LOG_INFO(BENCH, "Topic clustering (" << tabCount << " tabs, " << topicCount << " topics, "
+                  << std::thread::hardware_concurrency() << " hardware threads)");
+    std::mt19937 random(21);
+    auto makeWord = [&] {
+        static const char* syllables[] = {"ka", "lo", "ri", "ven", "tor", "mi", "sul", "dra", "pe", "qui",
+                                          "zan", "fe", "gro", "bel", "nu", "xar", "to", "lim", "sa", "wen"};
+        std::string word;
+        for (int i = 0; i < 3; ++i) word += syllables[random() % 20];
+        return word;
+    };
+    std::vector<std::vector<std::string>> vocabulary(topicCount);
+    for (auto& words : vocabulary) {
+        for (int i = 0; i < 6; ++i) words.push_back(makeWord());
+    }
+    std::vector<std::string> shared;
+    for (int i = 0; i < 300; ++i) shared.push_back(makeWord());
+    
+    std::unordered_map<const Tab*, size_t> truth;
+    auto makeTab = [&](size_t topic, std::shared_ptr<Tab> tab) {
+        const auto& words = vocabulary[topic];
+        auto pick = [&] { return words[random() % words.size()]; };
+        auto any = [&] { return shared[random() % shared.size()]; };
+        if (!tab) tab = std::make_shared<Tab>("about:blank");
+        tab->navigate("https://" + words[topic % 2] + ".example.org/" + pick() + "-" + pick() + "/" + std::to_string(random() % 100000));
+        tab->setTitle(pick() + " " + pick() + " " + pick() + " " + any() + " #" + std::to_string(random() % 1000));
+        tab->setPageMetadata(pick() + " " + pick() + " " + pick() + " " + pick() + " " + any() + " " + any(),
+                             {pick(), pick()});
+        truth[tab.get()] = topic;
+        return tab;
+    };
+    // Share of tabs whose proposed group is mostly their own topic
+    auto purity = [&](const std::vector<TopicClusterer::Topic>& groups, size_t total) {
+        size_t agreeing = 0;
+        for (const auto& group : groups) {
+            std::unordered_map<size_t, size_t> counts;
+            for (const auto& tab : group.tabs) counts[truth[tab.get()]]++;
+            size_t most = 0;
+            for (const auto& [topic, count] : counts) most = std::max(most, count);
+            agreeing += most;
+        }
+        return 100.0 * static_cast<double>(agreeing) / static_cast<double>(total);
+    };
+    
+    QuietLogs logs;
+    logs.quiet();
+    std::vector<std::shared_ptr<Tab>> tabs;
+    for (size_t i = 0; i < tabCount; ++i) tabs.push_back(makeTab(random() % topicCount, nullptr));
+    
+    TopicClusterer clusterer;
+    auto start = std::chrono::steady_clock::now();
+    clusterer.update(tabs);
+    double clusterMillis = millisSince(start);
+    auto stats = clusterer.getStats();
+    
+    AiAssistant assistant;
+    start = std::chrono::steady_clock::now();
+    auto groups = assistant.organizeTabsAutomatically(tabs);
+    double proposeMillis = millisSince(start);
+    logs.restore();
+    NOVA_LOG_INFO(BENCH, "  clustering " << tabCount << " tabs: " << clusterMillis << " ms (" << stats.topics << " topics)");
+    NOVA_LOG_INFO(BENCH, "  proposing groups: " << proposeMillis << " ms (" << groups.size() << " groups, "
+                  << purity(groups, tabCount) << "% of tabs with their topic)");
+    
+    logs.quiet();
+    for (size_t i = 0; i < 50; ++i) makeTab(random() % topicCount, tabs[random() % tabs.size()]);
+    for (size_t i = 0; i < 200; ++i) tabs.push_back(makeTab(random() % topicCount, nullptr));
+    start = std::chrono::steady_clock::now();
+    clusterer.update(tabs);
+    double updateMillis = millisSince(start);
+    start = std::chrono::steady_clock::now();
+    groups = assistant.organizeTabsAutomatically(tabs);
+    proposeMillis = millisSince(start);
+    logs.restore();
+    NOVA_LOG_INFO(BENCH, "  after 50 tabs navigate and 200 open: " << updateMillis << " ms to update ("
+                  << clusterer.getStats().placed << " placed), " << proposeMillis << " ms to propose again ("
+                  << purity(groups, tabs.size()) << "% of tabs with their topic)");
+}
+
+// 50k tabs over 8 windows and 40 groups, one in five reopening a page
+// already open under a tracking or reordered variant of its URL
+void duplicates() {
+    const size_t tabCount = 50000;
+    NOVA_LOG_INFO(BENCH, "Duplicate tabs (" << tabCount << " tabs, 8 windows, 40 groups)");
+    auto pageUrl = [](size_t page, size_t variant) {
+        std::string host = (variant % 2 ? "WWW.Site" : "site") + std::to_string(page % 500) + ".example.com";
+        std::string path = "/read/" + std::to_string(page);
+        std::string url = "https://" + host + path;
+        switch (variant % 4) {
+            case 0: return url + "?id=" + std::to_string(page) + "&lang=en";
+            case 1: return url + "?lang=en&utm_source=news&id=" + std::to_string(page) + "#comments";
+            case 2: return url + "?fbclid=x" + std::to_string(variant) + "&id=" + std::to_string(page) + "&lang=en";
+            default: return "https://" + host + ":443" + path + "?lang=en&id=" + std::to_string(page);
+        }
+    };
+    
+    QuietLogs logs;
+    logs.quiet();
+    {
+        NovaEngine engine;
+        for (int i = 1; i < 8; ++i) engine.createNewWindow();
+        auto windows = engine.getAllWindows();
+        auto space = engine.getAllSpaces().front();
+        std::vector<std::shared_ptr<TabGroup>> groups;
+        for (int i = 0; i < 40; ++i) {
+            groups.push_back(std::make_shared<TabGroup>("Group " + std::to_string(i)));
+            space->addTabGroup(groups.back());
+        }
+        
+        std::vector<std::string> urls;
+        for (size_t i = 0; i < tabCount; ++i) {
+            bool again = i % 5 == 4;
+            urls.push_back(pageUrl(again ? i / 2 : i, again ? i : 0));
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < tabCount; ++i) {
+            auto& window = windows[i % windows.size()];
+            window->openNewTab(urls[i]);
+            if (i % 3 == 0) groups[i % groups.size()]->addTab(window->getActiveTab());
+        }
+        double openMillis = millisSince(start);
+        auto stats = OpenTabIndex::instance().getStats();
+        logs.restore();
+        NOVA_LOG_INFO(BENCH, "  opening and indexing: " << openMillis << " ms (" << stats.pages << " pages, "
+                      << stats.duplicateTabs << " duplicate tabs)");
+        
+        report("isOpen, open page", measureNanosPerOp(200000, [&](size_t i) {
+            sink = sink + OpenTabIndex::instance().isOpen(urls[(i * 7919) % urls.size()]);
+        }));
+        report("find, tab and its windows and groups", measureNanosPerOp(200000, [&](size_t i) {
+            sink = sink + OpenTabIndex::instance().find(urls[(i * 7919) % urls.size()]).size();
+        }));
+        report("isOpen, page not open", measureNanosPerOp(200000, [&](size_t i) {
+            sink = sink + OpenTabIndex::instance().isOpen("https://elsewhere.example.net/" + std::to_string(i));
+        }));
+        
+        logs.quiet();
+        auto tabs = windows[0]->getTabs();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < 1000; ++i) tabs[i]->navigate(pageUrl(i * 3, i));
+        double navigateMicros = millisSince(start);
+        start = std::chrono::steady_clock::now();
+        auto result = engine.dedupeTabs();
+        double dedupeMillis = millisSince(start);
+        stats = OpenTabIndex::instance().getStats();
+        logs.restore();
+        NOVA_LOG_INFO(BENCH, "  1000 navigations, index following: " << navigateMicros << " us each");
+        NOVA_LOG_INFO(BENCH, "  dedupe: " << dedupeMillis << " ms, closed " << result.closedTabs << " tabs, "
+                      << result.reclaimedBytes / 1024 << " KB reclaimed (" << stats.duplicateTabs << " duplicates left open)");
+        logs.quiet();
+    }
+    logs.restore();
+}
+
+void tabRegistry() {
+    const size_t tabCount = 100000;
+    NOVA_LOG_INFO(BENCH, "Tab registry (" << tabCount << " tabs in one group)");
+    QuietLogs logs;
+    logs.quiet();
+    auto& registry = TabRegistry::instance();
+    std::vector<TabId> handles;
+    {
+        TabGroup group("bench");
+        std::vector<std::shared_ptr<Tab>> tabs;
+        for (size_t i = 0; i < tabCount; ++i) {
+            auto tab = std::make_shared<Tab>();
+            tab->navigate("https://site" + std::to_string(i % 300) + ".example.com/page/" + std::to_string(i));
+            tab->setTitle("Page " + std::to_string(i));
+            if (i % 50 == 0) tab->setPinned(true);
+            tabs.push_back(tab);
+            group.addTab(tab);
+        }
+        logs.restore();
+    
+        // Nothing is idle long enough, so both passes look at every tab and hibernate none
+        auto cutoff = std::chrono::system_clock::now() - std::chrono::minutes(61);
+        double objectNanos = measureNanosPerOp(20, [&](size_t) {
+            size_t due = 0;
+            for (const auto& tab : group.getTabs()) {
+                if (!tab->getIsActive() && !tab->getIsPinned() && !tab->getIsHibernated() &&
+                    tab->getLastVisited() <= cutoff) {
+                    due++;
+                }
+            }
+            sink = sink + due;
+        });
+        double columnNanos = measureNanosPerOp(20, [&](size_t) {
+            group.hibernateInactiveTabs(std::chrono::minutes(60));
+        });
+        report("idle scan through Tab objects, per tab", objectNanos / tabCount);
+        report("idle scan over registry columns, per tab", columnNanos / tabCount);
+    
+        for (const auto& tab : tabs) handles.push_back(tab->getHandle());
+        report("handle lookup", measureNanosPerOp(1000000, [&](size_t i) {
+            sink = sink + (registry.get(handles[(i * 7919) % handles.size()]) != nullptr);
+        }));
+    }
+    
+    // Closing tabs ahead of the active one leaves it active
+    logs.quiet();
+    {
+        BrowserWindow window;
+        for (size_t i = 0; i < 10000; ++i) window.openNewTab("https://example.com/" + std::to_string(i));
+        window.setActiveTab(5000);
+        auto active = window.getActiveTab();
+        double closeNanos = measureNanosPerOp(1000, [&](size_t) { window.closeTab(0); });
+        bool kept = window.getActiveTab() == active && active->getIsActive();
+        logs.restore();
+        report("closeTab before the active tab", closeNanos);
+        NOVA_LOG_INFO(BENCH, "  active tab kept: " << (kept ? "yes" : "no"));
+        logs.quiet();
+    }
+    
+    size_t stale = static_cast<size_t>(std::count_if(handles.begin(), handles.end(),
+                                                     [&](TabId id) { return !registry.get(id); }));
+    logs.restore();
+    NOVA_LOG_INFO(BENCH, "  handles left behind by the group: " << stale << " of " << handles.size()
+                  << " resolve to null (" << registry.size() << " tabs live)");
+}
+
+void arenas() {
+    const size_t windowCount = 4;
+    const size_t tabsPerWindow = 5000;
+    NOVA_LOG_INFO(BENCH, "Arenas (a space with " << windowCount << " windows of " << tabsPerWindow
+                  << " tabs and 20 groups, global heap against per-window and per-space arenas)");
+    QuietLogs logs;
+    
+    for (bool useArenas : {false, true}) {
+        logs.quiet();
+        auto space = std::make_shared<Space>("Work");
+        std::vector<std::shared_ptr<TabGroup>> groups;
+        for (int i = 0; i < 20; ++i) {
+            std::string name = "Group " + std::to_string(i);
+            groups.push_back(useArenas ? space->createTabGroup(name) : std::make_shared<TabGroup>(name));
+            if (!useArenas) space->addTabGroup(groups.back());
+        }
+        std::vector<std::shared_ptr<BrowserWindow>> windows;
+        for (size_t w = 0; w < windowCount; ++w) {
+            windows.push_back(useArenas ? std::make_shared<BrowserWindow>()
+                                        : std::make_shared<BrowserWindow>(nullptr));
+            space->addWindow(windows.back());
+        }
+        // Tabs open in turn across the windows, as they do over a day
+        for (size_t i = 0; i < windowCount * tabsPerWindow; ++i) {
+            auto& window = windows[i % windowCount];
+            window->openNewTab("https://site" + std::to_string(i % 400) + ".example.com/a/" + std::to_string(i));
+            auto tab = window->getActiveTab();
+            tab->setTitle("Article " + std::to_string(i));
+            if (i % 4 == 0) groups[i % groups.size()]->addTab(tab);
+        }
+        for (size_t i = 0; i < 200; ++i) groups[i % groups.size()]->createSnapshot();
+        for (auto& group : groups) group->restoreSnapshot(group->listSnapshots().front());
+        logs.restore();
+        
+        std::string mode = useArenas ? "arenas" : "global heap";
+        const auto& scanned = windows[1]->getTabs();
+        auto cutoff = std::chrono::system_clock::now() - std::chrono::hours(1);
+        report("scan one window's tabs, per tab (" + mode + ")", measureNanosPerOp(50, [&](size_t) {
+            size_t idle = 0;
+            for (const auto& tab : scanned) idle += tab->getLastVisited() < cutoff && !tab->getIsPinned();
+            sink = sink + idle;
+        }) / static_cast<double>(scanned.size()));
+        if (useArenas) {
+            auto stats = windows[1]->getArena()->getStats();
+            NOVA_LOG_INFO(BENCH, "  window arena: " << stats.allocations << " allocations, " << stats.liveBytes / 1024
+                          << " KB live, " << stats.reservedBytes / 1024 << " KB reserved");
+            stats = space->getArena()->getStats();
+            NOVA_LOG_INFO(BENCH, "  space arena: " << stats.allocations << " allocations, " << stats.liveBytes / 1024
+                          << " KB live, " << stats.reservedBytes / 1024 << " KB reserved");
+        }
+        
+        logs.quiet();
+        auto start = std::chrono::steady_clock::now();
+        windows.pop_back();
+        space->removeWindow(space->getWindows().back().get());
+        double windowMillis = millisSince(start);
+        start = std::chrono::steady_clock::now();
+        groups.clear();
+        windows.clear();
+        space.reset();
+        double spaceMillis = millisSince(start);
+        logs.restore();
+        NOVA_LOG_INFO(BENCH, "  close a window (" << mode << "): " << windowMillis << " ms");
+        NOVA_LOG_INFO(BENCH, "  close the space and its other windows (" << mode << "): " << spaceMillis << " ms");
+    }
+    
+    // Through the engine, with its bookkeeping
+    logs.quiet();
+    {
+        NovaEngine engine;
+        engine.createSpace("Work");
+        engine.switchToSpace(1);
+        for (size_t w = 0; w < windowCount; ++w) {
+            engine.createNewWindow();
+            auto window = engine.getActiveWindow();
+            for (size_t i = 0; i < tabsPerWindow; ++i) window->openNewTab("https://example.com/" + std::to_string(i));
+        }
+        auto usage = engine.getArenaUsage();
+        logs.restore();
+        for (const auto& [owner, stats] : usage) {
+            NOVA_LOG_INFO(BENCH, "  engine, " << owner << " arena: " << stats.allocations << " allocations, "
+                          << stats.liveBytes / 1024 << " KB live, " << stats.reservedBytes / 1024 << " KB reserved");
+        }
+        logs.quiet();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < 1000; ++i) engine.switchToSpace(i % 2);
+        double switchMicros = millisSince(start);
+        engine.switchToSpace(1);
+        start = std::chrono::steady_clock::now();
+        engine.closeSpace(1);
+        double closeMillis = millisSince(start);
+        logs.restore();
+        NOVA_LOG_INFO(BENCH, "  engine: switchToSpace " << switchMicros << " us each, closeSpace " << closeMillis << " ms");
+        logs.quiet();
+    }
+    logs.restore();
+}
+
+void theme() {
+    const size_t windowCount = 200;
+    const size_t listenersPerWindow = 4;  // tab strip, toolbar, sidebar, page
+    NOVA_LOG_INFO(BENCH, "Theme switching (" << windowCount << " windows, " << listenersPerWindow << " listeners each)");
+    QuietLogs logs;
+    logs.quiet();
+    std::vector<std::shared_ptr<BrowserWindow>> windows;
+    for (size_t i = 0; i < windowCount; ++i) windows.push_back(std::make_shared<BrowserWindow>());
+    auto switchAll = [&](size_t i) {
+        const char* preset = i % 2 ? "light" : "dark";
+        for (auto& window : windows) window->getTheme().loadThemePreset(preset);
+    };
+    
+    // What a listener had to do with the raw config: parse it and pick
+    // readable colors itself
+    for (size_t i = 0; i < windowCount * listenersPerWindow; ++i) {
+        windows[i % windowCount]->getTheme().addThemeChangeListener([](const Theme::ThemeConfig& config) {
+            uint32_t background = Theme::parseColor(config.backgroundColor).value_or(0xFFFFFFFF);
+            uint32_t text = Theme::parseColor(config.textColor).value_or(0x121212FF);
+            uint32_t accent = Theme::parseColor(config.accentColor).value_or(0x5D3FD3FF);
+            uint32_t link = Theme::parseColor(config.linkColor).value_or(accent);
+            bool whiteOnAccent = Theme::contrastRatio(0xFFFFFFFF, accent) >= Theme::contrastRatio(0x000000FF, accent);
+            sink = sink + background + text + link + whiteOnAccent + (Theme::contrastRatio(text, background) > 7.0);
+        });
+    }
+    double configNanos = measureNanosPerOp(2000, switchAll);
+    
+    // Fresh windows, listening to the compiled palette instead
+    windows.clear();
+    for (size_t i = 0; i < windowCount; ++i) windows.push_back(std::make_shared<BrowserWindow>());
+    size_t changedSlots = 0;
+    for (size_t i = 0; i < windowCount * listenersPerWindow; ++i) {
+        windows[i % windowCount]->getTheme().addPaletteListener([&](const Theme::Palette& palette, const std::vector<uint16_t>& slots) {
+            for (uint16_t slot : slots) sink = sink + palette.color(slot);
+            changedSlots += slots.size();
+        });
+    }
+    double paletteNanos = measureNanosPerOp(2000, switchAll);
+    
+    // Every switch a config no theme has had, so each one compiles
+    Theme& fresh = windows.front()->getTheme();
+    double compileNanos = measureNanosPerOp(2000, [&](size_t i) {
+        char accent[8];
+        std::snprintf(accent, sizeof(accent), "#%06zx", (i * 2654435761u) & 0xFFFFFF);
+        fresh.setCustomAccentColor(accent);
+    });
+    logs.restore();
+    
+    NOVA_LOG_INFO(BENCH, "  switch all windows, config listeners: " << configNanos / 1000 << " us");
+    NOVA_LOG_INFO(BENCH, "  switch all windows, palette listeners: " << paletteNanos / 1000 << " us ("
+                  << changedSlots / (2000 * windowCount * listenersPerWindow) << " changed slots per listener)");
+    report("compile a new palette", compileNanos);
+    NOVA_LOG_INFO(BENCH, "  css per palette: " << windows.back()->getTheme().getPalette()->css.size() << " bytes");
+}
+
+} // namespace bench
+
+int runBenchmarks(const std::string& filter) {
+    const std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+        {"url", bench::urlParsing},
+        {"domains", bench::domainIndex},
+        {"metrics", bench::groupMetrics},
+        {"events", bench::tabEvents},
+        {"hibernation", bench::hibernation},
+        {"timers", bench::timers},
+        {"archive", bench::archiveSearch},
+        {"archivestore", bench::archiveStore},
+        {"suggest", bench::suggestions},
+        {"history", bench::history},
+        {"navigation", bench::navigation},
+        {"filters", bench::filters},
+        {"cookies", bench::cookies},
+        {"bookmarks", bench::bookmarks},
+        {"transfer", bench::transfer},
+        {"session", bench::session},
+        {"startup", bench::startup},
+        {"sync", bench::sync},
+        {"tabsearch", bench::tabSearch},
+        {"topics", bench::topics},
+        {"duplicates", bench::duplicates},
+        {"registry", bench::tabRegistry},
+        {"arenas", bench::arenas},
+        {"theme", bench::theme},
+    };
+    
+    bool ran = false;
+    for (const auto& [name, run] : benchmarks) {
+        if (filter.empty() || filter == name) {
+            run();
+            ran = true;
+        }
+    }
+    
+    if (!ran) {
+        NOVA_LOG_ERROR(BENCH, "Unknown benchmark: " << filter);
+        return 1;
+    }
+    return 0;
+}
+
+// Keep the main function at the end of the file
+int main(int argc, char* argv[]) {
+    // The sync server process SyncServer::spawnProcess starts
+    if (argc > 2 && std::string(argv[1]) == "--sync-server") return SyncServer::serve(std::atoi(argv[2]));
+    
+    // NOVA_LOG_FILE additionally records every log line in the binary format
+    if (const char* logPath = std::getenv("NOVA_LOG_FILE")) {
+        Logger::instance().addSink(std::make_unique<BinaryLogSink>(logPath));
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        // Engine narration would swamp the measurements
+        Logger::instance().setOnlyCategory(LogCategory::BENCH);
+        int status = runBenchmarks(argc > 2 ? argv[2] : "");
+        Logger::instance().flush();
+        return status;
+    }
+    
     NovaEngine browser;
     demonstrateBrowserFeatures(browser);
+    browser.runPendingTasks();
     
+    Logger::instance().flush();
     return 0;
 }